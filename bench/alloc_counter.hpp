@@ -0,0 +1,226 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/**
+  @brief  Counts heap allocations, for tests and benches
+          Including this header replaces the global `operator new` and
+          `operator delete` with versions which count the allocations and
+          bytes of the calling thread, so it must be included by exactly one
+          translation unit of a program.
+          Read the counts around an operation with an `alloc_scope`.
+  */
+namespace alloc_counter
+{
+  struct counts_t
+  {
+    uint64_t n_allocs;
+
+    uint64_t n_bytes;
+
+    uint64_t n_frees;
+  };
+
+  /**
+    @brief  Counts of the calling thread since it started
+    */
+  inline counts_t& thread_counts()
+  {
+    static thread_local counts_t counts{0, 0, 0};
+    return counts;
+  }
+
+  inline void* allocate(size_t size, size_t alignment)
+  {
+    counts_t& counts = thread_counts();
+
+    counts.n_allocs++;
+    counts.n_bytes += size;
+
+    if (size == 0)
+    {
+      size = 1;
+    }
+
+    if (alignment <= alignof(std::max_align_t))
+    {
+      return std::malloc(size);
+    }
+
+    /* aligned_alloc needs a multiple of the alignment */
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  }
+
+  /**
+    @brief  Not inlined, so that the compiler does not see `free()` paired
+            with `operator new` and warn of a mismatch
+    */
+  __attribute__((noinline)) inline void deallocate(void* p)
+  {
+    if (p != nullptr)
+    {
+      thread_counts().n_frees++;
+      std::free(p);
+    }
+  }
+}
+
+/**
+  @brief  Allocations made by the calling thread during the lifetime of a
+          scope, or until `stop()`
+  */
+class alloc_scope
+{
+public:
+  alloc_scope()
+    : start(alloc_counter::thread_counts()),
+      stopped(false)
+  {}
+
+  void stop()
+  {
+    end = alloc_counter::thread_counts();
+    stopped = true;
+  }
+
+  uint64_t allocs() const
+  {
+    return _now().n_allocs - start.n_allocs;
+  }
+
+  uint64_t bytes() const
+  {
+    return _now().n_bytes - start.n_bytes;
+  }
+
+  uint64_t frees() const
+  {
+    return _now().n_frees - start.n_frees;
+  }
+
+protected:
+  alloc_counter::counts_t _now() const
+  {
+    return stopped ? end : alloc_counter::thread_counts();
+  }
+
+protected:
+  alloc_counter::counts_t start;
+
+  alloc_counter::counts_t end;
+
+  bool stopped;
+};
+
+void* operator new(size_t size)
+{
+  void* p = alloc_counter::allocate(size, alignof(std::max_align_t));
+
+  if (p == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  return alloc_counter::allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+  return alloc_counter::allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+  void* p = alloc_counter::allocate(size, size_t(alignment));
+
+  if (p == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+  return operator new(size, alignment);
+}
+
+void operator delete(void* p) noexcept
+{
+  alloc_counter::deallocate(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  alloc_counter::deallocate(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  alloc_counter::deallocate(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  alloc_counter::deallocate(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+  alloc_counter::deallocate(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+  alloc_counter::deallocate(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+  alloc_counter::deallocate(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+  alloc_counter::deallocate(p);
+}
@@ -0,0 +1,127 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include "polykey_aggregate.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -I ../include -o bin/bench_aggregate bench_aggregate.cpp
+//usage: bin/bench_aggregate [n_rows] [n_updates]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static const size_t n_tickers = 500;
+
+void fill(OrderTracker& otk, size_t n_rows)
+{
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"T" + std::to_string(i % n_tickers), int(i % 1000) - 500});
+  }
+}
+
+void update(OrderTracker& otk, size_t n_rows, size_t n_updates)
+{
+  for (size_t i = 0; i < n_updates; i++)
+  {
+    otk.modify<InternalOrderId>((i * 7919) % n_rows, [](Order& order) { order.svol++; });
+  }
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t n_updates = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+  auto by_ticker = [](const Order& order) { return order.ticker; };
+  auto svol = [](const Order& order) { return order.svol; };
+
+  std::cout << n_rows << " rows, " << n_tickers << " tickers, " << n_updates << " updates" << std::endl;
+
+  /* baseline: net svol per ticker by scanning */
+  {
+    OrderTracker otk;
+    fill(otk, n_rows);
+
+    auto start = bench_clock::now();
+    update(otk, n_rows, n_updates);
+    double update_ms = msSince(start);
+
+    start = bench_clock::now();
+    std::unordered_map<std::string, int64_t> net;
+
+    for (auto it = otk.cbegin(); it != otk.cend(); ++it)
+    {
+      net[it->ticker] += it->svol;
+    }
+
+    std::cout << "scan:       updates " << update_ms << " ms, read " << msSince(start) << " ms, T7 " << net["T7"] << std::endl;
+  }
+
+  {
+    OrderTracker otk;
+    fill(otk, n_rows);
+
+    auto net = xu::aggregate_by(otk, by_ticker, svol);
+
+    auto start = bench_clock::now();
+    update(otk, n_rows, n_updates);
+    double update_ms = msSince(start);
+
+    start = bench_clock::now();
+    int64_t t7 = net.at("T7").sum;
+
+    std::cout << "aggregate:  updates " << update_ms << " ms, read " << msSince(start) << " ms, T7 " << t7 << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "alloc_counter.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -I ../include -o bin/bench_allocations bench_allocations.cpp
+//usage: bin/bench_allocations [n_rows]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+/**
+  @brief  Allocations, bytes and time per operation of a measured batch
+  */
+class op_report
+{
+public:
+  op_report(const std::string& name_, size_t n_ops_)
+    : name(name_),
+      n_ops(n_ops_),
+      start(bench_clock::now())
+  {}
+
+  ~op_report()
+  {
+    double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+    scope.stop();
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << double(scope.allocs()) / double(n_ops) << " allocs/op"
+              << std::setw(10) << double(scope.bytes()) / double(n_ops) << " bytes/op"
+              << std::setw(10) << ns / double(n_ops) << " ns/op" << std::endl;
+  }
+
+protected:
+  std::string name;
+
+  size_t n_ops;
+
+  bench_clock::time_point start;
+
+  alloc_scope scope;
+};
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::vector<ExternalOrderId_t> external_ids;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    external_ids.push_back("external-order-" + std::to_string(i));
+  }
+
+  std::cout << n_rows << " rows" << std::endl;
+
+  OrderTracker otk;
+  long checksum = 0;
+
+  {
+    op_report report("insert", n_rows);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      otk.insert<InternalOrderId>(i, Order{"IBM", int(i)});
+    }
+  }
+
+  {
+    op_report report("link", n_rows);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      otk.link<InternalOrderId, ExternalOrderId>(i, external_ids[i]);
+    }
+  }
+
+  {
+    op_report report("at<P>", n_rows);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      checksum += otk.at<ExternalOrderId>(external_ids[i]).svol;
+    }
+  }
+
+  {
+    op_report report("convert_key", n_rows);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      checksum += otk.convert_key<ExternalOrderId, InternalOrderId>(external_ids[i]);
+    }
+  }
+
+  {
+    op_report report("modify", n_rows);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      otk.modify<InternalOrderId>(i, [](Order& order) { order.svol++; });
+    }
+  }
+
+  {
+    op_report report("iterate (per row)", n_rows);
+
+    for (const Order& order : otk)
+    {
+      checksum += order.svol;
+    }
+  }
+
+  {
+    op_report report("copy (per row)", n_rows);
+
+    OrderTracker copy(otk);
+    checksum += copy.size();
+  }
+
+  {
+    op_report report("erase", n_rows);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      otk.erase<ExternalOrderId>(external_ids[i]);
+    }
+  }
+
+  return checksum == 0;
+}
@@ -0,0 +1,138 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "perf_counters.hpp"
+#include "polykey_async.hpp"
+#include "polykey_map.hpp"
+#include "robin_hood_index.hpp"
+
+//g++ -std=c++20 -O2 -I ../include -o bin/bench_async_find bench_async_find.cpp
+//usage: bin/bench_async_find [n_rows] [n_lookups]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, xu::robin_hood<InternalOrderId_t>, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double nsPerOp(bench_clock::time_point start, bench_clock::time_point stop, size_t n_ops)
+{
+  return std::chrono::duration<double, std::nano>(stop - start).count() / double(n_ops);
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000000;
+  size_t n_lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000000;
+
+  std::mt19937_64 rng(1);
+
+  OrderTracker otk;
+  std::vector<InternalOrderId_t> ids;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    InternalOrderId_t id = rng();
+
+    if (!otk.contains<InternalOrderId>(id))
+    {
+      otk.insert<InternalOrderId>(id, Order{"AAPL", int(i)});
+      ids.push_back(id);
+    }
+  }
+
+  /* independent lookups in random order, as in a batch reconciliation */
+  std::vector<InternalOrderId_t> keys(n_lookups);
+
+  for (auto& key : keys)
+  {
+    key = ids[rng() % ids.size()];
+  }
+
+  std::cout << "rows=" << otk.size() << " lookups=" << n_lookups << std::endl;
+
+  long long checksum = 0;
+
+  perf_counters counters;
+
+  counters.start();
+  bench_clock::time_point start = bench_clock::now();
+
+  for (const auto& key : keys)
+  {
+    checksum += otk.at<InternalOrderId>(key).svol;
+  }
+
+  bench_clock::time_point stop = bench_clock::now();
+  counters.stop();
+
+  std::cout << "sequential at<P>:        " << nsPerOp(start, stop, n_lookups) << " ns/lookup" << std::endl;
+  counters.print(std::cout, n_lookups);
+
+  for (size_t width : {1, 4, 8, 16, 32, 64})
+  {
+    long long interleaved_checksum = 0;
+
+    counters.start();
+    start = bench_clock::now();
+
+    xu::run_interleaved(width, keys.size(),
+      [&](size_t i)
+      {
+        return xu::async_find<InternalOrderId>(otk, keys[i]);
+      },
+      [&](size_t, const Order* order)
+      {
+        interleaved_checksum += order->svol;
+      });
+
+    stop = bench_clock::now();
+    counters.stop();
+
+    std::cout << "interleaved width=" << width << ":" << std::string(width < 10 ? 3 : 2, ' ')
+              << nsPerOp(start, stop, n_lookups) << " ns/lookup"
+              << (interleaved_checksum == checksum ? "" : " (checksum mismatch)") << std::endl;
+    counters.print(std::cout, n_lookups);
+  }
+}
@@ -0,0 +1,125 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "columnar_export.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -I ../include -o bin/bench_columnar_export bench_columnar_export.cpp
+//usage: bin/bench_columnar_export [n_rows]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+double fileMiB(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  return double(file.tellg()) / (1 << 20);
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+
+  const std::string csv_path = "bench_columnar_export.csv";
+  const std::string col_path = "bench_columnar_export.col";
+
+  OrderTracker otk;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"AAPL", int(i)});
+    otk.link<InternalOrderId, ExternalOrderId>(i, "ext-" + std::to_string(i));
+  }
+
+  std::cout << n_rows << " rows" << std::endl;
+
+  /* baseline: iterate values, probing each row's keys */
+  auto start = bench_clock::now();
+
+  {
+    std::ofstream csv(csv_path);
+    csv << "internal_id,external_id,ticker,svol\n";
+
+    for (auto it = otk.cbegin(); it != otk.cend(); ++it)
+    {
+      if (it.has_key<InternalOrderId>())
+      {
+        csv << it.get_key<InternalOrderId>();
+      }
+
+      csv << ',';
+
+      if (it.has_key<ExternalOrderId>())
+      {
+        csv << it.get_key<ExternalOrderId>();
+      }
+
+      csv << ',' << it->ticker << ',' << it->svol << '\n';
+    }
+  }
+
+  std::cout << "csv:      " << msSince(start) << " ms, " << fileMiB(csv_path) << " MiB" << std::endl;
+
+  start = bench_clock::now();
+
+  xu::export_columnar(otk, col_path, {"internal_id", "external_id"},
+    xu::value_projection("ticker", [](const Order& o) { return o.ticker; }),
+    xu::value_projection("svol", [](const Order& o) { return o.svol; }));
+
+  std::cout << "columnar: " << msSince(start) << " ms, " << fileMiB(col_path) << " MiB" << std::endl;
+
+  std::remove(csv_path.c_str());
+  std::remove(col_path.c_str());
+
+  return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "delimited_import.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -pthread -I ../include -o bin/bench_delimited_import bench_delimited_import.cpp
+//usage: bin/bench_delimited_import [n_rows] [max_threads]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+  size_t max_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+
+  const std::string path = "bench_delimited_import.csv";
+
+  {
+    std::ofstream csv(path);
+    csv << "internal_id,external_id,ticker,svol\n";
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      csv << i << ",ext-" << i << ",AAPL," << i % 1000 << '\n';
+    }
+  }
+
+  std::cout << n_rows << " rows" << std::endl;
+
+  /* baseline: read lines, split them and insert and link one row at a time */
+  {
+    auto start = bench_clock::now();
+
+    OrderTracker otk;
+    std::ifstream csv(path);
+    std::string line;
+    std::getline(csv, line);
+
+    while (std::getline(csv, line))
+    {
+      std::istringstream fields(line);
+      std::string internal_id, external_id, ticker, svol;
+
+      std::getline(fields, internal_id, ',');
+      std::getline(fields, external_id, ',');
+      std::getline(fields, ticker, ',');
+      std::getline(fields, svol, ',');
+
+      InternalOrderId_t id = std::stoul(internal_id);
+      otk.insert<InternalOrderId>(id, Order{ticker, std::stoi(svol)});
+      otk.link<InternalOrderId, ExternalOrderId>(id, external_id);
+    }
+
+    std::cout << "naive loop: " << msSince(start) << " ms" << std::endl;
+  }
+
+  for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+  {
+    auto start = bench_clock::now();
+
+    OrderTracker otk;
+    xu::delimited_options_t options;
+    options.n_threads = n_threads;
+
+    xu::import_report_t report = xu::import_delimited(path, otk, {0, 1}, [](const xu::delimited_row_t& row)
+    {
+      int svol = 0;
+      std::string_view field = row.at(3);
+      std::from_chars(field.data(), field.data() + field.size(), svol);
+
+      return Order{std::string(row.at(2)), svol};
+    }, options);
+
+    std::cout << n_threads << " threads: " << msSince(start) << " ms, " << report.n_inserted << " rows inserted" << std::endl;
+  }
+
+  std::remove(path.c_str());
+
+  return 0;
+}
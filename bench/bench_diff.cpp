@@ -0,0 +1,166 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "merkle_digest.hpp"
+#include "polykey_diff.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -O2 -I ../include -o bin/bench_diff bench_diff.cpp
+//usage: bin/bench_diff [n_rows] [n_changes]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+
+  bool operator==(const Order& other) const
+  {
+    return ticker == other.ticker and svol == other.svol;
+  }
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+  size_t n_changes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+
+  OrderTracker a;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    a.insert<InternalOrderId>(i, Order{"AAPL", int(i)});
+    a.link<InternalOrderId, ExternalOrderId>(i, "ext-" + std::to_string(i));
+  }
+
+  OrderTracker b(a);
+
+  /* digests maintained as the maps change, e.g. by replicas */
+  xu::merkle_observer<Order, InternalOrderId_t, ExternalOrderId_t> digest_a(a);
+  xu::merkle_observer<Order, InternalOrderId_t, ExternalOrderId_t> digest_b(b);
+
+  for (size_t i = 0; i < n_changes; i++)
+  {
+    b.modify<InternalOrderId>(i * (n_rows / n_changes), [](Order& order) { order.svol = -1; });
+  }
+
+  std::cout << n_rows << " rows, " << n_changes << " changes" << std::endl;
+
+  /* baseline: probe the other map for every row and compare values */
+  {
+    auto start = bench_clock::now();
+    size_t differences = 0;
+
+    for (auto it = a.cbegin(); it != a.cend(); ++it)
+    {
+      InternalOrderId_t id = it.get_key<InternalOrderId>();
+
+      if (!b.contains<InternalOrderId>(id) or !(b.at<InternalOrderId>(id) == *it))
+      {
+        differences++;
+      }
+    }
+
+    for (auto it = b.cbegin(); it != b.cend(); ++it)
+    {
+      differences += !a.contains<InternalOrderId>(it.get_key<InternalOrderId>());
+    }
+
+    std::cout << "probe loop:    " << msSince(start) << " ms, " << differences << " differences" << std::endl;
+  }
+
+  {
+    auto start = bench_clock::now();
+    auto d = xu::diff(a, b);
+
+    std::cout << "map diff:      " << msSince(start) << " ms, " << d.changed.size() << " differences" << std::endl;
+  }
+
+  {
+    auto start = bench_clock::now();
+    auto d = xu::diff(a, digest_a.digest(), b, digest_b.digest());
+
+    std::cout << "digest diff:   " << msSince(start) << " ms, " << d.changed.size() << " differences" << std::endl;
+  }
+
+  /* snapshots of both, most of whose chunks are identical */
+  xu::save_snapshot(a, "bench_diff_a.snap");
+  xu::save_snapshot(b, "bench_diff_b.snap");
+
+  {
+    xu::mapped_snapshot<Order, InternalOrderId_t, ExternalOrderId_t> snap_a("bench_diff_a.snap");
+    xu::mapped_snapshot<Order, InternalOrderId_t, ExternalOrderId_t> snap_b("bench_diff_b.snap");
+
+    auto start = bench_clock::now();
+    auto d = xu::diff(snap_a, snap_b);
+
+    std::cout << "snapshot diff: " << msSince(start) << " ms, " << d.changed.size() << " differences" << std::endl;
+  }
+
+  std::remove("bench_diff_a.snap");
+  std::remove("bench_diff_b.snap");
+
+  return 0;
+}
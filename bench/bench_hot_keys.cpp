@@ -0,0 +1,109 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "hot_keys.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -I ../include -o bin/bench_hot_keys bench_hot_keys.cpp
+//usage: bin/bench_hot_keys [n_rows] [n_lookups]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+/* lookups of random rows, one in ten of them on a hot row */
+double run(const OrderTracker& otk, const std::vector<std::string>& ids, size_t n_lookups)
+{
+  auto start = bench_clock::now();
+  long checksum = 0;
+
+  for (size_t i = 0; i < n_lookups; i++)
+  {
+    size_t row = i % 10 == 0 ? 17 : (i * 7919) % ids.size();
+    checksum += otk.at<ExternalOrderId>(ids[row]).svol;
+  }
+
+  double ms = msSince(start);
+
+  return checksum == 0 ? -ms : ms;
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  size_t n_lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000;
+
+  OrderTracker otk;
+  std::vector<std::string> ids;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    ids.push_back("ext-" + std::to_string(i));
+    otk.insert<ExternalOrderId>(ids.back(), Order{"IBM", int(i) + 1});
+  }
+
+  std::cout << n_rows << " rows, " << n_lookups << " lookups" << std::endl;
+
+  std::cout << "no sampler:        " << run(otk, ids, n_lookups) << " ms" << std::endl;
+
+  for (uint64_t period : {1, 16, 256})
+  {
+    xu::hot_key_sampler<OrderTracker> sampler(otk, 64, period);
+
+    double ms = run(otk, ids, n_lookups);
+    auto top = sampler.top<ExternalOrderId>(1);
+
+    std::cout << "sample 1 in " << period << ": " << (period < 10 ? " " : "") << (period < 100 ? " " : "")
+              << ms << " ms, top " << top[0].key << " x" << top[0].count * period << std::endl;
+  }
+
+  return 0;
+}
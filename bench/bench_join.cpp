@@ -0,0 +1,144 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "perf_counters.hpp"
+#include "polykey_join.hpp"
+#include "polykey_map.hpp"
+#include "robin_hood_index.hpp"
+
+//g++ -std=c++17 -O2 -pthread -I ../include -o bin/bench_join bench_join.cpp
+//usage: bin/bench_join [n_orders] [max_threads]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+enum FillDim
+{
+  FillId,
+  FillOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = unsigned long;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+struct Fill
+{
+  int qty;
+};
+
+using OrderTracker = xu::polykey_map<Order, xu::robin_hood<InternalOrderId_t>, xu::robin_hood<ExternalOrderId_t>>;
+
+using FillTracker = xu::polykey_map<Fill, xu::robin_hood<unsigned long>, xu::robin_hood<ExternalOrderId_t>>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_orders = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000000;
+  size_t max_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+
+  OrderTracker otk;
+  FillTracker fills;
+
+  for (size_t i = 0; i < n_orders; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"AAPL", int(i % 1000)});
+    otk.link<InternalOrderId, ExternalOrderId>(i, i * 7919 % (4 * n_orders));
+
+    /* every other order was filled */
+    if (i % 2 == 0)
+    {
+      fills.insert<FillId>(i, Fill{int(i % 100)});
+      fills.link<FillId, FillOrderId>(i, i * 7919 % (4 * n_orders));
+    }
+  }
+
+  std::cout << n_orders << " orders, " << fills.size() << " fills" << std::endl;
+
+  perf_counters counters;
+
+  /* baseline: iterate the fills, looking each up in the orders */
+  {
+    counters.start();
+    auto start = bench_clock::now();
+    long long total = 0;
+
+    for (auto it = fills.cbegin(); it != fills.cend(); ++it)
+    {
+      ExternalOrderId_t key = it.get_key<FillOrderId>();
+
+      if (otk.contains<ExternalOrderId>(key))
+      {
+        total += otk.at<ExternalOrderId>(key).svol * it->qty;
+      }
+    }
+
+    double ms = msSince(start);
+    counters.stop();
+
+    std::cout << "lookup loop: " << ms << " ms (" << total << ")" << std::endl;
+    counters.print(std::cout, fills.size());
+  }
+
+  for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+  {
+    counters.start();
+    auto start = bench_clock::now();
+    std::atomic<long long> total(0);
+
+    xu::hash_join<ExternalOrderId, FillOrderId>(otk, fills, [&total](ExternalOrderId_t, const Order& order, const Fill& fill)
+    {
+      total.fetch_add(order.svol * fill.qty, std::memory_order_relaxed);
+    }, n_threads);
+
+    double ms = msSince(start);
+    counters.stop();
+
+    std::cout << n_threads << " threads: hash_join " << ms << " ms (" << total.load() << ")" << std::endl;
+    counters.print(std::cout, fills.size());
+  }
+
+  return 0;
+}
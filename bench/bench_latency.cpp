@@ -0,0 +1,140 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "latency_recorder.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -pthread -I ../include -o bin/bench_latency bench_latency.cpp
+//usage: bin/bench_latency [n_rows] [json_path]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+/* a mixed workload touching every operation */
+double run(OrderTracker& otk, const std::vector<std::string>& ids, xu::operation_timer* timer)
+{
+  size_t n_rows = ids.size();
+  long checksum = 0;
+
+  otk.set_operation_timer(timer);
+
+  auto start = bench_clock::now();
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"IBM", int(i) + 1});
+    otk.link<InternalOrderId, ExternalOrderId>(i, ids[i]);
+  }
+
+  for (size_t i = 0; i < 10 * n_rows; i++)
+  {
+    size_t row = (i * 7919) % n_rows;
+
+    checksum += otk.at<ExternalOrderId>(ids[row]).svol;
+    checksum += otk.contains<InternalOrderId>(row + n_rows / 2);
+  }
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    checksum += long(otk.convert_key<ExternalOrderId, InternalOrderId>(ids[i]));
+    otk.modify<InternalOrderId>(i, [](Order& order) { order.svol++; });
+  }
+
+  for (auto it = otk.begin(); it != otk.end(); ++it)
+  {
+    checksum += it->svol;
+  }
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    otk.erase<InternalOrderId>(i);
+  }
+
+  double ms = msSince(start);
+
+  otk.set_operation_timer(nullptr);
+
+  return checksum == 0 ? -ms : ms;
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::vector<std::string> ids;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    ids.push_back("ext-" + std::to_string(i));
+  }
+
+  OrderTracker otk;
+  xu::latency_recorder recorder;
+
+  /* warm up the allocator */
+  run(otk, ids, nullptr);
+
+  std::cout << n_rows << " rows, " << 26 * n_rows << " operations" << std::endl;
+  std::cout << "no timer:       " << run(otk, ids, nullptr) << " ms" << std::endl;
+  std::cout << "with recorder:  " << run(otk, ids, &recorder) << " ms" << std::endl << std::endl;
+
+  recorder.write_text(std::cout);
+
+  if (argc > 2)
+  {
+    std::ofstream json(argv[2]);
+    recorder.write_json(json);
+  }
+
+  return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -I ../include -o bin/bench_memory bench_memory.cpp
+//usage: bin/bench_memory [n_rows]
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+/* bytes in use by the allocator, including its per-chunk overhead */
+size_t heap_bytes()
+{
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+size_t rss_bytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  statm >> pages >> resident;
+  return resident * size_t(sysconf(_SC_PAGESIZE));
+}
+
+/* polykey_map of N_Paths paths keyed by Key_T */
+template <typename Key_T, size_t N_Paths>
+struct map_of;
+
+template <typename Key_T>
+struct map_of<Key_T, 1>
+{
+  using type = xu::polykey_map<Order, Key_T>;
+};
+
+template <typename Key_T>
+struct map_of<Key_T, 2>
+{
+  using type = xu::polykey_map<Order, Key_T, Key_T>;
+};
+
+template <typename Key_T>
+struct map_of<Key_T, 3>
+{
+  using type = xu::polykey_map<Order, Key_T, Key_T, Key_T>;
+};
+
+/* key of a row on a path: integer, string in the small string buffer, or longer string */
+enum class key_kind
+{
+  integer,
+  sso_string,
+  long_string
+};
+
+template <typename Key_T>
+Key_T make_key(size_t row, size_t path, key_kind kind)
+{
+  if constexpr (std::is_integral<Key_T>::value)
+  {
+    return Key_T(row * 4 + path);
+  }
+  else
+  {
+    std::string id = std::to_string(row) + char('a' + path);
+    return kind == key_kind::sso_string ? "k" + id : "external-order-identifier-" + id;
+  }
+}
+
+/* whether a row is linked on path, for a fraction fill of rows */
+bool linked(size_t row, size_t path, double fill)
+{
+  return double((row * 0x9e3779b97f4a7c15ull + path * 0xbf58476d1ce4e5b9ull) >> 11) / double(1ull << 53) < fill;
+}
+
+template <typename Map_T, typename Key_T, size_t ...Ps>
+void insert_row(Map_T& map, size_t row, key_kind kind, double fill, std::index_sequence<Ps...>)
+{
+  Key_T first = make_key<Key_T>(row, 0, kind);
+  map.template insert<0>(first, Order{"AAPL", int(row)});
+
+  /* link the other paths, each for a fraction fill of rows */
+  (void)fill;
+  ((linked(row, Ps + 1, fill) ? map.template link<0, Ps + 1>(first, make_key<Key_T>(row, Ps + 1, kind)) : void()), ...);
+}
+
+struct phase_t
+{
+  size_t heap;
+
+  size_t rss;
+
+  size_t n_rows;
+};
+
+template <typename Key_T, size_t N_Paths>
+void run(const std::string& key_name, key_kind kind, double fill, size_t n_rows)
+{
+  using map_t = typename map_of<Key_T, N_Paths>::type;
+
+  /* the bench's own buffers are allocated before the baseline, so that only the map is measured */
+  std::vector<phase_t> phases;
+  phases.reserve(3);
+
+  std::vector<size_t> rows(n_rows);
+
+  size_t heap_before = heap_bytes();
+  size_t rss_before = rss_bytes();
+
+  map_t map;
+
+  auto record = [&]()
+  {
+    phases.push_back(phase_t{heap_bytes() - heap_before, rss_bytes() - rss_before, map.size()});
+  };
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    rows[i] = i;
+    insert_row<map_t, Key_T>(map, i, kind, fill, std::make_index_sequence<N_Paths - 1>());
+  }
+
+  record();
+
+  /* churn: replace half of the rows with new ones */
+  std::mt19937_64 rng(1);
+
+  for (size_t i = 0; i < n_rows / 2; i++)
+  {
+    size_t& row = rows[rng() % n_rows];
+
+    map.template erase<0>(make_key<Key_T>(row, 0, kind));
+    row = n_rows + i;
+    insert_row<map_t, Key_T>(map, row, kind, fill, std::make_index_sequence<N_Paths - 1>());
+  }
+
+  record();
+
+  for (size_t i = 0; i < n_rows / 2; i++)
+  {
+    map.template erase<0>(make_key<Key_T>(rows[i], 0, kind));
+  }
+
+  record();
+
+  std::cout << std::left << std::setw(12) << key_name << std::right
+            << std::setw(3) << N_Paths << " paths"
+            << std::setw(6) << int(fill * 100) << "% linked"
+            << std::fixed << std::setprecision(0);
+
+  const char* names[] = {"filled", "churned", "half erased"};
+
+  for (size_t i = 0; i < phases.size(); i++)
+  {
+    std::cout << "   " << names[i] << " " << std::setw(4) << double(phases[i].heap) / double(phases[i].n_rows)
+              << " / " << std::setw(4) << double(phases[i].rss) / double(phases[i].n_rows);
+  }
+
+  std::cout << std::endl;
+}
+
+/* run in a child process, so that each configuration starts from a clean heap */
+template <typename Key_T, size_t N_Paths>
+void run_isolated(const std::string& key_name, key_kind kind, double fill, size_t n_rows)
+{
+  std::cout.flush();
+
+  pid_t pid = fork();
+
+  if (pid == 0)
+  {
+    run<Key_T, N_Paths>(key_name, kind, fill, n_rows);
+    std::cout.flush();
+    _exit(0);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+}
+
+template <typename Key_T>
+void run_all(const std::string& key_name, key_kind kind, size_t n_rows)
+{
+  run_isolated<Key_T, 1>(key_name, kind, 0, n_rows);
+
+  for (double fill : {0.5, 1.0})
+  {
+    run_isolated<Key_T, 2>(key_name, kind, fill, n_rows);
+    run_isolated<Key_T, 3>(key_name, kind, fill, n_rows);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::cout << n_rows << " rows, value of " << sizeof(Order) << " bytes; heap / RSS bytes per row after each phase" << std::endl;
+
+  run_all<unsigned long>("integer", key_kind::integer, n_rows);
+  run_all<std::string>("sso string", key_kind::sso_string, n_rows);
+  run_all<std::string>("long string", key_kind::long_string, n_rows);
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "ordered_index.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -O2 -I ../include -o bin/bench_ordered_index bench_ordered_index.cpp
+//usage: bin/bench_ordered_index [n_rows] [n_queries]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+  double price;
+  long time;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static const size_t n_tickers = 500;
+
+static const size_t best_n = 10;
+
+std::string ticker_of(size_t i)
+{
+  return "T" + std::to_string(i % n_tickers);
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t n_queries = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+
+  OrderTracker otk;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{ticker_of(i), 100, double((i * 7919) % 10000) / 100, long(i)});
+  }
+
+  std::cout << n_rows << " rows, " << n_tickers << " tickers, best " << best_n << " of " << n_queries << " tickers" << std::endl;
+
+  /* baseline: collect the ticker's orders, then partial sort */
+  {
+    auto start = bench_clock::now();
+    double checksum = 0;
+
+    for (size_t q = 0; q < n_queries; q++)
+    {
+      std::string ticker = ticker_of(q);
+      std::vector<const Order*> orders;
+
+      for (auto it = otk.cbegin(); it != otk.cend(); ++it)
+      {
+        if (it->ticker == ticker)
+        {
+          orders.push_back(&*it);
+        }
+      }
+
+      size_t n = std::min(best_n, orders.size());
+
+      std::partial_sort(orders.begin(), orders.begin() + n, orders.end(), [](const Order* a, const Order* b)
+      {
+        return std::make_tuple(-a->price, a->time) < std::make_tuple(-b->price, b->time);
+      });
+
+      for (size_t i = 0; i < n; i++)
+      {
+        checksum += orders[i]->price;
+      }
+    }
+
+    std::cout << "scan:          " << msSince(start) << " ms, checksum " << checksum << std::endl;
+  }
+
+  {
+    auto start = bench_clock::now();
+
+    auto book = xu::order_by(otk, [](const Order& order)
+    {
+      return std::make_tuple(order.ticker, -order.price, order.time);
+    });
+
+    std::cout << "index build:   " << msSince(start) << " ms" << std::endl;
+
+    start = bench_clock::now();
+    double checksum = 0;
+
+    for (size_t q = 0; q < n_queries; q++)
+    {
+      std::string ticker = ticker_of(q);
+      size_t n = 0;
+
+      for (auto it = book.lower_bound(std::make_tuple(ticker, -std::numeric_limits<double>::infinity(), 0L));
+           it != book.end() and std::get<0>(it.key()) == ticker and n < best_n; ++it, ++n)
+      {
+        checksum += it->price;
+      }
+    }
+
+    std::cout << "index:         " << msSince(start) << " ms, checksum " << checksum << std::endl;
+
+    start = bench_clock::now();
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      otk.modify<InternalOrderId>((i * 7919) % n_rows, [](Order& order) { order.price += 0.01; });
+    }
+
+    std::cout << "reprice all:   " << msSince(start) << " ms" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "async_journal.hpp"
+#include "polykey_journal.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -O2 -pthread -I ../include -o bin/bench_recovery bench_recovery.cpp
+//usage: bin/bench_recovery [n_rows] [n_threads]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using OrderSnapshot = xu::mapped_snapshot<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+const std::string snapshot_path = "bench_recovery.snap";
+const std::string journal_path = "bench_recovery.log";
+
+std::string external_id(size_t i)
+{
+  return "ext-" + std::to_string(i);
+}
+
+Order order(size_t i)
+{
+  return Order{"AAPL", int(i)};
+}
+
+/*
+  Run f in a child process, so that each strategy starts from a small
+  process and its peak RSS is its own. f returns the time to report, or a
+  negative value if the result is wrong.
+  */
+void measure(const std::string& name, size_t n_rows, std::function<double()> f)
+{
+  int fds[2];
+
+  if (pipe(fds) != 0)
+  {
+    std::perror("pipe");
+    std::exit(1);
+  }
+
+  std::cout.flush();
+
+  pid_t pid = fork();
+
+  if (pid == 0)
+  {
+    close(fds[0]);
+    double ms = f();
+    ssize_t written = write(fds[1], &ms, sizeof(ms));
+    _exit(written == sizeof(ms) ? 0 : 1);
+  }
+
+  close(fds[1]);
+
+  double ms = -1;
+  ssize_t n_read = read(fds[0], &ms, sizeof(ms));
+  close(fds[0]);
+
+  int status = 0;
+  rusage usage{};
+  wait4(pid, &status, 0, &usage);
+
+  if (n_read != sizeof(ms) or ms < 0 or !WIFEXITED(status) or WEXITSTATUS(status) != 0)
+  {
+    std::cout << std::left << std::setw(26) << name << "failed" << std::endl;
+    return;
+  }
+
+  std::cout << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(0)
+            << std::setw(10) << ms << " ms"
+            << std::setprecision(2) << std::setw(10) << double(n_rows) / ms / 1000 << " Mrows/s"
+            << std::setprecision(0) << std::setw(10) << double(usage.ru_maxrss) / 1024 << " MB peak RSS" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t n_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+
+  std::cout << n_rows << " rows, " << n_threads << " threads" << std::endl;
+
+  /* recovery inputs: a snapshot of all rows, and a journal of their insertion */
+  measure("write snapshot + journal", n_rows, [&]()
+  {
+    auto start = bench_clock::now();
+
+    xu::async_journal journal(journal_path);
+    OrderTracker otk;
+
+    {
+      xu::journal_observer<Order, InternalOrderId_t, ExternalOrderId_t> journaled(otk, journal);
+
+      for (size_t i = 0; i < n_rows; i++)
+      {
+        otk.insert<InternalOrderId>(i, order(i));
+        otk.link<InternalOrderId, ExternalOrderId>(i, external_id(i));
+      }
+
+      journal.wait_durable(journaled.last_seq());
+    }
+
+    xu::save_snapshot(otk, snapshot_path, n_threads);
+
+    return msSince(start);
+  });
+
+  measure("insert/link loop", n_rows, [&]()
+  {
+    auto start = bench_clock::now();
+    OrderTracker otk;
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      otk.insert<InternalOrderId>(i, order(i));
+      otk.link<InternalOrderId, ExternalOrderId>(i, external_id(i));
+    }
+
+    return msSince(start);
+  });
+
+  measure("bulk_insert", n_rows, [&]()
+  {
+    auto start = bench_clock::now();
+    OrderTracker otk;
+
+    std::vector<std::pair<OrderTracker::row_keys_t, Order>> rows;
+    rows.reserve(n_rows);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      rows.emplace_back(OrderTracker::row_keys_t(i, external_id(i)), order(i));
+    }
+
+    otk.bulk_insert(std::move(rows), n_threads);
+
+    return msSince(start);
+  });
+
+  measure("load_snapshot", n_rows, [&]()
+  {
+    auto start = bench_clock::now();
+    OrderTracker otk;
+
+    xu::load_snapshot(snapshot_path, otk, n_threads);
+
+    return msSince(start);
+  });
+
+  measure("mmap open", n_rows, [&]()
+  {
+    auto start = bench_clock::now();
+    OrderSnapshot snapshot(snapshot_path);
+
+    /* first lookups fault in the pages they touch */
+    long long checksum = 0;
+
+    for (size_t i = 0; i < 1000; i++)
+    {
+      checksum += snapshot.find<ExternalOrderId>(external_id(i * 7919 % n_rows)).has_value();
+    }
+
+    return checksum == 1000 ? msSince(start) : -1.0;
+  });
+
+  measure("mmap open + verify", n_rows, [&]()
+  {
+    auto start = bench_clock::now();
+    OrderSnapshot snapshot(snapshot_path);
+
+    return snapshot.verify(n_threads) ? msSince(start) : -1.0;
+  });
+
+  measure("replay journal", n_rows, [&]()
+  {
+    auto start = bench_clock::now();
+    OrderTracker otk;
+
+    xu::replay_journal(journal_path, otk);
+
+    return otk.size() == n_rows ? msSince(start) : -1.0;
+  });
+
+  std::remove(snapshot_path.c_str());
+  std::remove(journal_path.c_str());
+
+  return 0;
+}
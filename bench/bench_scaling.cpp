@@ -0,0 +1,431 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "partitioned_polykey_map.hpp"
+#include "polykey_map.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//g++ -std=c++17 -O2 -pthread -I ../include -o bin/bench_scaling bench_scaling.cpp
+//usage: bin/bench_scaling [n_rows] [ops_per_thread] [max_threads] [n_partitions]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+/* baseline: one reader-writer lock around the whole map */
+class locked_tracker
+{
+public:
+  locked_tracker& client(size_t)
+  {
+    return *this;
+  }
+
+  void insert(InternalOrderId_t id, const Order& order)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    map.insert<InternalOrderId>(id, order);
+  }
+
+  int read(InternalOrderId_t id)
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return map.at<InternalOrderId>(id).svol;
+  }
+
+  void update(InternalOrderId_t id)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    map.modify<InternalOrderId>(id, [](Order& order) { order.svol++; });
+  }
+
+protected:
+  std::shared_mutex mutex;
+
+  OrderTracker map;
+};
+
+/* sharding: rows spread over maps by key hash, each with its own lock */
+class striped_tracker
+{
+public:
+  static const size_t n_stripes = 16;
+
+  striped_tracker& client(size_t)
+  {
+    return *this;
+  }
+
+  void insert(InternalOrderId_t id, const Order& order)
+  {
+    stripe_t& stripe = _stripe(id);
+    std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+    stripe.map.insert<InternalOrderId>(id, order);
+  }
+
+  int read(InternalOrderId_t id)
+  {
+    stripe_t& stripe = _stripe(id);
+    std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+    return stripe.map.at<InternalOrderId>(id).svol;
+  }
+
+  void update(InternalOrderId_t id)
+  {
+    stripe_t& stripe = _stripe(id);
+    std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+    stripe.map.modify<InternalOrderId>(id, [](Order& order) { order.svol++; });
+  }
+
+protected:
+  struct alignas(64) stripe_t
+  {
+    std::shared_mutex mutex;
+
+    OrderTracker map;
+  };
+
+  stripe_t& _stripe(InternalOrderId_t id)
+  {
+    return stripes[(id * 0x9e3779b97f4a7c15ull) >> 60];
+  }
+
+  stripe_t stripes[n_stripes];
+};
+
+/* shared-nothing: rows owned by worker threads, each bench thread sends
+   requests through its own session and waits for every answer */
+class partitioned_tracker
+{
+public:
+  using map_t = xu::partitioned_polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+  class client_t
+  {
+  public:
+    explicit client_t(map_t& pm)
+      : session(pm)
+    {}
+
+    int read(InternalOrderId_t id)
+    {
+      return session.at<InternalOrderId>(id).get().svol;
+    }
+
+    void update(InternalOrderId_t id)
+    {
+      session.visit<InternalOrderId>(id, [](Order& order) { order.svol++; }).get();
+    }
+
+  protected:
+    map_t::session session;
+  };
+
+  partitioned_tracker(size_t n_partitions, size_t max_threads)
+    : map(n_partitions, 64, false, max_threads)
+  {
+    for (size_t t = 0; t < max_threads; t++)
+    {
+      clients.emplace_back(new client_t(map));
+    }
+  }
+
+  void insert(InternalOrderId_t id, const Order& order)
+  {
+    map.insert<InternalOrderId>(id, order);
+  }
+
+  void sync()
+  {
+    map.sync();
+  }
+
+  client_t& client(size_t t)
+  {
+    return *clients[t];
+  }
+
+protected:
+  map_t map;
+
+  std::vector<std::unique_ptr<client_t>> clients;
+};
+
+/* ranks drawn from a Zipf distribution over [0, n), by inverting its CDF */
+class zipf_table
+{
+public:
+  zipf_table(size_t n, double theta)
+    : cdf(n)
+  {
+    double sum = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+      sum += 1.0 / std::pow(double(i + 1), theta);
+      cdf[i] = sum;
+    }
+
+    for (double& c : cdf)
+    {
+      c /= sum;
+    }
+  }
+
+  size_t operator()(std::mt19937_64& rng) const
+  {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    return std::min(size_t(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()), cdf.size() - 1);
+  }
+
+protected:
+  std::vector<double> cdf;
+};
+
+void pin_to_core(size_t i)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+double percentile(std::vector<uint32_t>& ns, double p)
+{
+  if (ns.empty())
+  {
+    return 0;
+  }
+
+  size_t i = std::min(ns.size() - 1, size_t(p * double(ns.size())));
+  std::nth_element(ns.begin(), ns.begin() + i, ns.end());
+
+  return ns[i];
+}
+
+struct thread_result_t
+{
+  std::vector<uint32_t> read_ns;
+
+  std::vector<uint32_t> write_ns;
+};
+
+template <typename Tracker_T>
+void run(const std::string& mode, Tracker_T& tracker, size_t n_rows, size_t ops_per_thread, size_t max_threads, const zipf_table& zipf)
+{
+  for (double write_fraction : {0.0, 0.05, 0.5})
+  {
+    for (bool skewed : {false, true})
+    {
+      for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+      {
+        std::vector<thread_result_t> results(n_threads);
+        std::vector<std::thread> threads;
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> go(false);
+        long long checksum = 0;
+        std::mutex checksum_mutex;
+
+        for (size_t t = 0; t < n_threads; t++)
+        {
+          threads.emplace_back([&, t]()
+          {
+            pin_to_core(t);
+
+            auto& client = tracker.client(t);
+
+            /* keys and operations are drawn up front, outside the timing */
+            std::mt19937_64 rng(t + 1);
+            std::vector<InternalOrderId_t> keys(ops_per_thread);
+            std::vector<bool> writes(ops_per_thread);
+
+            for (size_t i = 0; i < ops_per_thread; i++)
+            {
+              size_t rank = skewed ? zipf(rng) : rng() % n_rows;
+
+              /* scatter hot ranks over the key space */
+              keys[i] = (rank * 0x9e3779b97f4a7c15ull) % n_rows;
+              writes[i] = std::uniform_real_distribution<double>(0, 1)(rng) < write_fraction;
+            }
+
+            thread_result_t& result = results[t];
+            result.read_ns.reserve(ops_per_thread);
+            result.write_ns.reserve(ops_per_thread);
+            long long sum = 0;
+
+            ready++;
+
+            while (!go.load(std::memory_order_acquire))
+            {}
+
+            for (size_t i = 0; i < ops_per_thread; i++)
+            {
+              auto start = bench_clock::now();
+
+              if (writes[i])
+              {
+                client.update(keys[i]);
+                result.write_ns.push_back(uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count()));
+              }
+              else
+              {
+                sum += client.read(keys[i]);
+                result.read_ns.push_back(uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count()));
+              }
+            }
+
+            std::lock_guard<std::mutex> lock(checksum_mutex);
+            checksum += sum;
+          });
+        }
+
+        while (ready.load() != n_threads)
+        {
+          std::this_thread::yield();
+        }
+
+        auto start = bench_clock::now();
+        go.store(true, std::memory_order_release);
+
+        for (auto& thread : threads)
+        {
+          thread.join();
+        }
+
+        double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        std::vector<uint32_t> read_ns;
+        std::vector<uint32_t> write_ns;
+
+        for (auto& result : results)
+        {
+          read_ns.insert(read_ns.end(), result.read_ns.begin(), result.read_ns.end());
+          write_ns.insert(write_ns.end(), result.write_ns.begin(), result.write_ns.end());
+        }
+
+        std::cout << std::left << std::setw(14) << mode << std::right
+                  << std::setw(5) << int(write_fraction * 100) << "% w"
+                  << std::setw(9) << (skewed ? "zipf" : "uniform")
+                  << std::setw(4) << n_threads << " thr"
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(9) << double(n_threads * ops_per_thread) / seconds / 1e6 << " Mops/s"
+                  << std::setprecision(0)
+                  << "   read p50/p99/p99.9 " << percentile(read_ns, 0.5) << "/" << percentile(read_ns, 0.99) << "/" << percentile(read_ns, 0.999) << " ns";
+
+        if (!write_ns.empty())
+        {
+          std::cout << "   write p50/p99/p99.9 " << percentile(write_ns, 0.5) << "/" << percentile(write_ns, 0.99) << "/" << percentile(write_ns, 0.999) << " ns";
+        }
+
+        std::cout << (checksum < 0 ? " !" : "") << std::endl;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t ops_per_thread = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+  size_t max_threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+  size_t n_partitions = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency() / 2);
+
+  std::cout << n_rows << " rows, " << ops_per_thread << " ops per thread, up to " << max_threads << " threads, " << n_partitions << " partitions" << std::endl;
+
+  zipf_table zipf(n_rows, 0.99);
+
+  {
+    auto tracker = std::make_unique<locked_tracker>();
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      tracker->insert(i, Order{"IBM", int(i % 1000)});
+    }
+
+    run("shared_mutex", *tracker, n_rows, ops_per_thread, max_threads, zipf);
+  }
+
+  {
+    auto tracker = std::make_unique<striped_tracker>();
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      tracker->insert(i, Order{"IBM", int(i % 1000)});
+    }
+
+    run("striped x16", *tracker, n_rows, ops_per_thread, max_threads, zipf);
+  }
+
+  {
+    auto tracker = std::make_unique<partitioned_tracker>(n_partitions, max_threads);
+
+    for (size_t i = 0; i < n_rows; i++)
+    {
+      tracker->insert(i, Order{"IBM", int(i % 1000)});
+    }
+
+    tracker->sync();
+
+    run("partitioned x" + std::to_string(n_partitions), *tracker, n_rows, ops_per_thread, max_threads, zipf);
+  }
+
+  return 0;
+}
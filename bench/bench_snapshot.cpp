@@ -0,0 +1,116 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -O2 -pthread -I ../include -o bin/bench_snapshot bench_snapshot.cpp
+//usage: bin/bench_snapshot [n_rows] [max_threads]
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using bench_clock = std::chrono::steady_clock;
+
+double msSince(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  size_t n_rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+  size_t max_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+
+  const std::string path = "bench_snapshot.snap";
+
+  OrderTracker otk;
+
+  for (size_t i = 0; i < n_rows; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"AAPL", int(i)});
+    otk.link<InternalOrderId, ExternalOrderId>(i, "ext-" + std::to_string(i));
+  }
+
+  std::cout << n_rows << " rows" << std::endl;
+
+  for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+  {
+    auto start = bench_clock::now();
+    xu::save_snapshot(otk, path, n_threads);
+    double save_ms = msSince(start);
+
+    start = bench_clock::now();
+    OrderTracker loaded;
+    xu::load_snapshot(path, loaded, n_threads);
+    double load_ms = msSince(start);
+
+    std::cout << n_threads << " threads: save " << save_ms << " ms, load " << load_ms << " ms" << std::endl;
+  }
+
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  std::cout << "snapshot size: " << double(file.tellg()) / n_rows << " bytes/row" << std::endl;
+
+  std::remove(path.c_str());
+
+  return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+  @brief  Hardware performance counters of the calling thread (and of the
+          threads it creates afterwards), for benches
+          Opens cycles, instructions, L1D and LLC read misses, dTLB read
+          misses, branch misses and page faults with `perf_event_open`,
+          counting user space only, so that `perf_event_paranoid` up to 2 is
+          enough. Counters which cannot be opened (e.g. hardware counters in
+          containers or VMs without a PMU) are reported as n/a, and the bench
+          runs unchanged.
+          Counts are scaled when the kernel multiplexes counters.
+  */
+class perf_counters
+{
+public:
+  perf_counters()
+  {
+    _open("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    _open("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    _open("L1D misses", PERF_TYPE_HW_CACHE, _cache_config(PERF_COUNT_HW_CACHE_L1D));
+    _open("LLC misses", PERF_TYPE_HW_CACHE, _cache_config(PERF_COUNT_HW_CACHE_LL));
+    _open("dTLB misses", PERF_TYPE_HW_CACHE, _cache_config(PERF_COUNT_HW_CACHE_DTLB));
+    _open("branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    _open("page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+  }
+
+  ~perf_counters()
+  {
+    for (counter_t& counter : counters)
+    {
+      if (counter.fd >= 0)
+      {
+        close(counter.fd);
+      }
+    }
+  }
+
+  perf_counters(const perf_counters& other) = delete;
+
+  perf_counters& operator=(const perf_counters& other) = delete;
+
+  /**
+    @brief  Checks if any counter could be opened
+    */
+  bool available() const
+  {
+    for (const counter_t& counter : counters)
+    {
+      if (counter.fd >= 0)
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /**
+    @brief  Reset and start counting
+    */
+  void start()
+  {
+    for (counter_t& counter : counters)
+    {
+      if (counter.fd >= 0)
+      {
+        ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  /**
+    @brief  Stop counting, and read the counts
+    */
+  void stop()
+  {
+    for (counter_t& counter : counters)
+    {
+      if (counter.fd >= 0)
+      {
+        ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+    }
+
+    for (counter_t& counter : counters)
+    {
+      counter.value = NAN;
+
+      /* value, time enabled, time running */
+      uint64_t buf[3];
+
+      if (counter.fd >= 0 and read(counter.fd, buf, sizeof(buf)) == sizeof(buf) and buf[2] != 0)
+      {
+        counter.value = double(buf[0]) * double(buf[1]) / double(buf[2]);
+      }
+    }
+  }
+
+  /**
+    @brief  Returns the last count of a counter, or NaN if unavailable
+    */
+  double value(const std::string& name) const
+  {
+    for (const counter_t& counter : counters)
+    {
+      if (counter.name == name)
+      {
+        return counter.value;
+      }
+    }
+
+    return NAN;
+  }
+
+  /**
+    @brief  Print the last counts divided by n_ops, and instructions per
+            cycle, on one line, followed by the unavailable counters the
+            first time
+    */
+  void print(std::ostream& os, size_t n_ops, const std::string& indent = "  ") const
+  {
+    if (!available())
+    {
+      os << indent << "perf counters unavailable (" << open_error << ")" << std::endl;
+      return;
+    }
+
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+
+    os << indent << std::fixed << std::setprecision(2);
+
+    std::string unavailable;
+
+    for (const counter_t& counter : counters)
+    {
+      if (std::isnan(counter.value))
+      {
+        unavailable += (unavailable.empty() ? "" : ", ") + counter.name;
+      }
+      else
+      {
+        os << counter.name << "/op " << counter.value / double(n_ops) << "  ";
+      }
+    }
+
+    double ipc = value("instructions") / value("cycles");
+
+    if (!std::isnan(ipc))
+    {
+      os << "IPC " << ipc << "  ";
+    }
+
+    if (!unavailable.empty() and !reported_unavailable)
+    {
+      os << "(n/a: " << unavailable << "; " << open_error << ")";
+      reported_unavailable = true;
+    }
+
+    os << std::endl;
+
+    os.flags(flags);
+    os.precision(precision);
+  }
+
+protected:
+  struct counter_t
+  {
+    std::string name;
+
+    int fd;
+
+    double value;
+  };
+
+  static uint64_t _cache_config(uint64_t cache)
+  {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+
+  void _open(const std::string& name, uint32_t type, uint64_t config)
+  {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    /* this thread, any cpu */
+    int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+
+    if (fd < 0 and open_error.empty())
+    {
+      open_error = name + ": " + std::strerror(errno);
+    }
+
+    counters.push_back(counter_t{name, fd, NAN});
+  }
+
+protected:
+  std::vector<counter_t> counters;
+
+  /**
+    @brief  Error opening the first counter which failed
+    */
+  std::string open_error;
+
+  mutable bool reported_unavailable = false;
+};
@@ -0,0 +1,882 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define XU_JOURNAL_HAS_IO_URING 1
+#else
+#define XU_JOURNAL_HAS_IO_URING 0
+#endif
+
+#include "polykey_codec.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Result of scanning a journal file, see `read_journal()`
+    */
+  struct journal_scan_t
+  {
+    /**
+      @brief  Sequence number of the last valid entry, 0 if none
+      */
+    uint64_t last_seq;
+
+    /**
+      @brief  Size of the valid part of the file
+      */
+    uint64_t valid_size;
+  };
+
+  /**
+    @brief  Read the entries of a journal file
+            Each entry is framed as a 32-bit payload size, a 64-bit sequence
+            number, the payload, and a 64-bit checksum of the payload (seeded
+            with the sequence number). Reading stops at the first truncated
+            or corrupt entry, which is where a crash during a write leaves
+            the file.
+    @param  path
+            Journal file path. A missing file reads as empty.
+    @param  f
+            Callable taking `(uint64_t seq, const char* data, size_t size)`
+    @throw  std::system_error
+            If the file exists but cannot be read
+    */
+  template <typename F>
+  journal_scan_t read_journal(const std::string& path, F&& f)
+  {
+    journal_scan_t scan{0, 0};
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+      if (errno == ENOENT)
+      {
+        return scan;
+      }
+
+      throw std::system_error(errno, std::generic_category(), "read_journal() : cannot open " + path);
+    }
+
+    std::string contents;
+    char buffer[1 << 16];
+    ssize_t n;
+
+    while ((n = ::read(fd, buffer, sizeof(buffer))) != 0)
+    {
+      if (n < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "read_journal() : cannot read " + path);
+      }
+
+      contents.append(buffer, size_t(n));
+    }
+
+    ::close(fd);
+
+    const size_t frame_overhead = sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+    size_t pos = 0;
+
+    while (contents.size() - pos >= frame_overhead)
+    {
+      uint32_t size;
+      uint64_t seq;
+      uint64_t checksum;
+
+      std::memcpy(&size, contents.data() + pos, sizeof(size));
+      std::memcpy(&seq, contents.data() + pos + sizeof(size), sizeof(seq));
+
+      if (contents.size() - pos - frame_overhead < size or seq <= scan.last_seq)
+      {
+        break;
+      }
+
+      const char* payload = contents.data() + pos + sizeof(size) + sizeof(seq);
+
+      std::memcpy(&checksum, payload + size, sizeof(checksum));
+
+      if (checksum != hash_bytes(payload, size, seq))
+      {
+        break;
+      }
+
+      f(seq, payload, size_t(size));
+
+      scan.last_seq = seq;
+      pos += frame_overhead + size;
+      scan.valid_size = pos;
+    }
+
+    return scan;
+  }
+
+  /**
+    @brief  Append-only journal whose writes and syncs never block the
+            appending thread
+            Entries are framed (see `read_journal()`) into a batch, which is
+            handed to the I/O backend when it grows past `batch_bytes`, or on
+            `submit()` or `wait_durable()`. Each batch is written at the end
+            of the file and followed by an `fdatasync()`; the durable
+            sequence number advances once a batch's sync completes.
+            The backend is io_uring when the kernel provides it and supports
+            its write and fsync operations: the write and sync are queued
+            with a single `io_uring_enter()` call (the sync drains earlier
+            writes, so it covers every earlier batch), and a completion
+            thread tracks them. Otherwise, a writer thread
+            writes queued batches with `pwrite()` and syncs once per round.
+    @note   `append()` and `submit()` are meant to be called from a single
+            thread; `wait_durable()` and `durable_seq()` from any thread.
+    */
+  class async_journal
+  {
+  protected:
+    /**
+      @brief  A batch handed to the backend
+      */
+    struct batch_t
+    {
+      std::string bytes;
+
+      uint64_t offset;
+
+      uint64_t last_seq;
+
+      bool written;
+
+      bool synced;
+    };
+
+    /**
+      @brief  user_data of the io_uring entry which stops the completion
+              thread
+      */
+    static const uint64_t stop_marker = ~uint64_t(0);
+
+  public:
+    /**
+      @brief  Open a journal for appending
+              A torn entry at the end of an existing file is cut off, and
+              sequence numbers continue after the last valid entry.
+      @param  path_
+              Journal file path
+      @param  try_io_uring
+              Whether to use io_uring when available
+      @param  queue_depth
+              Maximum number of batches being written at once. Further
+              batches are merged while waiting.
+      @param  batch_bytes_
+              Batch size which triggers a submission on append
+      @throw  std::system_error
+              If the file cannot be opened
+      */
+    explicit async_journal(const std::string& path_, bool try_io_uring = true, unsigned queue_depth = 32, size_t batch_bytes_ = 1 << 16)
+      : path(path_),
+        batch_bytes(batch_bytes_),
+        max_in_flight(queue_depth == 0 ? 1 : queue_depth),
+        batch_last_seq(0),
+        error(0),
+        stopping(false)
+    {
+      journal_scan_t scan = read_journal(path, [](uint64_t, const char*, size_t) {});
+
+      fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+      if (fd < 0)
+      {
+        throw std::system_error(errno, std::generic_category(), "async_journal() : cannot open " + path);
+      }
+
+      if (::ftruncate(fd, off_t(scan.valid_size)) != 0)
+      {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "async_journal() : cannot truncate " + path);
+      }
+
+      file_end = scan.valid_size;
+      next_seq = scan.last_seq + 1;
+      durable.store(scan.last_seq);
+
+      if (!(try_io_uring and _setup_io_uring()))
+      {
+        writer = std::thread([this]() { _write_loop(); });
+      }
+    }
+
+    /**
+      @brief  Write and sync everything appended, then close
+      */
+    ~async_journal()
+    {
+      try
+      {
+        wait_durable(next_seq - 1);
+      }
+      catch (...)
+      {}
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+
+#if XU_JOURNAL_HAS_IO_URING
+      if (ring_fd >= 0)
+      {
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          _push_sqe(IORING_OP_NOP, nullptr, 0, 0, 0, stop_marker);
+          _enter(1, 0, 0);
+        }
+
+        writer.join();
+        _teardown_io_uring();
+      }
+      else
+#endif
+      {
+        pending_cv.notify_all();
+        writer.join();
+      }
+
+      ::close(fd);
+    }
+
+    async_journal(const async_journal& other) = delete;
+
+    async_journal& operator=(const async_journal& other) = delete;
+
+    /**
+      @brief  Append an entry
+      @return Sequence number of the entry
+      */
+    uint64_t append(const char* data, size_t size)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+
+      uint64_t seq = next_seq++;
+
+      uint32_t size32 = uint32_t(size);
+      uint64_t checksum = hash_bytes(data, size, seq);
+
+      batch.append(reinterpret_cast<const char*>(&size32), sizeof(size32));
+      batch.append(reinterpret_cast<const char*>(&seq), sizeof(seq));
+      batch.append(data, size);
+      batch.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+      batch_last_seq = seq;
+
+      if (batch.size() >= batch_bytes)
+      {
+        _submit();
+      }
+
+      return seq;
+    }
+
+    uint64_t append(const std::string& data)
+    {
+      return append(data.data(), data.size());
+    }
+
+    /**
+      @brief  Hand the current batch to the backend, without waiting
+      */
+    void submit()
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      _submit();
+    }
+
+    /**
+      @brief  Block until the entry with a sequence number is durable
+      @throw  std::invalid_argument
+              If no entry with the sequence number was appended yet
+      @throw  std::system_error
+              If a write or sync failed
+      */
+    void wait_durable(uint64_t seq)
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      if (seq >= next_seq)
+      {
+        throw std::invalid_argument("async_journal::wait_durable() : sequence number was not appended");
+      }
+
+      if (seq > durable.load() and !batch.empty() and batch_last_seq >= seq)
+      {
+        _submit();
+      }
+
+      durable_cv.wait(guard, [this, seq]() { return durable.load() >= seq or error != 0; });
+
+      if (error != 0)
+      {
+        throw std::system_error(error, std::generic_category(), "async_journal::wait_durable() : write failed");
+      }
+    }
+
+    /**
+      @brief  Returns the sequence number up to which entries are durable
+      */
+    uint64_t durable_seq() const
+    {
+      return durable.load(std::memory_order_acquire);
+    }
+
+    /**
+      @brief  Returns the sequence number of the last appended entry
+      */
+    uint64_t last_seq() const
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      return next_seq - 1;
+    }
+
+    /**
+      @brief  Check whether the io_uring backend is used
+      */
+    bool uses_io_uring() const
+    {
+#if XU_JOURNAL_HAS_IO_URING
+      return ring_fd >= 0;
+#else
+      return false;
+#endif
+    }
+
+  protected:
+    //  ==========
+    //  Submission
+    //  ==========
+
+    /**
+      @brief  Move the current batch in flight, unless too many batches
+              already are (it is then submitted when one completes)
+      @note   Must hold lock
+      */
+    void _submit()
+    {
+      if (batch.empty() or in_flight.size() >= max_in_flight)
+      {
+        return;
+      }
+
+      in_flight.push_back(batch_t{std::move(batch), file_end, batch_last_seq, false, false});
+      batch = std::string();
+
+      batch_t& b = in_flight.back();
+      file_end += b.bytes.size();
+
+#if XU_JOURNAL_HAS_IO_URING
+      if (ring_fd >= 0)
+      {
+        uint64_t id = next_batch_id++;
+
+        /* the sync waits for all earlier writes, not only this batch's */
+        _push_sqe(IORING_OP_WRITE, b.bytes.data(), uint32_t(b.bytes.size()), b.offset, 0, id << 1);
+        _push_sqe(IORING_OP_FSYNC, nullptr, 0, 0, IOSQE_IO_DRAIN, (id << 1) | 1);
+
+        if (_enter(2, 0, 0) < 0)
+        {
+          error = errno;
+          durable_cv.notify_all();
+        }
+
+        return;
+      }
+#endif
+
+      pending_cv.notify_one();
+    }
+
+    /**
+      @brief  Advance the durable sequence number over synced batches
+      @note   Must hold lock
+      */
+    void _retire()
+    {
+      while (error == 0 and !in_flight.empty() and in_flight.front().written and in_flight.front().synced)
+      {
+        durable.store(in_flight.front().last_seq, std::memory_order_release);
+        in_flight.pop_front();
+      }
+
+      /* merged batches waited for a free slot */
+      _submit();
+
+      durable_cv.notify_all();
+    }
+
+    //  ==============
+    //  Thread backend
+    //  ==============
+
+    void _write_loop()
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      while (true)
+      {
+        pending_cv.wait(guard, [this]() { return stopping or _has_unwritten(); });
+
+        if (!_has_unwritten())
+        {
+          return;
+        }
+
+        /* batches stay in place while unlocked, only this thread pops them */
+        std::vector<batch_t*> round;
+
+        for (auto& b : in_flight)
+        {
+          if (!b.written)
+          {
+            round.push_back(&b);
+          }
+        }
+
+        guard.unlock();
+
+        int err = 0;
+
+        for (batch_t* b : round)
+        {
+          err = _pwrite_all(b->bytes.data(), b->bytes.size(), b->offset);
+
+          if (err != 0)
+          {
+            break;
+          }
+        }
+
+        if (err == 0 and ::fdatasync(fd) != 0)
+        {
+          err = errno;
+        }
+
+        guard.lock();
+
+        if (err != 0)
+        {
+          error = err;
+          durable_cv.notify_all();
+          return;
+        }
+
+        for (batch_t* b : round)
+        {
+          b->written = true;
+          b->synced = true;
+        }
+
+        _retire();
+      }
+    }
+
+    bool _has_unwritten() const
+    {
+      return !in_flight.empty() and !in_flight.back().written;
+    }
+
+    int _pwrite_all(const char* data, size_t size, uint64_t offset)
+    {
+      while (size != 0)
+      {
+        ssize_t n = ::pwrite(fd, data, size, off_t(offset));
+
+        if (n < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+
+          return errno;
+        }
+
+        data += n;
+        size -= size_t(n);
+        offset += uint64_t(n);
+      }
+
+      return 0;
+    }
+
+#if XU_JOURNAL_HAS_IO_URING
+    //  ================
+    //  io_uring backend
+    //  ================
+
+    /**
+      @brief  Set up the rings and start the completion thread
+      @return Whether io_uring is usable
+      */
+    bool _setup_io_uring()
+    {
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+
+      unsigned entries = 1;
+
+      while (entries < 2 * max_in_flight + 1)
+      {
+        entries *= 2;
+      }
+
+      ring_fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+
+      if (ring_fd < 0)
+      {
+        return false;
+      }
+
+      if (!_probe_io_uring())
+      {
+        _teardown_io_uring();
+        return false;
+      }
+
+      sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+      bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+      if (single_mmap)
+      {
+        sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+      }
+
+      sq_map = ::mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+      cq_map = single_mmap ? sq_map : ::mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+      sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+
+      if (sq_map == MAP_FAILED or cq_map == MAP_FAILED or sqes == MAP_FAILED)
+      {
+        _teardown_io_uring();
+        return false;
+      }
+
+      char* sq = static_cast<char*>(sq_map);
+      char* cq = static_cast<char*>(cq_map);
+
+      sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+      cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+      writer = std::thread([this]() { _complete_loop(); });
+
+      return true;
+    }
+
+    /**
+      @brief  Check that the kernel supports the operations the backend
+              submits
+              Older kernels create rings but reject some opcodes, which would
+              only show up as failed writes.
+      */
+    bool _probe_io_uring()
+    {
+      /* io_uring_probe ends with one io_uring_probe_op per opcode */
+      std::vector<uint64_t> buffer((sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op) + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+      io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+
+      if (::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+      {
+        return false;
+      }
+
+      auto supported = [probe](unsigned opcode)
+      {
+        return opcode <= probe->last_op and opcode < probe->ops_len and (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+      };
+
+      return supported(IORING_OP_NOP) and supported(IORING_OP_WRITE) and supported(IORING_OP_FSYNC);
+    }
+
+    void _teardown_io_uring()
+    {
+      if (sqes != nullptr and sqes != MAP_FAILED)
+      {
+        ::munmap(sqes, sqes_size);
+      }
+
+      if (cq_map != nullptr and cq_map != MAP_FAILED and cq_map != sq_map)
+      {
+        ::munmap(cq_map, cq_map_size);
+      }
+
+      if (sq_map != nullptr and sq_map != MAP_FAILED)
+      {
+        ::munmap(sq_map, sq_map_size);
+      }
+
+      ::close(ring_fd);
+      ring_fd = -1;
+    }
+
+    /**
+      @brief  Queue a submission entry
+      @note   Must hold lock. The ring has room for all batches in flight.
+      */
+    void _push_sqe(uint8_t opcode, const char* data, uint32_t size, uint64_t offset, uint8_t flags, uint64_t user_data)
+    {
+      unsigned tail = *sq_tail;
+      unsigned index = tail & sq_mask;
+
+      io_uring_sqe* sqe = &sqes[index];
+      std::memset(sqe, 0, sizeof(*sqe));
+
+      sqe->opcode = opcode;
+      sqe->flags = flags;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(data);
+      sqe->len = size;
+      sqe->off = offset;
+      sqe->user_data = user_data;
+
+      if (opcode == IORING_OP_FSYNC)
+      {
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+      }
+
+      sq_array[index] = index;
+
+      __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    int _enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+      int r;
+
+      do
+      {
+        r = int(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+      }
+      while (r < 0 and errno == EINTR);
+
+      return r;
+    }
+
+    /**
+      @brief  Completion thread: track writes and syncs of batches
+      */
+    void _complete_loop()
+    {
+      while (true)
+      {
+        if (_enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          error = errno;
+          durable_cv.notify_all();
+          return;
+        }
+
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        bool stop = false;
+
+        for (; head != tail; head++)
+        {
+          const io_uring_cqe& cqe = cqes[head & cq_mask];
+
+          if (cqe.user_data == stop_marker)
+          {
+            stop = true;
+            continue;
+          }
+
+          uint64_t id = cqe.user_data >> 1;
+          bool is_sync = cqe.user_data & 1;
+
+          /* batches are in flight in submission order */
+          batch_t& b = in_flight[size_t(id - (next_batch_id - in_flight.size()))];
+
+          if (cqe.res < 0)
+          {
+            error = -cqe.res;
+          }
+          else if (!is_sync and size_t(cqe.res) != b.bytes.size())
+          {
+            error = EIO;
+          }
+          else if (is_sync)
+          {
+            b.synced = true;
+          }
+          else
+          {
+            b.written = true;
+          }
+        }
+
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+        _retire();
+
+        if (stop)
+        {
+          return;
+        }
+      }
+    }
+#endif
+
+  protected:
+    //  ================
+    //  Member Variables
+    //  ================
+
+    const std::string path;
+
+    const size_t batch_bytes;
+
+    const size_t max_in_flight;
+
+    int fd;
+
+    /**
+      @brief  Guards everything below, except durable
+      */
+    mutable std::mutex lock;
+
+    /**
+      @brief  Sequence number of the next entry
+      */
+    uint64_t next_seq;
+
+    /**
+      @brief  File offset of the next batch
+      */
+    uint64_t file_end;
+
+    /**
+      @brief  Entries not yet handed to the backend
+      */
+    std::string batch;
+
+    uint64_t batch_last_seq;
+
+    /**
+      @brief  Batches handed to the backend, oldest first
+      */
+    std::deque<batch_t> in_flight;
+
+    /**
+      @brief  First write or sync error, 0 if none
+      */
+    int error;
+
+    bool stopping;
+
+    std::atomic<uint64_t> durable;
+
+    std::condition_variable durable_cv;
+
+    /**
+      @brief  Signals the writer thread of the thread backend
+      */
+    std::condition_variable pending_cv;
+
+    /**
+      @brief  Writer thread, or completion thread for io_uring
+      */
+    std::thread writer;
+
+#if XU_JOURNAL_HAS_IO_URING
+    int ring_fd = -1;
+
+    uint64_t next_batch_id = 0;
+
+    void* sq_map = nullptr;
+
+    void* cq_map = nullptr;
+
+    size_t sq_map_size = 0;
+
+    size_t cq_map_size = 0;
+
+    io_uring_sqe* sqes = nullptr;
+
+    size_t sqes_size = 0;
+
+    unsigned* sq_tail = nullptr;
+
+    unsigned sq_mask = 0;
+
+    unsigned* sq_array = nullptr;
+
+    unsigned* cq_head = nullptr;
+
+    unsigned* cq_tail = nullptr;
+
+    unsigned cq_mask = 0;
+
+    io_uring_cqe* cqes = nullptr;
+#endif
+  };
+}
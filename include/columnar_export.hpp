@@ -0,0 +1,1160 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "polykey_codec.hpp"
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Columnar file layout for exporting polykey_map contents
+            Modelled on the Arrow columnar format: rows are written in
+            batches, and each batch holds one set of buffers per column, so
+            that a column can be read without touching the others. All
+            integers are little endian, and every buffer starts on an 8-byte
+            boundary (padding is zeroed):
+
+              magic             char[8]
+              version           uint32_t
+              n_columns         uint32_t
+              columns           per column: uint8_t type, char[3] padding,
+                                uint32_t name size, name bytes
+              batches           uint64_t n_rows, then per column:
+                                  validity  1 bit per row, least significant
+                                            bit first, set if the row has a
+                                            value
+                                  values    boolean: 1 bit per row
+                                            utf8: int32_t offsets[n_rows + 1]
+                                            followed by a data buffer
+                                            others: fixed width values
+              footer            uint64_t batch_offsets[n_batches],
+                                uint64_t n_batches, uint64_t n_rows,
+                                magic char[8]
+
+            Null entries have zeroed values (and empty strings).
+    */
+  namespace columnar_format
+  {
+    static const char magic[8] = {'P', 'K', 'M', 'C', 'O', 'L', 'S', '\0'};
+
+    static const uint32_t version = 1;
+
+    /**
+      @brief  Default number of rows per batch
+      */
+    static const size_t default_batch_rows = 65536;
+  }
+
+  /**
+    @brief  Type of the values of a column
+    */
+  enum class column_type : uint8_t
+  {
+    boolean = 1,
+    int8,
+    int16,
+    int32,
+    int64,
+    uint8,
+    uint16,
+    uint32,
+    uint64,
+    float32,
+    float64,
+    utf8
+  };
+
+  /**
+    @brief  Column type of a C++ type
+            Defined for arithmetic types and `std::string`.
+    */
+  template <typename T, typename = void>
+  struct column_traits
+  {
+    static_assert(std::is_arithmetic<T>::value, "xu::column_traits : columns hold arithmetic types or std::string");
+  };
+
+  template <typename T>
+  struct column_traits<T, typename std::enable_if<std::is_integral<T>::value and !std::is_same<T, bool>::value>::type>
+  {
+    static constexpr column_type type = std::is_signed<T>::value
+      ? (sizeof(T) == 1 ? column_type::int8 : sizeof(T) == 2 ? column_type::int16 : sizeof(T) == 4 ? column_type::int32 : column_type::int64)
+      : (sizeof(T) == 1 ? column_type::uint8 : sizeof(T) == 2 ? column_type::uint16 : sizeof(T) == 4 ? column_type::uint32 : column_type::uint64);
+  };
+
+  template <typename T>
+  struct column_traits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+  {
+    static_assert(sizeof(T) == 4 or sizeof(T) == 8, "xu::column_traits : only 32 and 64-bit floating point columns are supported");
+
+    static constexpr column_type type = sizeof(T) == 4 ? column_type::float32 : column_type::float64;
+  };
+
+  template <>
+  struct column_traits<bool>
+  {
+    static constexpr column_type type = column_type::boolean;
+  };
+
+  template <>
+  struct column_traits<std::string>
+  {
+    static constexpr column_type type = column_type::utf8;
+  };
+
+  //  ===============
+  //  Column builders
+  //  ===============
+
+  /**
+    @brief  Buffers of one column of the batch being built
+    @tparam T
+            Type of the column's values
+    */
+  template <typename T, typename = void>
+  class column_builder
+  {
+  public:
+    /**
+      @brief  Throw if value cannot be appended, without changing the column
+      */
+    void check(const T&) const
+    {}
+
+    void append(const T& value)
+    {
+      _set_valid(true);
+      values.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void append_null()
+    {
+      _set_valid(false);
+      values.append(sizeof(T), '\0');
+    }
+
+    void clear()
+    {
+      n_rows = 0;
+      validity.clear();
+      values.clear();
+    }
+
+    /**
+      @brief  Call f(data, size) with each buffer of the column
+      */
+    template <typename F>
+    void for_each_buffer(F&& f) const
+    {
+      f(validity.data(), validity.size());
+      f(values.data(), values.size());
+    }
+
+  protected:
+    void _set_valid(bool valid)
+    {
+      if (n_rows % 8 == 0)
+      {
+        validity.push_back('\0');
+      }
+
+      if (valid)
+      {
+        validity.back() = char(uint8_t(validity.back()) | uint8_t(1u << (n_rows % 8)));
+      }
+
+      n_rows++;
+    }
+
+  protected:
+    size_t n_rows = 0;
+
+    std::string validity;
+
+    std::string values;
+  };
+
+  template <>
+  class column_builder<bool> : public column_builder<uint8_t>
+  {
+  public:
+    void append(bool value)
+    {
+      if (n_rows % 8 == 0)
+      {
+        values.push_back('\0');
+      }
+
+      if (value)
+      {
+        values.back() = char(uint8_t(values.back()) | uint8_t(1u << (n_rows % 8)));
+      }
+
+      _set_valid(true);
+    }
+
+    void append_null()
+    {
+      if (n_rows % 8 == 0)
+      {
+        values.push_back('\0');
+      }
+
+      _set_valid(false);
+    }
+  };
+
+  template <>
+  class column_builder<std::string> : public column_builder<uint8_t>
+  {
+  public:
+    void check(const std::string& value) const
+    {
+      if (data.size() + value.size() > size_t(std::numeric_limits<int32_t>::max()))
+      {
+        throw std::length_error("column_builder::append() : more than 2 GiB of strings in a batch");
+      }
+    }
+
+    void append(const std::string& value)
+    {
+      check(value);
+
+      _begin_row();
+      data.append(value);
+      _set_valid(true);
+      _end_row();
+    }
+
+    void append_null()
+    {
+      _begin_row();
+      _set_valid(false);
+      _end_row();
+    }
+
+    void clear()
+    {
+      column_builder<uint8_t>::clear();
+      data.clear();
+    }
+
+    template <typename F>
+    void for_each_buffer(F&& f) const
+    {
+      f(validity.data(), validity.size());
+
+      /* an empty column still has its leading zero offset */
+      if (values.empty())
+      {
+        int32_t zero = 0;
+        f(reinterpret_cast<const char*>(&zero), sizeof(zero));
+      }
+      else
+      {
+        f(values.data(), values.size());
+      }
+
+      f(data.data(), data.size());
+    }
+
+  protected:
+    void _begin_row()
+    {
+      if (values.empty())
+      {
+        int32_t zero = 0;
+        values.append(reinterpret_cast<const char*>(&zero), sizeof(zero));
+      }
+    }
+
+    void _end_row()
+    {
+      int32_t end = int32_t(data.size());
+      values.append(reinterpret_cast<const char*>(&end), sizeof(end));
+    }
+
+  protected:
+    std::string data;
+  };
+
+  //  ======
+  //  Writer
+  //  ======
+
+  /**
+    @brief  Name and type of a column
+    */
+  struct column_spec_t
+  {
+    std::string name;
+
+    column_type type;
+  };
+
+  /**
+    @brief  Writes a columnar file batch by batch
+            The file is written under a temporary name and renamed into place
+            by `finish()`, so readers never see a partial file.
+    */
+  class columnar_writer
+  {
+  public:
+    /**
+      @brief  Start writing a columnar file
+      @throw  std::system_error
+              If the temporary file cannot be created
+      */
+    columnar_writer(const std::string& path_, const std::vector<column_spec_t>& columns)
+      : path(path_),
+        tmp_path(path_ + ".tmp"),
+        file(std::fopen(tmp_path.c_str(), "wb")),
+        pos(0),
+        n_rows(0),
+        finished(false)
+    {
+      if (file == nullptr)
+      {
+        throw std::system_error(errno, std::generic_category(), "columnar_writer() : cannot create " + tmp_path);
+      }
+
+      uint32_t version = columnar_format::version;
+      uint32_t n_columns = uint32_t(columns.size());
+
+      _write(columnar_format::magic, sizeof(columnar_format::magic));
+      _write(reinterpret_cast<const char*>(&version), sizeof(version));
+      _write(reinterpret_cast<const char*>(&n_columns), sizeof(n_columns));
+
+      for (const column_spec_t& column : columns)
+      {
+        char type[4] = {char(column.type), 0, 0, 0};
+        uint32_t name_size = uint32_t(column.name.size());
+
+        _write(type, sizeof(type));
+        _write(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
+        _write(column.name.data(), column.name.size());
+      }
+
+      _align();
+    }
+
+    /**
+      @brief  Discard an unfinished file
+      */
+    ~columnar_writer()
+    {
+      if (!finished)
+      {
+        std::fclose(file);
+        std::remove(tmp_path.c_str());
+      }
+    }
+
+    columnar_writer(const columnar_writer& other) = delete;
+
+    columnar_writer& operator=(const columnar_writer& other) = delete;
+
+    /**
+      @brief  Start a batch of n rows
+              Must be followed by the buffers of every column, in order.
+      */
+    void begin_batch(uint64_t batch_rows)
+    {
+      batch_offsets.push_back(pos);
+      n_rows += batch_rows;
+
+      _write(reinterpret_cast<const char*>(&batch_rows), sizeof(batch_rows));
+    }
+
+    /**
+      @brief  Write one buffer of the current batch
+      */
+    void write_buffer(const char* data, size_t size)
+    {
+      _write(data, size);
+      _align();
+    }
+
+    /**
+      @brief  Write the footer and move the file into place
+      @throw  std::system_error
+              If writing, syncing or renaming fails
+      */
+    void finish()
+    {
+      uint64_t n_batches = batch_offsets.size();
+
+      _write(reinterpret_cast<const char*>(batch_offsets.data()), batch_offsets.size() * sizeof(uint64_t));
+      _write(reinterpret_cast<const char*>(&n_batches), sizeof(n_batches));
+      _write(reinterpret_cast<const char*>(&n_rows), sizeof(n_rows));
+      _write(columnar_format::magic, sizeof(columnar_format::magic));
+
+      if (std::fflush(file) != 0 or ::fsync(::fileno(file)) != 0)
+      {
+        throw std::system_error(errno, std::generic_category(), "columnar_writer::finish() : sync failed");
+      }
+
+      std::fclose(file);
+      finished = true;
+
+      if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+      {
+        throw std::system_error(errno, std::generic_category(), "columnar_writer::finish() : cannot rename to " + path);
+      }
+    }
+
+  protected:
+    void _align()
+    {
+      static const char zeros[8] = {};
+
+      if (pos % 8 != 0)
+      {
+        _write(zeros, 8 - pos % 8);
+      }
+    }
+
+    void _write(const char* data, size_t size)
+    {
+      if (size != 0 and std::fwrite(data, 1, size, file) != size)
+      {
+        throw std::system_error(errno, std::generic_category(), "columnar_writer : write failed");
+      }
+
+      pos += size;
+    }
+
+  protected:
+    const std::string path;
+
+    const std::string tmp_path;
+
+    std::FILE* file;
+
+    uint64_t pos;
+
+    uint64_t n_rows;
+
+    bool finished;
+
+    std::vector<uint64_t> batch_offsets;
+  };
+
+  //  ========
+  //  Exporter
+  //  ========
+
+  /**
+    @brief  A named column computed from each row's value
+            Created with `value_projection()`.
+    */
+  template <typename F>
+  struct value_projection_t
+  {
+    std::string name;
+
+    F f;
+  };
+
+  /**
+    @brief  Make a value column for `export_columnar()`
+    @param  name
+            Column name
+    @param  f
+            Projection called with each value. Returns an arithmetic type or
+            `std::string`, or a `std::optional` of one for nullable columns.
+    */
+  template <typename F>
+  value_projection_t<F> value_projection(const std::string& name, F f)
+  {
+    return value_projection_t<F>{name, std::move(f)};
+  }
+
+  /**
+    @brief  Streams the rows of a polykey_map into a columnar file
+            Writes one column per path (null where the row has no key on the
+            path), then one column per value projection. Rows are buffered
+            and written one batch at a time, so memory use is bounded by the
+            batch size rather than the size of the map.
+    @tparam Map_T
+            polykey_map type
+    @tparam F_Ts
+            Value projection types
+    */
+  template <typename Map_T, typename ...F_Ts>
+  class columnar_exporter;
+
+  template <typename Value_T, typename ...Path_Ts, typename ...F_Ts>
+  class columnar_exporter<polykey_map<Value_T, Path_Ts...>, F_Ts...>
+  {
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+    template <typename T>
+    struct nullable
+    {
+      using type = T;
+
+      static bool has_value(const T&)
+      {
+        return true;
+      }
+
+      static const T& get(const T& value)
+      {
+        return value;
+      }
+    };
+
+    template <typename T>
+    struct nullable<std::optional<T>>
+    {
+      using type = T;
+
+      static bool has_value(const std::optional<T>& value)
+      {
+        return value.has_value();
+      }
+
+      static const T& get(const std::optional<T>& value)
+      {
+        return *value;
+      }
+    };
+
+    template <typename F>
+    using projection_result_t = typename std::decay<decltype(std::declval<const F&>()(std::declval<const Value_T&>()))>::type;
+
+    template <typename F>
+    using projection_column_t = typename nullable<projection_result_t<F>>::type;
+
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    /**
+      @param  path
+              Target file path
+      @param  key_names
+              Column name of each path
+      @param  projections_
+              Value columns, see `value_projection()`
+      @param  batch_rows_
+              Number of rows per batch
+      @throw  std::system_error
+              If the file cannot be created
+      */
+    columnar_exporter(const std::string& path, const std::array<std::string, N_Paths>& key_names, const std::tuple<value_projection_t<F_Ts>...>& projections_, size_t batch_rows_ = columnar_format::default_batch_rows)
+      : projections(projections_),
+        batch_rows(batch_rows_ == 0 ? 1 : batch_rows_),
+        n_pending(0),
+        writer(path, _schema(key_names, projections_, std::index_sequence_for<F_Ts...>()))
+    {}
+
+    /**
+      @brief  Add the rows of a map
+      */
+    void add(const map_t& map)
+    {
+      map.for_each_row([this](const typename map_t::keyset_type& keys, const Value_T& value)
+      {
+        add_row(keys, value);
+      });
+    }
+
+    /**
+      @brief  Add a row
+              The projections are evaluated and every column is checked
+              before any is appended to, so that a throwing projection or an
+              oversized key leaves the batch unchanged.
+      @param  keys
+              Keyset providing `has_value<P>()` and `get<P>()`
+      @throw  std::length_error
+              If a string column would exceed 2 GiB in the batch
+      */
+    template <typename Keyset_T>
+    void add_row(const Keyset_T& keys, const Value_T& value)
+    {
+      std::tuple<projection_result_t<F_Ts>...> projected = _project(value, std::index_sequence_for<F_Ts...>());
+
+      _check_keys(keys);
+      _check_values(projected, std::index_sequence_for<F_Ts...>());
+
+      _append_keys(keys);
+      _append_values(projected, std::index_sequence_for<F_Ts...>());
+
+      if (++n_pending == batch_rows)
+      {
+        _flush();
+      }
+    }
+
+    /**
+      @brief  Write the last batch and the footer, and move the file into
+              place
+      */
+    void finish()
+    {
+      _flush();
+      writer.finish();
+    }
+
+  protected:
+    template <size_t ...Is>
+    static std::vector<column_spec_t> _schema(const std::array<std::string, N_Paths>& key_names, const std::tuple<value_projection_t<F_Ts>...>& projections, std::index_sequence<Is...>)
+    {
+      std::vector<column_spec_t> columns;
+      _key_schema(key_names, columns);
+      (columns.push_back(column_spec_t{std::get<Is>(projections).name, column_traits<projection_column_t<F_Ts>>::type}), ...);
+
+      return columns;
+    }
+
+    template <path_index_t P = 0>
+    static typename std::enable_if<P != N_Paths, void>::type _key_schema(const std::array<std::string, N_Paths>& key_names, std::vector<column_spec_t>& columns)
+    {
+      columns.push_back(column_spec_t{key_names[P], column_traits<Path_T<P>>::type});
+      _key_schema<P + 1>(key_names, columns);
+    }
+
+    template <path_index_t P = 0>
+    static typename std::enable_if<P == N_Paths, void>::type _key_schema(const std::array<std::string, N_Paths>&, std::vector<column_spec_t>&)
+    {}
+
+    template <path_index_t P = 0, typename Keyset_T>
+    typename std::enable_if<P != N_Paths, void>::type _check_keys(const Keyset_T& keys) const
+    {
+      if (keys.template has_value<P>())
+      {
+        std::get<P>(key_columns).check(keys.template get<P>());
+      }
+
+      _check_keys<P + 1>(keys);
+    }
+
+    template <path_index_t P = 0, typename Keyset_T>
+    typename std::enable_if<P == N_Paths, void>::type _check_keys(const Keyset_T&) const
+    {}
+
+    template <path_index_t P = 0, typename Keyset_T>
+    typename std::enable_if<P != N_Paths, void>::type _append_keys(const Keyset_T& keys)
+    {
+      if (keys.template has_value<P>())
+      {
+        std::get<P>(key_columns).append(keys.template get<P>());
+      }
+      else
+      {
+        std::get<P>(key_columns).append_null();
+      }
+
+      _append_keys<P + 1>(keys);
+    }
+
+    template <path_index_t P = 0, typename Keyset_T>
+    typename std::enable_if<P == N_Paths, void>::type _append_keys(const Keyset_T&)
+    {}
+
+    template <size_t ...Is>
+    std::tuple<projection_result_t<F_Ts>...> _project(const Value_T& value, std::index_sequence<Is...>) const
+    {
+      return std::tuple<projection_result_t<F_Ts>...>{std::get<Is>(projections).f(value)...};
+    }
+
+    template <size_t I>
+    void _check_value(const std::tuple<projection_result_t<F_Ts>...>& row) const
+    {
+      using nullable_t = nullable<projection_result_t<typename std::tuple_element<I, std::tuple<F_Ts...>>::type>>;
+
+      const auto& projected = std::get<I>(row);
+
+      if (nullable_t::has_value(projected))
+      {
+        std::get<I>(value_columns).check(nullable_t::get(projected));
+      }
+    }
+
+    template <size_t ...Is>
+    void _check_values(const std::tuple<projection_result_t<F_Ts>...>& row, std::index_sequence<Is...>) const
+    {
+      (_check_value<Is>(row), ...);
+    }
+
+    template <size_t I>
+    void _append_value(const std::tuple<projection_result_t<F_Ts>...>& row)
+    {
+      using nullable_t = nullable<projection_result_t<typename std::tuple_element<I, std::tuple<F_Ts...>>::type>>;
+
+      const auto& projected = std::get<I>(row);
+
+      if (nullable_t::has_value(projected))
+      {
+        std::get<I>(value_columns).append(nullable_t::get(projected));
+      }
+      else
+      {
+        std::get<I>(value_columns).append_null();
+      }
+    }
+
+    template <size_t ...Is>
+    void _append_values(const std::tuple<projection_result_t<F_Ts>...>& row, std::index_sequence<Is...>)
+    {
+      (_append_value<Is>(row), ...);
+    }
+
+    template <typename Builder_T>
+    void _write_column(Builder_T& column)
+    {
+      column.for_each_buffer([this](const char* data, size_t size)
+      {
+        writer.write_buffer(data, size);
+      });
+
+      column.clear();
+    }
+
+    void _flush()
+    {
+      if (n_pending == 0)
+      {
+        return;
+      }
+
+      writer.begin_batch(n_pending);
+
+      std::apply([this](auto& ...columns)
+      {
+        (_write_column(columns), ...);
+      }, key_columns);
+
+      std::apply([this](auto& ...columns)
+      {
+        (_write_column(columns), ...);
+      }, value_columns);
+
+      n_pending = 0;
+    }
+
+  protected:
+    std::tuple<value_projection_t<F_Ts>...> projections;
+
+    const size_t batch_rows;
+
+    size_t n_pending;
+
+    std::tuple<column_builder<path_key_t<Path_Ts>>...> key_columns;
+
+    std::tuple<column_builder<projection_column_t<F_Ts>>...> value_columns;
+
+    columnar_writer writer;
+  };
+
+  /**
+    @brief  Export the rows of a polykey_map to a columnar file, with a given
+            number of rows per batch
+    */
+  template <typename Value_T, typename ...Path_Ts, typename ...F_Ts>
+  void export_columnar(const polykey_map<Value_T, Path_Ts...>& map, const std::string& path, size_t batch_rows, const std::array<std::string, sizeof...(Path_Ts)>& key_names, const value_projection_t<F_Ts>&... projections)
+  {
+    columnar_exporter<polykey_map<Value_T, Path_Ts...>, F_Ts...> exporter(path, key_names, std::make_tuple(projections...), batch_rows);
+    exporter.add(map);
+    exporter.finish();
+  }
+
+  /**
+    @brief  Export the rows of a polykey_map to a columnar file
+            See `columnar_exporter`, e.g.:
+
+              xu::export_columnar(otk, "orders.col", {"internal_id", "external_id"},
+                xu::value_projection("ticker", [](const Order& o) { return o.ticker; }),
+                xu::value_projection("svol", [](const Order& o) { return o.svol; }));
+
+    @param  map
+            Map to export
+    @param  path
+            Target file path
+    @param  key_names
+            Column name of each path
+    @param  projections
+            Value columns
+    */
+  template <typename Value_T, typename ...Path_Ts, typename ...F_Ts>
+  void export_columnar(const polykey_map<Value_T, Path_Ts...>& map, const std::string& path, const std::array<std::string, sizeof...(Path_Ts)>& key_names, const value_projection_t<F_Ts>&... projections)
+  {
+    export_columnar(map, path, columnar_format::default_batch_rows, key_names, projections...);
+  }
+
+  //  ======
+  //  Reader
+  //  ======
+
+  /**
+    @brief  Reads a columnar file back, e.g. to check an export
+            The whole file is loaded and its layout validated on opening.
+    */
+  class columnar_file
+  {
+  protected:
+    struct column_buffers_t
+    {
+      const char* validity;
+
+      const char* values;
+
+      /**
+        @brief  String bytes of utf8 columns
+        */
+      const char* data;
+    };
+
+    struct batch_t
+    {
+      uint64_t n_rows;
+
+      std::vector<column_buffers_t> columns;
+    };
+
+  public:
+    /**
+      @throw  std::system_error
+              If the file cannot be read
+      @throw  xu::format_error
+              If the file is not a valid columnar file
+      */
+    explicit columnar_file(const std::string& path)
+    {
+      std::ifstream in(path, std::ios::binary);
+
+      if (!in)
+      {
+        throw std::system_error(errno, std::generic_category(), "columnar_file() : cannot open " + path);
+      }
+
+      bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+      _parse();
+    }
+
+    columnar_file(const columnar_file& other) = delete;
+
+    columnar_file& operator=(const columnar_file& other) = delete;
+
+    size_t n_columns() const
+    {
+      return columns.size();
+    }
+
+    const std::string& column_name(size_t column) const
+    {
+      return columns.at(column).name;
+    }
+
+    column_type type(size_t column) const
+    {
+      return columns.at(column).type;
+    }
+
+    /**
+      @brief  Returns the index of a column
+      @throw  std::out_of_range
+              If there is no such column
+      */
+    size_t column_index(const std::string& name) const
+    {
+      for (size_t i = 0; i < columns.size(); i++)
+      {
+        if (columns[i].name == name)
+        {
+          return i;
+        }
+      }
+
+      throw std::out_of_range("columnar_file::column_index() : no column " + name);
+    }
+
+    /**
+      @brief  Returns total number of rows
+      */
+    uint64_t n_rows() const
+    {
+      return total_rows;
+    }
+
+    size_t n_batches() const
+    {
+      return batches.size();
+    }
+
+    uint64_t batch_rows(size_t batch) const
+    {
+      return batches.at(batch).n_rows;
+    }
+
+    /**
+      @brief  Checks if a row has a value in a column
+      */
+    bool is_valid(size_t batch, size_t column, uint64_t row) const
+    {
+      const column_buffers_t& buffers = _buffers(batch, column, row);
+      return (uint8_t(buffers.validity[row / 8]) >> (row % 8)) & 1;
+    }
+
+    /**
+      @brief  Returns the value of a row in a column
+              Null entries read as zero or an empty string.
+      @tparam T
+              Type of the column's values, see `column_traits`
+      @throw  std::invalid_argument
+              If T does not match the column type
+      */
+    template <typename T>
+    T get(size_t batch, size_t column, uint64_t row) const
+    {
+      if (type(column) != column_traits<T>::type)
+      {
+        throw std::invalid_argument("columnar_file::get() : wrong type for column " + column_name(column));
+      }
+
+      const column_buffers_t& buffers = _buffers(batch, column, row);
+
+      if constexpr (std::is_same<T, bool>::value)
+      {
+        return (uint8_t(buffers.values[row / 8]) >> (row % 8)) & 1;
+      }
+      else if constexpr (std::is_same<T, std::string>::value)
+      {
+        int32_t offsets[2];
+        std::memcpy(offsets, buffers.values + row * sizeof(int32_t), sizeof(offsets));
+
+        return std::string(buffers.data + offsets[0], size_t(offsets[1] - offsets[0]));
+      }
+      else
+      {
+        T value;
+        std::memcpy(&value, buffers.values + row * sizeof(T), sizeof(T));
+
+        return value;
+      }
+    }
+
+  protected:
+    const column_buffers_t& _buffers(size_t batch, size_t column, uint64_t row) const
+    {
+      if (batch >= batches.size() or column >= columns.size() or row >= batches[batch].n_rows)
+      {
+        throw std::out_of_range("columnar_file : no such batch, column or row");
+      }
+
+      return batches[batch].columns[column];
+    }
+
+    static size_t _value_bytes(column_type type, uint64_t n_rows)
+    {
+      switch (type)
+      {
+        case column_type::boolean:
+          return size_t((n_rows + 7) / 8);
+        case column_type::int8:
+        case column_type::uint8:
+          return size_t(n_rows);
+        case column_type::int16:
+        case column_type::uint16:
+          return size_t(n_rows * 2);
+        case column_type::int32:
+        case column_type::uint32:
+        case column_type::float32:
+          return size_t(n_rows * 4);
+        case column_type::int64:
+        case column_type::uint64:
+        case column_type::float64:
+          return size_t(n_rows * 8);
+        case column_type::utf8:
+          return size_t((n_rows + 1) * 4);
+      }
+
+      throw format_error("columnar_file() : unknown column type");
+    }
+
+    /**
+      @brief  Reads bytes at pos, checking they are within the file
+      */
+    const char* _take(uint64_t& pos, uint64_t size, uint64_t end) const
+    {
+      if (pos > end or end - pos < size)
+      {
+        throw format_error("columnar_file() : truncated file");
+      }
+
+      const char* p = bytes.data() + pos;
+      pos += size;
+
+      return p;
+    }
+
+    template <typename T>
+    T _read(uint64_t& pos, uint64_t end) const
+    {
+      T value;
+      std::memcpy(&value, _take(pos, sizeof(T), end), sizeof(T));
+
+      return value;
+    }
+
+    static void _align(uint64_t& pos)
+    {
+      pos = (pos + 7) / 8 * 8;
+    }
+
+    void _parse()
+    {
+      const uint64_t footer_size = 3 * sizeof(uint64_t);
+
+      if (bytes.size() < 16 + footer_size
+          or std::memcmp(bytes.data(), columnar_format::magic, sizeof(columnar_format::magic)) != 0
+          or std::memcmp(bytes.data() + bytes.size() - 8, columnar_format::magic, sizeof(columnar_format::magic)) != 0)
+      {
+        throw format_error("columnar_file() : not a columnar file");
+      }
+
+      uint64_t pos = 8;
+      uint64_t end = bytes.size() - footer_size;
+
+      if (_read<uint32_t>(pos, end) != columnar_format::version)
+      {
+        throw format_error("columnar_file() : unsupported version");
+      }
+
+      uint32_t n_columns = _read<uint32_t>(pos, end);
+
+      for (uint32_t i = 0; i < n_columns; i++)
+      {
+        column_type type = column_type(uint8_t(*_take(pos, 4, end)));
+        uint32_t name_size = _read<uint32_t>(pos, end);
+        const char* name = _take(pos, name_size, end);
+
+        _value_bytes(type, 0);
+        columns.push_back(column_spec_t{std::string(name, name_size), type});
+      }
+
+      uint64_t footer = end;
+      uint64_t n_batches = _read<uint64_t>(footer, bytes.size());
+      total_rows = _read<uint64_t>(footer, bytes.size());
+
+      if (n_batches > end / sizeof(uint64_t))
+      {
+        throw format_error("columnar_file() : corrupt footer");
+      }
+
+      uint64_t table = end - n_batches * sizeof(uint64_t);
+      uint64_t rows = 0;
+
+      for (uint64_t b = 0; b < n_batches; b++)
+      {
+        uint64_t batch_pos = _read<uint64_t>(table, end);
+
+        batch_t batch;
+        batch.n_rows = _read<uint64_t>(batch_pos, end);
+
+        if (batch.n_rows > end)
+        {
+          throw format_error("columnar_file() : corrupt batch");
+        }
+
+        for (const column_spec_t& column : columns)
+        {
+          column_buffers_t buffers{nullptr, nullptr, nullptr};
+
+          buffers.validity = _take(batch_pos, (batch.n_rows + 7) / 8, end);
+          _align(batch_pos);
+          buffers.values = _take(batch_pos, _value_bytes(column.type, batch.n_rows), end);
+          _align(batch_pos);
+
+          if (column.type == column_type::utf8)
+          {
+            std::vector<int32_t> offsets(size_t(batch.n_rows + 1));
+            std::memcpy(offsets.data(), buffers.values, offsets.size() * sizeof(int32_t));
+
+            for (size_t i = 0; i < batch.n_rows; i++)
+            {
+              if (offsets[i] < 0 or offsets[i] > offsets[i + 1])
+              {
+                throw format_error("columnar_file() : corrupt string offsets");
+              }
+            }
+
+            buffers.data = _take(batch_pos, uint64_t(offsets.back()), end);
+            _align(batch_pos);
+          }
+
+          batch.columns.push_back(buffers);
+        }
+
+        rows += batch.n_rows;
+        batches.push_back(std::move(batch));
+      }
+
+      if (rows != total_rows)
+      {
+        throw format_error("columnar_file() : row count mismatch");
+      }
+    }
+
+  protected:
+    std::string bytes;
+
+    std::vector<column_spec_t> columns;
+
+    std::vector<batch_t> batches;
+
+    uint64_t total_rows = 0;
+  };
+}
@@ -0,0 +1,816 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace xu
+{
+  /**
+    @brief  Hash index with lock-free lookups and serialized writers
+            Lookups never take a lock and never wait for a writer, including
+            while the table is being rehashed:
+              - Buckets are singly linked lists of immutable nodes. Writers
+                publish new nodes and unlink erased ones with atomic stores.
+              - Rehashing builds a complete new bucket array (with copies of
+                the nodes) on the side and publishes it with a single atomic
+                store. Readers still walking the old array are unaffected.
+              - Erased nodes and replaced bucket arrays are retired, not freed.
+                They are reclaimed once every reader which could still observe
+                them has left its read-side section (epoch based reclamation
+                with two reader counters per stripe).
+            Writers (insert, erase, clear) are serialized by an internal mutex,
+            so any number of threads may write concurrently. Writers may block
+            each other, and a writer which reclaims memory waits for readers
+            already inside a read-side section to leave it, but readers are
+            never blocked.
+    @note   Copy and move construction/assignment are not safe against
+            concurrent access to the moved-from or assigned-to index.
+    @note   A thread must not write to the index while it holds a read_guard
+            (e.g. from within `visit()`), since reclamation would wait for
+            that thread's own read-side section.
+    @note   Iterators returned by `find()` may only be dereferenced while
+            the entry cannot be erased, i.e. by the writing thread or while
+            writers are excluded externally. Threads racing with writers
+            should use `contains()`, `get()` or `visit()`.
+    @tparam Key_T
+            Key type. Should be copy constructible.
+    @tparam Mapped_T
+            Mapped type. Should be copy constructible.
+    */
+  template <typename Key_T, typename Mapped_T, typename Hash = std::hash<Key_T>, typename Key_Equal = std::equal_to<Key_T>>
+  class concurrent_index
+  {
+  public:
+    //  ========
+    //  Typedefs
+    //  ========
+
+    using key_type = Key_T;
+    using mapped_type = Mapped_T;
+    using value_type = std::pair<const Key_T, Mapped_T>;
+    using size_type = size_t;
+
+    /**
+      @brief  Number of reader counter stripes
+              Readers on different stripes never write to the same cache line
+      */
+    static const size_type n_reader_stripes = 32;
+
+    /**
+      @brief  Number of retired nodes which triggers reclamation
+      */
+    static const size_type reclaim_threshold = 128;
+
+  protected:
+    /**
+      @brief  Bucket chain node
+              Only `next` changes after the node is published
+      */
+    struct node_t
+    {
+      value_type item;
+
+      std::atomic<node_t*> next;
+
+      node_t(const Key_T& key, const Mapped_T& mapped, node_t* next_)
+        : item(key, mapped),
+          next(next_)
+      {}
+    };
+
+    /**
+      @brief  Bucket array
+      */
+    struct table_t
+    {
+      const size_type n_buckets;
+
+      const uint32_t shift;
+
+      std::unique_ptr<std::atomic<node_t*>[]> buckets;
+
+      table_t(size_type n_buckets_, uint32_t shift_)
+        : n_buckets(n_buckets_),
+          shift(shift_),
+          buckets(new std::atomic<node_t*>[n_buckets_])
+      {
+        for (size_type i = 0; i < n_buckets; i++)
+        {
+          buckets[i].store(nullptr, std::memory_order_relaxed);
+        }
+      }
+
+      std::atomic<node_t*>& bucket(uint64_t h) const
+      {
+        return buckets[size_type(h >> shift)];
+      }
+    };
+
+    /**
+      @brief  Reader counters of one stripe, one per epoch parity
+      */
+    struct alignas(64) reader_stripe_t
+    {
+      std::atomic<size_type> active[2];
+
+      reader_stripe_t()
+      {
+        active[0].store(0, std::memory_order_relaxed);
+        active[1].store(0, std::memory_order_relaxed);
+      }
+    };
+
+    /**
+      @brief  Initial number of buckets
+      */
+    static const size_type min_buckets = 16;
+
+  public:
+    //  ====================
+    //  Read-side protection
+    //  ====================
+
+    /**
+      @brief  RAII read-side section
+              Memory reachable from the index while a guard is alive is not
+              reclaimed until the guard is destroyed. Entering and leaving
+              never blocks.
+      */
+    class read_guard
+    {
+    protected:
+      const concurrent_index* ci;
+
+      std::atomic<size_type>* counter;
+
+    public:
+      explicit read_guard(const concurrent_index& ci_)
+        : ci(&ci_)
+      {
+        reader_stripe_t& stripe = ci->stripes[_stripe_index()];
+
+        while (true)
+        {
+          uint64_t epoch = ci->epoch.load(std::memory_order_seq_cst);
+
+          counter = &stripe.active[epoch & 1];
+          counter->fetch_add(1, std::memory_order_seq_cst);
+
+          /* a writer may have flipped the epoch before seeing our increment */
+          if (ci->epoch.load(std::memory_order_seq_cst) == epoch)
+          {
+            break;
+          }
+
+          counter->fetch_sub(1, std::memory_order_seq_cst);
+        }
+      }
+
+      ~read_guard()
+      {
+        counter->fetch_sub(1, std::memory_order_release);
+      }
+
+      read_guard(const read_guard& other) = delete;
+
+      read_guard& operator=(const read_guard& other) = delete;
+    };
+
+    //  =========
+    //  Iterators
+    //  =========
+
+    /**
+      @brief  Iterator returned by `find()`
+              Points to a single entry, or is equal to `end()`
+      @tparam Deref_T
+              `value_type` or `const value_type`
+      */
+    template <typename Deref_T>
+    class iterator_base
+    {
+    protected:
+      node_t* node;
+
+    public:
+      explicit iterator_base(node_t* node_)
+        : node(node_)
+      {}
+
+      bool operator==(const iterator_base& other) const
+      {
+        return node == other.node;
+      }
+
+      bool operator!=(const iterator_base& other) const
+      {
+        return node != other.node;
+      }
+
+      Deref_T& operator*() const
+      {
+        return node->item;
+      }
+
+      Deref_T* operator->() const
+      {
+        return &node->item;
+      }
+    };
+
+    using iterator = iterator_base<value_type>;
+    using const_iterator = iterator_base<const value_type>;
+
+    iterator end()
+    {
+      return iterator(nullptr);
+    }
+
+    const_iterator end() const
+    {
+      return const_iterator(nullptr);
+    }
+
+  public:
+    //  ======================
+    //  Constructor/Destructor
+    //  ======================
+
+    concurrent_index()
+      : table(new table_t(min_buckets, 64 - _log2(min_buckets))),
+        n_entries(0),
+        epoch(0)
+    {}
+
+    /**
+      @brief  Free all memory
+      @note   No other thread may access the index during destruction
+      */
+    ~concurrent_index()
+    {
+      _free_table(table.load(std::memory_order_relaxed), true);
+      _free_retired(retired_nodes.size());
+    }
+
+    //  ===========
+    //  Copy & Move
+    //  ===========
+
+    concurrent_index(const concurrent_index& other)
+      : concurrent_index()
+    {
+      _copy(other);
+    }
+
+    concurrent_index& operator=(const concurrent_index& other)
+    {
+      if (this != &other)
+      {
+        clear();
+        _copy(other);
+      }
+
+      return *this;
+    }
+
+    concurrent_index(concurrent_index&& other)
+      : concurrent_index()
+    {
+      _swap(other);
+    }
+
+    concurrent_index& operator=(concurrent_index&& other)
+    {
+      if (this != &other)
+      {
+        _swap(other);
+      }
+
+      return *this;
+    }
+
+    //  ===========
+    //  Read Access
+    //  ===========
+
+    /**
+      @brief  Returns number of entries
+      */
+    size_type size() const
+    {
+      return n_entries.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const
+    {
+      return size() == 0;
+    }
+
+    /**
+      @brief  Check whether a key exists
+              Lock-free, safe against concurrent writers
+      */
+    bool contains(const Key_T& key) const
+    {
+      read_guard guard(*this);
+
+      return _find(key) != nullptr;
+    }
+
+    /**
+      @brief  Returns 1 if the key exists, otherwise 0
+      */
+    size_type count(const Key_T& key) const
+    {
+      return contains(key) ? 1 : 0;
+    }
+
+    /**
+      @brief  Returns a copy of the mapped value for a key
+              Lock-free, safe against concurrent writers
+      */
+    std::optional<Mapped_T> get(const Key_T& key) const
+    {
+      read_guard guard(*this);
+
+      node_t* node = _find(key);
+
+      if (node == nullptr)
+      {
+        return std::nullopt;
+      }
+
+      return node->item.second;
+    }
+
+    /**
+      @brief  Call f on the entry for a key from within a read-side section
+              Lock-free, safe against concurrent writers
+      @param  f
+              Callable taking `const value_type&`
+      @return Whether the key was found
+      */
+    template <typename F>
+    bool visit(const Key_T& key, F&& f) const
+    {
+      read_guard guard(*this);
+
+      node_t* node = _find(key);
+
+      if (node == nullptr)
+      {
+        return false;
+      }
+
+      f(const_cast<const value_type&>(node->item));
+
+      return true;
+    }
+
+    /**
+      @brief  Returns mapped value for a key
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    Mapped_T at(const Key_T& key) const
+    {
+      std::optional<Mapped_T> res = get(key);
+
+      if (!res)
+      {
+        throw std::out_of_range("concurrent_index::at() : key does not exist");
+      }
+
+      return *res;
+    }
+
+    /**
+      @brief  Find an entry (see the note on iterators above)
+      */
+    iterator find(const Key_T& key)
+    {
+      read_guard guard(*this);
+
+      return iterator(_find(key));
+    }
+
+    const_iterator find(const Key_T& key) const
+    {
+      read_guard guard(*this);
+
+      return const_iterator(_find(key));
+    }
+
+    //  ============
+    //  Write Access
+    //  ============
+
+    /**
+      @brief  Insert an entry if its key does not already exist
+      @return Iterator to the entry with the key, and whether insertion took
+              place
+      */
+    std::pair<iterator, bool> insert(const std::pair<Key_T, Mapped_T>& item)
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex);
+
+      node_t* existing = _find(item.first);
+
+      if (existing != nullptr)
+      {
+        return std::make_pair(iterator(existing), false);
+      }
+
+      table_t* cur = table.load(std::memory_order_relaxed);
+
+      if (size() + 1 > cur->n_buckets)
+      {
+        _rehash(cur->n_buckets * 2);
+        cur = table.load(std::memory_order_relaxed);
+      }
+
+      std::atomic<node_t*>& bucket = cur->bucket(_hash(item.first));
+
+      node_t* node = new node_t(item.first, item.second, bucket.load(std::memory_order_relaxed));
+
+      /* publish the fully constructed node */
+      bucket.store(node, std::memory_order_release);
+
+      n_entries.fetch_add(1, std::memory_order_relaxed);
+
+      return std::make_pair(iterator(node), true);
+    }
+
+    /**
+      @brief  Erase the entry for a key
+              The node is unlinked immediately and reclaimed later
+      @return Number of erased entries (0 or 1)
+      */
+    size_type erase(const Key_T& key)
+    {
+      return erase_if(key, [](const Mapped_T&) { return true; });
+    }
+
+    /**
+      @brief  Erase the entry for a key if pred accepts its mapped value
+              pred is called under the writers' lock, so that the check and
+              the erasure are atomic with respect to other writers.
+      @param  pred
+              Callable taking `const Mapped_T&`, returning bool
+      @return Number of erased entries (0 or 1)
+      */
+    template <typename F>
+    size_type erase_if(const Key_T& key, F&& pred)
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex);
+
+      table_t* cur = table.load(std::memory_order_relaxed);
+
+      std::atomic<node_t*>* link = &cur->bucket(_hash(key));
+      node_t* node = link->load(std::memory_order_relaxed);
+
+      while (node != nullptr and !Key_Equal()(node->item.first, key))
+      {
+        link = &node->next;
+        node = link->load(std::memory_order_relaxed);
+      }
+
+      if (node == nullptr or !pred(static_cast<const Mapped_T&>(node->item.second)))
+      {
+        return 0;
+      }
+
+      /* readers already on node may continue through node->next */
+      link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+
+      n_entries.fetch_sub(1, std::memory_order_relaxed);
+
+      retired_nodes.push_back(node);
+
+      if (retired_nodes.size() >= reclaim_threshold)
+      {
+        _reclaim();
+      }
+
+      return 1;
+    }
+
+    /**
+      @brief  Erase all entries
+      */
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex);
+
+      table_t* old_table = table.load(std::memory_order_relaxed);
+
+      table.store(new table_t(min_buckets, 64 - _log2(min_buckets)), std::memory_order_release);
+      n_entries.store(0, std::memory_order_relaxed);
+
+      _retire_table(old_table, true);
+      _reclaim();
+    }
+
+    /**
+      @brief  Grow the bucket array so that n entries fit without rehashing
+      */
+    void reserve(size_type n)
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex);
+
+      size_type n_buckets = table.load(std::memory_order_relaxed)->n_buckets;
+
+      if (n > n_buckets)
+      {
+        while (n_buckets < n)
+        {
+          n_buckets *= 2;
+        }
+
+        _rehash(n_buckets);
+      }
+    }
+
+    /**
+      @brief  Returns number of retired nodes awaiting reclamation
+      */
+    size_type retired_count() const
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex);
+
+      return retired_nodes.size();
+    }
+
+  protected:
+    //  =======
+    //  Helpers
+    //  =======
+
+    static uint64_t _hash(const Key_T& key)
+    {
+      return uint64_t(Hash()(key)) * 0x9e3779b97f4a7c15ull;
+    }
+
+    static uint32_t _log2(size_type n)
+    {
+      uint32_t res = 0;
+
+      while ((size_type(1) << res) < n)
+      {
+        res++;
+      }
+
+      return res;
+    }
+
+    /**
+      @brief  Stripe used by the calling thread
+      */
+    static size_type _stripe_index()
+    {
+      static thread_local size_type stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % n_reader_stripes;
+
+      return stripe;
+    }
+
+    /**
+      @brief  Walk the bucket chain for key
+      @note   Caller must be in a read-side section or hold the writer mutex
+      */
+    node_t* _find(const Key_T& key) const
+    {
+      uint64_t h = _hash(key);
+
+      table_t* cur = table.load(std::memory_order_acquire);
+
+      node_t* node = cur->bucket(h).load(std::memory_order_acquire);
+
+      while (node != nullptr and !Key_Equal()(node->item.first, key))
+      {
+        node = node->next.load(std::memory_order_acquire);
+      }
+
+      return node;
+    }
+
+    /**
+      @brief  Publish a copy of all entries in a new bucket array
+      @note   Caller must hold the writer mutex
+      */
+    void _rehash(size_type n_buckets)
+    {
+      table_t* old_table = table.load(std::memory_order_relaxed);
+      table_t* new_table = new table_t(n_buckets, 64 - _log2(n_buckets));
+
+      for (size_type i = 0; i < old_table->n_buckets; i++)
+      {
+        for (node_t* node = old_table->buckets[i].load(std::memory_order_relaxed); node != nullptr; node = node->next.load(std::memory_order_relaxed))
+        {
+          std::atomic<node_t*>& bucket = new_table->bucket(_hash(node->item.first));
+
+          bucket.store(new node_t(node->item.first, node->item.second, bucket.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+        }
+      }
+
+      table.store(new_table, std::memory_order_release);
+
+      _retire_table(old_table, true);
+      _reclaim();
+    }
+
+    /**
+      @brief  Retire a bucket array (and optionally its nodes)
+      @note   Caller must hold the writer mutex
+      */
+    void _retire_table(table_t* old_table, bool with_nodes)
+    {
+      if (with_nodes)
+      {
+        for (size_type i = 0; i < old_table->n_buckets; i++)
+        {
+          for (node_t* node = old_table->buckets[i].load(std::memory_order_relaxed); node != nullptr; node = node->next.load(std::memory_order_relaxed))
+          {
+            retired_nodes.push_back(node);
+          }
+        }
+      }
+
+      retired_tables.push_back(old_table);
+    }
+
+    /**
+      @brief  Wait for all readers which may observe retired memory, then free
+              it
+              Flips the epoch and waits until no reader remains on the old
+              parity. Readers entering after the flip cannot reach memory that
+              was unlinked before it.
+      @note   Caller must hold the writer mutex
+      */
+    void _reclaim()
+    {
+      size_type n_retired_nodes = retired_nodes.size();
+      size_type n_retired_tables = retired_tables.size();
+
+      uint64_t old_epoch = epoch.fetch_add(1, std::memory_order_seq_cst);
+
+      for (size_type i = 0; i < n_reader_stripes; i++)
+      {
+        while (stripes[i].active[old_epoch & 1].load(std::memory_order_seq_cst) != 0)
+        {
+          std::this_thread::yield();
+        }
+      }
+
+      /* tables first, their nodes are freed through retired_nodes */
+      for (size_type i = 0; i < n_retired_tables; i++)
+      {
+        delete retired_tables[i];
+      }
+
+      retired_tables.erase(retired_tables.begin(), retired_tables.begin() + n_retired_tables);
+
+      _free_retired(n_retired_nodes);
+    }
+
+    void _free_retired(size_type n)
+    {
+      for (size_type i = 0; i < n; i++)
+      {
+        delete retired_nodes[i];
+      }
+
+      retired_nodes.erase(retired_nodes.begin(), retired_nodes.begin() + n);
+    }
+
+    /**
+      @brief  Free a bucket array immediately (no readers may be present)
+      */
+    void _free_table(table_t* t, bool with_nodes)
+    {
+      if (with_nodes)
+      {
+        for (size_type i = 0; i < t->n_buckets; i++)
+        {
+          node_t* node = t->buckets[i].load(std::memory_order_relaxed);
+
+          while (node != nullptr)
+          {
+            node_t* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+          }
+        }
+      }
+
+      delete t;
+
+      for (table_t* retired : retired_tables)
+      {
+        delete retired;
+      }
+
+      retired_tables.clear();
+    }
+
+    void _copy(const concurrent_index& other)
+    {
+      std::lock_guard<std::mutex> lock(other.writer_mutex);
+
+      table_t* other_table = other.table.load(std::memory_order_relaxed);
+
+      for (size_type i = 0; i < other_table->n_buckets; i++)
+      {
+        for (node_t* node = other_table->buckets[i].load(std::memory_order_relaxed); node != nullptr; node = node->next.load(std::memory_order_relaxed))
+        {
+          insert(std::make_pair(node->item.first, node->item.second));
+        }
+      }
+    }
+
+    void _swap(concurrent_index& other)
+    {
+      table_t* tmp = table.load(std::memory_order_relaxed);
+      table.store(other.table.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      other.table.store(tmp, std::memory_order_relaxed);
+
+      size_type tmp_n = n_entries.load(std::memory_order_relaxed);
+      n_entries.store(other.n_entries.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      other.n_entries.store(tmp_n, std::memory_order_relaxed);
+
+      std::swap(retired_nodes, other.retired_nodes);
+      std::swap(retired_tables, other.retired_tables);
+    }
+
+  protected:
+    //  ================
+    //  Member Variables
+    //  ================
+
+    /**
+      @brief  Current bucket array
+      */
+    std::atomic<table_t*> table;
+
+    /**
+      @brief  Number of entries
+      */
+    std::atomic<size_type> n_entries;
+
+    /**
+      @brief  Reclamation epoch, only its parity selects reader counters
+      */
+    std::atomic<uint64_t> epoch;
+
+    /**
+      @brief  Reader counters
+      */
+    mutable reader_stripe_t stripes[n_reader_stripes];
+
+    /**
+      @brief  Serializes writers
+      */
+    mutable std::mutex writer_mutex;
+
+    /**
+      @brief  Unlinked nodes awaiting reclamation
+      */
+    std::vector<node_t*> retired_nodes;
+
+    /**
+      @brief  Replaced bucket arrays awaiting reclamation
+      */
+    std::vector<table_t*> retired_tables;
+  };
+}
@@ -0,0 +1,671 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parallel_for.hpp"
+#include "path_traits.hpp"
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Parses one field of a delimited file into a key
+            Defined for arithmetic types (with `std::from_chars`) and
+            `std::string`. Other key types may specialize it.
+    @tparam T
+            Key type
+    */
+  template <typename T, typename = void>
+  struct field_parser
+  {
+    static_assert(std::is_arithmetic<T>::value, "xu::field_parser must be specialized for keys which are not arithmetic or std::string");
+
+    /**
+      @return Whether the whole field is a valid T
+      */
+    static bool parse(std::string_view field, T& out)
+    {
+      auto result = std::from_chars(field.data(), field.data() + field.size(), out);
+      return result.ec == std::errc() and result.ptr == field.data() + field.size();
+    }
+  };
+
+  template <>
+  struct field_parser<std::string>
+  {
+    static bool parse(std::string_view field, std::string& out)
+    {
+      out.assign(field.data(), field.size());
+      return true;
+    }
+  };
+
+  /**
+    @brief  Fields of one line of a delimited file
+            Views into the mapped file, valid during the call they are passed
+            to.
+    */
+  class delimited_row_t
+  {
+  public:
+    size_t size() const
+    {
+      return fields.size();
+    }
+
+    std::string_view operator[](size_t i) const
+    {
+      return fields[i];
+    }
+
+    /**
+      @brief  Returns field i
+      @throw  std::out_of_range
+              If the line has fewer fields
+      */
+    std::string_view at(size_t i) const
+    {
+      if (i >= fields.size())
+      {
+        throw std::out_of_range("delimited_row_t::at() : line has " + std::to_string(fields.size()) + " fields");
+      }
+
+      return fields[i];
+    }
+
+    /**
+      @brief  Split a line, dropping a trailing carriage return
+      */
+    void split(std::string_view line, char delimiter)
+    {
+      if (!line.empty() and line.back() == '\r')
+      {
+        line.remove_suffix(1);
+      }
+
+      fields.clear();
+
+      for (size_t begin = 0;;)
+      {
+        size_t end = line.find(delimiter, begin);
+
+        if (end == std::string_view::npos)
+        {
+          fields.push_back(line.substr(begin));
+          return;
+        }
+
+        fields.push_back(line.substr(begin, end - begin));
+        begin = end + 1;
+      }
+    }
+
+  protected:
+    std::vector<std::string_view> fields;
+  };
+
+  /**
+    @brief  Options of `import_delimited()`
+    */
+  struct delimited_options_t
+  {
+    char delimiter = ',';
+
+    /**
+      @brief  Whether the first line is a header to skip
+      */
+    bool header = true;
+
+    /**
+      @brief  Maximum number of threads parsing lines and checking keys
+      */
+    size_t n_threads = 1;
+
+    /**
+      @brief  Approximate size of the line-aligned chunks parsed as a task
+      */
+    size_t chunk_bytes = size_t(1) << 22;
+  };
+
+  /**
+    @brief  A line of a delimited file which was not imported
+    */
+  struct import_issue_t
+  {
+    enum kind_t
+    {
+      /**
+        @brief  A key or the value could not be parsed
+        */
+      parse_error,
+
+      /**
+        @brief  The line has no keys
+        */
+      no_keys,
+
+      /**
+        @brief  A key is already in the map, or on an earlier line
+        */
+      conflict
+    };
+
+    /**
+      @brief  Line number, starting at 1
+      */
+    uint64_t line;
+
+    kind_t kind;
+
+    /**
+      @brief  Path of the conflicting key, for conflicts
+      */
+    size_t path;
+
+    std::string message;
+  };
+
+  /**
+    @brief  Outcome of `import_delimited()`
+    */
+  struct import_report_t
+  {
+    /**
+      @brief  Number of data lines read, not counting the header and empty
+              lines
+      */
+    uint64_t n_lines = 0;
+
+    uint64_t n_inserted = 0;
+
+    /**
+      @brief  Lines which were not imported, in line order
+      */
+    std::vector<import_issue_t> issues;
+  };
+
+  /**
+    @brief  Imports a delimited (CSV-like) file into a polykey_map
+            The file is memory mapped and split into line-aligned chunks,
+            which are parsed in parallel. The rows are inserted with
+            `polykey_map::bulk_insert()`; only if that reports a conflict are
+            the keys checked, per path in parallel, and the remaining rows
+            inserted.
+            A line whose key is already in the map or on an earlier line is
+            reported and skipped, the first line with a key winning. A
+            skipped line still claims its other keys, so later lines
+            sharing one of them are skipped too.
+    @note   Fields are not unquoted: they must not contain the delimiter or
+            line breaks.
+    @tparam Map_T
+            polykey_map type
+    */
+  template <typename Map_T>
+  class delimited_importer;
+
+  template <typename Value_T, typename ...Path_Ts>
+  class delimited_importer<polykey_map<Value_T, Path_Ts...>>
+  {
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_Tag = typename std::tuple_element<P, std::tuple<Path_Ts...>>::type;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<Path_Tag<P>>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using row_t = std::pair<typename map_t::row_keys_t, Value_T>;
+
+    /**
+      @param  key_fields_
+              Field index of each path's key. An empty field means the row
+              has no key on that path.
+      @param  options_
+              Delimiter, header and threading options
+      */
+    delimited_importer(const std::array<size_t, N_Paths>& key_fields_, const delimited_options_t& options_ = delimited_options_t())
+      : key_fields(key_fields_),
+        options(options_)
+    {}
+
+    /**
+      @brief  Import a file
+      @param  path
+              File to read
+      @param  map
+              Map to insert into
+      @param  make_value
+              Called as `make_value(const delimited_row_t&)` to build each
+              row's value, from several threads at once if n_threads > 1.
+              Exceptions it throws are reported as parse errors of the line.
+      @throw  std::system_error
+              If the file cannot be read
+      */
+    template <typename F>
+    import_report_t operator()(const std::string& path, map_t& map, F&& make_value) const
+    {
+      mapped_file_t file(path);
+
+      std::vector<std::pair<size_t, size_t>> ranges = _split(file.data, file.size);
+
+      std::vector<chunk_t> chunks(ranges.size());
+
+      parallel_for(ranges.size(), options.n_threads, [&](size_t c)
+      {
+        _parse(std::string_view(file.data + ranges[c].first, ranges[c].second - ranges[c].first), c == 0, chunks[c], make_value);
+      });
+
+      /* number lines and gather the rows */
+      import_report_t report;
+      std::vector<row_t> rows;
+      std::vector<uint64_t> lines;
+
+      size_t n_rows = 0;
+
+      for (chunk_t& chunk : chunks)
+      {
+        n_rows += chunk.rows.size();
+      }
+
+      rows.reserve(n_rows);
+      lines.reserve(n_rows);
+
+      uint64_t first_line = 1;
+
+      for (chunk_t& chunk : chunks)
+      {
+        for (size_t i = 0; i < chunk.rows.size(); i++)
+        {
+          rows.push_back(std::move(chunk.rows[i]));
+          lines.push_back(first_line + chunk.lines[i]);
+        }
+
+        for (import_issue_t& issue : chunk.issues)
+        {
+          issue.line += first_line;
+          report.issues.push_back(std::move(issue));
+        }
+
+        report.n_lines += chunk.n_data_lines;
+        first_line += chunk.n_lines;
+
+        std::vector<row_t>().swap(chunk.rows);
+      }
+
+      std::stable_sort(report.issues.begin(), report.issues.end(), [](const import_issue_t& a, const import_issue_t& b)
+      {
+        return a.line < b.line;
+      });
+
+      report.n_inserted = rows.size();
+
+      /* dumps rarely have conflicts, so first try inserting everything */
+      try
+      {
+        map.bulk_insert(std::move(rows), options.n_threads);
+        return report;
+      }
+      catch (const typename map_t::key_conflict_error&)
+      {}
+
+      /* find the conflicting rows, each path's keys on their own thread */
+      std::vector<std::vector<uint8_t>> conflicts(N_Paths);
+
+      parallel_for(N_Paths, options.n_threads, [&](size_t p)
+      {
+        conflicts[p].assign(rows.size(), 0);
+        _check_path(p, map, rows, conflicts[p]);
+      });
+
+      size_t kept = 0;
+
+      for (size_t i = 0; i < rows.size(); i++)
+      {
+        bool conflicting = false;
+
+        for (path_index_t p = 0; p < N_Paths; p++)
+        {
+          if (conflicts[p][i] != 0)
+          {
+            report.issues.push_back(import_issue_t{lines[i], import_issue_t::conflict, p, conflicts[p][i] == 1 ? "key already in map" : "duplicate key"});
+            conflicting = true;
+          }
+        }
+
+        if (!conflicting)
+        {
+          if (kept != i)
+          {
+            rows[kept] = std::move(rows[i]);
+          }
+
+          kept++;
+        }
+      }
+
+      rows.resize(kept);
+
+      std::stable_sort(report.issues.begin(), report.issues.end(), [](const import_issue_t& a, const import_issue_t& b)
+      {
+        return a.line < b.line;
+      });
+
+      map.bulk_insert(std::move(rows), options.n_threads);
+      report.n_inserted = kept;
+
+      return report;
+    }
+
+  protected:
+    /**
+      @brief  Parsed rows of a chunk, with line numbers relative to the
+              chunk's first line
+      */
+    struct chunk_t
+    {
+      std::vector<row_t> rows;
+
+      std::vector<uint64_t> lines;
+
+      std::vector<import_issue_t> issues;
+
+      uint64_t n_lines = 0;
+
+      uint64_t n_data_lines = 0;
+    };
+
+    /**
+      @brief  Read-only memory mapping of a whole file
+      */
+    struct mapped_file_t
+    {
+      explicit mapped_file_t(const std::string& path)
+        : data(nullptr),
+          size(0)
+      {
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+          throw std::system_error(errno, std::generic_category(), "delimited_importer : cannot open " + path);
+        }
+
+        struct stat st;
+
+        if (::fstat(fd, &st) != 0)
+        {
+          int err = errno;
+          ::close(fd);
+          throw std::system_error(err, std::generic_category(), "delimited_importer : cannot stat " + path);
+        }
+
+        size = size_t(st.st_size);
+
+        if (size != 0)
+        {
+          void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+          if (mapping == MAP_FAILED)
+          {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "delimited_importer : cannot map " + path);
+          }
+
+          ::madvise(mapping, size, MADV_SEQUENTIAL);
+          data = static_cast<const char*>(mapping);
+        }
+
+        ::close(fd);
+      }
+
+      ~mapped_file_t()
+      {
+        if (data != nullptr)
+        {
+          ::munmap(const_cast<char*>(data), size);
+        }
+      }
+
+      mapped_file_t(const mapped_file_t& other) = delete;
+
+      mapped_file_t& operator=(const mapped_file_t& other) = delete;
+
+      const char* data;
+
+      size_t size;
+    };
+
+    /**
+      @brief  Split a file into ranges of whole lines of about chunk_bytes
+      */
+    std::vector<std::pair<size_t, size_t>> _split(const char* data, size_t size) const
+    {
+      std::vector<std::pair<size_t, size_t>> ranges;
+
+      size_t chunk_bytes = std::max<size_t>(options.chunk_bytes, 1);
+
+      for (size_t begin = 0; begin < size;)
+      {
+        size_t end = std::min(size, begin + chunk_bytes);
+
+        if (end < size)
+        {
+          const void* newline = std::memchr(data + end, '\n', size - end);
+          end = newline == nullptr ? size : size_t(static_cast<const char*>(newline) - data) + 1;
+        }
+
+        ranges.emplace_back(begin, end);
+        begin = end;
+      }
+
+      return ranges;
+    }
+
+    template <typename F>
+    void _parse(std::string_view text, bool first_chunk, chunk_t& chunk, F& make_value) const
+    {
+      delimited_row_t row;
+
+      for (size_t begin = 0; begin < text.size();)
+      {
+        size_t end = text.find('\n', begin);
+
+        if (end == std::string_view::npos)
+        {
+          end = text.size();
+        }
+
+        std::string_view line = text.substr(begin, end - begin);
+        uint64_t line_index = chunk.n_lines++;
+        begin = end + 1;
+
+        if ((options.header and first_chunk and line_index == 0) or line.empty() or line == "\r")
+        {
+          continue;
+        }
+
+        chunk.n_data_lines++;
+
+        row.split(line, options.delimiter);
+
+        try
+        {
+          typename map_t::row_keys_t keys;
+
+          if (!_parse_keys(row, keys))
+          {
+            chunk.issues.push_back(import_issue_t{line_index, import_issue_t::parse_error, 0, "cannot parse key"});
+            continue;
+          }
+
+          if (!_has_any_key(keys))
+          {
+            chunk.issues.push_back(import_issue_t{line_index, import_issue_t::no_keys, 0, "line has no keys"});
+            continue;
+          }
+
+          chunk.rows.emplace_back(std::move(keys), make_value(static_cast<const delimited_row_t&>(row)));
+          chunk.lines.push_back(line_index);
+        }
+        catch (const std::exception& e)
+        {
+          chunk.issues.push_back(import_issue_t{line_index, import_issue_t::parse_error, 0, e.what()});
+        }
+      }
+    }
+
+    template <path_index_t P = 0>
+    typename std::enable_if<P != N_Paths, bool>::type _parse_keys(const delimited_row_t& row, typename map_t::row_keys_t& keys) const
+    {
+      std::string_view field = row.at(key_fields[P]);
+
+      if (!field.empty())
+      {
+        Path_T<P> key;
+
+        if (!field_parser<Path_T<P>>::parse(field, key))
+        {
+          return false;
+        }
+
+        std::get<P>(keys).emplace(std::move(key));
+      }
+
+      return _parse_keys<P + 1>(row, keys);
+    }
+
+    template <path_index_t P = 0>
+    typename std::enable_if<P == N_Paths, bool>::type _parse_keys(const delimited_row_t&, typename map_t::row_keys_t&) const
+    {
+      return true;
+    }
+
+    template <path_index_t P = 0>
+    static typename std::enable_if<P != N_Paths, bool>::type _has_any_key(const typename map_t::row_keys_t& keys)
+    {
+      return std::get<P>(keys).has_value() or _has_any_key<P + 1>(keys);
+    }
+
+    template <path_index_t P = 0>
+    static typename std::enable_if<P == N_Paths, bool>::type _has_any_key(const typename map_t::row_keys_t&)
+    {
+      return false;
+    }
+
+    /**
+      @brief  Mark the rows whose key on a path is in the map (1) or on an
+              earlier row (2)
+      */
+    template <path_index_t P = 0>
+    static typename std::enable_if<P != N_Paths, void>::type _check_path(path_index_t path, const map_t& map, const std::vector<row_t>& rows, std::vector<uint8_t>& conflicts)
+    {
+      if (path != P)
+      {
+        _check_path<P + 1>(path, map, rows, conflicts);
+        return;
+      }
+
+      path_index_map_t<Path_Tag<P>, size_t> seen;
+      seen.reserve(rows.size());
+
+      for (size_t i = 0; i < rows.size(); i++)
+      {
+        const auto& key = std::get<P>(rows[i].first);
+
+        if (!key)
+        {
+          continue;
+        }
+
+        if (map.template contains<P>(*key))
+        {
+          conflicts[i] = 1;
+        }
+        else if (!seen.emplace(*key, i).second)
+        {
+          conflicts[i] = 2;
+        }
+      }
+    }
+
+    template <path_index_t P = 0>
+    static typename std::enable_if<P == N_Paths, void>::type _check_path(path_index_t, const map_t&, const std::vector<row_t>&, std::vector<uint8_t>&)
+    {}
+
+  protected:
+    const std::array<size_t, N_Paths> key_fields;
+
+    const delimited_options_t options;
+  };
+
+  /**
+    @brief  Import a delimited file into a polykey_map
+            See `delimited_importer`, e.g. for lines of
+            `internal_id,external_id,ticker,svol`:
+
+              xu::import_report_t report = xu::import_delimited("orders.csv", otk, {0, 1},
+                [](const xu::delimited_row_t& row)
+                {
+                  return Order{std::string(row.at(2)), std::stoi(std::string(row.at(3)))};
+                });
+
+    @return The number of lines read and inserted, and the lines skipped
+    */
+  template <typename Value_T, typename ...Path_Ts, typename F>
+  import_report_t import_delimited(const std::string& path, polykey_map<Value_T, Path_Ts...>& map, const std::array<size_t, sizeof...(Path_Ts)>& key_fields, F&& make_value, const delimited_options_t& options = delimited_options_t())
+  {
+    return delimited_importer<polykey_map<Value_T, Path_Ts...>>(key_fields, options)(path, map, make_value);
+  }
+}
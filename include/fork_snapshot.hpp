@@ -0,0 +1,298 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cerrno>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Handle to a child process writing a snapshot
+            Returned by `fork_snapshot()`. The child is reaped by `wait()`, or
+            by the destructor if it was not waited for.
+    */
+  class snapshot_process
+  {
+  public:
+    snapshot_process(pid_t pid_, int error_fd_)
+      : pid(pid_),
+        error_fd(error_fd_)
+    {}
+
+    snapshot_process(snapshot_process&& other)
+      : pid(other.pid),
+        error_fd(other.error_fd),
+        exited(other.exited),
+        exit_status(other.exit_status)
+    {
+      other.pid = -1;
+      other.error_fd = -1;
+    }
+
+    snapshot_process& operator=(snapshot_process&& other)
+    {
+      if (this != &other)
+      {
+        _reap();
+
+        pid = other.pid;
+        error_fd = other.error_fd;
+        exited = other.exited;
+        exit_status = other.exit_status;
+
+        other.pid = -1;
+        other.error_fd = -1;
+      }
+
+      return *this;
+    }
+
+    snapshot_process(const snapshot_process& other) = delete;
+
+    snapshot_process& operator=(const snapshot_process& other) = delete;
+
+    ~snapshot_process()
+    {
+      _reap();
+    }
+
+    /**
+      @brief  Check whether the child has exited, without blocking
+              Once this returns true, `wait()` returns immediately.
+      */
+    bool done()
+    {
+      if (pid < 0)
+      {
+        return true;
+      }
+
+      int status;
+      pid_t r = ::waitpid(pid, &status, WNOHANG);
+
+      if (r == 0)
+      {
+        return false;
+      }
+
+      /* on error, let wait() report it */
+      if (r < 0)
+      {
+        return true;
+      }
+
+      exited = true;
+      exit_status = status;
+
+      return true;
+    }
+
+    /**
+      @brief  Wait for the snapshot to be written
+      @throw  std::runtime_error
+              If the child failed, with the child's error message
+      @throw  std::system_error
+              If waiting fails
+      */
+    void wait()
+    {
+      if (pid < 0)
+      {
+        throw std::logic_error("snapshot_process::wait() : no child process");
+      }
+
+      int status = exit_status;
+
+      if (!exited)
+      {
+        while (::waitpid(pid, &status, 0) < 0)
+        {
+          if (errno != EINTR)
+          {
+            throw std::system_error(errno, std::generic_category(), "snapshot_process::wait() : waitpid failed");
+          }
+        }
+      }
+
+      std::string message = _read_error();
+
+      pid = -1;
+      exited = false;
+
+      if (!WIFEXITED(status) or WEXITSTATUS(status) != 0)
+      {
+        throw std::runtime_error("snapshot_process::wait() : snapshot failed" + (message.empty() ? std::string() : " : " + message));
+      }
+    }
+
+    /**
+      @brief  Returns the child's process id, or -1 once reaped
+      */
+    pid_t id() const
+    {
+      return pid;
+    }
+
+  protected:
+    /**
+      @brief  Read the error message the child may have written, then close
+              the pipe
+      */
+    std::string _read_error()
+    {
+      std::string message;
+
+      if (error_fd >= 0)
+      {
+        char buffer[256];
+        ssize_t n;
+
+        while ((n = ::read(error_fd, buffer, sizeof(buffer))) > 0 or (n < 0 and errno == EINTR))
+        {
+          if (n > 0)
+          {
+            message.append(buffer, size_t(n));
+          }
+        }
+
+        ::close(error_fd);
+        error_fd = -1;
+      }
+
+      return message;
+    }
+
+    void _reap()
+    {
+      if (pid >= 0)
+      {
+        try
+        {
+          wait();
+        }
+        catch (...)
+        {}
+      }
+    }
+
+  protected:
+    pid_t pid;
+
+    /**
+      @brief  Read end of a pipe carrying the child's error message
+      */
+    int error_fd;
+
+    /**
+      @brief  Whether `done()` already reaped the child
+      */
+    bool exited = false;
+
+    int exit_status = 0;
+  };
+
+  /**
+    @brief  Write a snapshot of a map from a forked child process
+            The child serializes its copy-on-write image of the map, so the
+            caller can resume modifying the map as soon as `fork()` returns;
+            the pause is the cost of the fork (copying page tables), not of
+            the serialization. Pages the parent modifies meanwhile are copied
+            by the kernel.
+    @note   Only the calling thread exists in the child. Other threads must
+            not hold locks the serialization needs (such as in a custom
+            `xu::codec`) while forking. The map must not be modified by other
+            threads during the call.
+    @param  map
+            Map to write
+    @param  path
+            Target file path
+    @return Handle to the child process
+    @throw  std::system_error
+            If the process cannot be forked
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  snapshot_process fork_snapshot(const polykey_map<Value_T, Path_Ts...>& map, const std::string& path)
+  {
+    int fds[2];
+
+    /* close-on-exec, so that processes spawned meanwhile by other threads do not hold the write end open */
+    if (::pipe2(fds, O_CLOEXEC) != 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "fork_snapshot() : pipe2 failed");
+    }
+
+    pid_t pid = ::fork();
+
+    if (pid < 0)
+    {
+      int err = errno;
+      ::close(fds[0]);
+      ::close(fds[1]);
+      throw std::system_error(err, std::generic_category(), "fork_snapshot() : fork failed");
+    }
+
+    if (pid == 0)
+    {
+      /* child: never return to the caller, nor run exit handlers */
+      ::close(fds[0]);
+
+      int code = 0;
+
+      try
+      {
+        save_snapshot(map, path);
+      }
+      catch (const std::exception& e)
+      {
+        ssize_t n = ::write(fds[1], e.what(), std::char_traits<char>::length(e.what()));
+        (void)n;
+        code = 1;
+      }
+      catch (...)
+      {
+        code = 1;
+      }
+
+      ::_exit(code);
+    }
+
+    ::close(fds[1]);
+
+    return snapshot_process(pid, fds[0]);
+  }
+}
@@ -0,0 +1,378 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Approximate counts of the most frequent keys of a stream, in
+            bounded memory (the space-saving algorithm)
+            Up to capacity keys are counted. When a key which is not counted
+            arrives while full, it replaces the key with the lowest count and
+            inherits that count, which becomes its possible overcount
+            (`error`). Any key whose true count exceeds n / capacity, for n
+            the total count, is guaranteed to be counted.
+    @tparam Key_T
+            Type of the keys. Must be hashable with Hash_T.
+    @tparam Key_Equal_T
+            Equality of keys, consistent with Hash_T
+    */
+  template <typename Key_T, typename Hash_T = std::hash<Key_T>, typename Key_Equal_T = std::equal_to<Key_T>>
+  class space_saving
+  {
+  public:
+    /**
+      @brief  Count of a key
+              The true count is between `count - error` and `count`.
+      */
+    struct counter_t
+    {
+      Key_T key;
+
+      uint64_t count;
+
+      uint64_t error;
+    };
+
+  public:
+    /**
+      @param  capacity_
+              Maximum number of keys counted, at least 1
+      */
+    explicit space_saving(size_t capacity_)
+      : capacity(std::max(capacity_, size_t(1))),
+        total(0)
+    {
+      heap.reserve(capacity);
+      positions.reserve(capacity);
+    }
+
+    /**
+      @brief  Count key weight times
+      */
+    void add(const Key_T& key, uint64_t weight = 1)
+    {
+      total += weight;
+
+      auto it = positions.find(key);
+
+      if (it != positions.end())
+      {
+        heap[it->second].count += weight;
+        _sift_down(it->second);
+        return;
+      }
+
+      if (heap.size() < capacity)
+      {
+        heap.push_back(counter_t{key, weight, 0});
+        positions.emplace(key, heap.size() - 1);
+        _sift_up(heap.size() - 1);
+        return;
+      }
+
+      /* replace the least counted key, at the root */
+      counter_t& min = heap[0];
+
+      positions.erase(min.key);
+
+      min.error = min.count;
+      min.count += weight;
+      min.key = key;
+
+      positions.emplace(key, 0);
+      _sift_down(0);
+    }
+
+    /**
+      @brief  Returns the n most counted keys, by decreasing count
+      */
+    std::vector<counter_t> top(size_t n) const
+    {
+      std::vector<counter_t> res(heap);
+
+      n = std::min(n, res.size());
+
+      std::partial_sort(res.begin(), res.begin() + n, res.end(), [](const counter_t& a, const counter_t& b)
+      {
+        return a.count > b.count;
+      });
+
+      res.resize(n);
+
+      return res;
+    }
+
+    /**
+      @brief  Returns total count of all keys added
+      */
+    uint64_t total_count() const
+    {
+      return total;
+    }
+
+    /**
+      @brief  Returns number of keys counted
+      */
+    size_t size() const
+    {
+      return heap.size();
+    }
+
+    void clear()
+    {
+      heap.clear();
+      positions.clear();
+      total = 0;
+    }
+
+  protected:
+    void _swap(size_t i, size_t j)
+    {
+      std::swap(heap[i], heap[j]);
+      positions[heap[i].key] = i;
+      positions[heap[j].key] = j;
+    }
+
+    void _sift_up(size_t i)
+    {
+      while (i > 0 and heap[i].count < heap[(i - 1) / 2].count)
+      {
+        _swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+      }
+    }
+
+    void _sift_down(size_t i)
+    {
+      for (;;)
+      {
+        size_t min = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < heap.size() and heap[left].count < heap[min].count)
+        {
+          min = left;
+        }
+
+        if (right < heap.size() and heap[right].count < heap[min].count)
+        {
+          min = right;
+        }
+
+        if (min == i)
+        {
+          return;
+        }
+
+        _swap(i, min);
+        i = min;
+      }
+    }
+
+  protected:
+    size_t capacity;
+
+    uint64_t total;
+
+    /**
+      @brief  Counters, as a min-heap on count
+      */
+    std::vector<counter_t> heap;
+
+    /**
+      @brief  Position of each counted key in heap
+      */
+    std::unordered_map<Key_T, size_t, Hash_T, Key_Equal_T> positions;
+  };
+
+  template <typename Map_T>
+  class hot_key_sampler;
+
+  /**
+    @brief  Finds the most looked up keys of each path of a polykey_map
+            Samples on average one in period lookups made on each path with
+            `at<P>()` and `find<P>()`, at random intervals, and counts the
+            sampled keys of each path with a `space_saving` counter. Counts
+            are thus estimates of a period-th of the true counts.
+            While no sampler is set, lookups only test a null pointer.
+    @note   Not thread-safe: lookups must not be made concurrently while the
+            sampler is set.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class hot_key_sampler<polykey_map<Value_T, Path_Ts...>> : public polykey_map<Value_T, Path_Ts...>::lookup_sampler
+  {
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_Tag_T = typename std::tuple_element<P, std::tuple<Path_Ts...>>::type;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<Path_Tag_T<P>>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+    /**
+      @brief  Counters of a path, hashing keys as the path's index does
+      */
+    template <typename Path_Tag>
+    using counters_t = space_saving<path_key_t<Path_Tag>, path_hasher_t<Path_Tag>, path_key_equal_t<Path_Tag>>;
+
+  public:
+    /**
+      @brief  Sample the lookups of map until destruction
+      @param  capacity
+              Number of keys counted per path
+      @param  period_
+              Sample one lookup in period_ on average, at least 1
+      @note   Replaces any sampler already set on map
+      */
+    hot_key_sampler(map_t& map_, size_t capacity = 64, uint64_t period_ = 16)
+      : map(map_),
+        period(std::max(period_, uint64_t(1))),
+        countdowns{},
+        rng(0x9e3779b97f4a7c15ull),
+        counters(counters_t<Path_Ts>(capacity)...)
+    {
+      map.set_lookup_sampler(this);
+    }
+
+    ~hot_key_sampler()
+    {
+      map.set_lookup_sampler(nullptr);
+    }
+
+    hot_key_sampler(const hot_key_sampler& other) = delete;
+
+    hot_key_sampler& operator=(const hot_key_sampler& other) = delete;
+
+    /**
+      @brief  Returns the n most looked up keys of a path, by decreasing
+              (sampled) count
+      @tparam P
+              Path index
+      */
+    template <path_index_t P>
+    std::vector<typename counters_t<Path_Tag_T<P>>::counter_t> top(size_t n) const
+    {
+      static_assert(P < N_Paths);
+
+      return std::get<P>(counters).top(n);
+    }
+
+    /**
+      @brief  Returns number of sampled lookups of a path
+      @tparam P
+              Path index
+      */
+    template <path_index_t P>
+    uint64_t n_sampled() const
+    {
+      static_assert(P < N_Paths);
+
+      return std::get<P>(counters).total_count();
+    }
+
+    void on_lookup(path_index_t path, const void* key) override
+    {
+      if (countdowns[path]-- != 0)
+      {
+        return;
+      }
+
+      countdowns[path] = _next_gap();
+
+      _sample(path, key);
+    }
+
+  protected:
+    /**
+      @brief  Returns lookups to skip until the next sample, uniform in
+              [0, 2 * period - 2] so that samples are one in period on
+              average but do not follow periodic lookup patterns
+      */
+    uint64_t _next_gap()
+    {
+      /* xorshift64 */
+      rng ^= rng << 13;
+      rng ^= rng >> 7;
+      rng ^= rng << 17;
+
+      return rng % (2 * period - 1);
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P != N_Paths, void>::type _sample(path_index_t path, const void* key)
+    {
+      if (path == P)
+      {
+        std::get<P>(counters).add(*static_cast<const Path_T<P>*>(key));
+        return;
+      }
+
+      _sample<P + 1>(path, key);
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P == N_Paths, void>::type _sample(path_index_t, const void*)
+    {}
+
+  protected:
+    map_t& map;
+
+    uint64_t period;
+
+    /**
+      @brief  Lookups left until the next sample of each path
+              Counted per path, so that lookups alternating between paths
+              are not sampled on one path only.
+      */
+    uint64_t countdowns[N_Paths];
+
+    /**
+      @brief  State of the generator of sampling gaps
+      */
+    uint64_t rng;
+
+    std::tuple<counters_t<Path_Ts>...> counters;
+  };
+}
@@ -0,0 +1,520 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Histogram of latencies in nanoseconds, with log-linear buckets
+            (as in HdrHistogram)
+            Values below 2 * sub_buckets have a bucket each. Above, each power
+            of two is split into sub_buckets equal buckets, so a value is
+            known to within 1 / sub_buckets (1.6%) of itself, whatever its
+            magnitude. Values of 2^max_magnitude ns (about 69 s) and above
+            share the last bucket; `max()` is exact nonetheless.
+    */
+  class latency_histogram
+  {
+    friend class latency_recorder;
+
+  public:
+    static const unsigned sub_bucket_bits = 6;
+
+    static const uint64_t sub_buckets = uint64_t(1) << sub_bucket_bits;
+
+    static const unsigned max_magnitude = 36;
+
+    static const size_t n_buckets = (max_magnitude - sub_bucket_bits + 1) * sub_buckets;
+
+    /**
+      @brief  Returns the bucket of value
+      */
+    static size_t bucket_of(uint64_t value)
+    {
+      value = std::min(value, (uint64_t(1) << max_magnitude) - 1);
+
+      if (value < 2 * sub_buckets)
+      {
+        return size_t(value);
+      }
+
+#if defined(__GNUC__)
+      unsigned magnitude = 63 - unsigned(__builtin_clzll(value));
+#else
+      unsigned magnitude = 0;
+
+      while ((value >> magnitude) > 1)
+      {
+        magnitude++;
+      }
+#endif
+
+      unsigned shift = magnitude - sub_bucket_bits;
+
+      return size_t(shift * sub_buckets + (value >> shift));
+    }
+
+    /**
+      @brief  Returns the lowest value of a bucket
+      */
+    static uint64_t lowest_of(size_t bucket)
+    {
+      if (bucket < 2 * sub_buckets)
+      {
+        return bucket;
+      }
+
+      unsigned shift = unsigned(bucket / sub_buckets) - 1;
+
+      return (bucket % sub_buckets + sub_buckets) << shift;
+    }
+
+    /**
+      @brief  Returns the highest value of a bucket
+      */
+    static uint64_t highest_of(size_t bucket)
+    {
+      if (bucket < 2 * sub_buckets)
+      {
+        return bucket;
+      }
+
+      unsigned shift = unsigned(bucket / sub_buckets) - 1;
+
+      return lowest_of(bucket) + (uint64_t(1) << shift) - 1;
+    }
+
+  public:
+    latency_histogram()
+      : counts(n_buckets),
+        total(0),
+        sum(0),
+        min_value(std::numeric_limits<uint64_t>::max()),
+        max_value(0)
+    {}
+
+    void record(uint64_t value, uint64_t n = 1)
+    {
+      counts[bucket_of(value)] += n;
+      total += n;
+      sum += value * n;
+      min_value = std::min(min_value, value);
+      max_value = std::max(max_value, value);
+    }
+
+    /**
+      @brief  Add the values of other
+      */
+    void merge(const latency_histogram& other)
+    {
+      for (size_t i = 0; i < n_buckets; i++)
+      {
+        counts[i] += other.counts[i];
+      }
+
+      total += other.total;
+      sum += other.sum;
+      min_value = std::min(min_value, other.min_value);
+      max_value = std::max(max_value, other.max_value);
+    }
+
+    /**
+      @brief  Returns number of values recorded
+      */
+    uint64_t count() const
+    {
+      return total;
+    }
+
+    /**
+      @brief  Returns the smallest value, or 0 if none were recorded
+      */
+    uint64_t min() const
+    {
+      return total == 0 ? 0 : min_value;
+    }
+
+    uint64_t max() const
+    {
+      return max_value;
+    }
+
+    double mean() const
+    {
+      return total == 0 ? 0 : double(sum) / double(total);
+    }
+
+    /**
+      @brief  Returns the value below or at which percentile % of the values
+              are, to within the precision of its bucket
+      @param  percentile
+              Between 0 and 100
+      */
+    uint64_t value_at_percentile(double percentile) const
+    {
+      if (total == 0)
+      {
+        return 0;
+      }
+
+      uint64_t rank = uint64_t(std::ceil(std::min(std::max(percentile, 0.0), 100.0) / 100 * double(total)));
+      rank = std::max(rank, uint64_t(1));
+
+      uint64_t seen = 0;
+
+      for (size_t i = 0; i < n_buckets; i++)
+      {
+        seen += counts[i];
+
+        if (seen >= rank)
+        {
+          return std::min(highest_of(i), max_value);
+        }
+      }
+
+      return max_value;
+    }
+
+    /**
+      @brief  Calls f(lowest, highest, count) for each bucket with values
+      */
+    template <typename F>
+    void for_each_bucket(F&& f) const
+    {
+      for (size_t i = 0; i < n_buckets; i++)
+      {
+        if (counts[i] != 0)
+        {
+          f(lowest_of(i), highest_of(i), counts[i]);
+        }
+      }
+    }
+
+  protected:
+    std::vector<uint64_t> counts;
+
+    uint64_t total;
+
+    uint64_t sum;
+
+    uint64_t min_value;
+
+    uint64_t max_value;
+  };
+
+  /**
+    @brief  Latency histograms of each operation of polykey_maps
+            Set on maps with `set_operation_timer()`, after which every
+            `insert`, `link`, `erase`, `at`, `find`, `contains`,
+            `convert_key`, `modify` and iterator increment is timed.
+            Each thread records into its own histograms, which only it
+            writes, so recording takes no lock and no atomic read-modify-write
+            (the histograms of a thread are allocated, under a lock, on its
+            first record). `histogram()` and the dumps merge the histograms of
+            all threads, and may be called while threads record.
+    @note   Timing an operation reads the clock twice (about 75 ns in all
+            with recording), and the reads keep the cache misses of
+            consecutive operations from overlapping, so timed operations on
+            a large map can be several times slower. The recorder is meant
+            for canaries; while no timer is set, an operation only tests a
+            null pointer. A thread's histograms take about 140 kB, and are
+            kept until the recorder is destroyed.
+    */
+  class latency_recorder : public operation_timer
+  {
+  protected:
+    /**
+      @brief  Histograms of one thread, written by it only
+      */
+    struct thread_histograms_t
+    {
+      std::thread::id owner;
+
+      std::atomic<uint64_t> counts[n_map_operations][latency_histogram::n_buckets];
+
+      std::atomic<uint64_t> sums[n_map_operations];
+
+      std::atomic<uint64_t> mins[n_map_operations];
+
+      std::atomic<uint64_t> maxs[n_map_operations];
+
+      explicit thread_histograms_t(std::thread::id owner_)
+        : owner(owner_)
+      {
+        for (size_t op = 0; op < n_map_operations; op++)
+        {
+          for (auto& count : counts[op])
+          {
+            count.store(0, std::memory_order_relaxed);
+          }
+
+          sums[op].store(0, std::memory_order_relaxed);
+          mins[op].store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+          maxs[op].store(0, std::memory_order_relaxed);
+        }
+      }
+    };
+
+    /**
+      @brief  Histograms last used by the calling thread, and their recorder
+      */
+    struct thread_cache_t
+    {
+      unsigned long long recorder = 0;
+
+      thread_histograms_t* histograms = nullptr;
+    };
+
+    static unsigned long long _next_id()
+    {
+      static std::atomic<unsigned long long> next_id(1);
+
+      return next_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+      @brief  Returns the calling thread's histograms, allocating them on
+              its first record
+              Only the last recorder used is cached, so a thread alternating
+              between recorders takes the lock on each switch.
+      */
+    thread_histograms_t& _local()
+    {
+      static thread_local thread_cache_t cache;
+
+      if (cache.recorder == id)
+      {
+        return *cache.histograms;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      std::thread::id self = std::this_thread::get_id();
+
+      auto it = std::find_if(threads.begin(), threads.end(), [&](const std::unique_ptr<thread_histograms_t>& t)
+      {
+        return t->owner == self;
+      });
+
+      if (it == threads.end())
+      {
+        threads.push_back(std::make_unique<thread_histograms_t>(self));
+        it = threads.end() - 1;
+      }
+
+      cache.recorder = id;
+      cache.histograms = it->get();
+
+      return *cache.histograms;
+    }
+
+    /* only the owning thread writes, so a load and a store suffice */
+    static void _bump(std::atomic<uint64_t>& counter, uint64_t n)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+  public:
+    latency_recorder()
+      : id(_next_id())
+    {}
+
+    latency_recorder(const latency_recorder& other) = delete;
+
+    latency_recorder& operator=(const latency_recorder& other) = delete;
+
+    /**
+      @brief  Record that op took ns nanoseconds on the calling thread
+      */
+    void record(map_operation op, uint64_t ns)
+    {
+      thread_histograms_t& local = _local();
+      size_t i = size_t(op);
+
+      _bump(local.counts[i][latency_histogram::bucket_of(ns)], 1);
+      _bump(local.sums[i], ns);
+
+      if (ns < local.mins[i].load(std::memory_order_relaxed))
+      {
+        local.mins[i].store(ns, std::memory_order_relaxed);
+      }
+
+      if (ns > local.maxs[i].load(std::memory_order_relaxed))
+      {
+        local.maxs[i].store(ns, std::memory_order_relaxed);
+      }
+    }
+
+    void on_operation(map_operation op, uint64_t ns) override
+    {
+      record(op, ns);
+    }
+
+    /**
+      @brief  Returns the latencies of op, merged over all threads
+      @note   Records made meanwhile may be partly included (e.g. in the
+              count but not yet in the maximum).
+      */
+    latency_histogram histogram(map_operation op) const
+    {
+      latency_histogram res;
+      latency_histogram thread;
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for (const auto& t : threads)
+      {
+        thread = latency_histogram();
+
+        size_t i = size_t(op);
+
+        for (size_t b = 0; b < latency_histogram::n_buckets; b++)
+        {
+          uint64_t n = t->counts[i][b].load(std::memory_order_relaxed);
+
+          if (n != 0)
+          {
+            thread.record(latency_histogram::lowest_of(b), n);
+          }
+        }
+
+        if (thread.count() == 0)
+        {
+          continue;
+        }
+
+        /* restore the exact sum and extremes, which bucketing lost */
+        thread.sum = t->sums[i].load(std::memory_order_relaxed);
+        thread.min_value = std::min(thread.min_value, t->mins[i].load(std::memory_order_relaxed));
+        thread.max_value = std::max(thread.max_value, t->maxs[i].load(std::memory_order_relaxed));
+
+        res.merge(thread);
+      }
+
+      return res;
+    }
+
+    /**
+      @brief  Write a table of the count, mean and percentiles of each
+              operation recorded, in nanoseconds
+      */
+    void write_text(std::ostream& os) const
+    {
+      char line[256];
+
+      std::snprintf(line, sizeof(line), "%-12s %12s %10s %10s %10s %10s %10s %10s %10s\n",
+                    "operation", "count", "mean ns", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+      os << line;
+
+      for (size_t i = 0; i < n_map_operations; i++)
+      {
+        latency_histogram h = histogram(map_operation(i));
+
+        if (h.count() == 0)
+        {
+          continue;
+        }
+
+        std::snprintf(line, sizeof(line), "%-12s %12llu %10.0f %10llu %10llu %10llu %10llu %10llu %10llu\n",
+                      operation_name(map_operation(i)), (unsigned long long)h.count(), h.mean(),
+                      (unsigned long long)h.value_at_percentile(50), (unsigned long long)h.value_at_percentile(90),
+                      (unsigned long long)h.value_at_percentile(99), (unsigned long long)h.value_at_percentile(99.9),
+                      (unsigned long long)h.value_at_percentile(99.99), (unsigned long long)h.max());
+        os << line;
+      }
+    }
+
+    /**
+      @brief  Write the histogram of each operation as JSON
+              Each operation has its count, min, mean, max and percentiles in
+              nanoseconds, and its non-empty buckets as `[lowest, count]`
+              pairs, so that dumps of several processes can be merged.
+      */
+    void write_json(std::ostream& os) const
+    {
+      os << "{\"unit\":\"ns\",\"operations\":{";
+
+      for (size_t i = 0; i < n_map_operations; i++)
+      {
+        latency_histogram h = histogram(map_operation(i));
+
+        os << (i == 0 ? "" : ",") << "\"" << operation_name(map_operation(i)) << "\":{"
+           << "\"count\":" << h.count()
+           << ",\"min\":" << h.min()
+           << ",\"mean\":" << uint64_t(std::llround(h.mean()))
+           << ",\"max\":" << h.max()
+           << ",\"percentiles\":{"
+           << "\"50\":" << h.value_at_percentile(50)
+           << ",\"90\":" << h.value_at_percentile(90)
+           << ",\"99\":" << h.value_at_percentile(99)
+           << ",\"99.9\":" << h.value_at_percentile(99.9)
+           << ",\"99.99\":" << h.value_at_percentile(99.99)
+           << "},\"buckets\":[";
+
+        bool first = true;
+
+        h.for_each_bucket([&](uint64_t lowest, uint64_t, uint64_t count)
+        {
+          os << (first ? "" : ",") << "[" << lowest << "," << count << "]";
+          first = false;
+        });
+
+        os << "]}";
+      }
+
+      os << "}}";
+    }
+
+  protected:
+    /**
+      @brief  Process-wide unique number, which tells thread caches apart
+              from those of a destroyed recorder at the same address
+      */
+    const unsigned long long id;
+
+    /**
+      @brief  Guards threads
+      */
+    mutable std::mutex mutex;
+
+    std::vector<std::unique_ptr<thread_histograms_t>> threads;
+  };
+}
@@ -0,0 +1,218 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+namespace xu
+{
+  /**
+    @brief  Per-thread direct-mapped cache of recent lookups in front of a
+            polykey_map
+            Each thread owns one cache per (map type, path, size). A slot holds
+            a key, a pointer to the value it was found at, and the row token of
+            that value. A hit is accepted only if the token is still valid for
+            the map being searched, so entries of erased rows, of other maps
+            and of maps which were reassigned are rejected without touching
+            the map's index.
+            Misses (keys which do not exist) are never cached.
+    @note   The cache does not synchronize anything by itself. Like a plain
+            lookup, a cached lookup may run concurrently with other lookups,
+            but not with writers of the same map.
+    @tparam Map_T
+            polykey_map type
+    @tparam P
+            Path index
+    @tparam N_Slots
+            Number of slots, must be a power of two
+    */
+  template <typename Map_T, size_t P, size_t N_Slots = 64>
+  class lookup_cache
+  {
+    static_assert(N_Slots != 0 and (N_Slots & (N_Slots - 1)) == 0, "lookup_cache: N_Slots must be a power of two");
+
+  public:
+    //  ========
+    //  Typedefs
+    //  ========
+
+    using key_type = typename Map_T::template key_type<P>;
+
+    using value_type = typename Map_T::value_type;
+
+    /**
+      @brief  Hit and miss counts of the calling thread's cache
+      */
+    struct stats_t
+    {
+      unsigned long long hits = 0;
+
+      unsigned long long misses = 0;
+    };
+
+  protected:
+    struct slot_t
+    {
+      std::optional<key_type> key;
+
+      const value_type* value = nullptr;
+
+      typename Map_T::row_token_t token{};
+    };
+
+    struct cache_t
+    {
+      slot_t slots[N_Slots];
+
+      stats_t stats;
+    };
+
+    /**
+      @brief  Returns the calling thread's cache
+      */
+    static cache_t& _local()
+    {
+      static thread_local cache_t cache;
+
+      return cache;
+    }
+
+    static size_t _slot_index(const key_type& key)
+    {
+      uint64_t h = uint64_t(std::hash<key_type>()(key)) * 0x9e3779b97f4a7c15ull;
+
+      return size_t(h >> 40) & (N_Slots - 1);
+    }
+
+  public:
+    //  ======
+    //  Lookup
+    //  ======
+
+    /**
+      @brief  Find a value, consulting the calling thread's cache first
+      @return Pointer to the value, or null if key does not exist
+      */
+    static const value_type* find(const Map_T& map, const key_type& key)
+    {
+      cache_t& cache = _local();
+      slot_t& slot = cache.slots[_slot_index(key)];
+
+      if (slot.value != nullptr and map.is_valid(slot.token) and *slot.key == key)
+      {
+        cache.stats.hits++;
+        return slot.value;
+      }
+
+      cache.stats.misses++;
+
+      auto it = map.template find<P>(key);
+
+      if (it == map.cend())
+      {
+        return nullptr;
+      }
+
+      slot.key = key;
+      slot.value = &*it;
+      slot.token = map.row_token(it);
+
+      return slot.value;
+    }
+
+    /**
+      @brief  Retrieve a value, consulting the calling thread's cache first
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    static const value_type& at(const Map_T& map, const key_type& key)
+    {
+      const value_type* value = find(map, key);
+
+      if (value == nullptr)
+      {
+        throw std::out_of_range("lookup_cache::at() : key does not exist for path");
+      }
+
+      return *value;
+    }
+
+    static value_type& at(Map_T& map, const key_type& key)
+    {
+      /* delegate at() */
+      return const_cast<value_type&>(at(const_cast<const Map_T&>(map), key));
+    }
+
+    /**
+      @brief  Forget all entries of the calling thread's cache
+      */
+    static void clear()
+    {
+      cache_t& cache = _local();
+
+      for (slot_t& slot : cache.slots)
+      {
+        slot = slot_t();
+      }
+    }
+
+    /**
+      @brief  Returns hit and miss counts of the calling thread's cache
+      */
+    static stats_t stats()
+    {
+      return _local().stats;
+    }
+  };
+
+  /**
+    @brief  Retrieve a value through the calling thread's lookup cache
+            Shorthand for `lookup_cache<Map_T, P>::at(map, key)`
+    @tparam P
+            Path index
+    */
+  template <size_t P, typename Map_T>
+  auto& cached_at(Map_T& map, const typename std::remove_const<Map_T>::type::template key_type<P>& key)
+  {
+    return lookup_cache<typename std::remove_const<Map_T>::type, P>::at(map, key);
+  }
+
+  /**
+    @brief  Find a value through the calling thread's lookup cache
+            Shorthand for `lookup_cache<Map_T, P>::find(map, key)`
+    @tparam P
+            Path index
+    */
+  template <size_t P, typename Map_T>
+  auto cached_find(const Map_T& map, const typename Map_T::template key_type<P>& key)
+  {
+    return lookup_cache<Map_T, P>::find(map, key);
+  }
+}
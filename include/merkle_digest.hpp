@@ -0,0 +1,400 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "polykey_codec.hpp"
+#include "polykey_diff.hpp"
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Merkle tree over the buckets of a `bucket_digest`
+            The leaves are the bucket sums and each inner node hashes its two
+            children, so two digests with equal roots hold the same rows
+            (with high probability), and differing buckets are found by
+            descending only into differing subtrees, one level per exchange
+            (see `divergent_buckets()`).
+            Updates only adjust a bucket sum and mark its ancestors stale;
+            stale nodes are rehashed when read, so a burst of updates costs
+            O(1) each and one O(updated paths) refresh.
+    @note   Reading nodes refreshes them, so concurrent reads must be
+            synchronized like writes.
+    */
+  class merkle_digest
+  {
+  public:
+    /**
+      @brief  Default number of buckets (leaves)
+      */
+    static const size_t default_buckets = 4096;
+
+    /**
+      @param  n_buckets
+              Number of buckets, rounded up to a power of two
+      */
+    explicit merkle_digest(size_t n_buckets = default_buckets)
+      : buckets(n_buckets),
+        nodes(buckets.n_buckets(), 0),
+        stale(buckets.n_buckets(), true)
+    {}
+
+    size_t n_buckets() const
+    {
+      return buckets.n_buckets();
+    }
+
+    /**
+      @brief  Returns the level of the leaves; the root is level 0
+      */
+    size_t depth() const
+    {
+      size_t d = 0;
+
+      while ((size_t(1) << d) < n_buckets())
+      {
+        d++;
+      }
+
+      return d;
+    }
+
+    /**
+      @brief  Returns number of rows
+      */
+    size_t size() const
+    {
+      return buckets.size();
+    }
+
+    /**
+      @brief  Returns the bucket of a row given its anchor hash
+      */
+    size_t bucket(uint64_t anchor_hash) const
+    {
+      return buckets.bucket(anchor_hash);
+    }
+
+    void add(uint64_t anchor_hash, uint64_t row_hash)
+    {
+      buckets.add(anchor_hash, row_hash);
+      _invalidate(bucket(anchor_hash));
+    }
+
+    void remove(uint64_t anchor_hash, uint64_t row_hash)
+    {
+      buckets.remove(anchor_hash, row_hash);
+      _invalidate(bucket(anchor_hash));
+    }
+
+    /**
+      @brief  Returns the sum of a bucket, i.e. `node(depth(), bucket)`
+      */
+    uint64_t sum(size_t bucket) const
+    {
+      return buckets.sum(bucket);
+    }
+
+    uint64_t root() const
+    {
+      return node(0, 0);
+    }
+
+    /**
+      @brief  Returns the hash of node index of a level
+              Level l has 2^l nodes; the nodes of level `depth()` are the
+              bucket sums.
+      */
+    uint64_t node(size_t level, size_t index) const
+    {
+      return _node((size_t(1) << level) + index);
+    }
+
+    bool operator==(const merkle_digest& other) const
+    {
+      return n_buckets() == other.n_buckets() and size() == other.size() and root() == other.root();
+    }
+
+    bool operator!=(const merkle_digest& other) const
+    {
+      return !(*this == other);
+    }
+
+  protected:
+    /**
+      @brief  Returns the hash of a node, numbered from 1 (the root), the
+              children of node i being 2i and 2i + 1
+      */
+    uint64_t _node(size_t i) const
+    {
+      if (i >= n_buckets())
+      {
+        return buckets.sum(i - n_buckets());
+      }
+
+      if (stale[i])
+      {
+        uint64_t children[2] = {_node(2 * i), _node(2 * i + 1)};
+
+        nodes[i] = hash_bytes(reinterpret_cast<const char*>(children), sizeof(children));
+        stale[i] = false;
+      }
+
+      return nodes[i];
+    }
+
+    /**
+      @brief  Mark the ancestors of a leaf stale
+              A stale node's ancestors are all stale, so marking stops at the
+              first one already marked.
+      */
+    void _invalidate(size_t bucket)
+    {
+      for (size_t i = (n_buckets() + bucket) / 2; i != 0 and !stale[i]; i /= 2)
+      {
+        stale[i] = true;
+      }
+    }
+
+  protected:
+    bucket_digest buckets;
+
+    /**
+      @brief  Inner nodes, indexed from 1
+      */
+    mutable std::vector<uint64_t> nodes;
+
+    mutable std::vector<bool> stale;
+  };
+
+  /**
+    @brief  Find the buckets where a local digest and a remote one differ
+            Walks down both trees level by level, comparing only the
+            children of differing nodes, so that d differing buckets take
+            `depth() + 1` exchanges of at most 2d hashes each.
+    @param  local
+            Local digest
+    @param  remote
+            Called as `remote(level, indices)`, returns the remote digest's
+            `node(level, i)` for each index, e.g. by asking a standby. The
+            remote digest must have the same number of buckets.
+    @return Differing bucket indices, in increasing order
+    */
+  template <typename Remote_F>
+  std::vector<size_t> divergent_buckets(const merkle_digest& local, Remote_F&& remote)
+  {
+    std::vector<size_t> indices(1, 0);
+
+    for (size_t level = 0; ; level++)
+    {
+      std::vector<uint64_t> hashes = remote(level, static_cast<const std::vector<size_t>&>(indices));
+
+      std::vector<size_t> differing;
+
+      for (size_t i = 0; i < indices.size(); i++)
+      {
+        if (hashes.at(i) != local.node(level, indices[i]))
+        {
+          differing.push_back(indices[i]);
+        }
+      }
+
+      if (level == local.depth() or differing.empty())
+      {
+        return differing;
+      }
+
+      indices.clear();
+
+      for (size_t i : differing)
+      {
+        indices.push_back(2 * i);
+        indices.push_back(2 * i + 1);
+      }
+    }
+  }
+
+  /**
+    @brief  Keeps a `merkle_digest` of the rows of a polykey_map up to date
+            Rows are hashed as in `polykey_differ`, in their `row_codec`
+            encoding, and are updated on insertion, link, `modify<P>()` and
+            erasure.
+    @note   Changes made through `at<P>()` references or iterators are not
+            seen (see `polykey_map::observer`), and leave the digest stale.
+    @tparam Value_T
+            Type of the stored values. Must have a `xu::codec`.
+    @tparam Path_Ts
+            Each path's type (or path tag). Keys must have a `xu::codec`.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class merkle_observer : public polykey_map<Value_T, Path_Ts...>::observer
+  {
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using keyset_type = typename map_t::keyset_type;
+
+    using differ_t = polykey_differ<Value_T, Path_Ts...>;
+
+  public:
+    /**
+      @brief  Digest the rows of map, and follow its changes until
+              destruction
+      @param  n_buckets
+              Number of buckets. Replicas must use the same.
+      */
+    merkle_observer(map_t& map_, size_t n_buckets = merkle_digest::default_buckets)
+      : map(map_),
+        tree(n_buckets)
+    {
+      map.for_each_row([this](const keyset_type& keys, const Value_T& value)
+      {
+        _add(keys, value);
+      });
+
+      map.add_observer(this);
+    }
+
+    ~merkle_observer()
+    {
+      map.remove_observer(this);
+    }
+
+    merkle_observer(const merkle_observer& other) = delete;
+
+    merkle_observer& operator=(const merkle_observer& other) = delete;
+
+    const merkle_digest& digest() const
+    {
+      return tree;
+    }
+
+    /**
+      @brief  Returns the encoded rows of some buckets, e.g. those found by
+              `divergent_buckets()`
+              Decode them with `row_codec`, or match them by first key with
+              the other side's.
+      */
+    std::vector<std::string> bucket_rows(const std::vector<size_t>& buckets) const
+    {
+      std::vector<bool> wanted(tree.n_buckets());
+
+      for (size_t bucket : buckets)
+      {
+        wanted.at(bucket) = true;
+      }
+
+      std::vector<std::string> rows;
+      std::string key;
+
+      map.for_each_row([&](const keyset_type& keys, const Value_T& value)
+      {
+        if (wanted[tree.bucket(differ_t::hash_anchor(keys, key))])
+        {
+          rows.emplace_back();
+          row_codec<Value_T, Path_Ts...>::encode(keys, value, rows.back());
+        }
+      });
+
+      return rows;
+    }
+
+    void on_insert(const keyset_type& keys, const Value_T& value) override
+    {
+      _add(keys, value);
+    }
+
+    void on_link(const keyset_type& keys, size_t path, const Value_T& value) override
+    {
+      _remove(keyset_without_t{keys, path}, value);
+      _add(keys, value);
+    }
+
+    void on_modify(const keyset_type& keys, const Value_T& old_value, const Value_T& value) override
+    {
+      _remove(keys, old_value);
+      _add(keys, value);
+    }
+
+    void on_erase(const keyset_type& keys, const Value_T& value) override
+    {
+      _remove(keys, value);
+    }
+
+  protected:
+    /**
+      @brief  A keyset minus one of its keys, i.e. as it was before a link
+      */
+    struct keyset_without_t
+    {
+      template <size_t P>
+      bool has_value() const
+      {
+        return P != path and keys.template has_value<P>();
+      }
+
+      template <size_t P>
+      decltype(auto) get() const
+      {
+        return keys.template get<P>();
+      }
+
+      const keyset_type& keys;
+
+      size_t path;
+    };
+
+    template <typename Keyset_T>
+    void _add(const Keyset_T& keys, const Value_T& value)
+    {
+      std::pair<uint64_t, uint64_t> h = differ_t::hash_row(keys, value, scratch);
+      tree.add(h.first, h.second);
+    }
+
+    template <typename Keyset_T>
+    void _remove(const Keyset_T& keys, const Value_T& value)
+    {
+      std::pair<uint64_t, uint64_t> h = differ_t::hash_row(keys, value, scratch);
+      tree.remove(h.first, h.second);
+    }
+
+  protected:
+    map_t& map;
+
+    merkle_digest tree;
+
+    /**
+      @brief  Buffer reused for encoding rows
+      */
+    std::string scratch;
+  };
+}
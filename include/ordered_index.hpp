@@ -0,0 +1,346 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  template <typename Map_T, typename Key_F, typename Compare_T = std::less<>>
+  class ordered_index;
+
+  /**
+    @brief  Ordered, non-unique index over a projection of the values of a
+            polykey_map, kept up to date as an observer
+            Rows are ordered by `key(value)`, then by insertion order, e.g.
+            by (symbol, price, time) for a price-time priority book. Each
+            insertion and erasure adds or removes one entry, and
+            `modify<P>()` moves the row's entry only if its key changed, in
+            O(log n) without allocating.
+            Entries reference the rows stored in the map, so reading through
+            the index costs no lookup in the map.
+    @note   Changes made through `at<P>()` references or iterators are not
+            seen (see `polykey_map::observer`): a row whose key changed that
+            way is left out of order, and the index must not be used again.
+            Iterators are invalidated when their row is erased or moved by
+            `modify<P>()`.
+    @tparam Key_F
+            Called as `key(value)`, returns the key to order a value by
+    @tparam Compare_T
+            Strict weak ordering of keys
+    */
+  template <typename Value_T, typename ...Path_Ts, typename Key_F, typename Compare_T>
+  class ordered_index<polykey_map<Value_T, Path_Ts...>, Key_F, Compare_T> : public polykey_map<Value_T, Path_Ts...>::observer
+  {
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using keyset_type = typename map_t::keyset_type;
+
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
+
+    using key_type = std::decay_t<std::invoke_result_t<Key_F&, const Value_T&>>;
+
+  protected:
+    using intermediate_key_t = decltype(std::declval<const keyset_type&>().get_ink());
+
+    /**
+      @brief  Entry of a row, pointing into the map
+      */
+    struct entry_t
+    {
+      key_type key;
+
+      intermediate_key_t ink;
+
+      const keyset_type* keys;
+
+      const Value_T* value;
+    };
+
+    /**
+      @brief  Orders entries by key, then by ink, i.e. insertion order
+      */
+    struct entry_less
+    {
+      bool operator()(const entry_t& a, const entry_t& b) const
+      {
+        if (comp(a.key, b.key))
+        {
+          return true;
+        }
+
+        return !comp(b.key, a.key) and a.ink < b.ink;
+      }
+
+      Compare_T comp;
+    };
+
+    using entry_set = std::set<entry_t, entry_less>;
+
+  public:
+    /**
+      @brief  Iterator over the rows in key order
+      */
+    class const_iterator
+    {
+      friend class ordered_index;
+
+    public:
+      using iterator_category = std::bidirectional_iterator_tag;
+
+      using value_type = Value_T;
+
+      using difference_type = std::ptrdiff_t;
+
+      using pointer = const Value_T*;
+
+      using reference = const Value_T&;
+
+      const_iterator& operator++()
+      {
+        ++underlying;
+        return *this;
+      }
+
+      const_iterator operator++(int)
+      {
+        const_iterator res = *this;
+        operator++();
+        return res;
+      }
+
+      const_iterator& operator--()
+      {
+        --underlying;
+        return *this;
+      }
+
+      const_iterator operator--(int)
+      {
+        const_iterator res = *this;
+        operator--();
+        return res;
+      }
+
+      bool operator==(const const_iterator& other) const
+      {
+        return underlying == other.underlying;
+      }
+
+      bool operator!=(const const_iterator& other) const
+      {
+        return underlying != other.underlying;
+      }
+
+      const Value_T& operator*() const
+      {
+        return *underlying->value;
+      }
+
+      const Value_T* operator->() const
+      {
+        return underlying->value;
+      }
+
+      /**
+        @brief  Return the index key of the row
+        */
+      const key_type& key() const
+      {
+        return underlying->key;
+      }
+
+      /**
+        @brief  Check if the row has a key for path
+        @tparam P
+                Path index
+        */
+      template <path_index_t P>
+      bool has_key() const
+      {
+        return underlying->keys->template has_value<P>();
+      }
+
+      /**
+        @brief  Return the row's key for path
+        @tparam P
+                Path index
+        */
+      template <path_index_t P>
+      const Path_T<P> get_key() const
+      {
+        return underlying->keys->template get<P>();
+      }
+
+    protected:
+      const_iterator(typename entry_set::const_iterator underlying_)
+        : underlying(underlying_)
+      {}
+
+      typename entry_set::const_iterator underlying;
+    };
+
+  public:
+    /**
+      @brief  Index the rows of map, and follow its changes until
+              destruction
+      */
+    ordered_index(map_t& map_, Key_F key_, Compare_T comp = Compare_T())
+      : map(map_),
+        key(std::move(key_)),
+        entries(entry_less{std::move(comp)})
+    {
+      map.for_each_row([this](const keyset_type& keys, const Value_T& value)
+      {
+        on_insert(keys, value);
+      });
+
+      map.add_observer(this);
+    }
+
+    ~ordered_index()
+    {
+      map.remove_observer(this);
+    }
+
+    ordered_index(const ordered_index& other) = delete;
+
+    ordered_index& operator=(const ordered_index& other) = delete;
+
+    size_t size() const
+    {
+      return entries.size();
+    }
+
+    bool empty() const
+    {
+      return entries.empty();
+    }
+
+    const_iterator begin() const
+    {
+      return const_iterator(entries.begin());
+    }
+
+    const_iterator end() const
+    {
+      return const_iterator(entries.end());
+    }
+
+    /**
+      @brief  Returns the first value in key order
+      @throw  std::out_of_range
+              If the index is empty
+      */
+    const Value_T& front() const
+    {
+      if (entries.empty())
+      {
+        throw std::out_of_range("ordered_index::front() : index is empty");
+      }
+
+      return *entries.begin()->value;
+    }
+
+    /**
+      @brief  Returns iterator to the first row whose key is not less than k
+      */
+    const_iterator lower_bound(const key_type& k) const
+    {
+      return const_iterator(entries.lower_bound(entry_t{k, 0, nullptr, nullptr}));
+    }
+
+    /**
+      @brief  Returns iterator to the first row whose key is greater than k
+      */
+    const_iterator upper_bound(const key_type& k) const
+    {
+      return const_iterator(entries.lower_bound(entry_t{k, std::numeric_limits<intermediate_key_t>::max(), nullptr, nullptr}));
+    }
+
+    void on_insert(const keyset_type& keys, const Value_T& value) override
+    {
+      entries.insert(entry_t{key(value), keys.get_ink(), &keys, &value});
+    }
+
+    void on_modify(const keyset_type& keys, const Value_T& old_value, const Value_T& value) override
+    {
+      key_type old_key = key(old_value);
+      key_type new_key = key(value);
+
+      const Compare_T& comp = entries.key_comp().comp;
+
+      if (!comp(old_key, new_key) and !comp(new_key, old_key))
+      {
+        return;
+      }
+
+      /* move the entry without reallocating it */
+      auto node = entries.extract(entry_t{std::move(old_key), keys.get_ink(), nullptr, nullptr});
+
+      node.value().key = std::move(new_key);
+
+      entries.insert(std::move(node));
+    }
+
+    void on_erase(const keyset_type& keys, const Value_T& value) override
+    {
+      entries.erase(entry_t{key(value), keys.get_ink(), nullptr, nullptr});
+    }
+
+  protected:
+    map_t& map;
+
+    Key_F key;
+
+    entry_set entries;
+  };
+
+  /**
+    @brief  Returns an ordered index of map by key(value), see
+            `ordered_index`
+    */
+  template <typename Map_T, typename Key_F, typename Compare_T = std::less<>>
+  ordered_index<Map_T, Key_F, Compare_T> order_by(Map_T& map, Key_F key, Compare_T comp = Compare_T())
+  {
+    return ordered_index<Map_T, Key_F, Compare_T>(map, std::move(key), std::move(comp));
+  }
+}
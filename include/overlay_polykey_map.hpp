@@ -0,0 +1,394 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+namespace xu
+{
+  /**
+    @brief  A polykey_map layered over a memory mapped snapshot
+            Opening the map only maps the snapshot, so it is available right
+            away regardless of its size. Reads of untouched rows are served
+            from the snapshot. Writes go to an in-memory delta map: modifying
+            a snapshot row first copies it into the delta ("promotes" it), and
+            erasing one records a tombstone. `flatten()` writes the merged
+            contents to a new snapshot in the background.
+    @note   A key exists either in the delta or in a live (not tombstoned)
+            snapshot row, never both.
+    @tparam Value_T
+            Type of the stored values. Must have a `xu::codec`.
+    @tparam Path_Ts
+            Each path's type (or path tag). Keys must have a `xu::codec`.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class overlay_polykey_map
+  {
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using snapshot_t = mapped_snapshot<Value_T, Path_Ts...>;
+
+    using row_index_t = typename snapshot_t::row_index_t;
+
+    using key_conflict_error = typename map_t::key_conflict_error;
+
+    /**
+      @brief  Keys of a snapshot row, decoded on access
+              Provides the same `has_value<P>()` and `get<P>()` interface as
+              the keysets of `polykey_map::for_each_row()`.
+      */
+    class base_keyset
+    {
+    public:
+      base_keyset(const snapshot_t& snapshot_, row_index_t row_)
+        : snapshot(snapshot_),
+          row(row_)
+      {}
+
+      template <path_index_t P>
+      bool has_value() const
+      {
+        return snapshot.template has_key<P>(row);
+      }
+
+      template <path_index_t P>
+      Path_T<P> get() const
+      {
+        return snapshot.template key<P>(row);
+      }
+
+    protected:
+      const snapshot_t& snapshot;
+
+      row_index_t row;
+    };
+
+  public:
+    /**
+      @brief  Open a snapshot file as the base of the map
+      */
+    explicit overlay_polykey_map(const std::string& path)
+      : base(std::make_shared<const snapshot_t>(path))
+    {}
+
+    /**
+      @brief  Use an already mapped snapshot as the base of the map
+              The snapshot may be shared by several maps.
+      */
+    explicit overlay_polykey_map(std::shared_ptr<const snapshot_t> base_)
+      : base(std::move(base_))
+    {}
+
+    //  =====
+    //  Reads
+    //  =====
+
+    /**
+      @brief  Returns number of rows
+      */
+    size_t size() const
+    {
+      return delta.size() + base->size() - tombstones.size();
+    }
+
+    /**
+      @brief  Returns number of rows copied or inserted into the delta
+      */
+    size_t delta_size() const
+    {
+      return delta.size();
+    }
+
+    /**
+      @brief  Returns number of snapshot rows shadowed by the delta or erased
+      */
+    size_t tombstone_count() const
+    {
+      return tombstones.size();
+    }
+
+    /**
+      @brief  Check whether key exists for a path
+      */
+    template <path_index_t P>
+    bool contains(const Path_T<P>& key) const
+    {
+      return delta.template contains<P>(key) or _base_find<P>(key).has_value();
+    }
+
+    /**
+      @brief  Get a copy of the value of a key, without promoting its row
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    template <path_index_t P>
+    Value_T get(const Path_T<P>& key) const
+    {
+      auto it = delta.template find<P>(key);
+
+      if (it != delta.cend())
+      {
+        return *it;
+      }
+
+      std::optional<row_index_t> row = _base_find<P>(key);
+
+      if (!row)
+      {
+        throw std::out_of_range("overlay_polykey_map::get() : key does not exist for path");
+      }
+
+      return base->value(*row);
+    }
+
+    /**
+      @brief  Call f on every row, with all of its keys
+      @param  f
+              Callable taking `(const keyset&, const Value_T&)`, where the
+              keyset provides `has_value<P>()` and `get<P>()`
+      */
+    template <typename F>
+    void for_each_row(F&& f) const
+    {
+      delta.for_each_row(f);
+
+      for (row_index_t row = 0; row < base->size(); row++)
+      {
+        if (tombstones.count(row) == 0)
+        {
+          f(base_keyset(*base, row), base->value(row));
+        }
+      }
+    }
+
+    //  ======
+    //  Writes
+    //  ======
+
+    /**
+      @brief  Get a modifiable reference to the value of a key
+              A snapshot row is promoted into the delta first.
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    template <path_index_t P>
+    Value_T& at(const Path_T<P>& key)
+    {
+      auto it = delta.template find<P>(key);
+
+      if (it != delta.end())
+      {
+        return *it;
+      }
+
+      std::optional<row_index_t> row = _base_find<P>(key);
+
+      if (!row)
+      {
+        throw std::out_of_range("overlay_polykey_map::at() : key does not exist for path");
+      }
+
+      _promote(*row);
+
+      return delta.template at<P>(key);
+    }
+
+    /**
+      @brief  Insert a new value
+      @throw  key_conflict_error
+              If key already exists for path
+      */
+    template <path_index_t P>
+    void insert(const Path_T<P>& key, const Value_T& value)
+    {
+      if (_base_find<P>(key))
+      {
+        throw key_conflict_error("overlay_polykey_map::insert() : key already exists for path");
+      }
+
+      delta.template insert<P>(key, value);
+    }
+
+    /**
+      @brief  Link two keys, promoting the snapshot row of the existing key
+      @throw  std::out_of_range
+              If neither key exists
+      @throw  key_conflict_error
+              If both keys exist
+      */
+    template <path_index_t P1, path_index_t P2>
+    void link(const Path_T<P1>& key1, const Path_T<P2>& key2)
+    {
+      bool has_key1 = contains<P1>(key1);
+      bool has_key2 = contains<P2>(key2);
+
+      if (!has_key1 and !has_key2)
+      {
+        throw std::out_of_range("overlay_polykey_map::link() : keys do not exist");
+      }
+
+      if (has_key1 and has_key2)
+      {
+        throw key_conflict_error("overlay_polykey_map::link() : both keys already exist");
+      }
+
+      std::optional<row_index_t> row = has_key1 ? _base_find<P1>(key1) : _base_find<P2>(key2);
+
+      if (row)
+      {
+        _promote(*row);
+      }
+
+      delta.template link<P1, P2>(key1, key2);
+    }
+
+    /**
+      @brief  Remove a value and all keys which point to it
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    template <path_index_t P>
+    void erase(const Path_T<P>& key)
+    {
+      if (delta.template contains<P>(key))
+      {
+        delta.template erase<P>(key);
+        return;
+      }
+
+      std::optional<row_index_t> row = _base_find<P>(key);
+
+      if (!row)
+      {
+        throw std::out_of_range("overlay_polykey_map::erase() : key does not exist for path");
+      }
+
+      tombstones.insert(*row);
+    }
+
+    //  ==========
+    //  Compaction
+    //  ==========
+
+    /**
+      @brief  Write the merged contents of the map to a new snapshot
+              The delta and tombstones are copied on the calling thread,
+              then the snapshot is written on a background thread, so the
+              map may keep being used meanwhile. Snapshot rows which were not
+              touched are copied as raw records without being decoded.
+      @param  path
+              Target file path. Must not be the path of the mapped base.
+      @return Future which becomes ready (or holds the write error) once
+              the snapshot is published
+      */
+    std::future<void> flatten(const std::string& path) const
+    {
+      return std::async(std::launch::async, [path, base = base, delta = delta, tombstones = tombstones]()
+      {
+        snapshot_writer<Value_T, Path_Ts...> writer(path);
+
+        delta.for_each_row([&writer](const auto& keys, const Value_T& value)
+        {
+          writer.add_row(keys, value);
+        });
+
+        for (row_index_t row = 0; row < base->size(); row++)
+        {
+          if (tombstones.count(row) == 0)
+          {
+            std::pair<const char*, size_t> rec = base->record(row);
+            writer.add_record(rec.first, rec.second);
+          }
+        }
+
+        writer.finish();
+      });
+    }
+
+  protected:
+    //  =======
+    //  Helpers
+    //  =======
+
+    /**
+      @brief  Find the live snapshot row of a key
+      */
+    template <path_index_t P>
+    std::optional<row_index_t> _base_find(const Path_T<P>& key) const
+    {
+      std::optional<row_index_t> row = base->template find<P>(key);
+
+      if (row and tombstones.count(*row) != 0)
+      {
+        return std::nullopt;
+      }
+
+      return row;
+    }
+
+    /**
+      @brief  Copy a snapshot row into the delta and shadow it
+      */
+    void _promote(row_index_t row)
+    {
+      base->insert_into(row, delta);
+      tombstones.insert(row);
+    }
+
+  protected:
+    //  ================
+    //  Member Variables
+    //  ================
+
+    std::shared_ptr<const snapshot_t> base;
+
+    map_t delta;
+
+    /**
+      @brief  Snapshot rows which were erased or promoted into the delta
+      */
+    std::unordered_set<row_index_t> tombstones;
+  };
+}
@@ -0,0 +1,128 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace xu
+{
+  /**
+    @brief  Run f(i) for every i in [0, n_tasks) on up to n_threads threads
+            The calling thread takes part, so `n_threads - 1` threads are
+            started. Tasks are handed out one at a time, so uneven tasks
+            balance out.
+    @param  n_tasks
+            Number of tasks
+    @param  n_threads
+            Maximum number of threads, 0 or 1 runs the tasks on the caller
+    @param  f
+            Callable taking the task index
+    @throw  The first exception thrown by a task, after all threads stopped.
+            Remaining tasks are skipped once a task has thrown.
+    */
+  template <typename F>
+  void parallel_for(size_t n_tasks, size_t n_threads, F&& f)
+  {
+    if (n_threads > n_tasks)
+    {
+      n_threads = n_tasks;
+    }
+
+    if (n_threads <= 1)
+    {
+      for (size_t i = 0; i < n_tasks; i++)
+      {
+        f(i);
+      }
+
+      return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto run = [&]()
+    {
+      size_t i;
+
+      while (!failed.load(std::memory_order_relaxed) and (i = next.fetch_add(1, std::memory_order_relaxed)) < n_tasks)
+      {
+        try
+        {
+          f(i);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(error_mutex);
+
+          if (!error)
+          {
+            error = std::current_exception();
+          }
+
+          failed.store(true, std::memory_order_relaxed);
+        }
+      }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads - 1);
+
+    for (size_t t = 1; t < n_threads; t++)
+    {
+      /* carry on with fewer threads if one cannot be started */
+      try
+      {
+        threads.emplace_back(run);
+      }
+      catch (const std::system_error&)
+      {
+        break;
+      }
+    }
+
+    run();
+
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+}
@@ -0,0 +1,1647 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "concurrent_index.hpp"
+#include "polykey_map.hpp"
+#include "spsc_ring.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Shared-nothing polykey_map partitioned across worker threads
+            Rows are partitioned by owner. Each partition is a private
+            polykey_map owned by one worker thread (optionally pinned to a
+            core), and all access to it happens on that thread:
+              - Clients are sessions (see `session`). Each session has its
+                own pair of SPSC rings to every partition: it sends requests
+                in batches over one, and receives one response per batch over
+                the other. Sessions used by different threads therefore
+                submit in parallel, and a worker serves the rings of all
+                sessions in turn. The container's own member functions use a
+                built-in session.
+              - A new row is owned by the partition its insertion key hashes
+                to. Keys linked later (e.g. an external id) are routed to the
+                owner of the row, wherever they would hash.
+              - Routing uses a directory per path, mapping each key to its
+                owning partition. It is shared by all sessions: writes are
+                serialized, reads are lock-free, and `partition_of<P>()` may
+                be called from any thread.
+            Mutations and lookups are queued and return a `result<R>`, which
+            behaves like a future whose `get()` first flushes the batch it was
+            queued in. Operations are stored in place in their batch, and
+            each records its outcome next to itself; the worker sends the
+            batch back as its response, so queuing an operation allocates
+            nothing and no memory is written by both threads at once.
+            An idle worker spins for `idle_spin`, then sleeps until a session
+            pushes a batch, so idle partitions do not hold a core.
+            Ordering:
+              - The operations of a session run in the order they were
+                queued, so a session always sees its own changes.
+              - Operations of different sessions are not ordered, except that
+                an operation queued after the `get()` of another operation's
+                result returned (the threads having synchronized) runs after
+                that operation.
+              - The directory is checked when an operation is queued, and
+                includes the keys of operations queued by every session. An
+                operation on a key whose insertion, queued by another
+                session, has not run yet fails through its result.
+              - Operations of different sessions which change the same row
+                must be ordered that way by the caller: the directory entries
+                of their keys could otherwise be removed or kept wrongly.
+            Misuse which can be detected from the directory (key conflicts,
+            unknown keys) is reported by throwing immediately, with the same
+            exception types as polykey_map. Erasing a row removes its linked
+            keys from the directory once the owning partition responds. Until
+            then, operations of the erasing session which would fail because
+            of such a key first wait for its outstanding erasures; other
+            sessions see the keys as present.
+    @note   A session, including the container's built-in one, must be used
+            by one thread at a time, and its results on that thread. Sessions
+            must be destroyed before the container.
+    @tparam Value_T
+            Type of the stored values. Should be copy constructible.
+    @tparam Path_Ts
+            Each path's type (or path tag), as for polykey_map
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class partitioned_polykey_map
+  {
+  public:
+    //  ========
+    //  Typedefs
+    //  ========
+
+    /**
+      @brief  Map type owned by each partition
+      */
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using key_conflict_error = typename map_t::key_conflict_error;
+
+    /**
+      @brief  Index of a partition
+      */
+    using partition_index_t = size_t;
+
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_Tag_T = typename std::tuple_element<P, std::tuple<Path_Ts...>>::type;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<Path_Tag_T<P>>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+    /**
+      @brief  Operation sequence number, shared by all sessions
+              Used to tell directory entries apart from later ones for the
+              same key
+      */
+    using stamp_t = unsigned long long;
+
+    /**
+      @brief  Directory entry
+      */
+    struct route_t
+    {
+      partition_index_t partition;
+
+      stamp_t stamp;
+    };
+
+    /**
+      @brief  Outcome of a queued operation, stored next to it in its batch
+      */
+    template <typename R>
+    struct outcome_t
+    {
+      using stored_type = std::conditional_t<std::is_void<R>::value, bool, R>;
+
+      std::optional<stored_type> value;
+
+      std::exception_ptr error;
+    };
+
+    /**
+      @brief  A queued operation and its outcome
+      */
+    template <typename R, typename Op>
+    struct queued_op_t
+    {
+      outcome_t<R> outcome;
+
+      Op op;
+    };
+
+    /**
+      @brief  Batch of operations, sent to a worker in one ring message and
+              sent back as its response
+              Operations are constructed in place in blocks owned by the
+              batch, which never move, so that results can point to their
+              outcomes. A batch with `stop` set terminates the worker.
+      */
+    struct batch_t
+    {
+      /**
+        @brief  Type-erased operation, called as `run(op, map, batch)`
+        */
+      struct entry_t
+      {
+        void (*run)(void*, map_t&, batch_t&);
+
+        void (*destroy)(void*);
+
+        void* op;
+      };
+
+      static constexpr size_t block_units = 4096 / sizeof(std::max_align_t);
+
+      std::vector<entry_t> ops;
+
+      std::vector<std::unique_ptr<std::max_align_t[]>> blocks;
+
+      /**
+        @brief  Units of the last block in use
+        */
+      size_t block_used = block_units;
+
+      bool stop = false;
+
+      /**
+        @brief  Keys to remove from the directory, if their entry is not
+                newer than the stamp (written by the worker)
+        */
+      std::tuple<std::vector<std::pair<path_key_t<Path_Ts>, stamp_t>>...> unroute;
+
+      /**
+        @brief  Number of erasures processed in the batch (written by the
+                worker)
+        */
+      size_t n_erases = 0;
+
+      /**
+        @brief  State only touched by the session's thread, on its own cache
+                line since results may be dropped while the worker runs
+        */
+      struct alignas(64) client_t
+      {
+        /**
+          @brief  Number of results which still refer to the batch
+          */
+        size_t n_results = 0;
+
+        /**
+          @brief  Whether the response was received
+          */
+        bool answered = false;
+
+        /**
+          @brief  Position in the session's `retained`, once answered
+          */
+        size_t retained_index = 0;
+
+        /**
+          @brief  Whether the session was closed, leaving the batch to its
+                  remaining results
+          */
+        bool orphaned = false;
+      } client;
+
+      explicit batch_t(size_t capacity)
+      {
+        ops.reserve(capacity);
+      }
+
+      ~batch_t()
+      {
+        for (entry_t& entry : ops)
+        {
+          entry.destroy(entry.op);
+        }
+      }
+
+      batch_t(const batch_t& other) = delete;
+
+      batch_t& operator=(const batch_t& other) = delete;
+
+      /**
+        @brief  Construct a T in the batch's blocks
+        */
+      template <typename T>
+      T* emplace(T&& value)
+      {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "partitioned_polykey_map : over-aligned operation");
+
+        size_t units = (sizeof(T) + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+
+        if (block_used + units > block_units)
+        {
+          blocks.emplace_back(new std::max_align_t[std::max(units, block_units)]);
+          block_used = 0;
+        }
+
+        void* p = blocks.back().get() + block_used;
+        block_used += units;
+
+        return new (p) T(std::move(value));
+      }
+    };
+
+    /**
+      @brief  A session's rings to a partition
+      */
+    struct channel_t
+    {
+      spsc_ring<batch_t*> requests;
+
+      spsc_ring<batch_t*> responses;
+
+      explicit channel_t(size_t ring_capacity)
+        : requests(ring_capacity),
+          responses(ring_capacity)
+      {}
+    };
+
+    /**
+      @brief  State of a session for a partition, only touched by the
+              session's thread
+      */
+    struct alignas(64) client_state_t
+    {
+      /**
+        @brief  Batch being filled
+        */
+      std::unique_ptr<batch_t> pending;
+
+      /**
+        @brief  Number of batches sent and not yet answered
+        */
+      size_t in_flight = 0;
+
+      /**
+        @brief  Number of erasures sent and not yet answered
+        */
+      size_t pending_erases = 0;
+    };
+
+    /**
+      @brief  Lets an idle worker sleep until a session pushes a batch
+      */
+    struct alignas(64) park_t
+    {
+      std::mutex mutex;
+
+      std::condition_variable cv;
+
+      std::atomic<bool> parked{false};
+    };
+
+    /**
+      @brief  A partition: private map, channels and worker thread
+      */
+    struct partition_t
+    {
+      /**
+        @brief  Owned by the worker thread
+        */
+      alignas(64) map_t map;
+
+      /**
+        @brief  One per session slot
+        */
+      std::vector<std::unique_ptr<channel_t>> channels;
+
+      park_t park;
+
+      std::thread worker;
+
+      explicit partition_t(size_t n_channels)
+      {
+        for (size_t i = 0; i < n_channels; i++)
+        {
+          channels.emplace_back(new channel_t(ring_capacity));
+        }
+      }
+    };
+
+  public:
+    class session;
+
+    //  ======
+    //  Result
+    //  ======
+
+    /**
+      @brief  Result of a queued operation
+      @tparam R
+              Result type
+      */
+    template <typename R>
+    class result
+    {
+      friend session;
+
+    protected:
+      using stored_type = typename outcome_t<R>::stored_type;
+
+      session* owner;
+
+      partition_index_t partition;
+
+      /**
+        @brief  Batch holding the operation, null once the result was taken
+                or if it was known without queuing
+        */
+      batch_t* batch;
+
+      outcome_t<R>* outcome;
+
+      /**
+        @brief  Result known without queuing
+        */
+      std::optional<stored_type> immediate;
+
+      result(session* owner_, partition_index_t partition_, batch_t* batch_, outcome_t<R>* outcome_)
+        : owner(owner_),
+          partition(partition_),
+          batch(batch_),
+          outcome(outcome_)
+      {}
+
+      explicit result(stored_type value)
+        : owner(nullptr),
+          partition(0),
+          batch(nullptr),
+          outcome(nullptr),
+          immediate(std::move(value))
+      {}
+
+      void _release()
+      {
+        if (batch == nullptr)
+        {
+          return;
+        }
+
+        /* the session is gone: the last result frees the batch */
+        if (batch->client.orphaned)
+        {
+          if (--batch->client.n_results == 0)
+          {
+            delete batch;
+          }
+        }
+        else
+        {
+          owner->_release(*batch);
+        }
+
+        batch = nullptr;
+      }
+
+    public:
+      result(result&& other)
+        : owner(other.owner),
+          partition(other.partition),
+          batch(other.batch),
+          outcome(other.outcome),
+          immediate(std::move(other.immediate))
+      {
+        other.batch = nullptr;
+      }
+
+      result& operator=(result&& other)
+      {
+        if (this != &other)
+        {
+          _release();
+
+          owner = other.owner;
+          partition = other.partition;
+          batch = other.batch;
+          outcome = other.outcome;
+          immediate = std::move(other.immediate);
+
+          other.batch = nullptr;
+        }
+
+        return *this;
+      }
+
+      ~result()
+      {
+        _release();
+      }
+
+      result(const result& other) = delete;
+
+      result& operator=(const result& other) = delete;
+
+      /**
+        @brief  Flush the batch holding the operation and wait for the result
+                May be called once, also after the session was closed.
+        @throw  Whatever the operation threw on the partition
+        */
+      R get()
+      {
+        if (batch != nullptr)
+        {
+          if (!batch->client.answered)
+          {
+            owner->_wait(partition, *batch);
+          }
+
+          std::exception_ptr error = outcome->error;
+          immediate = std::move(outcome->value);
+
+          _release();
+
+          if (error)
+          {
+            std::rethrow_exception(error);
+          }
+        }
+
+        if constexpr (!std::is_void<R>::value)
+        {
+          return std::move(*immediate);
+        }
+      }
+
+      /**
+        @brief  Check whether the result is available without waiting
+                Applies the responses received so far, but does not flush.
+        */
+      bool ready()
+      {
+        if (batch == nullptr or batch->client.answered)
+        {
+          return true;
+        }
+
+        owner->_drain();
+
+        return batch->client.answered;
+      }
+    };
+
+    //  =======
+    //  Session
+    //  =======
+
+    /**
+      @brief  Client of a partitioned_polykey_map, used by one thread at a
+              time
+              Each session sends its batches over its own rings, so that
+              threads with a session each submit in parallel. See the
+              container's documentation for the ordering of operations.
+      */
+    class session
+    {
+      friend partitioned_polykey_map;
+
+      template <typename R>
+      friend class result;
+
+    public:
+      /**
+        @brief  Open a session on a container
+        @throw  std::length_error
+                If the container's `max_sessions` sessions are open
+        */
+      explicit session(partitioned_polykey_map& pm_)
+        : pm(pm_),
+          channel(pm_._claim_channel()),
+          clients(pm_.partitions.size())
+      {
+        for (client_state_t& client : clients)
+        {
+          client.pending.reset(new batch_t(pm.batch_size));
+        }
+      }
+
+      /**
+        @brief  Complete the session's queued operations and close it
+                Results still alive remain readable with `get()`.
+        */
+      ~session()
+      {
+        sync();
+
+        for (batch_t* batch : retained)
+        {
+          batch->client.orphaned = true;
+        }
+
+        pm._release_channel(channel);
+      }
+
+      session(const session& other) = delete;
+
+      session& operator=(const session& other) = delete;
+
+      /**
+        @brief  Returns total number of stored values
+                Counted by each partition after the session's queued
+                operations
+        */
+      size_t size()
+      {
+        std::vector<result<size_t>> sizes;
+
+        for (partition_index_t i = 0; i < clients.size(); i++)
+        {
+          sizes.push_back(_submit<size_t>(i, [](map_t& map, batch_t&)
+          {
+            return map.size();
+          }));
+        }
+
+        flush();
+
+        size_t res = 0;
+
+        for (auto& size : sizes)
+        {
+          res += size.get();
+        }
+
+        return res;
+      }
+
+      /**
+        @brief  Insert a new value, owned by the partition key hashes to
+        @throw  key_conflict_error
+                If key already exists for path
+        */
+      template <path_index_t P>
+      result<void> insert(const Path_T<P>& key, const Value_T& value)
+      {
+        static_assert(P < N_Paths);
+
+        partition_index_t partition = pm.template _home<P>(key);
+        std::optional<stamp_t> stamp;
+
+        if (!_routed<P>(key))
+        {
+          stamp = _route<P>(key, partition);
+        }
+
+        if (!stamp)
+        {
+          throw key_conflict_error("partitioned_polykey_map::insert() : key already exists for path");
+        }
+
+        return _submit<void>(partition, [key, value, stamp = *stamp](map_t& map, batch_t& batch)
+        {
+          try
+          {
+            map.template insert<P>(key, value);
+          }
+          catch (...)
+          {
+            std::get<P>(batch.unroute).emplace_back(key, stamp);
+            throw;
+          }
+        });
+      }
+
+      /**
+        @brief  Link two keys so they point to the same value
+                The operation is sent to the partition owning the existing key
+        @throw  key_conflict_error
+                If both keys already exist
+        @throw  std::out_of_range
+                If neither key exists
+        */
+      template <path_index_t P1, path_index_t P2>
+      result<void> link(const Path_T<P1>& key1, const Path_T<P2>& key2)
+      {
+        static_assert(P1 < N_Paths);
+        static_assert(P2 < N_Paths);
+        static_assert(P1 != P2);
+
+        std::optional<route_t> route1 = std::get<P1>(pm.directory).get(key1);
+        std::optional<route_t> route2 = std::get<P2>(pm.directory).get(key2);
+
+        /* one of the keys may belong to a row whose erasure is in flight */
+        if (route1 and route2 and _settle())
+        {
+          route1 = std::get<P1>(pm.directory).get(key1);
+          route2 = std::get<P2>(pm.directory).get(key2);
+        }
+
+        if (!route1 and !route2)
+        {
+          throw std::out_of_range("partitioned_polykey_map::link() : keys do not exist");
+        }
+
+        if (route1 and route2)
+        {
+          throw key_conflict_error("partitioned_polykey_map::link() : both keys already exist");
+        }
+
+        if (route1)
+        {
+          std::optional<stamp_t> stamp = _route<P2>(key2, route1->partition);
+
+          if (!stamp)
+          {
+            throw key_conflict_error("partitioned_polykey_map::link() : both keys already exist");
+          }
+
+          return _submit<void>(route1->partition, [key1, key2, stamp = *stamp](map_t& map, batch_t& batch)
+          {
+            try
+            {
+              map.template link<P1, P2>(key1, key2);
+            }
+            catch (...)
+            {
+              std::get<P2>(batch.unroute).emplace_back(key2, stamp);
+              throw;
+            }
+          });
+        }
+        else
+        {
+          std::optional<stamp_t> stamp = _route<P1>(key1, route2->partition);
+
+          if (!stamp)
+          {
+            throw key_conflict_error("partitioned_polykey_map::link() : both keys already exist");
+          }
+
+          return _submit<void>(route2->partition, [key1, key2, stamp = *stamp](map_t& map, batch_t& batch)
+          {
+            try
+            {
+              map.template link<P1, P2>(key1, key2);
+            }
+            catch (...)
+            {
+              std::get<P1>(batch.unroute).emplace_back(key1, stamp);
+              throw;
+            }
+          });
+        }
+      }
+
+      /**
+        @brief  Check whether a value exists for the given key
+                Answered from the directory, waiting for the session's
+                outstanding erasures only if the key is routed
+        */
+      template <path_index_t P>
+      bool contains(const Path_T<P>& key)
+      {
+        static_assert(P < N_Paths);
+
+        return _routed<P>(key);
+      }
+
+      /**
+        @brief  Remove a value and all keys which point to it
+        @throw  std::out_of_range
+                If key does not exist
+        */
+      template <path_index_t P>
+      result<void> erase(const Path_T<P>& key)
+      {
+        static_assert(P < N_Paths);
+
+        std::optional<route_t> route;
+
+        /* take the entry being removed, since another session may change
+           the key at the same time */
+        std::get<P>(pm.directory).erase_if(key, [&route](const route_t& entry)
+        {
+          route = entry;
+          return true;
+        });
+
+        if (!route)
+        {
+          throw std::out_of_range("partitioned_polykey_map::erase() : key does not exist for path");
+        }
+
+        stamp_t stamp = pm.next_stamp.fetch_add(1, std::memory_order_relaxed);
+
+        clients[route->partition].pending_erases++;
+
+        return _submit<void>(route->partition, [key, stamp](map_t& map, batch_t& batch)
+        {
+          batch.n_erases++;
+
+          /* report the row's other keys so that the session can unroute them */
+          _collect_linked<P>(map, key, stamp, batch);
+
+          map.template erase<P>(key);
+        });
+      }
+
+      /**
+        @brief  Retrieve a copy of a value
+        @throw  std::out_of_range
+                If key does not exist (thrown immediately if the key is not
+                routed, otherwise through the result)
+        */
+      template <path_index_t P>
+      result<Value_T> at(const Path_T<P>& key)
+      {
+        static_assert(P < N_Paths);
+
+        std::optional<route_t> route = std::get<P>(pm.directory).get(key);
+
+        if (!route)
+        {
+          throw std::out_of_range("partitioned_polykey_map::at() : key does not exist for path");
+        }
+
+        return _submit<Value_T>(route->partition, [key](map_t& map, batch_t&)
+        {
+          return map.template at<P>(key);
+        });
+      }
+
+      /**
+        @brief  Retrieve a copy of a value, if it exists
+        */
+      template <path_index_t P>
+      result<std::optional<Value_T>> find(const Path_T<P>& key)
+      {
+        static_assert(P < N_Paths);
+
+        std::optional<route_t> route = std::get<P>(pm.directory).get(key);
+
+        if (!route)
+        {
+          return result<std::optional<Value_T>>(std::optional<Value_T>());
+        }
+
+        return _submit<std::optional<Value_T>>(route->partition, [key](map_t& map, batch_t&)
+        {
+          if (!map.template contains<P>(key))
+          {
+            return std::optional<Value_T>();
+          }
+
+          return std::optional<Value_T>(map.template at<P>(key));
+        });
+      }
+
+      /**
+        @brief  Run f on a value on the thread owning it
+                f may modify the value. A copy of its return value is passed
+                back through the result.
+        @param  f
+                Callable taking `Value_T&`. Copied to the owning thread.
+        @throw  std::out_of_range
+                If key does not exist
+        */
+      template <path_index_t P, typename F>
+      result<std::decay_t<std::invoke_result_t<F, Value_T&>>> visit(const Path_T<P>& key, F f)
+      {
+        static_assert(P < N_Paths);
+
+        std::optional<route_t> route = std::get<P>(pm.directory).get(key);
+
+        if (!route)
+        {
+          throw std::out_of_range("partitioned_polykey_map::visit() : key does not exist for path");
+        }
+
+        return _submit<std::decay_t<std::invoke_result_t<F, Value_T&>>>(route->partition, [key, f](map_t& map, batch_t&) mutable
+        {
+          return f(map.template at<P>(key));
+        });
+      }
+
+      /**
+        @brief  Send the batch being filled for every partition
+        */
+      void flush()
+      {
+        for (partition_index_t i = 0; i < clients.size(); i++)
+        {
+          _flush(i);
+        }
+
+        _drain();
+      }
+
+      /**
+        @brief  Send all batches and wait until every partition has answered
+        */
+      void sync()
+      {
+        flush();
+
+        while (_in_flight() != 0)
+        {
+          _drain();
+          std::this_thread::yield();
+        }
+      }
+
+    protected:
+      /**
+        @brief  Add a directory entry, unless key is routed
+        @return Stamp of the entry, or nothing if key is routed
+        */
+      template <path_index_t P>
+      std::optional<stamp_t> _route(const Path_T<P>& key, partition_index_t partition)
+      {
+        stamp_t stamp = pm.next_stamp.fetch_add(1, std::memory_order_relaxed);
+
+        if (!std::get<P>(pm.directory).insert(std::make_pair(key, route_t{partition, stamp})).second)
+        {
+          return std::nullopt;
+        }
+
+        return stamp;
+      }
+
+      /**
+        @brief  Check whether key is routed, waiting for the session's
+                outstanding erasures if it is
+        */
+      template <path_index_t P>
+      bool _routed(const Path_T<P>& key)
+      {
+        if (!std::get<P>(pm.directory).contains(key))
+        {
+          return false;
+        }
+
+        if (_settle())
+        {
+          return std::get<P>(pm.directory).contains(key);
+        }
+
+        return true;
+      }
+
+      /**
+        @brief  Wait for the session's outstanding erasures
+        @return Whether there were any
+        */
+      bool _settle()
+      {
+        bool any = false;
+
+        for (partition_index_t i = 0; i < clients.size(); i++)
+        {
+          if (clients[i].pending_erases != 0)
+          {
+            _flush(i);
+            any = true;
+          }
+        }
+
+        if (!any)
+        {
+          return false;
+        }
+
+        while (_pending_erases() != 0)
+        {
+          _drain();
+          std::this_thread::yield();
+        }
+
+        return true;
+      }
+
+      /**
+        @brief  Queue an operation
+        @param  op
+                Callable taking `(map_t&, batch_t&)` and returning R
+        */
+      template <typename R, typename Op>
+      result<R> _submit(partition_index_t partition, Op op)
+      {
+        using queued_t = queued_op_t<R, Op>;
+
+        batch_t& pending = *clients[partition].pending;
+
+        queued_t* queued = pending.emplace(queued_t{outcome_t<R>(), std::move(op)});
+
+        pending.ops.push_back(typename batch_t::entry_t{&_run_op<R, Op>, &_destroy_op<queued_t>, queued});
+        pending.client.n_results++;
+
+        result<R> res(this, partition, &pending, &queued->outcome);
+
+        if (pending.ops.size() >= pm.batch_size)
+        {
+          _flush(partition);
+        }
+
+        return res;
+      }
+
+      /**
+        @brief  Send the batch being filled for a partition
+        */
+      void _flush(partition_index_t partition)
+      {
+        client_state_t& client = clients[partition];
+
+        if (client.pending->ops.empty())
+        {
+          return;
+        }
+
+        _push(partition, client.pending.release());
+
+        client.pending.reset(new batch_t(pm.batch_size));
+        client.in_flight++;
+      }
+
+      /**
+        @brief  Push a batch, draining responses while the ring is full, and
+                wake the worker if it sleeps
+        */
+      void _push(partition_index_t partition, batch_t* batch)
+      {
+        partition_t& part = *pm.partitions[partition];
+
+        while (!part.channels[channel]->requests.try_push(batch))
+        {
+          _drain();
+          std::this_thread::yield();
+        }
+
+        _wake(part);
+      }
+
+      /**
+        @brief  Apply all available responses
+                Batches whose results are all gone are freed, the others are
+                retained until they are.
+        */
+      void _drain()
+      {
+        for (partition_index_t i = 0; i < clients.size(); i++)
+        {
+          spsc_ring<batch_t*>& responses = pm.partitions[i]->channels[channel]->responses;
+          batch_t* batch;
+
+          while (responses.try_pop(batch))
+          {
+            _unroute(*batch);
+
+            clients[i].pending_erases -= batch->n_erases;
+            clients[i].in_flight--;
+
+            batch->client.answered = true;
+
+            if (batch->client.n_results == 0)
+            {
+              delete batch;
+            }
+            else
+            {
+              batch->client.retained_index = retained.size();
+              retained.push_back(batch);
+            }
+          }
+        }
+      }
+
+      /**
+        @brief  A result referring to batch was taken or destroyed
+        */
+      void _release(batch_t& batch)
+      {
+        if (--batch.client.n_results != 0 or !batch.client.answered)
+        {
+          return;
+        }
+
+        batch_t* last = retained.back();
+
+        retained[batch.client.retained_index] = last;
+        last->client.retained_index = batch.client.retained_index;
+        retained.pop_back();
+
+        delete &batch;
+      }
+
+      /**
+        @brief  Remove directory entries reported by an answered batch
+        */
+      template <path_index_t Q = 0>
+      inline typename std::enable_if<Q != N_Paths, void>::type _unroute(const batch_t& batch)
+      {
+        static_assert(Q < N_Paths);
+
+        for (auto& it : std::get<Q>(batch.unroute))
+        {
+          /* keep entries added after the operation which removed the key */
+          std::get<Q>(pm.directory).erase_if(it.first, [&it](const route_t& route)
+          {
+            return route.stamp <= it.second;
+          });
+        }
+
+        _unroute<Q + 1>(batch);
+      }
+
+      template <path_index_t Q = 0>
+      inline typename std::enable_if<Q == N_Paths, void>::type _unroute(const batch_t&)
+      {}
+
+      /**
+        @brief  Wait until a batch is answered, flushing it if it is still
+                being filled
+        */
+      void _wait(partition_index_t partition, batch_t& batch)
+      {
+        if (batch.client.answered)
+        {
+          return;
+        }
+
+        if (&batch == clients[partition].pending.get())
+        {
+          _flush(partition);
+        }
+
+        while (!batch.client.answered)
+        {
+          _drain();
+          std::this_thread::yield();
+        }
+      }
+
+      size_t _in_flight() const
+      {
+        size_t res = 0;
+
+        for (const client_state_t& client : clients)
+        {
+          res += client.in_flight;
+        }
+
+        return res;
+      }
+
+      size_t _pending_erases() const
+      {
+        size_t res = 0;
+
+        for (const client_state_t& client : clients)
+        {
+          res += client.pending_erases;
+        }
+
+        return res;
+      }
+
+    protected:
+      partitioned_polykey_map& pm;
+
+      /**
+        @brief  Index of the session's channel in every partition
+        */
+      const size_t channel;
+
+      std::vector<client_state_t> clients;
+
+      /**
+        @brief  Answered batches which results still refer to
+        */
+      std::vector<batch_t*> retained;
+    };
+
+  public:
+    //  ======================
+    //  Constructor/Destructor
+    //  ======================
+
+    /**
+      @brief  Start one worker thread per partition
+      @param  n_partitions
+              Number of partitions (worker threads)
+      @param  batch_size_
+              Number of operations after which a batch is sent without an
+              explicit `flush()`
+      @param  pin_threads
+              Pin worker i to core i (modulo the number of cores)
+      @param  max_sessions
+              Number of sessions which may be open at once, besides the
+              container's built-in one
+      */
+    explicit partitioned_polykey_map(size_t n_partitions, size_t batch_size_ = 64, bool pin_threads = false, size_t max_sessions = 8)
+      : batch_size(batch_size_),
+        next_stamp(0),
+        n_channels(max_sessions + 1),
+        channel_used(new std::atomic<bool>[max_sessions + 1])
+      {
+      for (size_t i = 0; i < n_channels; i++)
+      {
+        channel_used[i].store(false, std::memory_order_relaxed);
+      }
+
+      for (partition_index_t i = 0; i < n_partitions; i++)
+      {
+        partitions.emplace_back(new partition_t(n_channels));
+      }
+
+      for (partition_index_t i = 0; i < n_partitions; i++)
+      {
+        partition_t* part = partitions[i].get();
+
+        part->worker = std::thread([part]()
+        {
+          _run_worker(*part);
+        });
+
+        if (pin_threads)
+        {
+          _pin(part->worker, i);
+        }
+      }
+
+      own.reset(new session(*this));
+    }
+
+    /**
+      @brief  Complete the built-in session's operations and stop the workers
+              Results still alive remain readable with `get()`.
+      */
+    ~partitioned_polykey_map()
+    {
+      own.reset();
+
+      for (auto& part : partitions)
+      {
+        batch_t* stop = new batch_t(0);
+        stop->stop = true;
+
+        while (!part->channels[0]->requests.try_push(stop))
+        {
+          std::this_thread::yield();
+        }
+
+        _wake(*part);
+      }
+
+      for (auto& part : partitions)
+      {
+        part->worker.join();
+      }
+    }
+
+    partitioned_polykey_map(const partitioned_polykey_map& other) = delete;
+
+    partitioned_polykey_map& operator=(const partitioned_polykey_map& other) = delete;
+
+    //  ==================
+    //  Container Behavior
+    //  ==================
+
+    /**
+      @brief  Returns number of partitions
+      */
+    size_t n_partitions() const
+    {
+      return partitions.size();
+    }
+
+    /**
+      @brief  Returns the partition owning a key, if the key is routed
+      @note   Safe to call from any thread. May briefly include keys of rows
+              whose erasure has not been answered yet.
+      */
+    template <path_index_t P>
+    std::optional<partition_index_t> partition_of(const Path_T<P>& key) const
+    {
+      std::optional<route_t> route = std::get<P>(directory).get(key);
+
+      if (!route)
+      {
+        return std::nullopt;
+      }
+
+      return route->partition;
+    }
+
+    /**
+      @brief  Returns total number of stored values, see `session::size()`
+      */
+    size_t size()
+    {
+      return own->size();
+    }
+
+    /**
+      @brief  Insert a new value, see `session::insert()`
+      */
+    template <path_index_t P>
+    result<void> insert(const Path_T<P>& key, const Value_T& value)
+    {
+      return own->template insert<P>(key, value);
+    }
+
+    /**
+      @brief  Link two keys so they point to the same value, see
+              `session::link()`
+      */
+    template <path_index_t P1, path_index_t P2>
+    result<void> link(const Path_T<P1>& key1, const Path_T<P2>& key2)
+    {
+      return own->template link<P1, P2>(key1, key2);
+    }
+
+    /**
+      @brief  Check whether a value exists for the given key, see
+              `session::contains()`
+      */
+    template <path_index_t P>
+    bool contains(const Path_T<P>& key)
+    {
+      return own->template contains<P>(key);
+    }
+
+    /**
+      @brief  Remove a value and all keys which point to it, see
+              `session::erase()`
+      */
+    template <path_index_t P>
+    result<void> erase(const Path_T<P>& key)
+    {
+      return own->template erase<P>(key);
+    }
+
+    /**
+      @brief  Retrieve a copy of a value, see `session::at()`
+      */
+    template <path_index_t P>
+    result<Value_T> at(const Path_T<P>& key)
+    {
+      return own->template at<P>(key);
+    }
+
+    /**
+      @brief  Retrieve a copy of a value, if it exists, see `session::find()`
+      */
+    template <path_index_t P>
+    result<std::optional<Value_T>> find(const Path_T<P>& key)
+    {
+      return own->template find<P>(key);
+    }
+
+    /**
+      @brief  Run f on a value on the thread owning it, see `session::visit()`
+      */
+    template <path_index_t P, typename F>
+    result<std::decay_t<std::invoke_result_t<F, Value_T&>>> visit(const Path_T<P>& key, F f)
+    {
+      return own->template visit<P>(key, std::move(f));
+    }
+
+    //  ========
+    //  Batching
+    //  ========
+
+    /**
+      @brief  Send the built-in session's batches, see `session::flush()`
+      */
+    void flush()
+    {
+      own->flush();
+    }
+
+    /**
+      @brief  Send the built-in session's batches and wait for their
+              answers, see `session::sync()`
+      */
+    void sync()
+    {
+      own->sync();
+    }
+
+  protected:
+    //  ===========
+    //  Worker Side
+    //  ===========
+
+    static void _run_worker(partition_t& part)
+    {
+      size_t next = 0;
+
+      while (true)
+      {
+        channel_t* channel;
+        batch_t* batch = _next_batch(part, next, channel);
+
+        if (batch->stop)
+        {
+          delete batch;
+          return;
+        }
+
+        for (typename batch_t::entry_t& entry : batch->ops)
+        {
+          entry.run(entry.op, part.map, *batch);
+        }
+
+        while (!channel->responses.try_push(batch))
+        {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+    /**
+      @brief  Pop a batch from the first non-empty channel from next on
+              Channels are served in turn, so that a busy session does not
+              starve the others.
+      @return The batch, or null if every channel is empty
+      */
+    static batch_t* _try_pop(partition_t& part, size_t& next, channel_t*& channel)
+    {
+      for (size_t n = 0; n < part.channels.size(); n++)
+      {
+        channel_t* candidate = part.channels[next].get();
+        next = next + 1 == part.channels.size() ? 0 : next + 1;
+
+        batch_t* batch;
+
+        if (candidate->requests.try_pop(batch))
+        {
+          channel = candidate;
+          return batch;
+        }
+      }
+
+      return nullptr;
+    }
+
+    /**
+      @brief  Wait for the next batch, spinning for idle_spin and then
+              sleeping until a session wakes the worker (see `_wake()`)
+      */
+    static batch_t* _next_batch(partition_t& part, size_t& next, channel_t*& channel)
+    {
+      batch_t* batch;
+
+      auto start = std::chrono::steady_clock::now();
+
+      while (std::chrono::steady_clock::now() - start < idle_spin)
+      {
+        if ((batch = _try_pop(part, next, channel)) != nullptr)
+        {
+          return batch;
+        }
+
+        std::this_thread::yield();
+      }
+
+      std::unique_lock<std::mutex> lock(part.park.mutex);
+
+      while (true)
+      {
+        /* announce parking before checking the rings one last time; sessions
+           push before checking parked, so one of us sees the other */
+        part.park.parked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if ((batch = _try_pop(part, next, channel)) != nullptr)
+        {
+          part.park.parked.store(false, std::memory_order_relaxed);
+          return batch;
+        }
+
+        part.park.cv.wait(lock, [&part]()
+        {
+          return !part.park.parked.load(std::memory_order_relaxed);
+        });
+      }
+    }
+
+    /**
+      @brief  Run a queued operation, recording its outcome in place
+      */
+    template <typename R, typename Op>
+    static void _run_op(void* p, map_t& map, batch_t& batch)
+    {
+      queued_op_t<R, Op>& queued = *static_cast<queued_op_t<R, Op>*>(p);
+
+      try
+      {
+        if constexpr (std::is_void<R>::value)
+        {
+          queued.op(map, batch);
+          queued.outcome.value.emplace(true);
+        }
+        else
+        {
+          queued.outcome.value.emplace(queued.op(map, batch));
+        }
+      }
+      catch (...)
+      {
+        queued.outcome.error = std::current_exception();
+      }
+    }
+
+    template <typename T>
+    static void _destroy_op(void* p)
+    {
+      static_cast<T*>(p)->~T();
+    }
+
+    /**
+      @brief  Collect every key of the row of key into batch.unroute
+      */
+    template <path_index_t P, path_index_t Q = 0>
+    static inline typename std::enable_if<Q != N_Paths, void>::type _collect_linked(const map_t& map, const Path_T<P>& key, stamp_t stamp, batch_t& batch)
+    {
+      static_assert(Q < N_Paths);
+
+      if constexpr (Q != P)
+      {
+        if (map.template is_linked<P, Q>(key))
+        {
+          std::get<Q>(batch.unroute).emplace_back(map.template convert_key<P, Q>(key), stamp);
+        }
+      }
+
+      _collect_linked<P, Q + 1>(map, key, stamp, batch);
+    }
+
+    template <path_index_t P, path_index_t Q = 0>
+    static inline typename std::enable_if<Q == N_Paths, void>::type _collect_linked(const map_t&, const Path_T<P>&, stamp_t, batch_t&)
+    {}
+
+    //  ===========
+    //  Client Side
+    //  ===========
+
+    /**
+      @brief  Partition a new row with this key is owned by
+      */
+    template <path_index_t P>
+    partition_index_t _home(const Path_T<P>& key) const
+    {
+      uint64_t h = uint64_t(path_hasher_t<Path_Tag_T<P>>()(key)) * 0x9e3779b97f4a7c15ull;
+
+      return partition_index_t((h >> 32) % partitions.size());
+    }
+
+    /**
+      @brief  Wake a partition's worker if it sleeps, after pushing a batch
+      */
+    static void _wake(partition_t& part)
+    {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (part.park.parked.load(std::memory_order_relaxed))
+      {
+        {
+          std::lock_guard<std::mutex> lock(part.park.mutex);
+          part.park.parked.store(false, std::memory_order_relaxed);
+        }
+
+        part.park.cv.notify_one();
+      }
+    }
+
+    /**
+      @brief  Claim a free channel for a new session
+      @throw  std::length_error
+              If every channel is in use
+      */
+    size_t _claim_channel()
+    {
+      for (size_t i = 0; i < n_channels; i++)
+      {
+        bool expected = false;
+
+        if (channel_used[i].compare_exchange_strong(expected, true))
+        {
+          return i;
+        }
+      }
+
+      throw std::length_error("partitioned_polykey_map::session() : too many open sessions");
+    }
+
+    void _release_channel(size_t i)
+    {
+      channel_used[i].store(false);
+    }
+
+    static void _pin(std::thread& thread, partition_index_t i)
+    {
+#ifdef __linux__
+      unsigned n_cores = std::thread::hardware_concurrency();
+
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      CPU_SET(n_cores == 0 ? 0 : i % n_cores, &cpuset);
+
+      pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+#else
+      (void)thread;
+      (void)i;
+#endif
+    }
+
+  protected:
+    //  ================
+    //  Member Variables
+    //  ================
+
+    /**
+      @brief  Capacity of each ring, in batches
+      */
+    static const size_t ring_capacity = 256;
+
+    /**
+      @brief  How long an idle worker polls its rings before sleeping
+      */
+    static constexpr std::chrono::microseconds idle_spin{100};
+
+    /**
+      @brief  Operations per batch before it is sent automatically
+      */
+    const size_t batch_size;
+
+    /**
+      @brief  Next operation stamp
+      */
+    std::atomic<stamp_t> next_stamp;
+
+    /**
+      @brief  Number of channels per partition, one per session slot
+      */
+    const size_t n_channels;
+
+    /**
+      @brief  Whether each channel belongs to an open session
+      */
+    std::unique_ptr<std::atomic<bool>[]> channel_used;
+
+    /**
+      @brief  Key to owning partition, one directory per path
+      */
+    std::tuple<concurrent_index<path_key_t<Path_Ts>, route_t, path_hasher_t<Path_Ts>, path_key_equal_t<Path_Ts>>...> directory;
+
+    std::vector<std::unique_ptr<partition_t>> partitions;
+
+    /**
+      @brief  Session used by the container's member functions
+      */
+    std::unique_ptr<session> own;
+  };
+}
@@ -0,0 +1,135 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace xu
+{
+  /**
+    @brief  Describes how a path of polykey_map is keyed and indexed
+            By default, a path type is used directly as the key type and is
+            indexed with `std::unordered_map`. Path tags (such as
+            `xu::robin_hood<K>`) specialize this struct to keep `K` as the key
+            type while selecting a different index for that path only.
+    @tparam Path_Tag
+            Path type as given in the polykey_map template argument list
+    */
+  template <typename Path_Tag>
+  struct path_traits
+  {
+    /**
+      @brief  Type of the keys stored for the path
+      */
+    using key_type = Path_Tag;
+
+    /**
+      @brief  Hash function for keys of the path
+      */
+    using hasher = std::hash<key_type>;
+
+    /**
+      @brief  Equality for keys of the path
+      */
+    using key_equal = std::equal_to<key_type>;
+
+    /**
+      @brief  Index from key to `Mapped_T` used for the path
+      */
+    template <typename Mapped_T>
+    using index_type = std::unordered_map<key_type, Mapped_T>;
+  };
+
+  /**
+    @brief  Returns the key type of a path tag
+    */
+  template <typename Path_Tag>
+  using path_key_t = typename path_traits<Path_Tag>::key_type;
+
+  /**
+    @brief  Returns the index type of a path tag
+    */
+  template <typename Path_Tag, typename Mapped_T>
+  using path_index_map_t = typename path_traits<Path_Tag>::template index_type<Mapped_T>;
+
+  /**
+    @brief  Returns the hash function of a path tag
+            Falls back to `std::hash` for specializations of path_traits which
+            do not declare a `hasher`.
+    */
+  template <typename Path_Tag, typename = void>
+  struct path_hasher
+  {
+    using type = std::hash<path_key_t<Path_Tag>>;
+  };
+
+  template <typename Path_Tag>
+  struct path_hasher<Path_Tag, std::void_t<typename path_traits<Path_Tag>::hasher>>
+  {
+    using type = typename path_traits<Path_Tag>::hasher;
+  };
+
+  template <typename Path_Tag>
+  using path_hasher_t = typename path_hasher<Path_Tag>::type;
+
+  /**
+    @brief  Returns the key equality of a path tag
+            Falls back to `std::equal_to` for specializations of path_traits
+            which do not declare a `key_equal`.
+    */
+  template <typename Path_Tag, typename = void>
+  struct path_key_equal
+  {
+    using type = std::equal_to<path_key_t<Path_Tag>>;
+  };
+
+  template <typename Path_Tag>
+  struct path_key_equal<Path_Tag, std::void_t<typename path_traits<Path_Tag>::key_equal>>
+  {
+    using type = typename path_traits<Path_Tag>::key_equal;
+  };
+
+  template <typename Path_Tag>
+  using path_key_equal_t = typename path_key_equal<Path_Tag>::type;
+
+  /**
+    @brief  Checks whether an index provides `prefetch(key)`
+            Indexes which can compute the address of a key's slot without
+            touching it may implement `void prefetch(const key_type&) const`
+            to let callers overlap lookups.
+    @tparam Index_T
+            Index type
+    */
+  template <typename Index_T, typename = void>
+  struct index_has_prefetch : std::false_type
+  {};
+
+  template <typename Index_T>
+  struct index_has_prefetch<Index_T, std::void_t<decltype(std::declval<const Index_T&>().prefetch(std::declval<const typename Index_T::key_type&>()))>> : std::true_type
+  {};
+}
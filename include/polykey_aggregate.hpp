@@ -0,0 +1,287 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Aggregates of the measures of the rows of a group
+    @tparam Measure_T
+            Arithmetic type of the measures
+    @tparam Track_Extremes
+            Whether the minimum and maximum are kept. Unlike the count and
+            sum, they need an ordered count of each distinct measure, so each
+            update costs O(log distinct measures) instead of O(1).
+    */
+  template <typename Measure_T, bool Track_Extremes = false>
+  struct group_aggregate_t
+  {
+    static_assert(std::is_arithmetic<Measure_T>::value, "group_aggregate_t : measures must be arithmetic");
+
+    /**
+      @brief  Type of sums, wide enough not to overflow where the measures
+              would
+      */
+    using sum_type = std::conditional_t<std::is_floating_point<Measure_T>::value, double,
+                       std::conditional_t<std::is_signed<Measure_T>::value, int64_t, uint64_t>>;
+
+    size_t count = 0;
+
+    sum_type sum = 0;
+
+    /**
+      @brief  Count of each distinct measure, empty unless Track_Extremes
+      */
+    std::map<Measure_T, size_t> measures;
+
+    template <bool E = Track_Extremes>
+    std::enable_if_t<E, Measure_T> min() const
+    {
+      return measures.begin()->first;
+    }
+
+    template <bool E = Track_Extremes>
+    std::enable_if_t<E, Measure_T> max() const
+    {
+      return measures.rbegin()->first;
+    }
+
+    void add(Measure_T measure)
+    {
+      count++;
+      sum += measure;
+
+      if constexpr (Track_Extremes)
+      {
+        measures[measure]++;
+      }
+    }
+
+    void remove(Measure_T measure)
+    {
+      count--;
+      sum -= measure;
+
+      if constexpr (Track_Extremes)
+      {
+        auto it = measures.find(measure);
+
+        if (--it->second == 0)
+        {
+          measures.erase(it);
+        }
+      }
+    }
+  };
+
+  template <typename Map_T, typename Group_F, typename Measure_F, bool Track_Extremes = false>
+  class grouped_aggregate;
+
+  /**
+    @brief  Aggregates of a projection of the values of a polykey_map,
+            grouped by another projection, kept up to date as an observer
+            Each insertion, `modify<P>()` and erasure updates the aggregates
+            of the groups of the old and new values, so that reading them is
+            a lookup instead of a scan of the map.
+    @note   Changes made through `at<P>()` references or iterators are not
+            seen (see `polykey_map::observer`), and leave the aggregates
+            stale. Floating point sums may drift from a fresh sum as
+            measures are added and removed.
+    @tparam Group_F
+            Called as `group(value)`, returns the group of a value. Must be
+            hashable with `std::hash`.
+    @tparam Measure_F
+            Called as `measure(value)`, returns the arithmetic measure of a
+            value
+    @tparam Track_Extremes
+            Whether the minimum and maximum of each group are kept, see
+            `group_aggregate_t`
+    */
+  template <typename Value_T, typename ...Path_Ts, typename Group_F, typename Measure_F, bool Track_Extremes>
+  class grouped_aggregate<polykey_map<Value_T, Path_Ts...>, Group_F, Measure_F, Track_Extremes> : public polykey_map<Value_T, Path_Ts...>::observer
+  {
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using keyset_type = typename map_t::keyset_type;
+
+    using group_type = std::decay_t<std::invoke_result_t<Group_F&, const Value_T&>>;
+
+    using measure_type = std::decay_t<std::invoke_result_t<Measure_F&, const Value_T&>>;
+
+    using aggregate_type = group_aggregate_t<measure_type, Track_Extremes>;
+
+  public:
+    /**
+      @brief  Aggregate the rows of map, and follow its changes until
+              destruction
+      */
+    grouped_aggregate(map_t& map_, Group_F group_, Measure_F measure_)
+      : map(map_),
+        group(std::move(group_)),
+        measure(std::move(measure_))
+    {
+      map.for_each_row([this](const keyset_type&, const Value_T& value)
+      {
+        _add(value);
+      });
+
+      map.add_observer(this);
+    }
+
+    ~grouped_aggregate()
+    {
+      map.remove_observer(this);
+    }
+
+    grouped_aggregate(const grouped_aggregate& other) = delete;
+
+    grouped_aggregate& operator=(const grouped_aggregate& other) = delete;
+
+    /**
+      @brief  Checks if a group has rows
+      */
+    bool contains(const group_type& g) const
+    {
+      return groups.find(g) != groups.end();
+    }
+
+    /**
+      @brief  Returns the aggregates of a group
+      @throw  std::out_of_range
+              If the group has no rows
+      */
+    const aggregate_type& at(const group_type& g) const
+    {
+      auto it = groups.find(g);
+
+      if (it == groups.end())
+      {
+        throw std::out_of_range("grouped_aggregate::at() : group has no rows");
+      }
+
+      return it->second;
+    }
+
+    /**
+      @brief  Returns number of groups with rows
+      */
+    size_t size() const
+    {
+      return groups.size();
+    }
+
+    /**
+      @brief  Calls f(group, aggregate) for each group with rows
+      */
+    template <typename F>
+    void for_each(F&& f) const
+    {
+      for (const auto& entry : groups)
+      {
+        f(entry.first, entry.second);
+      }
+    }
+
+    void on_insert(const keyset_type& /* keys */, const Value_T& value) override
+    {
+      _add(value);
+    }
+
+    void on_modify(const keyset_type& /* keys */, const Value_T& old_value, const Value_T& value) override
+    {
+      group_type old_group = group(old_value);
+      group_type new_group = group(value);
+
+      /* usually only the measure changed: update the group in place */
+      if (old_group == new_group)
+      {
+        aggregate_type& aggregate = groups.find(old_group)->second;
+
+        aggregate.remove(measure(old_value));
+        aggregate.add(measure(value));
+        return;
+      }
+
+      _remove(old_value);
+      _add(value);
+    }
+
+    void on_erase(const keyset_type& /* keys */, const Value_T& value) override
+    {
+      _remove(value);
+    }
+
+  protected:
+    void _add(const Value_T& value)
+    {
+      groups[group(value)].add(measure(value));
+    }
+
+    void _remove(const Value_T& value)
+    {
+      auto it = groups.find(group(value));
+
+      it->second.remove(measure(value));
+
+      if (it->second.count == 0)
+      {
+        groups.erase(it);
+      }
+    }
+
+  protected:
+    map_t& map;
+
+    Group_F group;
+
+    Measure_F measure;
+
+    std::unordered_map<group_type, aggregate_type> groups;
+  };
+
+  /**
+    @brief  Returns aggregates of measure(value) grouped by group(value),
+            kept up to date with map, see `grouped_aggregate`
+    @tparam Track_Extremes
+            Whether the minimum and maximum of each group are kept
+    */
+  template <bool Track_Extremes = false, typename Map_T, typename Group_F, typename Measure_F>
+  grouped_aggregate<Map_T, Group_F, Measure_F, Track_Extremes> aggregate_by(Map_T& map, Group_F group, Measure_F measure)
+  {
+    return grouped_aggregate<Map_T, Group_F, Measure_F, Track_Extremes>(map, std::move(group), std::move(measure));
+  }
+}
@@ -0,0 +1,369 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#if __cplusplus < 202002L or !__has_include(<coroutine>)
+#error "polykey_async.hpp requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+namespace xu
+{
+  /**
+    @brief  Coroutine task producing a single result
+            Created suspended; a scheduler drives it with `resume()` until
+            `done()`, then reads `result()`. Each suspension point is where a
+            lookup has issued a prefetch and is waiting for the memory to
+            arrive.
+    @tparam Result_T
+            Result type. Should be default constructible.
+    */
+  template <typename Result_T>
+  class lookup_task
+  {
+  public:
+    struct promise_type
+    {
+      Result_T value{};
+
+      std::exception_ptr error;
+
+      lookup_task get_return_object()
+      {
+        return lookup_task(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+
+      std::suspend_always initial_suspend() noexcept
+      {
+        return {};
+      }
+
+      std::suspend_always final_suspend() noexcept
+      {
+        return {};
+      }
+
+      void return_value(Result_T value_)
+      {
+        value = std::move(value_);
+      }
+
+      void unhandled_exception()
+      {
+        error = std::current_exception();
+      }
+
+      /**
+        @brief  Allocate the coroutine frame from a per-thread free list
+                Lookups are short lived and started in large numbers, so
+                frames are recycled instead of going through malloc each time
+        */
+      static void* operator new(size_t size)
+      {
+        if (size > frame_block_size)
+        {
+          return ::operator new(size);
+        }
+
+        frame_block_t*& free_list = _free_list();
+
+        if (free_list == nullptr)
+        {
+          return ::operator new(frame_block_size);
+        }
+
+        frame_block_t* block = free_list;
+        free_list = block->next;
+
+        return block;
+      }
+
+      static void operator delete(void* ptr, size_t size)
+      {
+        if (size > frame_block_size)
+        {
+          ::operator delete(ptr);
+          return;
+        }
+
+        frame_block_t*& free_list = _free_list();
+
+        frame_block_t* block = static_cast<frame_block_t*>(ptr);
+        block->next = free_list;
+        free_list = block;
+      }
+    };
+
+  protected:
+    /**
+      @brief  Size of pooled coroutine frames
+      */
+    static const size_t frame_block_size = 256;
+
+    struct frame_block_t
+    {
+      frame_block_t* next;
+    };
+
+    /**
+      @brief  Free frame blocks of one thread, released when the thread exits
+      */
+    struct frame_pool_t
+    {
+      frame_block_t* free_list = nullptr;
+
+      ~frame_pool_t()
+      {
+        while (free_list != nullptr)
+        {
+          frame_block_t* next = free_list->next;
+          ::operator delete(free_list);
+          free_list = next;
+        }
+      }
+    };
+
+    static frame_block_t*& _free_list()
+    {
+      static thread_local frame_pool_t pool;
+
+      return pool.free_list;
+    }
+
+  protected:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit lookup_task(std::coroutine_handle<promise_type> handle_)
+      : handle(handle_)
+    {}
+
+  public:
+    lookup_task()
+      : handle(nullptr)
+    {}
+
+    ~lookup_task()
+    {
+      if (handle)
+      {
+        handle.destroy();
+      }
+    }
+
+    lookup_task(const lookup_task& other) = delete;
+
+    lookup_task& operator=(const lookup_task& other) = delete;
+
+    lookup_task(lookup_task&& other) noexcept
+      : handle(std::exchange(other.handle, nullptr))
+    {}
+
+    lookup_task& operator=(lookup_task&& other) noexcept
+    {
+      if (this != &other)
+      {
+        if (handle)
+        {
+          handle.destroy();
+        }
+
+        handle = std::exchange(other.handle, nullptr);
+      }
+
+      return *this;
+    }
+
+    /**
+      @brief  Run until the next suspension point (or completion)
+      */
+    void resume()
+    {
+      handle.resume();
+    }
+
+    /**
+      @brief  Check whether the task has completed
+              An empty (default constructed) task counts as completed
+      */
+    bool done() const
+    {
+      return !handle or handle.done();
+    }
+
+    /**
+      @brief  Returns the result of a completed task
+      @throw  Whatever the coroutine threw
+      */
+    Result_T& result()
+    {
+      if (handle.promise().error)
+      {
+        std::rethrow_exception(handle.promise().error);
+      }
+
+      return handle.promise().value;
+    }
+  };
+
+  /**
+    @brief  Coroutine version of `polykey_map::find<P>()`
+            Prefetches the index slot of key and suspends, then looks up the
+            slot, prefetches the row it references and suspends again. Run
+            many of these through
+            `run_interleaved()` so that their cache misses overlap.
+    @note   Only paths whose index provides `prefetch()` (e.g.
+            `xu::robin_hood<K>`) actually prefetch; other paths still work but
+            gain little from interleaving.
+    @note   The map must outlive the task and must not be modified while the
+            task is pending.
+    @tparam P
+            Path index
+    @return Pointer to the value, or null if key does not exist
+    */
+  template <size_t P, typename Map_T>
+  lookup_task<const typename Map_T::value_type*> async_find(const Map_T& map, typename Map_T::template key_type<P> key)
+  {
+    /* first miss: the index slot of key */
+    map.template prefetch<P>(key);
+
+    co_await std::suspend_always{};
+
+    auto it = map.template find<P>(key);
+
+    if (it == map.cend())
+    {
+      co_return nullptr;
+    }
+
+    /* second miss: the row itself, whose address the index slot holds */
+    const typename Map_T::value_type* value = &*it;
+
+#if defined(__GNUC__)
+    __builtin_prefetch(value);
+    __builtin_prefetch(reinterpret_cast<const char*>(value + 1) - 1);
+#endif
+
+    co_await std::suspend_always{};
+
+    co_return value;
+  }
+
+  /**
+    @brief  Interleave the execution of many lookup tasks (AMAC style)
+            Keeps up to `width` tasks in flight and resumes them round robin,
+            so that while one task waits on a prefetch the others make
+            progress. Completed tasks are handed to the sink and replaced by
+            new ones until `n` tasks have run.
+    @param  width
+            Maximum number of tasks in flight
+    @param  n
+            Total number of tasks
+    @param  make_task
+            Callable taking the task number `i` in `[0, n)` and returning a
+            `lookup_task`
+    @param  sink
+            Callable taking `(i, result)` for each completed task
+    */
+  template <typename Make_Task_F, typename Sink_F>
+  void run_interleaved(size_t width, size_t n, Make_Task_F&& make_task, Sink_F&& sink)
+  {
+    using task_t = decltype(make_task(size_t(0)));
+
+    if (width == 0)
+    {
+      width = 1;
+    }
+
+    std::vector<task_t> tasks(width);
+    std::vector<size_t> task_ids(width);
+
+    size_t next = 0;
+    size_t n_active = 0;
+
+    /* fill a slot with the next task which does not complete immediately */
+    auto start = [&](size_t slot)
+    {
+      while (next < n)
+      {
+        tasks[slot] = make_task(next);
+        task_ids[slot] = next++;
+
+        /* each task stops right after issuing its first prefetch */
+        tasks[slot].resume();
+
+        if (!tasks[slot].done())
+        {
+          return true;
+        }
+
+        sink(task_ids[slot], tasks[slot].result());
+      }
+
+      tasks[slot] = task_t();
+
+      return false;
+    };
+
+    for (size_t slot = 0; slot < width; slot++)
+    {
+      if (start(slot))
+      {
+        n_active++;
+      }
+    }
+
+    while (n_active != 0)
+    {
+      for (size_t slot = 0; slot < width; slot++)
+      {
+        task_t& task = tasks[slot];
+
+        if (task.done())
+        {
+          continue;
+        }
+
+        task.resume();
+
+        if (!task.done())
+        {
+          continue;
+        }
+
+        sink(task_ids[slot], task.result());
+
+        if (!start(slot))
+        {
+          n_active--;
+        }
+      }
+    }
+  }
+}
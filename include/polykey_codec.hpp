@@ -0,0 +1,343 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace xu
+{
+  /**
+    @brief  Error type thrown when decoding malformed or truncated data
+    */
+  class format_error : public std::runtime_error
+  {
+  public:
+    explicit format_error(const std::string& what_arg)
+      : std::runtime_error(what_arg)
+    {}
+  };
+
+  /**
+    @brief  Maximum size of an encoded varint
+    */
+  static const size_t max_varint_size = 10;
+
+  /**
+    @brief  Encode an integer as a varint (LEB128): 7 bits per byte, least
+            significant first, with the top bit set on all bytes but the last
+    @param  value
+            Value to encode
+    @param  out
+            Buffer of at least max_varint_size bytes
+    @return Number of bytes written
+    */
+  inline size_t varint_encode(uint64_t value, char* out)
+  {
+    size_t n = 0;
+
+    while (value >= 0x80)
+    {
+      out[n++] = char(uint8_t(value) | 0x80);
+      value >>= 7;
+    }
+
+    out[n++] = char(value);
+
+    return n;
+  }
+
+  /**
+    @brief  Append a varint to a buffer
+    */
+  inline void varint_encode(uint64_t value, std::string& out)
+  {
+    char buffer[max_varint_size];
+    out.append(buffer, varint_encode(value, buffer));
+  }
+
+  /**
+    @brief  Decode a varint from `[p, end)`, advancing `p`
+            When 8 bytes are readable, varints of up to 8 bytes (56 bits) are
+            decoded without a loop: the terminating byte is found from the
+            word's top bits, and the 7-bit groups are packed together with
+            `pext` when BMI2 is available, or with three shift-and-mask steps
+            otherwise.
+    @throw  xu::format_error
+            If the varint is truncated or overflows 64 bits
+    */
+  inline uint64_t varint_decode(const char*& p, const char* end)
+  {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (end - p >= 8)
+    {
+      uint64_t word;
+      std::memcpy(&word, p, sizeof(word));
+
+      uint64_t stops = ~word & 0x8080808080808080ull;
+
+      if (stops != 0)
+      {
+        size_t n_bytes = size_t(__builtin_ctzll(stops) >> 3) + 1;
+
+        uint64_t x = n_bytes == 8 ? word : word & ((uint64_t(1) << (8 * n_bytes)) - 1);
+
+#if defined(__BMI2__)
+        x = _pext_u64(x, 0x7f7f7f7f7f7f7f7full);
+#else
+        x &= 0x7f7f7f7f7f7f7f7full;
+        x = (x & 0x00ff00ff00ff00ffull) | ((x & 0xff00ff00ff00ff00ull) >> 1);
+        x = (x & 0x0000ffff0000ffffull) | ((x & 0xffff0000ffff0000ull) >> 2);
+        x = (x & 0x00000000ffffffffull) | ((x & 0xffffffff00000000ull) >> 4);
+#endif
+
+        p += n_bytes;
+        return x;
+      }
+    }
+#endif
+
+    uint64_t value = 0;
+
+    for (unsigned shift = 0; p != end; shift += 7)
+    {
+      uint8_t byte = uint8_t(*p++);
+
+      if (shift == 63 and byte > 1)
+      {
+        throw format_error("varint_decode() : varint overflows 64 bits");
+      }
+
+      value |= uint64_t(byte & 0x7f) << shift;
+
+      if (!(byte & 0x80))
+      {
+        return value;
+      }
+    }
+
+    throw format_error("varint_decode() : truncated varint");
+  }
+
+  /**
+    @brief  Binary encoding of keys and values for snapshots and journals
+            Encoded bytes are appended to a `std::string` used as a byte
+            buffer, and decoded from a `[p, end)` range, advancing `p`.
+            Integers wider than a byte are stored as varints (signed ones
+            zigzag encoded first), so that small ids take a byte or two.
+            Other trivially copyable types are stored as their raw bytes in
+            native byte order. Other types must specialize `xu::codec`, e.g.:
+
+              template <>
+              struct xu::codec<Order>
+              {
+                static void encode(const Order& order, std::string& out)
+                {
+                  xu::codec<std::string>::encode(order.ticker, out);
+                  xu::codec<int>::encode(order.svol, out);
+                }
+
+                static Order decode(const char*& p, const char* end)
+                {
+                  std::string ticker = xu::codec<std::string>::decode(p, end);
+                  return Order{ticker, xu::codec<int>::decode(p, end)};
+                }
+              };
+
+    @note   Encoded data is only meant to be read back on a machine with the
+            same byte order and type layouts.
+    @tparam T
+            Encoded type
+    */
+  template <typename T, typename = void>
+  struct codec
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "xu::codec must be specialized for types which are not trivially copyable");
+
+    static void encode(const T& value, std::string& out)
+    {
+      out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static T decode(const char*& p, const char* end)
+    {
+      if (size_t(end - p) < sizeof(T))
+      {
+        throw format_error("codec::decode() : truncated data");
+      }
+
+      T value;
+      std::memcpy(&value, p, sizeof(T));
+      p += sizeof(T);
+
+      return value;
+    }
+  };
+
+  /**
+    @brief  Integers wider than a byte are stored as varints
+            Signed integers are zigzag encoded (0, -1, 1, -2, ... map to
+            0, 1, 2, 3, ...), so that small negative values stay small.
+    */
+  template <typename T>
+  struct codec<T, typename std::enable_if<std::is_integral<T>::value and (sizeof(T) > 1)>::type>
+  {
+    using unsigned_t = typename std::make_unsigned<T>::type;
+
+    static void encode(const T& value, std::string& out)
+    {
+      varint_encode(_zigzag(value), out);
+    }
+
+    static T decode(const char*& p, const char* end)
+    {
+      uint64_t x = varint_decode(p, end);
+
+      if constexpr (sizeof(T) < sizeof(uint64_t))
+      {
+        if ((x >> (8 * sizeof(T))) != 0)
+        {
+          throw format_error("codec::decode() : integer out of range");
+        }
+      }
+
+      return _unzigzag(x);
+    }
+
+  protected:
+    static uint64_t _zigzag(T value)
+    {
+      if (std::is_signed<T>::value)
+      {
+        /* shift in the unsigned type, then spread the sign over all bits */
+        return uint64_t(unsigned_t(unsigned_t(value) << 1) ^ unsigned_t(value < 0 ? -1 : 0));
+      }
+
+      return uint64_t(value);
+    }
+
+    static T _unzigzag(uint64_t x)
+    {
+      if (std::is_signed<T>::value)
+      {
+        unsigned_t u = unsigned_t(x);
+        return T(unsigned_t(u >> 1) ^ unsigned_t(-unsigned_t(u & 1)));
+      }
+
+      return T(x);
+    }
+  };
+
+  /**
+    @brief  Strings are stored as a varint length followed by their bytes
+    */
+  template <>
+  struct codec<std::string>
+  {
+    static void encode(const std::string& value, std::string& out)
+    {
+      varint_encode(value.size(), out);
+      out.append(value);
+    }
+
+    static std::string decode(const char*& p, const char* end)
+    {
+      uint64_t size = varint_decode(p, end);
+
+      if (uint64_t(end - p) < size)
+      {
+        throw format_error("codec::decode() : truncated string");
+      }
+
+      std::string value(p, size_t(size));
+      p += size;
+
+      return value;
+    }
+  };
+
+  /**
+    @brief  Encode a value into a new buffer
+    */
+  template <typename T>
+  std::string encode(const T& value)
+  {
+    std::string out;
+    codec<T>::encode(value, out);
+    return out;
+  }
+
+  /**
+    @brief  Decode a value from a whole buffer
+    @throw  xu::format_error
+            If the buffer is truncated or has trailing bytes
+    */
+  template <typename T>
+  T decode(const char* data, size_t size)
+  {
+    const char* p = data;
+    T value = codec<T>::decode(p, data + size);
+
+    if (p != data + size)
+    {
+      throw format_error("decode() : trailing bytes");
+    }
+
+    return value;
+  }
+
+  /**
+    @brief  Stable 64-bit hash of a byte range
+            Unlike `std::hash`, the result does not depend on the process or
+            standard library, so it may be stored in files.
+    */
+  inline uint64_t hash_bytes(const char* data, size_t size, uint64_t seed = 0)
+  {
+    /* FNV-1a, followed by a finalizer to spread the low bits */
+    uint64_t h = 0xcbf29ce484222325ull ^ seed;
+
+    for (size_t i = 0; i < size; i++)
+    {
+      h ^= uint64_t(uint8_t(data[i]));
+      h *= 0x100000001b3ull;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return h;
+  }
+}
@@ -0,0 +1,657 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "polykey_codec.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Order-independent digest of a set of rows, split in buckets
+            Each row is placed in a bucket by the hash of its anchor (its
+            first key, i.e. the key of the lowest path it has), and a
+            bucket's digest is the sum of its rows' hashes (modulo 2^64).
+            Sums can be updated row by row as rows are added and removed,
+            and two sets of rows with equal bucket digests are identical
+            with high probability, so comparing digests finds the buckets
+            holding differences without comparing rows.
+    */
+  class bucket_digest
+  {
+  public:
+    /**
+      @param  n_buckets
+              Number of buckets, rounded up to a power of two
+      */
+    explicit bucket_digest(size_t n_buckets = 1)
+      : n_rows(0)
+    {
+      size_t n = 1;
+
+      while (n < n_buckets)
+      {
+        n *= 2;
+      }
+
+      sums.assign(n, 0);
+    }
+
+    /**
+      @brief  Returns a bucket count suited to n rows
+              About 64 rows per bucket, so that the rows of a differing
+              bucket are few and the digest small.
+      */
+    static size_t buckets_for(size_t n_rows)
+    {
+      return n_rows / 64 + 1;
+    }
+
+    size_t n_buckets() const
+    {
+      return sums.size();
+    }
+
+    /**
+      @brief  Returns the bucket of a row given its anchor hash
+      */
+    size_t bucket(uint64_t anchor_hash) const
+    {
+      return size_t(anchor_hash & (sums.size() - 1));
+    }
+
+    void add(uint64_t anchor_hash, uint64_t row_hash)
+    {
+      sums[bucket(anchor_hash)] += row_hash;
+      n_rows++;
+    }
+
+    void remove(uint64_t anchor_hash, uint64_t row_hash)
+    {
+      sums[bucket(anchor_hash)] -= row_hash;
+      n_rows--;
+    }
+
+    uint64_t sum(size_t bucket) const
+    {
+      return sums[bucket];
+    }
+
+    size_t size() const
+    {
+      return n_rows;
+    }
+
+    bool operator==(const bucket_digest& other) const
+    {
+      return n_rows == other.n_rows and sums == other.sums;
+    }
+
+    bool operator!=(const bucket_digest& other) const
+    {
+      return !(*this == other);
+    }
+
+  protected:
+    std::vector<uint64_t> sums;
+
+    size_t n_rows;
+  };
+
+  /**
+    @brief  Differences between two versions of a map
+            Rows are matched by their anchor (first key). A row whose anchor
+            changed, e.g. which gained a key on a lower path, shows as erased
+            and inserted. Lists are in no particular order.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  struct polykey_diff_t
+  {
+    using row_keys_t = typename polykey_map<Value_T, Path_Ts...>::row_keys_t;
+
+    struct row_t
+    {
+      row_keys_t keys;
+
+      Value_T value;
+    };
+
+    struct change_t
+    {
+      row_keys_t old_keys;
+
+      row_keys_t keys;
+
+      Value_T old_value;
+
+      Value_T value;
+    };
+
+    /**
+      @brief  Rows only in the new version
+      */
+    std::vector<row_t> inserted;
+
+    /**
+      @brief  Rows only in the old version
+      */
+    std::vector<row_t> erased;
+
+    /**
+      @brief  Rows whose keys changed (other than their anchor), and maybe
+              their value too
+      */
+    std::vector<change_t> rekeyed;
+
+    /**
+      @brief  Rows with the same keys and a different value
+      */
+    std::vector<change_t> changed;
+
+    bool empty() const
+    {
+      return inserted.empty() and erased.empty() and rekeyed.empty() and changed.empty();
+    }
+  };
+
+  /**
+    @brief  Compares maps or snapshots through their encoded rows
+            Rows are encoded with `row_codec`, so keys and values need a
+            `xu::codec`, and are compared as bytes: values need no
+            `operator==`.
+            A diff first computes the `bucket_digest` of both sides, a
+            sequential pass hashing each row. Only the rows of buckets whose
+            digests differ are then gathered and compared, so for mostly
+            identical inputs the work besides hashing is proportional to the
+            number of changes. Snapshots additionally skip chunks which have
+            the same checksum at the same position on both sides.
+            Maps whose digests are maintained as they change (see
+            `merkle_observer`) are best compared with those digests: rows
+            are then only encoded when their bucket differs, the other rows
+            costing a hash of their first key.
+    @tparam Value_T
+            Type of the stored values
+    @tparam Path_Ts
+            Each path's type (or path tag)
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class polykey_differ
+  {
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using snapshot_t = mapped_snapshot<Value_T, Path_Ts...>;
+
+    using diff_t = polykey_diff_t<Value_T, Path_Ts...>;
+
+    using codec_t = row_codec<Value_T, Path_Ts...>;
+
+    /**
+      @brief  Returns (anchor hash, row hash) of an encoded row
+      */
+    static std::pair<uint64_t, uint64_t> hash_record(const char* data, size_t size)
+    {
+      return std::make_pair(_anchor(data, size).hash(), hash_bytes(data, size, 1));
+    }
+
+    /**
+      @brief  Returns (anchor hash, row hash) of a row
+      @param  keys
+              Keyset providing `has_value<P>()` and `get<P>()`
+      @param  scratch
+              Buffer the row is encoded into
+      */
+    template <typename Keyset_T>
+    static std::pair<uint64_t, uint64_t> hash_row(const Keyset_T& keys, const Value_T& value, std::string& scratch)
+    {
+      scratch.clear();
+      codec_t::encode(keys, value, scratch);
+
+      return hash_record(scratch.data(), scratch.size());
+    }
+
+    /**
+      @brief  Returns the anchor hash of a row, i.e. the first of
+              `hash_row()`, encoding only its first key
+      @param  keys
+              Keyset providing `has_value<P>()` and `get<P>()`
+      @param  scratch
+              Buffer the key is encoded into
+      */
+    template <typename Keyset_T>
+    static uint64_t hash_anchor(const Keyset_T& keys, std::string& scratch)
+    {
+      return _hash_anchor(keys, scratch);
+    }
+
+    /**
+      @brief  Digest of the rows of a map
+      */
+    static bucket_digest digest(const map_t& map, size_t n_buckets)
+    {
+      bucket_digest result(n_buckets);
+      map_source_t source{map, {}};
+
+      source.for_each([&result](const char* data, size_t size, const typename map_source_t::handle_t&)
+      {
+        std::pair<uint64_t, uint64_t> h = hash_record(data, size);
+        result.add(h.first, h.second);
+      });
+
+      return result;
+    }
+
+    /**
+      @brief  Compare two maps
+              Every row of both maps is encoded and hashed; prefer the
+              overload taking maintained digests when there are some.
+      */
+    static diff_t diff(const map_t& a, const map_t& b)
+    {
+      map_source_t source_a{a, {}};
+      map_source_t source_b{b, {}};
+
+      return _diff(source_a, source_b, bucket_digest::buckets_for(std::max(a.size(), b.size())));
+    }
+
+    /**
+      @brief  Compare two maps given up to date digests of their rows
+              Only the rows of differing buckets are encoded; the others
+              cost a hash of their first key, and no row is visited when the
+              digests are equal.
+      @tparam Digest_T
+              `bucket_digest` or `merkle_digest`
+      @param  digest_a
+              Digest of a's rows, e.g. `merkle_observer::digest()`
+      @param  digest_b
+              Digest of b's rows, with the same number of buckets
+      @throw  std::invalid_argument
+              If the digests have different numbers of buckets
+      */
+    template <typename Digest_T>
+    static diff_t diff(const map_t& a, const Digest_T& digest_a, const map_t& b, const Digest_T& digest_b)
+    {
+      if (digest_a.n_buckets() != digest_b.n_buckets())
+      {
+        throw std::invalid_argument("polykey_differ::diff() : digests have different numbers of buckets");
+      }
+
+      if (digest_a == digest_b)
+      {
+        return diff_t();
+      }
+
+      std::vector<bool> differing(digest_a.n_buckets());
+
+      for (size_t i = 0; i < differing.size(); i++)
+      {
+        differing[i] = digest_a.sum(i) != digest_b.sum(i);
+      }
+
+      return _compare(_gather_rows(a, digest_a, differing), _gather_rows(b, digest_b, differing));
+    }
+
+    /**
+      @brief  Compare two snapshots
+      @throw  xu::format_error
+              If a snapshot is corrupt
+      */
+    static diff_t diff(const snapshot_t& a, const snapshot_t& b)
+    {
+      /* rows of chunks identical at the same position are the same on both sides */
+      std::vector<bool> skip(std::min(a.n_chunks(), b.n_chunks()));
+
+      for (size_t c = 0; c < skip.size(); c++)
+      {
+        skip[c] = a.chunk_rows(c) == b.chunk_rows(c) and a.chunk_checksum(c) == b.chunk_checksum(c);
+      }
+
+      snapshot_source_t source_a{a, skip};
+      snapshot_source_t source_b{b, skip};
+
+      return _diff(source_a, source_b, bucket_digest::buckets_for(std::max(a.size(), b.size())));
+    }
+
+  protected:
+    /**
+      @brief  First key of an encoded row, which identifies the row
+      */
+    struct anchor_t
+    {
+      size_t path;
+
+      const char* key;
+
+      size_t size;
+
+      uint64_t hash() const
+      {
+        return hash_bytes(key, size, path);
+      }
+
+      std::string str() const
+      {
+        return char(path) + std::string(key, size);
+      }
+    };
+
+    static anchor_t _anchor(const char* data, size_t size)
+    {
+      anchor_t anchor{0, nullptr, 0};
+
+      codec_t::for_each_key(data, size, [&anchor](size_t path, const char* key, size_t key_size)
+      {
+        if (anchor.key == nullptr)
+        {
+          anchor = anchor_t{path, key, key_size};
+        }
+      });
+
+      if (anchor.key == nullptr)
+      {
+        throw format_error("polykey_differ : row has no keys");
+      }
+
+      return anchor;
+    }
+
+    /**
+      @brief  Encoded rows of a map, remembered by their keyset and value
+      */
+    struct map_source_t
+    {
+      using handle_t = std::pair<const typename map_t::keyset_type*, const Value_T*>;
+
+      template <typename F>
+      void for_each(F&& f)
+      {
+        map.for_each_row([this, &f](const typename map_t::keyset_type& keys, const Value_T& value)
+        {
+          scratch.clear();
+          codec_t::encode(keys, value, scratch);
+          f(scratch.data(), scratch.size(), handle_t(&keys, &value));
+        });
+      }
+
+      std::pair<const char*, size_t> record(const handle_t& handle)
+      {
+        scratch.clear();
+        codec_t::encode(*handle.first, *handle.second, scratch);
+
+        return std::make_pair(scratch.data(), scratch.size());
+      }
+
+      const map_t& map;
+
+      std::string scratch;
+    };
+
+    /**
+      @brief  Records of a snapshot, except those of skipped chunks
+      */
+    struct snapshot_source_t
+    {
+      using handle_t = uint64_t;
+
+      template <typename F>
+      void for_each(F&& f)
+      {
+        for (size_t c = 0; c < snapshot.n_chunks(); c++)
+        {
+          if (c < skip.size() and skip[c])
+          {
+            continue;
+          }
+
+          std::pair<uint64_t, uint64_t> rows = snapshot.chunk_rows(c);
+
+          for (uint64_t row = rows.first; row < rows.second; row++)
+          {
+            std::pair<const char*, size_t> rec = snapshot.record(row);
+            f(rec.first, rec.second, row);
+          }
+        }
+      }
+
+      std::pair<const char*, size_t> record(handle_t row)
+      {
+        return snapshot.record(row);
+      }
+
+      const snapshot_t& snapshot;
+
+      const std::vector<bool>& skip;
+    };
+
+    /**
+      @brief  Digest the rows of a source, remembering the bucket and handle
+              of each
+      */
+    template <typename Source_T>
+    static bucket_digest _digest(Source_T& source, size_t n_buckets, std::vector<std::pair<size_t, typename Source_T::handle_t>>& rows)
+    {
+      bucket_digest result(n_buckets);
+
+      source.for_each([&result, &rows](const char* data, size_t size, const typename Source_T::handle_t& handle)
+      {
+        std::pair<uint64_t, uint64_t> h = hash_record(data, size);
+        result.add(h.first, h.second);
+        rows.emplace_back(result.bucket(h.first), handle);
+      });
+
+      return result;
+    }
+
+    /**
+      @brief  Gather the encoded rows of the differing buckets, by anchor
+      */
+    template <typename Source_T>
+    static std::unordered_map<std::string, std::string> _gather(Source_T& source, const std::vector<std::pair<size_t, typename Source_T::handle_t>>& rows, const std::vector<bool>& differing)
+    {
+      std::unordered_map<std::string, std::string> result;
+
+      for (auto& row : rows)
+      {
+        if (differing[row.first])
+        {
+          std::pair<const char*, size_t> rec = source.record(row.second);
+          result.emplace(_anchor(rec.first, rec.second).str(), std::string(rec.first, rec.second));
+        }
+      }
+
+      return result;
+    }
+
+    /**
+      @brief  Gather the encoded rows of a map in the differing buckets of
+              its digest, by anchor
+      */
+    template <typename Digest_T>
+    static std::unordered_map<std::string, std::string> _gather_rows(const map_t& map, const Digest_T& digest, const std::vector<bool>& differing)
+    {
+      std::unordered_map<std::string, std::string> result;
+      std::string scratch;
+
+      map.for_each_row([&](const typename map_t::keyset_type& keys, const Value_T& value)
+      {
+        if (differing[digest.bucket(_hash_anchor(keys, scratch))])
+        {
+          scratch.clear();
+          codec_t::encode(keys, value, scratch);
+          result.emplace(_anchor(scratch.data(), scratch.size()).str(), scratch);
+        }
+      });
+
+      return result;
+    }
+
+    template <typename Source_T>
+    static diff_t _diff(Source_T& source_a, Source_T& source_b, size_t n_buckets)
+    {
+      std::vector<std::pair<size_t, typename Source_T::handle_t>> handles_a;
+      std::vector<std::pair<size_t, typename Source_T::handle_t>> handles_b;
+
+      bucket_digest digest_a = _digest(source_a, n_buckets, handles_a);
+      bucket_digest digest_b = _digest(source_b, n_buckets, handles_b);
+
+      if (digest_a == digest_b)
+      {
+        return diff_t();
+      }
+
+      std::vector<bool> differing(digest_a.n_buckets());
+
+      for (size_t i = 0; i < differing.size(); i++)
+      {
+        differing[i] = digest_a.sum(i) != digest_b.sum(i);
+      }
+
+      return _compare(_gather(source_a, handles_a, differing), _gather(source_b, handles_b, differing));
+    }
+
+    /**
+      @brief  Match gathered rows by anchor and list their differences
+      */
+    static diff_t _compare(const std::unordered_map<std::string, std::string>& rows_a, std::unordered_map<std::string, std::string> rows_b)
+    {
+      diff_t result;
+
+      for (auto& it : rows_a)
+      {
+        auto other = rows_b.find(it.first);
+
+        if (other == rows_b.end())
+        {
+          auto row = codec_t::decode(it.second.data(), it.second.size());
+          result.erased.push_back(typename diff_t::row_t{std::move(row.first), std::move(row.second)});
+          continue;
+        }
+
+        if (other->second != it.second)
+        {
+          auto old_row = codec_t::decode(it.second.data(), it.second.size());
+          auto new_row = codec_t::decode(other->second.data(), other->second.size());
+
+          typename diff_t::change_t change{std::move(old_row.first), std::move(new_row.first), std::move(old_row.second), std::move(new_row.second)};
+
+          if (_keys_size(it.second) != _keys_size(other->second) or std::memcmp(it.second.data(), other->second.data(), _keys_size(it.second)) != 0)
+          {
+            result.rekeyed.push_back(std::move(change));
+          }
+          else
+          {
+            result.changed.push_back(std::move(change));
+          }
+        }
+
+        rows_b.erase(other);
+      }
+
+      for (auto& it : rows_b)
+      {
+        auto row = codec_t::decode(it.second.data(), it.second.size());
+        result.inserted.push_back(typename diff_t::row_t{std::move(row.first), std::move(row.second)});
+      }
+
+      return result;
+    }
+
+    /**
+      @brief  Helper function to hash the first key of a keyset, as
+              `anchor_t::hash()` does from the encoded row
+      */
+    template <typename Keyset_T, size_t P = 0>
+    static inline typename std::enable_if<P != sizeof...(Path_Ts), uint64_t>::type _hash_anchor(const Keyset_T& keys, std::string& scratch)
+    {
+      if (!keys.template has_value<P>())
+      {
+        return _hash_anchor<Keyset_T, P + 1>(keys, scratch);
+      }
+
+      scratch.clear();
+      codec<typename codec_t::template Path_T<P>>::encode(keys.template get<P>(), scratch);
+
+      return hash_bytes(scratch.data(), scratch.size(), P);
+    }
+
+    template <typename Keyset_T, size_t P = 0>
+    static inline typename std::enable_if<P == sizeof...(Path_Ts), uint64_t>::type _hash_anchor(const Keyset_T&, std::string&)
+    {
+      throw format_error("polykey_differ : row has no keys");
+    }
+
+    /**
+      @brief  Returns the size of the key mask and keys of an encoded row
+      */
+    static size_t _keys_size(const std::string& record)
+    {
+      return size_t(codec_t::for_each_key(record.data(), record.size(), [](size_t, const char*, size_t) {}) - record.data());
+    }
+  };
+
+  /**
+    @brief  Compare two maps, see `polykey_differ`
+    @param  a
+            Old version
+    @param  b
+            New version
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  polykey_diff_t<Value_T, Path_Ts...> diff(const polykey_map<Value_T, Path_Ts...>& a, const polykey_map<Value_T, Path_Ts...>& b)
+  {
+    return polykey_differ<Value_T, Path_Ts...>::diff(a, b);
+  }
+
+  /**
+    @brief  Compare two maps given up to date digests of their rows, see
+            `polykey_differ`
+    */
+  template <typename Value_T, typename ...Path_Ts, typename Digest_T>
+  polykey_diff_t<Value_T, Path_Ts...> diff(const polykey_map<Value_T, Path_Ts...>& a, const Digest_T& digest_a, const polykey_map<Value_T, Path_Ts...>& b, const Digest_T& digest_b)
+  {
+    return polykey_differ<Value_T, Path_Ts...>::diff(a, digest_a, b, digest_b);
+  }
+
+  /**
+    @brief  Compare two snapshots, see `polykey_differ`
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  polykey_diff_t<Value_T, Path_Ts...> diff(const mapped_snapshot<Value_T, Path_Ts...>& a, const mapped_snapshot<Value_T, Path_Ts...>& b)
+  {
+    return polykey_differ<Value_T, Path_Ts...>::diff(a, b);
+  }
+}
@@ -0,0 +1,194 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.hpp"
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Number of probes a join keeps in flight, see `hash_join()`
+    */
+  static const size_t join_batch_size = 16;
+
+  /**
+    @brief  Joins by walking the index of one map's path (the driver) and
+            probing the other's, see `hash_join()`
+    */
+  template <size_t P_Driver, size_t P_Probed, typename Driver_T, typename Probed_T>
+  class hash_join_driver
+  {
+  protected:
+    using key_t = typename Driver_T::template key_type<P_Driver>;
+
+    using driver_value_t = typename Driver_T::value_type;
+
+    using probed_value_t = typename Probed_T::value_type;
+
+    using row_t = std::pair<const key_t*, const driver_value_t*>;
+
+  public:
+    /**
+      @brief  Call g(key, driver value, probed value) for every match
+      @return Number of matches
+      */
+    template <typename G>
+    static size_t run(const Driver_T& driver, const Probed_T& probed, G&& g, size_t n_threads)
+    {
+      std::vector<row_t> rows;
+      rows.reserve(driver.template size<P_Driver>());
+
+      driver.template for_each_key<P_Driver>([&rows](const key_t& key, const driver_value_t& value)
+      {
+        rows.emplace_back(&key, &value);
+      });
+
+      if (n_threads <= 1)
+      {
+        return _probe_range(rows, 0, rows.size(), probed, g);
+      }
+
+      /* a few ranges per thread, so that uneven ones even out */
+      const size_t n_ranges = std::min(rows.size() / join_batch_size + 1, 4 * n_threads);
+
+      std::atomic<size_t> matches(0);
+
+      parallel_for(n_ranges, n_threads, [&](size_t r)
+      {
+        size_t begin = rows.size() * r / n_ranges;
+        size_t end = rows.size() * (r + 1) / n_ranges;
+
+        matches.fetch_add(_probe_range(rows, begin, end, probed, g), std::memory_order_relaxed);
+      });
+
+      return matches.load();
+    }
+
+  protected:
+    /**
+      @brief  Probe with the keys of rows [begin, end), a batch at a time:
+              the index slots (and driving rows) of a batch are prefetched,
+              then the probed rows, before any is touched
+      */
+    template <typename G>
+    static size_t _probe_range(const std::vector<row_t>& rows, size_t begin, size_t end, const Probed_T& probed, G& g)
+    {
+      const probed_value_t* found[join_batch_size];
+
+      size_t matches = 0;
+
+      for (size_t first = begin; first < end; first += join_batch_size)
+      {
+        size_t n = std::min(join_batch_size, end - first);
+
+        for (size_t i = 0; i < n; i++)
+        {
+          probed.template prefetch<P_Probed>(*rows[first + i].first);
+#if defined(__GNUC__)
+          __builtin_prefetch(rows[first + i].second);
+#endif
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+          auto it = probed.template find<P_Probed>(*rows[first + i].first);
+
+          found[i] = it == probed.cend() ? nullptr : &*it;
+
+#if defined(__GNUC__)
+          if (found[i] != nullptr)
+          {
+            __builtin_prefetch(found[i]);
+          }
+#endif
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+          if (found[i] != nullptr)
+          {
+            g(*rows[first + i].first, *rows[first + i].second, *found[i]);
+            matches++;
+          }
+        }
+      }
+
+      return matches;
+    }
+  };
+
+  /**
+    @brief  Join two maps on a path both have
+            Calls f for every key present on path P_A of a and on path P_B of
+            b. The side with fewer keys on the path drives: its index is
+            walked, and the other side probed in batches of
+            `join_batch_size` keys whose index slots and rows are prefetched
+            before use (index slots only for indexes with `prefetch()`, such
+            as `xu::robin_hood<K>`).
+    @tparam P_A
+            Path index in a
+    @tparam P_B
+            Path index in b, with the same key type
+    @param  f
+            Callable taking `(const key&, const A_Value&, const B_Value&)`.
+            With n_threads > 1, it is called from several threads at once,
+            in no particular order.
+    @param  n_threads
+            Maximum number of threads to probe with
+    @return Number of matched row pairs
+    @note   Neither map may be modified during the join.
+    */
+  template <size_t P_A, size_t P_B, typename Map_A, typename Map_B, typename F>
+  size_t hash_join(const Map_A& a, const Map_B& b, F&& f, size_t n_threads = 1)
+  {
+    using key_a_t = typename Map_A::template key_type<P_A>;
+    using key_b_t = typename Map_B::template key_type<P_B>;
+
+    static_assert(std::is_same<key_a_t, key_b_t>::value, "xu::hash_join() : paths must have the same key type");
+
+    if (a.template size<P_A>() <= b.template size<P_B>())
+    {
+      return hash_join_driver<P_A, P_B, Map_A, Map_B>::run(a, b, [&f](const key_a_t& key, const typename Map_A::value_type& va, const typename Map_B::value_type& vb)
+      {
+        f(key, va, vb);
+      }, n_threads);
+    }
+
+    return hash_join_driver<P_B, P_A, Map_B, Map_A>::run(b, a, [&f](const key_a_t& key, const typename Map_B::value_type& vb, const typename Map_A::value_type& va)
+    {
+      f(key, va, vb);
+    }, n_threads);
+  }
+}
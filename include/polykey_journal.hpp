@@ -0,0 +1,332 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "async_journal.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Journal entry types
+            An entry is one of these bytes followed by a row encoded with
+            `row_codec`: the full row after the change, or the erased row.
+    */
+  namespace journal_op
+  {
+    static const char row = 'R';
+
+    static const char erase = 'E';
+  }
+
+  /**
+    @brief  Observer which journals every change of a polykey_map
+            Each insertion, link, `modify<P>()` and erasure appends an entry
+            to an `async_journal` without waiting for it to be written.
+    @note   Changes made through `at<P>()` references are not journaled
+            (see `polykey_map::observer`).
+    @tparam Value_T
+            Type of the stored values. Must have a `xu::codec`.
+    @tparam Path_Ts
+            Each path's type (or path tag). Keys must have a `xu::codec`.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class journal_observer : public polykey_map<Value_T, Path_Ts...>::observer
+  {
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using keyset_type = typename map_t::keyset_type;
+
+  public:
+    /**
+      @brief  Journal the changes of map until destruction
+      */
+    journal_observer(map_t& map_, async_journal& journal_)
+      : map(map_),
+        journal(journal_),
+        seq(0)
+    {
+      map.add_observer(this);
+    }
+
+    ~journal_observer()
+    {
+      map.remove_observer(this);
+    }
+
+    journal_observer(const journal_observer& other) = delete;
+
+    journal_observer& operator=(const journal_observer& other) = delete;
+
+    /**
+      @brief  Returns sequence number of the last journaled change
+              Pass it to `async_journal::wait_durable()` to wait until all
+              changes so far are durable.
+      */
+    uint64_t last_seq() const
+    {
+      return seq;
+    }
+
+    void on_insert(const keyset_type& keys, const Value_T& value) override
+    {
+      _append(journal_op::row, keys, value);
+    }
+
+    void on_link(const keyset_type& keys, size_t /* path */, const Value_T& value) override
+    {
+      _append(journal_op::row, keys, value);
+    }
+
+    void on_modify(const keyset_type& keys, const Value_T& /* old_value */, const Value_T& value) override
+    {
+      _append(journal_op::row, keys, value);
+    }
+
+    void on_erase(const keyset_type& keys, const Value_T& value) override
+    {
+      _append(journal_op::erase, keys, value);
+    }
+
+  protected:
+    void _append(char op, const keyset_type& keys, const Value_T& value)
+    {
+      entry.clear();
+      entry.push_back(op);
+
+      row_codec<Value_T, Path_Ts...>::encode(keys, value, entry);
+
+      seq = journal.append(entry);
+    }
+
+  protected:
+    map_t& map;
+
+    async_journal& journal;
+
+    uint64_t seq;
+
+    /**
+      @brief  Buffer reused for encoding entries
+      */
+    std::string entry;
+  };
+
+  /**
+    @brief  Applies decoded journal entries, see replay_journal()
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class journal_replayer
+  {
+  protected:
+    using path_index_t = size_t;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+  public:
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+    using row_keys_t = typename map_t::row_keys_t;
+
+  public:
+    explicit journal_replayer(map_t& map_)
+      : map(map_)
+    {}
+
+    /**
+      @brief  Apply one journal entry
+      */
+    void apply(const char* data, size_t size)
+    {
+      if (size == 0)
+      {
+        throw format_error("journal_replayer::apply() : empty entry");
+      }
+
+      std::pair<row_keys_t, Value_T> row = row_codec<Value_T, Path_Ts...>::decode(data + 1, size - 1);
+
+      if (data[0] == journal_op::row)
+      {
+        _upsert(row.first, row.second);
+      }
+      else if (data[0] == journal_op::erase)
+      {
+        _erase(row.first);
+      }
+      else
+      {
+        throw format_error("journal_replayer::apply() : unknown entry type");
+      }
+    }
+
+  protected:
+    /**
+      @brief  Helper function to update the row of the first key which exists
+              in map (linking any new keys), or insert the row if none does
+      */
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P != N_Paths, void>::type _upsert(const row_keys_t& keys, const Value_T& value)
+    {
+      auto& key = std::get<P>(keys);
+
+      if (!key or !map.template contains<P>(*key))
+      {
+        _upsert<P + 1>(keys, value);
+        return;
+      }
+
+      map.template modify<P>(*key, [&value](Value_T& v) { v = value; });
+
+      _link_missing<P, 0>(keys);
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P == N_Paths, void>::type _upsert(const row_keys_t& keys, const Value_T& value)
+    {
+      _insert<0>(keys, value);
+    }
+
+    /**
+      @brief  Helper function to insert a row with its first key, then link
+              the others
+      */
+    template <path_index_t P>
+    inline typename std::enable_if<P != N_Paths, void>::type _insert(const row_keys_t& keys, const Value_T& value)
+    {
+      auto& key = std::get<P>(keys);
+
+      if (!key)
+      {
+        _insert<P + 1>(keys, value);
+        return;
+      }
+
+      map.template insert<P>(*key, value);
+
+      _link_missing<P, 0>(keys);
+    }
+
+    template <path_index_t P>
+    inline typename std::enable_if<P == N_Paths, void>::type _insert(const row_keys_t&, const Value_T&)
+    {
+      throw format_error("journal_replayer : row has no keys");
+    }
+
+    /**
+      @brief  Helper function to link the keys missing from map to the key of
+              path P_Row
+      */
+    template <path_index_t P_Row, path_index_t P>
+    inline typename std::enable_if<P != N_Paths and P != P_Row, void>::type _link_missing(const row_keys_t& keys)
+    {
+      auto& key = std::get<P>(keys);
+
+      if (key and !map.template contains<P>(*key))
+      {
+        map.template link<P_Row, P>(*std::get<P_Row>(keys), *key);
+      }
+
+      _link_missing<P_Row, P + 1>(keys);
+    }
+
+    template <path_index_t P_Row, path_index_t P>
+    inline typename std::enable_if<P != N_Paths and P == P_Row, void>::type _link_missing(const row_keys_t& keys)
+    {
+      _link_missing<P_Row, P + 1>(keys);
+    }
+
+    template <path_index_t P_Row, path_index_t P>
+    inline typename std::enable_if<P == N_Paths, void>::type _link_missing(const row_keys_t&)
+    {}
+
+    /**
+      @brief  Helper function to erase the row of the first key which exists
+              in map
+      */
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P != N_Paths, void>::type _erase(const row_keys_t& keys)
+    {
+      auto& key = std::get<P>(keys);
+
+      if (key and map.template contains<P>(*key))
+      {
+        map.template erase<P>(*key);
+        return;
+      }
+
+      _erase<P + 1>(keys);
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P == N_Paths, void>::type _erase(const row_keys_t&)
+    {}
+
+  protected:
+    map_t& map;
+  };
+
+  /**
+    @brief  Apply the entries of a journal to a polykey_map
+            Typically used after loading the snapshot the journal was started
+            from. Entries with a sequence number up to `after_seq` are
+            skipped.
+    @param  path
+            Journal file path
+    @param  map
+            Map to apply the changes to
+    @param  after_seq
+            Sequence number already reflected in map
+    @return Sequence number of the last applied entry
+    @throw  xu::format_error
+            If an entry is malformed
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  uint64_t replay_journal(const std::string& path, polykey_map<Value_T, Path_Ts...>& map, uint64_t after_seq = 0)
+  {
+    journal_replayer<Value_T, Path_Ts...> replayer(map);
+
+    uint64_t last_seq = after_seq;
+
+    read_journal(path, [&replayer, &last_seq, after_seq](uint64_t seq, const char* data, size_t size)
+    {
+      if (seq > after_seq)
+      {
+        replayer.apply(data, size);
+        last_seq = seq;
+      }
+    });
+
+    return last_seq;
+  }
+}
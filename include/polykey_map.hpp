@@ -24,12 +24,117 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <optional>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.hpp"
+#include "path_traits.hpp"
+
+/* inlining hints, for compilers which support them */
+#if defined(__GNUC__)
+#define XU_FORCE_INLINE __attribute__((always_inline))
+#define XU_NOINLINE __attribute__((noinline))
+#else
+#define XU_FORCE_INLINE
+#define XU_NOINLINE
+#endif
 
 namespace xu
 {
+  /**
+    @brief  Public operations of a polykey_map, as reported to an
+            operation_timer
+    */
+  enum class map_operation
+  {
+    insert,
+    link,
+    erase,
+    at,
+    find,
+    contains,
+    convert_key,
+    modify,
+    iterate
+  };
+
+  const size_t n_map_operations = 9;
+
+  /**
+    @brief  Returns the name of an operation
+    */
+  inline const char* operation_name(map_operation op)
+  {
+    static const char* names[n_map_operations] = {"insert", "link", "erase", "at", "find", "contains", "convert_key", "modify", "iterate"};
+
+    return names[size_t(op)];
+  }
+
+  /**
+    @brief  Receives the duration of each operation made on a polykey_map
+            Set with `set_operation_timer()`. Called on the operating thread
+            after the operation, including ones which throw.
+    @note   Operations may be timed from several threads at once (e.g.
+            concurrent lookups), so a timer must be thread-safe.
+    */
+  class operation_timer
+  {
+  public:
+    virtual ~operation_timer()
+    {}
+
+    /**
+      @brief  op took ns nanoseconds
+      */
+    virtual void on_operation(map_operation op, uint64_t ns) = 0;
+  };
+
+  /**
+    @brief  Times the scope it lives in and reports it to a timer, if any
+    */
+  class timed_operation
+  {
+  public:
+    timed_operation(operation_timer* timer_, map_operation op_)
+      : timer(timer_),
+        op(op_)
+    {
+      if (timer != nullptr)
+      {
+        start = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~timed_operation()
+    {
+      if (timer != nullptr)
+      {
+        timer->on_operation(op, uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+      }
+    }
+
+    timed_operation(const timed_operation& other) = delete;
+
+    timed_operation& operator=(const timed_operation& other) = delete;
+
+  protected:
+    operation_timer* timer;
+
+    map_operation op;
+
+    std::chrono::steady_clock::time_point start;
+  };
+
   /**
     @brief  Many-to-one container class
             This class implements a container whose behavior is defined as
@@ -67,7 +172,10 @@ namespace xu
     @tparam Value_T
             Type of the stored values. Should be copy constructible.
     @tparam Path_Ts
-            Each path's type. Should be copy constructible.
+            Each path's type. Should be copy constructible. A path may instead
+            be given as a path tag (e.g. `xu::robin_hood<K>`, see
+            path_traits.hpp), which keys the path by `K` but selects a
+            different index for it.
     */
   template <typename Value_T, typename ...Path_Ts>
   class polykey_map
@@ -88,7 +196,7 @@ namespace xu
               Path index
       */
     template <path_index_t P>
-    using Path_T = typename std::tuple_element<P, std::tuple<Path_Ts...>>::type;
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
 
     /**
       @brief  The number of different paths
@@ -108,6 +216,13 @@ namespace xu
       */
     static const intermediate_key_t ink_cnt_init_val = 0;
 
+    /**
+      @brief  Number of erase generation stripes
+              Rows are spread over the stripes by intermediate key. Erasing a
+              row only invalidates row tokens of its own stripe.
+      */
+    static const size_t n_generation_stripes = 64;
+
     /**
       @brief  A collection of linked keys which point to the same value
       */
@@ -122,7 +237,7 @@ namespace xu
         @brief  Linked keys
                 If non-null, key is valid
         */
-      std::tuple<std::optional<Path_Ts>...> keys;
+      std::tuple<std::optional<path_key_t<Path_Ts>>...> keys;
 
       /**
         @brief  The linked intermediate key
@@ -163,12 +278,12 @@ namespace xu
       }
 
       /**
-        @brief  Returns copy of key
+        @brief  Returns reference to key
         @note   Must only be used after checking has_value() is true. Otherwise,
                 behavior is not defined
         */
       template <path_index_t P>
-      Path_T<P> get() const
+      const Path_T<P>& get() const
       {
         return *std::get<P>(keys);
       }
@@ -190,6 +305,14 @@ namespace xu
         : ink(ink_)
       {}
 
+      /**
+        @brief  Construct keyset with intermediate key and keys
+        */
+      keyset_t(intermediate_key_t ink_, const std::tuple<std::optional<path_key_t<Path_Ts>>...>& keys_)
+        : keys(keys_),
+          ink(ink_)
+      {}
+
     protected:
       /**
         @brief  Helper function to copy keys from another keyset
@@ -254,11 +377,136 @@ namespace xu
       */
     using ink_keyset_pair = std::pair<intermediate_key_t, keyset_t>;
 
+    /**
+      @brief  Container which holds stored values
+      */
+    using ink_value_map = std::unordered_map<intermediate_key_t, Value_T>;
+
+    /**
+      @brief  Reference to a row, stored in key_to_ink
+              Holds the intermediate key, and a pointer to the row's entry in
+              ink_to_val so that a key lookup reaches the value without a
+              second hash lookup. The pointer stays valid until the row is
+              erased, since ink_to_val never relocates its elements; an
+              iterator would not, as rehashing invalidates iterators.
+      */
+    struct row_ref_t
+    {
+      intermediate_key_t ink;
+
+      typename ink_value_map::value_type* row;
+    };
+
     /**
       @brief  Item type stored in key_to_ink
       */
     template <path_index_t P>
-    using key_ink_pair = std::pair<Path_T<P>, intermediate_key_t>;
+    using key_ink_pair = std::pair<Path_T<P>, row_ref_t>;
+
+  public:
+    /**
+      @brief  Type of the stored values
+      */
+    using value_type = Value_T;
+
+    /**
+      @brief  Returns a path's key type
+      @tparam P
+              Path index
+      */
+    template <path_index_t P>
+    using key_type = Path_T<P>;
+
+    /**
+      @brief  Keyset type passed by `for_each_row()`
+      */
+    using keyset_type = keyset_t;
+
+    /**
+      @brief  Keys of a row for `bulk_insert()`
+              Holds one optional key per path.
+      */
+    using row_keys_t = std::tuple<std::optional<path_key_t<Path_Ts>>...>;
+
+    /**
+      @brief  Receives notifications of changes to a polykey_map
+              Registered with `add_observer()`. Notifications are made on the
+              modifying thread, after the change (before it for erasures).
+      @note   Changes made through references returned by `at<P>()` or
+              through iterators are not seen; use `modify<P>()` for changes
+              which must be observed. Copying, assigning or moving the
+              container is not reported either.
+      */
+    class observer
+    {
+    public:
+      virtual ~observer()
+      {}
+
+      /**
+        @brief  A row was inserted with the keys of keys
+        */
+      virtual void on_insert(const keyset_type& /* keys */, const Value_T& /* value */)
+      {}
+
+      /**
+        @brief  A key was linked to a row on path, keys includes it
+        */
+      virtual void on_link(const keyset_type& /* keys */, path_index_t /* path */, const Value_T& /* value */)
+      {}
+
+      /**
+        @brief  The value of a row was changed by `modify<P>()`
+        */
+      virtual void on_modify(const keyset_type& /* keys */, const Value_T& /* old_value */, const Value_T& /* value */)
+      {}
+
+      /**
+        @brief  A row is about to be erased
+        */
+      virtual void on_erase(const keyset_type& /* keys */, const Value_T& /* value */)
+      {}
+    };
+
+    /**
+      @brief  Receives the keys looked up by `at<P>()` and `find<P>()`
+              Set with `set_lookup_sampler()`. Called on the looking up thread
+              before the lookup, whether the key exists or not.
+      @note   Lookups are otherwise read-only, so a sampler must be
+              synchronized if lookups are made from several threads.
+      */
+    class lookup_sampler
+    {
+    public:
+      virtual ~lookup_sampler()
+      {}
+
+      /**
+        @brief  key was looked up on path, and points to a `Path_T<path>`
+        */
+      virtual void on_lookup(path_index_t path, const void* key) = 0;
+    };
+
+    /**
+      @brief  Counter type for erase generations
+      */
+    using generation_t = unsigned long long;
+
+    /**
+      @brief  Token for cheaply checking that a row found earlier still exists
+              Obtained with `row_token()` and checked with `is_valid()`. A
+              token becomes invalid when its row (or any other row of the same
+              stripe) is erased, or when the container is assigned to, moved
+              from or destroyed. It never becomes valid again.
+      */
+    struct row_token_t
+    {
+      unsigned long long instance;
+
+      size_t stripe;
+
+      generation_t generation;
+    };
 
     /**
       @brief  Error type thrown when inserting or linking keys
@@ -339,6 +587,12 @@ namespace xu
         */
       value_iterator_base& operator++()
       {
+        if (pk->timer != nullptr)
+        {
+          pk->_timed(map_operation::iterate, [&]() { underlying++; });
+          return *this;
+        }
+
         underlying++;
         return *this;
       }
@@ -469,7 +723,9 @@ namespace xu
       @brief  Default constructor
       */
     polykey_map()
-      : ink_cnt(ink_cnt_init_val)
+      : ink_cnt(ink_cnt_init_val),
+        instance(_next_instance()),
+        erase_generations{}
     {}
 
     /**
@@ -487,40 +743,70 @@ namespace xu
     //  Copy & Move
     //  ===========
 
+    /**
+      @brief  Copy constructor
+      @note   key_to_ink is rebuilt rather than copied, since its row
+              references point into other's ink_to_val
+      */
     polykey_map(const polykey_map& other)
       : ink_cnt(other.ink_cnt),
+        instance(_next_instance()),
+        erase_generations{},
         ink_to_val(other.ink_to_val),
-        ink_to_keys(other.ink_to_keys),
-        key_to_ink(other.key_to_ink)
+        ink_to_keys(other.ink_to_keys)
     {
-
+      _rebuild_key_to_ink(other);
     }
 
     polykey_map& operator=(const polykey_map& other)
     {
+      if (this == &other)
+      {
+        return *this;
+      }
+
+      if (!observers.empty())
+      {
+        throw std::logic_error("polykey_map::operator=() : observers are registered");
+      }
+
       ink_cnt = other.ink_cnt;
+      instance = _next_instance();
 
       ink_to_val = other.ink_to_val;
       ink_to_keys = other.ink_to_keys;
-      key_to_ink = other.key_to_ink;
+      key_to_ink = decltype(key_to_ink)();
+
+      _rebuild_key_to_ink(other);
 
       return *this;
     }
 
     polykey_map(polykey_map&& other)
       : ink_cnt(other.ink_cnt),
-        ink_to_val(std::move(other.ink_to_val)),
+        instance(_next_instance()),
+        erase_generations{},
+        ink_to_val(std::move(_check_unobserved(other).ink_to_val)),
         ink_to_keys(std::move(other.ink_to_keys)),
         key_to_ink(std::move(other.key_to_ink))
     {
       other.ink_cnt = ink_cnt_init_val;
+      other.instance = _next_instance();
     }
 
-    polykey_map& operator=(const polykey_map&& other)
+    polykey_map& operator=(polykey_map&& other)
     {
+      if (!observers.empty() or !other.observers.empty())
+      {
+        throw std::logic_error("polykey_map::operator=() : observers are registered");
+      }
+
       ink_cnt = other.ink_cnt;
       other.ink_cnt = ink_cnt_init_val;
 
+      instance = _next_instance();
+      other.instance = _next_instance();
+
       ink_to_val = std::move(other.ink_to_val);
       ink_to_keys = std::move(other.ink_to_keys);
       key_to_ink = std::move(other.key_to_ink);
@@ -551,6 +837,97 @@ namespace xu
       return std::get<P>(key_to_ink).size();
     }
 
+    /**
+      @brief  Call f on every row, with all of its keys
+              Cheaper than iterating values and calling `has_key<P>()` and
+              `get_key<P>()` for each path, which looks up the row's keys
+              again every time.
+      @param  f
+              Callable taking `(const keyset&, const Value_T&)`, where the
+              keyset provides `has_value<P>()` and `get<P>()`
+      */
+    template <typename F>
+    void for_each_row(F&& f) const
+    {
+      for (auto& it : ink_to_keys)
+      {
+        f(it.second, ink_to_val.find(it.first)->second);
+      }
+    }
+
+    /**
+      @brief  Call f on every key of a path, with its value
+              Walks the path's index, which references the rows directly, so
+              no other lookups are made.
+      @tparam P
+              Path index
+      @param  f
+              Callable taking `(const Path_T<P>&, const Value_T&)`
+      */
+    template <path_index_t P, typename F>
+    void for_each_key(F&& f) const
+    {
+      static_assert(P < N_Paths);
+
+      for (auto& it : std::get<P>(key_to_ink))
+      {
+        f(it.first, it.second.row->second);
+      }
+    }
+
+    /**
+      @brief  Register an observer of changes
+      @note   The observer must be removed before either is destroyed. The
+              library's observers (e.g. `xu::ordered_index`) remove themselves
+              in their destructor, so the container must outlive them.
+              Observers are not copied or moved with the container, and
+              assigning to it or moving from it throws `std::logic_error`
+              while observers are registered, since they would not see the
+              change.
+      */
+    void add_observer(observer* obs)
+    {
+      observers.push_back(obs);
+    }
+
+    /**
+      @brief  Set the sampler of lookups, or nullptr for none (the default)
+      @note   The sampler must be unset before either is destroyed. The
+              library's samplers (e.g. `xu::hot_key_sampler`) unset themselves
+              in their destructor, so the container must outlive them. The
+              sampler is not copied or moved with the container.
+      */
+    void set_lookup_sampler(lookup_sampler* sampler_)
+    {
+      sampler = sampler_;
+    }
+
+    /**
+      @brief  Set the timer of operations, or nullptr for none (the default)
+              See `xu::latency_recorder`.
+      @note   The timer must outlive the container, or be unset first. It is
+              not copied or moved with the container.
+      */
+    void set_operation_timer(operation_timer* timer_)
+    {
+      timer = timer_;
+    }
+
+    /**
+      @brief  Unregister an observer
+      */
+    void remove_observer(observer* obs)
+    {
+      for (auto it = observers.begin(); it != observers.end(); ++it)
+      {
+        if (*it == obs)
+        {
+          observers.erase(it);
+          return;
+        }
+      }
+    }
+
     /**
       @brief  Insert a new value
       @tparam P
@@ -565,35 +942,108 @@ namespace xu
     template <path_index_t P>
     void insert(const Path_T<P>& key, const Value_T& value)
     {
-      static_assert(P < N_Paths);
+      if (timer != nullptr)
+      {
+        _timed(map_operation::insert, [&]() { _insert<P>(key, value); });
+        return;
+      }
 
-      auto it = std::get<P>(key_to_ink).find(key);
+      _insert<P>(key, value);
+    }
 
-      if (it != std::get<P>(key_to_ink).end())
+    /**
+      @brief  Insert many values at once, each with all of its keys
+              Faster than inserting and linking row by row: containers are
+              reserved once, values and keysets are stored on two threads,
+              then the index of each path is filled on its own thread.
+      @param  rows
+              Keys and value of each row. Values are moved from.
+      @param  n_threads
+              Maximum number of threads to use
+      @throw  xu::polykey_map::key_conflict_error
+              If a key already exists for its path, or appears twice in rows.
+              None of the rows are inserted then, and rows keeps its values
+              so that the call may be retried.
+      @throw  std::invalid_argument
+              If a row has no keys
+      */
+    void bulk_insert(std::vector<std::pair<row_keys_t, Value_T>>&& rows, size_t n_threads = 1)
+    {
+      for (auto& row : rows)
       {
-        throw key_conflict_error("polykey_map::insert() : key already exists for path");
+        if (!_has_any_key(row.first))
+        {
+          throw std::invalid_argument("polykey_map::bulk_insert() : row has no keys");
+        }
       }
 
-      /* check intermediate key isn't already taken */
-      auto ink_it = ink_to_val.find(ink_cnt);
-
-      if (ink_it != ink_to_val.end())
+      if (rows.size() > std::numeric_limits<intermediate_key_t>::max() - ink_cnt)
       {
-        throw std::out_of_range("polykey_map::insert() : reached polykey_map insertion limit");
+        throw std::out_of_range("polykey_map::bulk_insert() : reached polykey_map insertion limit");
       }
 
-      /* insert the value with intermediate key */
-      ink_to_val.insert(ink_value_pair(ink_cnt, value));
+      const intermediate_key_t first_ink = ink_cnt;
 
-      /* link key and intermediate key */
-      keyset_t ks(ink_cnt);
-      ks.template set<P>(key);
-      
-      ink_to_keys.insert(ink_keyset_pair(ink_cnt, ks));
+      std::vector<row_ref_t> refs(rows.size());
 
-      std::get<P>(key_to_ink).insert(key_ink_pair<P>(key, ink_cnt));
+      std::array<bool, N_Paths> conflicts{};
 
-      ink_cnt++;
+      try
+      {
+        /* values and keysets do not depend on each other */
+        parallel_for(2, n_threads, [&](size_t task)
+        {
+          if (task == 0)
+          {
+            ink_to_val.reserve(ink_to_val.size() + rows.size());
+
+            for (size_t i = 0; i < rows.size(); i++)
+            {
+              auto row = ink_to_val.emplace(first_ink + i, std::move(rows[i].second)).first;
+              refs[i] = row_ref_t{first_ink + i, &*row};
+            }
+          }
+          else
+          {
+            ink_to_keys.reserve(ink_to_keys.size() + rows.size());
+
+            for (size_t i = 0; i < rows.size(); i++)
+            {
+              ink_to_keys.emplace(std::piecewise_construct, std::forward_as_tuple(first_ink + i), std::forward_as_tuple(first_ink + i, rows[i].first));
+            }
+          }
+        });
+
+        /* neither do the paths' indexes */
+        parallel_for(N_Paths, n_threads, [&](size_t path)
+        {
+          conflicts[path] = !_bulk_index(path, rows, refs);
+        });
+      }
+      catch (...)
+      {
+        _bulk_rollback(rows, first_ink);
+        throw;
+      }
+
+      for (bool conflict : conflicts)
+      {
+        if (conflict)
+        {
+          _bulk_rollback(rows, first_ink);
+          throw key_conflict_error("polykey_map::bulk_insert() : key already exists for path");
+        }
+      }
+
+      ink_cnt += rows.size();
+
+      if (!observers.empty())
+      {
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+          _notify_insert(ink_to_keys.at(first_ink + i), refs[i].row->second);
+        }
+      }
     }
 
     /**
@@ -608,20 +1058,12 @@ namespace xu
     template <path_index_t P>
     const Value_T& at(const Path_T<P>& key) const
     {
-      static_assert(P < N_Paths);
-
-      /* get intermediate key */
-      auto it = std::get<P>(key_to_ink).find(key);
-
-      if (it == std::get<P>(key_to_ink).end())
+      if (timer != nullptr)
       {
-        throw std::out_of_range("polykey_map::at() : key does not exist for path");
+        return _timed(map_operation::at, [&]() -> const Value_T& { return _at<P>(key); });
       }
 
-      intermediate_key_t ink = it->second;
-
-      /* return value for intermediate key */
-      return ink_to_val.at(ink);
+      return _at<P>(key);
     }
 
     /**
@@ -641,61 +1083,115 @@ namespace xu
     }
 
     /**
-      @brief  Link two keys so they point to the same value
-              Takes two keys as parameters. If only one of the keys is valid
-              (points to an object), the other key is set to point to the same
-              value. If both keys are valid, or if neither key is valid, then an
-              error is thrown
-      @tparam P1
-              Path index for first key
-      @tparam P2
-              Path index for second key
-      @param  key1
-              First key
-      @param  key2
-              Second key
-      @throw  xu::polykey_map::key_conflict_error
-              If both keys already exist
+      @brief  Modify a value in place, notifying observers
+      @tparam P
+              Path index
+      @param  key
+              Key of the value to modify
+      @param  f
+              Callable taking `Value_T&`
       @throw  std::out_of_range
-              If neither key exists
+              If key does not exist
+      @note   When observers are registered, the old value is copied so that
+              they can see both.
       */
-    template <path_index_t P1, path_index_t P2>
-    void link(const Path_T<P1>& key1, const Path_T<P2>& key2)
+    template <path_index_t P, typename F>
+    void modify(const Path_T<P>& key, F&& f)
     {
-      static_assert(P1 < N_Paths);
-      static_assert(P2 < N_Paths);
-      static_assert(P1 != P2);
+      if (timer != nullptr)
+      {
+        _timed(map_operation::modify, [&]() { _modify<P>(key, std::forward<F>(f)); });
+        return;
+      }
 
-      /* get intermediate keys */
-      auto it1 = std::get<P1>(key_to_ink).find(key1);
-      auto it2 = std::get<P2>(key_to_ink).find(key2);
+      _modify<P>(key, std::forward<F>(f));
+    }
 
-      if (it1 == std::get<P1>(key_to_ink).end() and it2 == std::get<P2>(key_to_ink).end())
+    /**
+      @brief  Find a value (const-qualified)
+      @tparam P
+              Path index
+      @param  key
+              Key to find value for
+      @return Iterator to the value, or `cend()` if key does not exist
+      */
+    template <path_index_t P>
+    const_value_iterator find(const Path_T<P>& key) const
+    {
+      if (timer != nullptr)
       {
-        throw std::out_of_range("polykey_map::link() : keys do not exist");
+        return _timed(map_operation::find, [&]() -> const_value_iterator { return _find<P>(key); });
       }
 
-      if (it1 != std::get<P1>(key_to_ink).end() and it2 != std::get<P2>(key_to_ink).end())
+      return _find<P>(key);
+    }
+
+    /**
+      @brief  Find a value
+      @tparam P
+              Path index
+      @param  key
+              Key to find value for
+      @return Iterator to the value, or `end()` if key does not exist
+      */
+    template <path_index_t P>
+    value_iterator find(const Path_T<P>& key)
+    {
+      if (timer != nullptr)
       {
-        throw key_conflict_error("polykey_map::link() : both keys already exist");
+        return _timed(map_operation::find, [&]() -> value_iterator { return _find<P>(key); });
       }
 
-      /* link key1 with existing key2 */
-      if (it1 == std::get<P1>(key_to_ink).end() and it2 != std::get<P2>(key_to_ink).end())
-      {
-        keyset_t& ks =  ink_to_keys.at(it2->second);
-        ks.template set<P1>(key1);
+      return _find<P>(key);
+    }
 
-        std::get<P1>(key_to_ink).insert(key_ink_pair<P1>(key1, ks.get_ink()));
-      }
-      /* link key2 with existing key1 */
-      else if (it1 != std::get<P1>(key_to_ink).end() and it2 == std::get<P2>(key_to_ink).end())
+    /**
+      @brief  Hint that key is about to be looked up
+              Issues a prefetch for the index slot of key if the path's index
+              supports it (see `index_has_prefetch`), otherwise does nothing
+      @tparam P
+              Path index
+      */
+    template <path_index_t P>
+    void prefetch(const Path_T<P>& key) const
+    {
+      static_assert(P < N_Paths);
+
+      if constexpr (index_has_prefetch<typename std::tuple_element<P, decltype(key_to_ink)>::type>::value)
       {
-        keyset_t& ks =  ink_to_keys.at(it1->second);
-        ks.template set<P2>(key2);
+        std::get<P>(key_to_ink).prefetch(key);
+      }
+    }
 
-        std::get<P2>(key_to_ink).insert(key_ink_pair<P2>(key2, ks.get_ink()));
+    /**
+      @brief  Link two keys so they point to the same value
+              Takes two keys as parameters. If only one of the keys is valid
+              (points to an object), the other key is set to point to the same
+              value. If both keys are valid, or if neither key is valid, then an
+              error is thrown
+      @tparam P1
+              Path index for first key
+      @tparam P2
+              Path index for second key
+      @param  key1
+              First key
+      @param  key2
+              Second key
+      @throw  xu::polykey_map::key_conflict_error
+              If both keys already exist
+      @throw  std::out_of_range
+              If neither key exists
+      */
+    template <path_index_t P1, path_index_t P2>
+    void link(const Path_T<P1>& key1, const Path_T<P2>& key2)
+    {
+      if (timer != nullptr)
+      {
+        _timed(map_operation::link, [&]() { _link<P1, P2>(key1, key2); });
+        return;
       }
+
+      _link<P1, P2>(key1, key2);
     }
 
     /**
@@ -708,18 +1204,12 @@ namespace xu
     template <path_index_t P>
     bool contains(const Path_T<P>& key) const
     {
-      static_assert(P < N_Paths);
-
-      auto it = std::get<P>(key_to_ink).find(key);
-
-      if (it == std::get<P>(key_to_ink).end())
+      if (timer != nullptr)
       {
-        return false;
-      }
-      else
-      {
-        return true;
+        return _timed(map_operation::contains, [&]() -> bool { return _contains<P>(key); });
       }
+
+      return _contains<P>(key);
     }
 
     /**
@@ -744,7 +1234,7 @@ namespace xu
         throw std::out_of_range("polykey_map::is_linked() : key does not exist for first path");
       }
 
-      auto keys_it = ink_to_keys.find(ink_it->second);
+      auto keys_it = ink_to_keys.find(ink_it->second.ink);
 
       return keys_it->second.template has_value<P2>();
     }
@@ -761,27 +1251,73 @@ namespace xu
     template <path_index_t P1, path_index_t P2>
     Path_T<P2> convert_key(const Path_T<P1>& key) const
     {
-      static_assert(P1 < N_Paths);
-      static_assert(P2 < N_Paths);
-
-      auto ink_it = std::get<P1>(key_to_ink).find(key);
-
-      if (ink_it == std::get<P1>(key_to_ink).end())
+      if (timer != nullptr)
       {
-        throw std::out_of_range("polykey_map::convert_key() : key does not exist for first path");
+        return _timed(map_operation::convert_key, [&]() -> Path_T<P2> { return _convert_key<P1, P2>(key); });
       }
 
-      auto keys_it = ink_to_keys.find(ink_it->second);
+      return _convert_key<P1, P2>(key);
+    }
+    
+    /**
+      @brief  Returns a token for the row an iterator points to
+              Lets callers (e.g. a lookup cache) keep a pointer to the value
+              and later check cheaply whether it is still valid
+      @param  it
+              Valid, dereferenceable iterator
+      */
+    row_token_t row_token(const const_value_iterator& it) const
+    {
+      size_t stripe = it.underlying->first & (n_generation_stripes - 1);
+
+      return row_token_t{instance, stripe, erase_generations[stripe]};
+    }
 
-      if (!keys_it->second.template has_value<P2>())
+    /**
+      @brief  Check whether no row of a token's stripe has been erased since
+              the token was obtained from this container
+      */
+    bool is_valid(const row_token_t& token) const
+    {
+      return token.instance == instance and erase_generations[token.stripe] == token.generation;
+    }
+
+  protected:
+    /**
+      @brief  Returns a process-wide unique instance number
+              Assigned whenever the rows of a container are replaced
+      */
+    static unsigned long long _next_instance()
+    {
+      static std::atomic<unsigned long long> next_instance(1);
+
+      return next_instance.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+      @brief  Returns other, after checking that it has no observers
+              Used before moving its rows away, which observers would miss.
+      @throw  std::logic_error
+              If observers are registered with other
+      */
+    static polykey_map& _check_unobserved(polykey_map& other)
+    {
+      if (!other.observers.empty())
       {
-        throw std::out_of_range("polykey_map::convert_key() : key does not exist for second path");
+        throw std::logic_error("polykey_map::polykey_map() : observers are registered with the moved container");
       }
 
-      return keys_it->second.template get<P2>();
+      return other;
     }
-    
-  protected:
+
+    /**
+      @brief  Invalidate the row tokens of the stripe of an intermediate key
+      */
+    void _bump_generation(intermediate_key_t ink)
+    {
+      erase_generations[ink & (n_generation_stripes - 1)]++;
+    }
+
     /**
       @brief  Helper function to iterate over keyset_t.keys
               Checks if any of keyset_t.keys are non-null and unlinks if so
@@ -812,6 +1348,186 @@ namespace xu
     inline typename std::enable_if<P == N_Paths, void>::type _erase(keyset_t& ks)
     {}
 
+    /**
+      @brief  Helper function to add each key of a keyset to key_to_ink
+      */
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P != N_Paths, void>::type _index(const keyset_t& ks, const row_ref_t& ref)
+    {
+      static_assert(P < N_Paths);
+
+      if (ks.template has_value<P>())
+      {
+        std::get<P>(key_to_ink).insert(key_ink_pair<P>(ks.template get<P>(), ref));
+      }
+
+      _index<P + 1>(ks, ref);
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P == N_Paths, void>::type _index(const keyset_t&, const row_ref_t&)
+    {}
+
+    /**
+      @brief  Helper function to reserve key_to_ink like other's
+      */
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P != N_Paths, void>::type _reserve_like(const polykey_map& other)
+    {
+      static_assert(P < N_Paths);
+
+      std::get<P>(key_to_ink).reserve(other.size<P>());
+
+      _reserve_like<P + 1>(other);
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P == N_Paths, void>::type _reserve_like(const polykey_map&)
+    {}
+
+    /**
+      @brief  Fill an empty key_to_ink from ink_to_keys, referencing the rows
+              of this container's ink_to_val
+      */
+    void _rebuild_key_to_ink(const polykey_map& other)
+    {
+      _reserve_like(other);
+
+      for (auto& it : ink_to_keys)
+      {
+        _index(it.second, row_ref_t{it.first, &*ink_to_val.find(it.first)});
+      }
+    }
+
+    void _notify_insert(const keyset_t& ks, const Value_T& value)
+    {
+      for (observer* obs : observers)
+      {
+        obs->on_insert(ks, value);
+      }
+    }
+
+    void _notify_erase(const keyset_t& ks, const Value_T& value)
+    {
+      for (observer* obs : observers)
+      {
+        obs->on_erase(ks, value);
+      }
+    }
+
+    /**
+      @brief  Helper function to check that a row of bulk_insert() has a key
+      */
+    template <path_index_t P = 0>
+    static inline typename std::enable_if<P != N_Paths, bool>::type _has_any_key(const row_keys_t& keys)
+    {
+      return std::get<P>(keys).has_value() or _has_any_key<P + 1>(keys);
+    }
+
+    template <path_index_t P = 0>
+    static inline typename std::enable_if<P == N_Paths, bool>::type _has_any_key(const row_keys_t&)
+    {
+      return false;
+    }
+
+    /**
+      @brief  Helper function to fill the index of one path for bulk_insert()
+      @return Whether all keys were new
+      */
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P != N_Paths, bool>::type _bulk_index(path_index_t path, const std::vector<std::pair<row_keys_t, Value_T>>& rows, const std::vector<row_ref_t>& refs)
+    {
+      static_assert(P < N_Paths);
+
+      if (path != P)
+      {
+        return _bulk_index<P + 1>(path, rows, refs);
+      }
+
+      auto& index = std::get<P>(key_to_ink);
+
+      size_t n_keys = 0;
+
+      for (auto& row : rows)
+      {
+        n_keys += std::get<P>(row.first).has_value();
+      }
+
+      index.reserve(index.size() + n_keys);
+
+      for (size_t i = 0; i < rows.size(); i++)
+      {
+        auto& key = std::get<P>(rows[i].first);
+
+        if (key and !index.insert(key_ink_pair<P>(*key, refs[i])).second)
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P == N_Paths, bool>::type _bulk_index(path_index_t, const std::vector<std::pair<row_keys_t, Value_T>>&, const std::vector<row_ref_t>&)
+    {
+      return true;
+    }
+
+    /**
+      @brief  Helper function to remove the keys bulk_insert() added to
+              key_to_ink, leaving keys of existing rows alone
+      */
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P != N_Paths, void>::type _bulk_unindex(const std::vector<std::pair<row_keys_t, Value_T>>& rows, intermediate_key_t first_ink)
+    {
+      static_assert(P < N_Paths);
+
+      auto& index = std::get<P>(key_to_ink);
+
+      for (auto& row : rows)
+      {
+        auto& key = std::get<P>(row.first);
+
+        if (key)
+        {
+          auto it = index.find(*key);
+
+          if (it != index.end() and it->second.ink >= first_ink)
+          {
+            index.erase(*key);
+          }
+        }
+      }
+
+      _bulk_unindex<P + 1>(rows, first_ink);
+    }
+
+    template <path_index_t P = 0>
+    inline typename std::enable_if<P == N_Paths, void>::type _bulk_unindex(const std::vector<std::pair<row_keys_t, Value_T>>&, intermediate_key_t)
+    {}
+
+    /**
+      @brief  Undo a failed bulk_insert(), moving values back into rows
+      */
+    void _bulk_rollback(std::vector<std::pair<row_keys_t, Value_T>>& rows, intermediate_key_t first_ink)
+    {
+      _bulk_unindex(rows, first_ink);
+
+      for (size_t i = 0; i < rows.size(); i++)
+      {
+        auto row = ink_to_val.find(first_ink + i);
+
+        if (row != ink_to_val.end())
+        {
+          rows[i].second = std::move(row->second);
+          ink_to_val.erase(row);
+        }
+
+        ink_to_keys.erase(first_ink + i);
+      }
+    }
+
   public:
     /**
       @brief  Remove a value and all keys which point to it
@@ -823,7 +1539,279 @@ namespace xu
               If key does not exist
       */
     template <path_index_t P>
-    void erase(Path_T<P> key)
+    void erase(const Path_T<P>& key)
+    {
+      if (timer != nullptr)
+      {
+        _timed(map_operation::erase, [&]() { _erase_key<P>(key); });
+        return;
+      }
+
+      _erase_key<P>(key);
+    }
+
+    /**
+      @brief  Remove a value using an iterator
+      @param  it
+              Valid iterator
+      */
+    value_iterator erase(const value_iterator& it)
+    {
+      if (timer != nullptr)
+      {
+        return _timed(map_operation::erase, [&]() -> value_iterator { return _erase_iterator(it); });
+      }
+
+      return _erase_iterator(it);
+    }
+
+  protected:
+    //  ==================
+    //  Untimed operations
+    //  ==================
+
+    /**
+      @brief  Returns f(), timed by timer as operation op
+              Each timed operation is a public wrapper, which calls this
+              only if a timer is set, and one of the bodies below. Bodies are
+              forced inline, since their second call site (from f) would
+              otherwise keep them out of line, so that while no timer is set
+              an operation costs one more test than untimed code.
+      */
+    template <typename F>
+    XU_NOINLINE decltype(auto) _timed(map_operation op, F&& f) const
+    {
+      timed_operation timed(timer, op);
+
+      return f();
+    }
+
+    template <path_index_t P>
+    XU_FORCE_INLINE void _insert(const Path_T<P>& key, const Value_T& value)
+    {
+      static_assert(P < N_Paths);
+
+      auto it = std::get<P>(key_to_ink).find(key);
+
+      if (it != std::get<P>(key_to_ink).end())
+      {
+        throw key_conflict_error("polykey_map::insert() : key already exists for path");
+      }
+
+      /* check intermediate key isn't already taken */
+      auto ink_it = ink_to_val.find(ink_cnt);
+
+      if (ink_it != ink_to_val.end())
+      {
+        throw std::out_of_range("polykey_map::insert() : reached polykey_map insertion limit");
+      }
+
+      /* insert the value with intermediate key */
+      auto row = ink_to_val.insert(ink_value_pair(ink_cnt, value)).first;
+
+      /* link key and intermediate key, constructing the keyset in place */
+      keyset_t& ks = ink_to_keys.emplace(std::piecewise_construct, std::forward_as_tuple(ink_cnt), std::forward_as_tuple(ink_cnt)).first->second;
+      ks.template set<P>(key);
+
+      std::get<P>(key_to_ink).insert(key_ink_pair<P>(key, row_ref_t{ink_cnt, &*row}));
+
+      ink_cnt++;
+
+      if (!observers.empty())
+      {
+        _notify_insert(ink_to_keys.at(ink_cnt - 1), row->second);
+      }
+    }
+
+    template <path_index_t P>
+    XU_FORCE_INLINE const Value_T& _at(const Path_T<P>& key) const
+    {
+      static_assert(P < N_Paths);
+
+      if (sampler != nullptr)
+      {
+        sampler->on_lookup(P, &key);
+      }
+
+      /* get intermediate key */
+      auto it = std::get<P>(key_to_ink).find(key);
+
+      if (it == std::get<P>(key_to_ink).end())
+      {
+        throw std::out_of_range("polykey_map::at() : key does not exist for path");
+      }
+
+      /* return value through the row reference */
+      return it->second.row->second;
+    }
+
+    template <path_index_t P, typename F>
+    XU_FORCE_INLINE void _modify(const Path_T<P>& key, F&& f)
+    {
+      static_assert(P < N_Paths);
+
+      auto it = std::get<P>(key_to_ink).find(key);
+
+      if (it == std::get<P>(key_to_ink).end())
+      {
+        throw std::out_of_range("polykey_map::modify() : key does not exist for path");
+      }
+
+      row_ref_t ref = it->second;
+
+      if (observers.empty())
+      {
+        f(ref.row->second);
+        return;
+      }
+
+      Value_T old_value(ref.row->second);
+
+      f(ref.row->second);
+
+      const keyset_t& ks = ink_to_keys.at(ref.ink);
+
+      for (observer* obs : observers)
+      {
+        obs->on_modify(ks, old_value, ref.row->second);
+      }
+    }
+
+    template <path_index_t P>
+    XU_FORCE_INLINE const_value_iterator _find(const Path_T<P>& key) const
+    {
+      static_assert(P < N_Paths);
+
+      if (sampler != nullptr)
+      {
+        sampler->on_lookup(P, &key);
+      }
+
+      auto it = std::get<P>(key_to_ink).find(key);
+
+      if (it == std::get<P>(key_to_ink).end())
+      {
+        return cend();
+      }
+
+      return const_value_iterator(this, ink_to_val.find(it->second.ink));
+    }
+
+    template <path_index_t P>
+    XU_FORCE_INLINE value_iterator _find(const Path_T<P>& key)
+    {
+      static_assert(P < N_Paths);
+
+      if (sampler != nullptr)
+      {
+        sampler->on_lookup(P, &key);
+      }
+
+      auto it = std::get<P>(key_to_ink).find(key);
+
+      if (it == std::get<P>(key_to_ink).end())
+      {
+        return end();
+      }
+
+      return value_iterator(this, ink_to_val.find(it->second.ink));
+    }
+
+    template <path_index_t P1, path_index_t P2>
+    XU_FORCE_INLINE void _link(const Path_T<P1>& key1, const Path_T<P2>& key2)
+    {
+      static_assert(P1 < N_Paths);
+      static_assert(P2 < N_Paths);
+      static_assert(P1 != P2);
+
+      /* get intermediate keys */
+      auto it1 = std::get<P1>(key_to_ink).find(key1);
+      auto it2 = std::get<P2>(key_to_ink).find(key2);
+
+      if (it1 == std::get<P1>(key_to_ink).end() and it2 == std::get<P2>(key_to_ink).end())
+      {
+        throw std::out_of_range("polykey_map::link() : keys do not exist");
+      }
+
+      if (it1 != std::get<P1>(key_to_ink).end() and it2 != std::get<P2>(key_to_ink).end())
+      {
+        throw key_conflict_error("polykey_map::link() : both keys already exist");
+      }
+
+      /* link key1 with existing key2 */
+      if (it1 == std::get<P1>(key_to_ink).end() and it2 != std::get<P2>(key_to_ink).end())
+      {
+        row_ref_t ref = it2->second;
+
+        keyset_t& ks =  ink_to_keys.at(ref.ink);
+        ks.template set<P1>(key1);
+
+        std::get<P1>(key_to_ink).insert(key_ink_pair<P1>(key1, ref));
+
+        for (observer* obs : observers)
+        {
+          obs->on_link(ks, P1, ref.row->second);
+        }
+      }
+      /* link key2 with existing key1 */
+      else if (it1 != std::get<P1>(key_to_ink).end() and it2 == std::get<P2>(key_to_ink).end())
+      {
+        row_ref_t ref = it1->second;
+
+        keyset_t& ks =  ink_to_keys.at(ref.ink);
+        ks.template set<P2>(key2);
+
+        std::get<P2>(key_to_ink).insert(key_ink_pair<P2>(key2, ref));
+
+        for (observer* obs : observers)
+        {
+          obs->on_link(ks, P2, ref.row->second);
+        }
+      }
+    }
+
+    template <path_index_t P>
+    XU_FORCE_INLINE bool _contains(const Path_T<P>& key) const
+    {
+      static_assert(P < N_Paths);
+
+      auto it = std::get<P>(key_to_ink).find(key);
+
+      if (it == std::get<P>(key_to_ink).end())
+      {
+        return false;
+      }
+      else
+      {
+        return true;
+      }
+    }
+
+    template <path_index_t P1, path_index_t P2>
+    XU_FORCE_INLINE Path_T<P2> _convert_key(const Path_T<P1>& key) const
+    {
+      static_assert(P1 < N_Paths);
+      static_assert(P2 < N_Paths);
+
+      auto ink_it = std::get<P1>(key_to_ink).find(key);
+
+      if (ink_it == std::get<P1>(key_to_ink).end())
+      {
+        throw std::out_of_range("polykey_map::convert_key() : key does not exist for first path");
+      }
+
+      auto keys_it = ink_to_keys.find(ink_it->second.ink);
+
+      if (!keys_it->second.template has_value<P2>())
+      {
+        throw std::out_of_range("polykey_map::convert_key() : key does not exist for second path");
+      }
+
+      return keys_it->second.template get<P2>();
+    }
+
+    template <path_index_t P>
+    XU_FORCE_INLINE void _erase_key(const Path_T<P>& key)
     {
       static_assert(P < N_Paths);
 
@@ -835,27 +1823,36 @@ namespace xu
         throw std::out_of_range("polykey_map::erase() : key does not exist for path");
       }
 
-      intermediate_key_t ink = it->second;
+      row_ref_t ref = it->second;
+
+      if (!observers.empty())
+      {
+        _notify_erase(ink_to_keys.at(ref.ink), ref.row->second);
+      }
+
+      _bump_generation(ref.ink);
 
       /* then remove linked keys */
-      _erase(ink_to_keys.at(ink));
+      _erase(ink_to_keys.at(ref.ink));
 
-      ink_to_keys.erase(ink);
+      ink_to_keys.erase(ref.ink);
 
       /* finally, erase the value itself */
-      ink_to_val.erase(ink);
+      ink_to_val.erase(ref.ink);
     }
 
-    /**
-      @brief  Remove a value using an iterator
-      @param  it
-              Valid iterator
-      */
-    value_iterator erase(const value_iterator& it)
+    XU_FORCE_INLINE value_iterator _erase_iterator(const value_iterator& it)
     {
       /* first get the intermediate key */
       intermediate_key_t ink = it.underlying->first;
 
+      if (!observers.empty())
+      {
+        _notify_erase(ink_to_keys.at(ink), it.underlying->second);
+      }
+
+      _bump_generation(ink);
+
       /* then remove linked keys */
       _erase(ink_to_keys.at(ink));
 
@@ -867,7 +1864,6 @@ namespace xu
       return value_iterator(it.pk, new_underlying);
     }
 
-  protected:
     //  ================
     //  Member Variables
     //  ================
@@ -878,10 +1874,20 @@ namespace xu
       */
     intermediate_key_t ink_cnt;
 
+    /**
+      @brief  Unique number of the current contents, see row_token_t
+      */
+    unsigned long long instance;
+
+    /**
+      @brief  Number of erasures per stripe, see row_token_t
+      */
+    generation_t erase_generations[n_generation_stripes];
+
     /**
       @brief  Container which actually holds stored values
       */
-    std::unordered_map<intermediate_key_t, Value_T> ink_to_val;
+    ink_value_map ink_to_val;
 
     /**
       @brief  Keysets which contain info on all keys for a value
@@ -890,7 +1896,23 @@ namespace xu
 
     /**
       @brief  Link keys to intermediate key
+              Each path uses the index selected by its path_traits
+      */
+    std::tuple<path_index_map_t<Path_Ts, row_ref_t>...> key_to_ink;
+
+    /**
+      @brief  Registered observers, see add_observer()
+      */
+    std::vector<observer*> observers;
+
+    /**
+      @brief  Sampler of lookups, see set_lookup_sampler()
+      */
+    lookup_sampler* sampler = nullptr;
+
+    /**
+      @brief  Timer of operations, see set_operation_timer()
       */
-    std::tuple<std::unordered_map<Path_Ts, intermediate_key_t>...> key_to_ink;
+    operation_timer* timer = nullptr;
   };
 }
\ No newline at end of file
@@ -0,0 +1,1444 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parallel_for.hpp"
+#include "polykey_codec.hpp"
+#include "polykey_map.hpp"
+
+namespace xu
+{
+  /**
+    @brief  On-disk layout of polykey_map snapshots
+            A snapshot file is laid out so that it can be used directly from
+            a read-only memory mapping, without loading it:
+
+              header            snapshot_header_t
+              path directory    snapshot_path_entry_t, one per path
+              records           one per row, unaligned, grouped in chunks
+              offsets           uint32_t[n_rows], record offsets within
+                                their chunk
+              chunk table       snapshot_chunk_t[n_chunks + 1]
+              path indexes      snapshot_slot_t[n_slots], one table per path
+
+            A record is a row encoded with `row_codec`.
+            Chunks are runs of `chunk_rows` consecutive records (the last one
+            may be shorter), each with a checksum (`hash_bytes()` of its
+            records), so that they can be encoded, decoded and validated
+            independently. Record offsets are stored relative to the file
+            offset of their chunk (frame of reference), and the last entry of
+            the chunk table marks the end of the records.
+            Each path index is an open addressing table (linear probing) of
+            key hashes (see `hash_bytes()`) to row numbers. Slots keep the
+            upper half of the hash, the lower half giving the home slot.
+    @note   Integers are stored in native byte order.
+    */
+  namespace snapshot_format
+  {
+    /**
+      @brief  File magic
+      */
+    static const char magic[8] = {'P', 'K', 'M', 'S', 'N', 'A', 'P', '\0'};
+
+    /**
+      @brief  Current format version
+      */
+    static const uint32_t version = 3;
+
+    /**
+      @brief  Maximum number of paths (bits in a record's key mask)
+      */
+    static const size_t max_paths = 32;
+
+    /**
+      @brief  Default number of rows per chunk
+      */
+    static const size_t default_chunk_rows = 4096;
+  }
+
+  struct snapshot_header_t
+  {
+    char magic[8];
+
+    uint32_t version;
+
+    uint32_t n_paths;
+
+    uint64_t n_rows;
+
+    uint64_t n_chunks;
+
+    uint64_t chunk_rows;
+
+    /**
+      @brief  File offset of the record offsets table
+      */
+    uint64_t offsets_offset;
+
+    /**
+      @brief  File offset of the chunk table
+      */
+    uint64_t chunks_offset;
+  };
+
+  struct snapshot_path_entry_t
+  {
+    /**
+      @brief  File offset of the path's index table
+      */
+    uint64_t index_offset;
+
+    /**
+      @brief  Number of slots, a power of two
+      */
+    uint64_t n_slots;
+
+    /**
+      @brief  Number of keys for the path
+      */
+    uint64_t n_keys;
+  };
+
+  struct snapshot_chunk_t
+  {
+    /**
+      @brief  File offset of the chunk's first record
+      */
+    uint64_t offset;
+
+    uint64_t checksum;
+  };
+
+  struct snapshot_slot_t
+  {
+    /**
+      @brief  Upper 32 bits of the key hash
+      */
+    uint32_t tag;
+
+    /**
+      @brief  Row number plus one, or zero for an empty slot
+      */
+    uint32_t row_plus_one;
+  };
+
+  /**
+    @brief  Encoding of a row (its keys and value)
+            Used for snapshot records and journal entries: a varint mask of
+            the paths the row has a key for, then for each such path (in path
+            order) a varint length and the key's encoded bytes, then the
+            encoded value. With the varint integer codec, a row keyed by a
+            small integer id spends 3 to 4 bytes on it.
+    @tparam Value_T
+            Type of the stored values. Must have a `xu::codec`.
+    @tparam Path_Ts
+            Each path's type (or path tag). Keys must have a `xu::codec`.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  struct row_codec
+  {
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+    static_assert(N_Paths <= snapshot_format::max_paths);
+
+    using row_keys_t = typename polykey_map<Value_T, Path_Ts...>::row_keys_t;
+
+    /**
+      @brief  Encode a row
+      @param  keys
+              Keyset providing `has_value<P>()` and `get<P>()`, such as the
+              one passed by `polykey_map::for_each_row()`
+      @param  value
+              Value of the row
+      @param  out
+              Buffer to append the encoded row to
+      */
+    template <typename Keyset_T>
+    static void encode(const Keyset_T& keys, const Value_T& value, std::string& out)
+    {
+      codec<uint32_t>::encode(_key_mask(keys), out);
+
+      _encode_keys(keys, out);
+
+      codec<Value_T>::encode(value, out);
+    }
+
+    /**
+      @brief  Decode a row
+      @throw  xu::format_error
+              If the row is malformed
+      */
+    static std::pair<row_keys_t, Value_T> decode(const char* data, size_t size)
+    {
+      const char* p = data;
+      const char* end = data + size;
+
+      row_keys_t keys;
+
+      uint32_t mask = codec<uint32_t>::decode(p, end);
+      _decode_keys(mask, p, end, keys);
+
+      return std::make_pair(std::move(keys), xu::decode<Value_T>(p, size_t(end - p)));
+    }
+
+    /**
+      @brief  Call f(path, key data, key size) for each key of an encoded row
+      @return Beginning of the encoded value
+      @throw  xu::format_error
+              If the row is malformed
+      */
+    template <typename F>
+    static const char* for_each_key(const char* data, size_t size, F&& f)
+    {
+      const char* p = data;
+      const char* end = data + size;
+
+      uint32_t mask = codec<uint32_t>::decode(p, end);
+
+      for (path_index_t i = 0; i < N_Paths; i++)
+      {
+        if (mask & (uint32_t(1) << i))
+        {
+          uint32_t key_size = codec<uint32_t>::decode(p, end);
+
+          if (size_t(end - p) < key_size)
+          {
+            throw format_error("row_codec : truncated key");
+          }
+
+          f(i, p, size_t(key_size));
+          p += key_size;
+        }
+      }
+
+      return p;
+    }
+
+  protected:
+    /**
+      @brief  Helper function to get the mask of paths a keyset has keys for
+      */
+    template <typename Keyset_T, path_index_t P = 0>
+    static inline typename std::enable_if<P != N_Paths, uint32_t>::type _key_mask(const Keyset_T& keys)
+    {
+      return (keys.template has_value<P>() ? uint32_t(1) << P : 0) | _key_mask<Keyset_T, P + 1>(keys);
+    }
+
+    template <typename Keyset_T, path_index_t P = 0>
+    static inline typename std::enable_if<P == N_Paths, uint32_t>::type _key_mask(const Keyset_T&)
+    {
+      return 0;
+    }
+
+    /**
+      @brief  Helper function to encode the keys of a keyset
+      */
+    template <typename Keyset_T, path_index_t P = 0>
+    static inline typename std::enable_if<P != N_Paths, void>::type _encode_keys(const Keyset_T& keys, std::string& out)
+    {
+      static_assert(P < N_Paths);
+
+      if (keys.template has_value<P>())
+      {
+        size_t key_pos = out.size();
+
+        codec<Path_T<P>>::encode(keys.template get<P>(), out);
+
+        /* the length goes before the key, and is usually a single byte */
+        char length[max_varint_size];
+        out.insert(key_pos, length, varint_encode(out.size() - key_pos, length));
+      }
+
+      _encode_keys<Keyset_T, P + 1>(keys, out);
+    }
+
+    template <typename Keyset_T, path_index_t P = 0>
+    static inline typename std::enable_if<P == N_Paths, void>::type _encode_keys(const Keyset_T&, std::string&)
+    {}
+
+    /**
+      @brief  Helper function to decode the keys of a row
+      */
+    template <path_index_t P = 0>
+    static inline typename std::enable_if<P != N_Paths, void>::type _decode_keys(uint32_t mask, const char*& p, const char* end, row_keys_t& keys)
+    {
+      static_assert(P < N_Paths);
+
+      if (mask & (uint32_t(1) << P))
+      {
+        uint32_t key_size = codec<uint32_t>::decode(p, end);
+
+        if (size_t(end - p) < key_size)
+        {
+          throw format_error("row_codec : truncated key");
+        }
+
+        std::get<P>(keys).emplace(xu::decode<Path_T<P>>(p, key_size));
+        p += key_size;
+      }
+
+      _decode_keys<P + 1>(mask, p, end, keys);
+    }
+
+    template <path_index_t P = 0>
+    static inline typename std::enable_if<P == N_Paths, void>::type _decode_keys(uint32_t, const char*&, const char*, row_keys_t&)
+    {}
+  };
+
+  /**
+    @brief  Writes a snapshot file
+            Rows are encoded into chunks, which are streamed to a temporary
+            file next to the target. `finish()` appends the offsets, chunk
+            table and path indexes, syncs the file and renames it over the
+            target, so that readers never see a partial snapshot.
+            Chunks may also be encoded separately (e.g. on other threads) with
+            the static `encode_row()`/`encode_record()` and appended with
+            `add_chunk()`.
+    @tparam Value_T
+            Type of the stored values. Must have a `xu::codec`.
+    @tparam Path_Ts
+            Each path's type (or path tag). Keys must have a `xu::codec`.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class snapshot_writer
+  {
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+    static_assert(N_Paths <= snapshot_format::max_paths);
+
+  public:
+    /**
+      @brief  Encoded rows, with the hashes of their keys
+      */
+    struct chunk_t
+    {
+      /**
+        @brief  Records, back to back
+        */
+      std::string bytes;
+
+      /**
+        @brief  End of each record within bytes
+        */
+      std::vector<uint64_t> ends;
+
+      /**
+        @brief  (key hash, row within chunk) of each key, per path
+        */
+      std::array<std::vector<std::pair<uint64_t, uint64_t>>, N_Paths> key_hashes;
+
+      size_t size() const
+      {
+        return ends.size();
+      }
+
+      void clear()
+      {
+        bytes.clear();
+        ends.clear();
+
+        for (auto& hashes : key_hashes)
+        {
+          hashes.clear();
+        }
+      }
+    };
+
+  public:
+    /**
+      @brief  Start writing a snapshot
+      @param  path_
+              Target file path
+      @param  chunk_rows_
+              Number of rows per chunk for `add_row()` and `add_record()`
+      @param  n_threads_
+              Maximum number of threads `finish()` uses to build indexes
+      @throw  std::system_error
+              If the temporary file cannot be created
+      */
+    explicit snapshot_writer(const std::string& path_, size_t chunk_rows_ = snapshot_format::default_chunk_rows, size_t n_threads_ = 1)
+      : path(path_),
+        tmp_path(path_ + ".tmp"),
+        chunk_rows(chunk_rows_ == 0 ? 1 : chunk_rows_),
+        n_threads(n_threads_),
+        file(std::fopen(tmp_path.c_str(), "wb")),
+        pos(0),
+        finished(false)
+    {
+      if (file == nullptr)
+      {
+        throw std::system_error(errno, std::generic_category(), "snapshot_writer() : cannot create " + tmp_path);
+      }
+
+      /* header and directory are written last, reserve their space */
+      std::string placeholder(_data_offset(), '\0');
+      _write(placeholder.data(), placeholder.size());
+    }
+
+    /**
+      @brief  Discard an unfinished snapshot
+      */
+    ~snapshot_writer()
+    {
+      if (!finished)
+      {
+        std::fclose(file);
+        std::remove(tmp_path.c_str());
+      }
+    }
+
+    snapshot_writer(const snapshot_writer& other) = delete;
+
+    snapshot_writer& operator=(const snapshot_writer& other) = delete;
+
+    //  ========
+    //  Encoding
+    //  ========
+
+    /**
+      @brief  Encode a row into a chunk
+      @param  keys
+              Keyset providing `has_value<P>()` and `get<P>()`, such as the
+              one passed by `polykey_map::for_each_row()`
+      @param  value
+              Value of the row
+      @param  chunk
+              Chunk to append the record to
+      */
+    template <typename Keyset_T>
+    static void encode_row(const Keyset_T& keys, const Value_T& value, chunk_t& chunk)
+    {
+      size_t begin = chunk.bytes.size();
+
+      row_codec<Value_T, Path_Ts...>::encode(keys, value, chunk.bytes);
+
+      _add_key_hashes(chunk.bytes.data() + begin, chunk.bytes.size() - begin, chunk);
+
+      chunk.ends.push_back(chunk.bytes.size());
+    }
+
+    /**
+      @brief  Append an already encoded record (e.g. copied from another
+              snapshot) to a chunk
+      @throw  xu::format_error
+              If the record is malformed
+      */
+    static void encode_record(const char* data, size_t size, chunk_t& chunk)
+    {
+      _add_key_hashes(data, size, chunk);
+
+      chunk.bytes.append(data, size);
+      chunk.ends.push_back(chunk.bytes.size());
+    }
+
+    //  =======
+    //  Writing
+    //  =======
+
+    /**
+      @brief  Append a row
+      @param  keys
+              Keyset providing `has_value<P>()` and `get<P>()`
+      @param  value
+              Value of the row
+      */
+    template <typename Keyset_T>
+    void add_row(const Keyset_T& keys, const Value_T& value)
+    {
+      encode_row(keys, value, pending);
+
+      if (pending.size() >= chunk_rows)
+      {
+        _flush_pending();
+      }
+    }
+
+    /**
+      @brief  Append an already encoded record
+      @throw  xu::format_error
+              If the record is malformed
+      */
+    void add_record(const char* data, size_t size)
+    {
+      encode_record(data, size, pending);
+
+      if (pending.size() >= chunk_rows)
+      {
+        _flush_pending();
+      }
+    }
+
+    /**
+      @brief  Append the rows of an encoded chunk
+              A chunk of `chunk_rows` rows, following only whole chunks, is
+              written as is. Other chunks are split and merged like rows
+              added with `add_record()`.
+      */
+    void add_chunk(const chunk_t& chunk)
+    {
+      if (pending.size() == 0 and chunk.size() == chunk_rows)
+      {
+        _write_chunk(chunk);
+        return;
+      }
+
+      for (size_t i = 0; i < chunk.size(); i++)
+      {
+        size_t begin = i == 0 ? 0 : size_t(chunk.ends[i - 1]);
+        add_record(chunk.bytes.data() + begin, size_t(chunk.ends[i]) - begin);
+      }
+    }
+
+    /**
+      @brief  Returns number of rows added so far
+      */
+    size_t size() const
+    {
+      return offsets.size() + pending.size();
+    }
+
+    /**
+      @brief  Write the offsets, chunk table and indexes, then publish the
+              snapshot
+      @throw  std::system_error
+              If writing, syncing or renaming fails
+      */
+    void finish()
+    {
+      _flush_pending();
+
+      snapshot_header_t header;
+      std::memcpy(header.magic, snapshot_format::magic, sizeof(header.magic));
+      header.version = snapshot_format::version;
+      header.n_paths = N_Paths;
+      header.n_rows = offsets.size();
+      header.n_chunks = chunks.size();
+      header.chunk_rows = chunk_rows;
+
+      /* the chunk table's final entry marks the end of the last record */
+      chunks.push_back(snapshot_chunk_t{pos, 0});
+
+      _align();
+      header.offsets_offset = pos;
+      _write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+
+      _align();
+      header.chunks_offset = pos;
+      _write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(snapshot_chunk_t));
+
+      /* path indexes are independent, build them in parallel */
+      std::vector<std::vector<snapshot_slot_t>> tables(N_Paths);
+
+      parallel_for(N_Paths, n_threads, [this, &tables](size_t i)
+      {
+        tables[i] = _build_index(key_hashes[i]);
+        std::vector<std::pair<uint64_t, uint64_t>>().swap(key_hashes[i]);
+      });
+
+      std::vector<snapshot_path_entry_t> directory(N_Paths);
+
+      for (path_index_t i = 0; i < N_Paths; i++)
+      {
+        _align();
+        directory[i] = snapshot_path_entry_t{pos, tables[i].size(), n_keys[i]};
+        _write(reinterpret_cast<const char*>(tables[i].data()), tables[i].size() * sizeof(snapshot_slot_t));
+        std::vector<snapshot_slot_t>().swap(tables[i]);
+      }
+
+      if (std::fseek(file, 0, SEEK_SET) != 0)
+      {
+        throw std::system_error(errno, std::generic_category(), "snapshot_writer::finish() : seek failed");
+      }
+
+      _write(reinterpret_cast<const char*>(&header), sizeof(header));
+      _write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(snapshot_path_entry_t));
+
+      if (std::fflush(file) != 0 or ::fsync(::fileno(file)) != 0)
+      {
+        throw std::system_error(errno, std::generic_category(), "snapshot_writer::finish() : sync failed");
+      }
+
+      std::fclose(file);
+      finished = true;
+
+      if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+      {
+        throw std::system_error(errno, std::generic_category(), "snapshot_writer::finish() : cannot rename to " + path);
+      }
+    }
+
+  protected:
+    static size_t _data_offset()
+    {
+      return sizeof(snapshot_header_t) + N_Paths * sizeof(snapshot_path_entry_t);
+    }
+
+    /**
+      @brief  Record the key hashes of the next record of a chunk
+      */
+    static void _add_key_hashes(const char* data, size_t size, chunk_t& chunk)
+    {
+      uint64_t row = chunk.size();
+
+      row_codec<Value_T, Path_Ts...>::for_each_key(data, size, [&chunk, row](size_t path, const char* key, size_t key_size)
+      {
+        chunk.key_hashes[path].emplace_back(hash_bytes(key, key_size), row);
+      });
+    }
+
+    void _flush_pending()
+    {
+      if (pending.size() != 0)
+      {
+        _write_chunk(pending);
+        pending.clear();
+      }
+    }
+
+    /**
+      @brief  Write a chunk's records and remember its offsets, checksum and
+              key hashes
+      */
+    void _write_chunk(const chunk_t& chunk)
+    {
+      if (chunk.size() == 0)
+      {
+        return;
+      }
+
+      if (chunk.bytes.size() > std::numeric_limits<uint32_t>::max())
+      {
+        throw std::length_error("snapshot_writer : chunk larger than 4 GiB");
+      }
+
+      if (offsets.size() + chunk.size() >= std::numeric_limits<uint32_t>::max())
+      {
+        throw std::length_error("snapshot_writer : too many rows");
+      }
+
+      uint64_t first_row = offsets.size();
+
+      chunks.push_back(snapshot_chunk_t{pos, hash_bytes(chunk.bytes.data(), chunk.bytes.size())});
+
+      offsets.push_back(0);
+
+      for (size_t i = 0; i + 1 < chunk.size(); i++)
+      {
+        offsets.push_back(uint32_t(chunk.ends[i]));
+      }
+
+      for (path_index_t i = 0; i < N_Paths; i++)
+      {
+        n_keys[i] += chunk.key_hashes[i].size();
+
+        for (auto& it : chunk.key_hashes[i])
+        {
+          key_hashes[i].emplace_back(it.first, first_row + it.second);
+        }
+      }
+
+      _write(chunk.bytes.data(), chunk.bytes.size());
+    }
+
+    /**
+      @brief  Build the index table of one path
+      */
+    static std::vector<snapshot_slot_t> _build_index(const std::vector<std::pair<uint64_t, uint64_t>>& hashes)
+    {
+      uint64_t n_slots = 2;
+
+      while (n_slots < hashes.size() * 2)
+      {
+        n_slots *= 2;
+      }
+
+      std::vector<snapshot_slot_t> slots(n_slots, snapshot_slot_t{0, 0});
+
+      for (auto& it : hashes)
+      {
+        uint64_t i = it.first & (n_slots - 1);
+
+        while (slots[i].row_plus_one != 0)
+        {
+          i = (i + 1) & (n_slots - 1);
+        }
+
+        slots[i] = snapshot_slot_t{uint32_t(it.first >> 32), uint32_t(it.second + 1)};
+      }
+
+      return slots;
+    }
+
+    void _align()
+    {
+      static const char zeros[8] = {};
+
+      if (pos % 8 != 0)
+      {
+        _write(zeros, 8 - pos % 8);
+      }
+    }
+
+    void _write(const char* data, size_t size)
+    {
+      if (size != 0 and std::fwrite(data, 1, size, file) != size)
+      {
+        throw std::system_error(errno, std::generic_category(), "snapshot_writer : write failed");
+      }
+
+      pos += size;
+    }
+
+  protected:
+    const std::string path;
+
+    const std::string tmp_path;
+
+    const size_t chunk_rows;
+
+    const size_t n_threads;
+
+    std::FILE* file;
+
+    /**
+      @brief  Current write position
+      */
+    uint64_t pos;
+
+    bool finished;
+
+    /**
+      @brief  Rows added with add_row() or add_record(), not written yet
+      */
+    chunk_t pending;
+
+    /**
+      @brief  Offset of each written record within its chunk
+      */
+    std::vector<uint32_t> offsets;
+
+    /**
+      @brief  File offset and checksum of each written chunk
+      */
+    std::vector<snapshot_chunk_t> chunks;
+
+    /**
+      @brief  (key hash, row) of each written key, per path
+      */
+    std::array<std::vector<std::pair<uint64_t, uint64_t>>, N_Paths> key_hashes;
+
+    std::array<uint64_t, N_Paths> n_keys{};
+  };
+
+  /**
+    @brief  Write a snapshot of a polykey_map
+    @param  map
+            Map to write
+    @param  path
+            Target file path
+    @param  n_threads
+            Maximum number of threads encoding rows and building indexes
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  void save_snapshot(const polykey_map<Value_T, Path_Ts...>& map, const std::string& path, size_t n_threads = 1)
+  {
+    using writer_t = snapshot_writer<Value_T, Path_Ts...>;
+
+    writer_t writer(path, snapshot_format::default_chunk_rows, n_threads);
+
+    if (n_threads <= 1)
+    {
+      map.for_each_row([&writer](const auto& keys, const Value_T& value)
+      {
+        writer.add_row(keys, value);
+      });
+
+      writer.finish();
+      return;
+    }
+
+    /* gather the rows, then encode a few chunks per thread at a time */
+    using keyset_t = typename polykey_map<Value_T, Path_Ts...>::keyset_type;
+
+    std::vector<std::pair<const keyset_t*, const Value_T*>> rows;
+    rows.reserve(map.size());
+
+    map.for_each_row([&rows](const keyset_t& keys, const Value_T& value)
+    {
+      rows.emplace_back(&keys, &value);
+    });
+
+    const size_t chunk_rows = snapshot_format::default_chunk_rows;
+    const size_t n_chunks = (rows.size() + chunk_rows - 1) / chunk_rows;
+
+    std::vector<typename writer_t::chunk_t> chunks(4 * n_threads);
+
+    for (size_t first = 0; first < n_chunks; first += chunks.size())
+    {
+      size_t n = std::min(chunks.size(), n_chunks - first);
+
+      parallel_for(n, n_threads, [&](size_t c)
+      {
+        chunks[c].clear();
+
+        size_t end = std::min(rows.size(), (first + c + 1) * chunk_rows);
+
+        for (size_t i = (first + c) * chunk_rows; i < end; i++)
+        {
+          writer_t::encode_row(*rows[i].first, *rows[i].second, chunks[c]);
+        }
+      });
+
+      for (size_t c = 0; c < n; c++)
+      {
+        writer.add_chunk(chunks[c]);
+      }
+    }
+
+    writer.finish();
+  }
+
+  /**
+    @brief  Read-only view of a snapshot file through a memory mapping
+            Opening only maps the file and checks its header, so it takes
+            constant time regardless of the number of rows. Lookups go
+            through the on-disk path indexes, and values and keys are decoded
+            on access.
+    @tparam Value_T
+            Type of the stored values. Must have a `xu::codec`.
+    @tparam Path_Ts
+            Each path's type (or path tag). Keys must have a `xu::codec`.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class mapped_snapshot
+  {
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+  public:
+    /**
+      @brief  Row number within the snapshot
+      */
+    using row_index_t = uint64_t;
+
+    /**
+      @brief  Map type the snapshot was taken from
+      */
+    using map_t = polykey_map<Value_T, Path_Ts...>;
+
+  public:
+    /**
+      @brief  Map a snapshot file
+      @throw  std::system_error
+              If the file cannot be opened or mapped
+      @throw  xu::format_error
+              If the file is not a snapshot for this map type
+      */
+    explicit mapped_snapshot(const std::string& path)
+      : data(nullptr),
+        file_size(0)
+    {
+      int fd = ::open(path.c_str(), O_RDONLY);
+
+      if (fd < 0)
+      {
+        throw std::system_error(errno, std::generic_category(), "mapped_snapshot() : cannot open " + path);
+      }
+
+      struct stat st;
+
+      if (::fstat(fd, &st) != 0)
+      {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "mapped_snapshot() : cannot stat " + path);
+      }
+
+      file_size = size_t(st.st_size);
+
+      if (file_size != 0)
+      {
+        void* mapping = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping == MAP_FAILED)
+        {
+          int err = errno;
+          ::close(fd);
+          throw std::system_error(err, std::generic_category(), "mapped_snapshot() : cannot map " + path);
+        }
+
+        data = static_cast<const char*>(mapping);
+      }
+
+      ::close(fd);
+
+      try
+      {
+        _validate();
+      }
+      catch (...)
+      {
+        _unmap();
+        throw;
+      }
+    }
+
+    ~mapped_snapshot()
+    {
+      _unmap();
+    }
+
+    mapped_snapshot(const mapped_snapshot& other) = delete;
+
+    mapped_snapshot& operator=(const mapped_snapshot& other) = delete;
+
+    //  ======
+    //  Access
+    //  ======
+
+    /**
+      @brief  Returns number of rows
+      */
+    size_t size() const
+    {
+      return size_t(header->n_rows);
+    }
+
+    /**
+      @brief  Returns number of keys for a path
+      */
+    template <path_index_t P>
+    size_t size() const
+    {
+      return size_t(directory[P].n_keys);
+    }
+
+    /**
+      @brief  Find the row of a key
+      @return Row number, or nothing if key does not exist
+      @throw  xu::format_error
+              If the path's index has no empty slot (a corrupt file)
+      */
+    template <path_index_t P>
+    std::optional<row_index_t> find(const Path_T<P>& key) const
+    {
+      static_assert(P < N_Paths);
+
+      /* reused, so that lookups do not allocate once it has grown to the longest key */
+      thread_local std::string encoded;
+
+      encoded.clear();
+      codec<Path_T<P>>::encode(key, encoded);
+
+      uint64_t h = hash_bytes(encoded.data(), encoded.size());
+
+      const snapshot_path_entry_t& entry = directory[P];
+      const snapshot_slot_t* slots = reinterpret_cast<const snapshot_slot_t*>(data + entry.index_offset);
+
+      uint64_t i = h & (entry.n_slots - 1);
+
+      /* a valid index always has an empty slot, so at most n_slots probes */
+      for (uint64_t n = 0; slots[i].row_plus_one != 0; n++, i = (i + 1) & (entry.n_slots - 1))
+      {
+        if (n == entry.n_slots)
+        {
+          throw format_error("mapped_snapshot::find() : corrupt key index");
+        }
+
+        if (slots[i].tag != uint32_t(h >> 32))
+        {
+          continue;
+        }
+
+        row_index_t row = slots[i].row_plus_one - 1;
+
+        std::pair<const char*, size_t> key_bytes = _key_bytes(row, P);
+
+        if (key_bytes.first != nullptr and key_bytes.second == encoded.size() and std::memcmp(key_bytes.first, encoded.data(), encoded.size()) == 0)
+        {
+          return row;
+        }
+      }
+
+      return std::nullopt;
+    }
+
+    /**
+      @brief  Check whether a row has a key for a path
+      */
+    template <path_index_t P>
+    bool has_key(row_index_t row) const
+    {
+      return _key_bytes(row, P).first != nullptr;
+    }
+
+    /**
+      @brief  Decode the key of a row for a path
+      @throw  std::out_of_range
+              If the row has no key for the path
+      */
+    template <path_index_t P>
+    Path_T<P> key(row_index_t row) const
+    {
+      std::pair<const char*, size_t> key_bytes = _key_bytes(row, P);
+
+      if (key_bytes.first == nullptr)
+      {
+        throw std::out_of_range("mapped_snapshot::key() : row has no key for path");
+      }
+
+      return decode<Path_T<P>>(key_bytes.first, key_bytes.second);
+    }
+
+    /**
+      @brief  Decode the value of a row
+      */
+    Value_T value(row_index_t row) const
+    {
+      std::pair<const char*, size_t> rec = record(row);
+
+      const char* value_begin = row_codec<Value_T, Path_Ts...>::for_each_key(rec.first, rec.second, [](size_t, const char*, size_t) {});
+
+      return decode<Value_T>(value_begin, size_t(rec.first + rec.second - value_begin));
+    }
+
+    /**
+      @brief  Returns the encoded record of a row
+      @throw  std::out_of_range
+              If row does not exist
+      */
+    std::pair<const char*, size_t> record(row_index_t row) const
+    {
+      if (row >= header->n_rows)
+      {
+        throw std::out_of_range("mapped_snapshot::record() : row does not exist");
+      }
+
+      uint64_t chunk = row / header->chunk_rows;
+      uint64_t base = chunks[chunk].offset;
+
+      uint64_t begin = base + offsets[row];
+      uint64_t end = (row + 1) % header->chunk_rows != 0 and row + 1 < header->n_rows ? base + offsets[row + 1] : chunks[chunk + 1].offset;
+
+      if (begin > end or end > chunks[header->n_chunks].offset)
+      {
+        throw format_error("mapped_snapshot::record() : corrupt record offsets");
+      }
+
+      return std::make_pair(data + begin, size_t(end - begin));
+    }
+
+    /**
+      @brief  Decode the keys and value of a row, e.g. for
+              `polykey_map::bulk_insert()`
+      */
+    std::pair<typename map_t::row_keys_t, Value_T> decode_row(row_index_t row) const
+    {
+      std::pair<const char*, size_t> rec = record(row);
+
+      return row_codec<Value_T, Path_Ts...>::decode(rec.first, rec.second);
+    }
+
+    //  ======
+    //  Chunks
+    //  ======
+
+    /**
+      @brief  Returns number of chunks
+      */
+    size_t n_chunks() const
+    {
+      return size_t(header->n_chunks);
+    }
+
+    /**
+      @brief  Returns the rows [first, last) of a chunk
+      @throw  std::out_of_range
+              If chunk does not exist
+      */
+    std::pair<row_index_t, row_index_t> chunk_rows(size_t chunk) const
+    {
+      if (chunk >= header->n_chunks)
+      {
+        throw std::out_of_range("mapped_snapshot::chunk_rows() : chunk does not exist");
+      }
+
+      row_index_t first = row_index_t(chunk * header->chunk_rows);
+      row_index_t last = row_index_t(std::min<uint64_t>(first + header->chunk_rows, header->n_rows));
+
+      return std::make_pair(first, last);
+    }
+
+    /**
+      @brief  Returns the checksum of a chunk's records, as written
+      */
+    uint64_t chunk_checksum(size_t chunk) const
+    {
+      if (chunk >= header->n_chunks)
+      {
+        throw std::out_of_range("mapped_snapshot::chunk_checksum() : chunk does not exist");
+      }
+
+      return chunks[chunk].checksum;
+    }
+
+    /**
+      @brief  Check the checksum of a chunk
+              Allows validating only the parts of a snapshot being used.
+      */
+    bool verify_chunk(size_t chunk) const
+    {
+      if (chunk >= header->n_chunks)
+      {
+        throw std::out_of_range("mapped_snapshot::verify_chunk() : chunk does not exist");
+      }
+
+      uint64_t begin = chunks[chunk].offset;
+      uint64_t end = chunks[chunk + 1].offset;
+
+      if (begin > end or end > header->offsets_offset)
+      {
+        return false;
+      }
+
+      return hash_bytes(data + begin, size_t(end - begin)) == chunks[chunk].checksum;
+    }
+
+    /**
+      @brief  Check the checksums of all chunks
+      @param  n_threads
+              Maximum number of threads to use
+      */
+    bool verify(size_t n_threads = 1) const
+    {
+      std::atomic<bool> valid(true);
+
+      parallel_for(n_chunks(), n_threads, [this, &valid](size_t chunk)
+      {
+        if (valid.load(std::memory_order_relaxed) and !verify_chunk(chunk))
+        {
+          valid.store(false, std::memory_order_relaxed);
+        }
+      });
+
+      return valid.load();
+    }
+
+    /**
+      @brief  Insert a row into a polykey_map, with all of its keys
+      @tparam Map_T
+              polykey_map with the same paths, whose value type can be
+              constructed from Value_T
+      @throw  Map_T::key_conflict_error
+              If one of the row's keys already exists in map
+      */
+    template <typename Map_T>
+    void insert_into(row_index_t row, Map_T& map) const
+    {
+      _insert_first<0>(row, map);
+    }
+
+  protected:
+    //  =======
+    //  Helpers
+    //  =======
+
+    void _validate()
+    {
+      if (file_size < sizeof(snapshot_header_t))
+      {
+        throw format_error("mapped_snapshot() : file too small");
+      }
+
+      header = reinterpret_cast<const snapshot_header_t*>(data);
+
+      if (std::memcmp(header->magic, snapshot_format::magic, sizeof(header->magic)) != 0)
+      {
+        throw format_error("mapped_snapshot() : not a snapshot file");
+      }
+
+      if (header->version != snapshot_format::version)
+      {
+        throw format_error("mapped_snapshot() : unsupported snapshot version");
+      }
+
+      if (header->n_paths != N_Paths)
+      {
+        throw format_error("mapped_snapshot() : snapshot has a different number of paths");
+      }
+
+      directory = reinterpret_cast<const snapshot_path_entry_t*>(data + sizeof(snapshot_header_t));
+
+      if (file_size < sizeof(snapshot_header_t) + N_Paths * sizeof(snapshot_path_entry_t)
+          or header->offsets_offset % 8 != 0
+          or header->offsets_offset > file_size
+          or (file_size - header->offsets_offset) / sizeof(uint32_t) < header->n_rows)
+      {
+        throw format_error("mapped_snapshot() : truncated snapshot");
+      }
+
+      offsets = reinterpret_cast<const uint32_t*>(data + header->offsets_offset);
+
+      if (header->chunks_offset % 8 != 0
+          or header->chunks_offset > file_size
+          or (file_size - header->chunks_offset) / sizeof(snapshot_chunk_t) < header->n_chunks + 1
+          or header->chunk_rows == 0
+          or header->n_chunks != (header->n_rows + header->chunk_rows - 1) / header->chunk_rows)
+      {
+        throw format_error("mapped_snapshot() : corrupt chunk table");
+      }
+
+      chunks = reinterpret_cast<const snapshot_chunk_t*>(data + header->chunks_offset);
+
+      if (chunks[header->n_chunks].offset > header->offsets_offset)
+      {
+        throw format_error("mapped_snapshot() : corrupt chunk table");
+      }
+
+      for (path_index_t i = 0; i < N_Paths; i++)
+      {
+        const snapshot_path_entry_t& entry = directory[i];
+
+        if (entry.n_slots == 0
+            or (entry.n_slots & (entry.n_slots - 1)) != 0
+            or entry.index_offset % 8 != 0
+            or entry.index_offset > file_size
+            or (file_size - entry.index_offset) / sizeof(snapshot_slot_t) < entry.n_slots)
+        {
+          throw format_error("mapped_snapshot() : corrupt path index");
+        }
+      }
+    }
+
+    void _unmap()
+    {
+      if (data != nullptr)
+      {
+        ::munmap(const_cast<char*>(data), file_size);
+        data = nullptr;
+      }
+    }
+
+    /**
+      @brief  Locate the encoded key of a row for a path
+      @return Key bytes, or a null pointer if the row has no key for the path
+      */
+    std::pair<const char*, size_t> _key_bytes(row_index_t row, path_index_t path) const
+    {
+      std::pair<const char*, size_t> rec = record(row);
+
+      const char* p = rec.first;
+      const char* end = rec.first + rec.second;
+
+      uint32_t mask = codec<uint32_t>::decode(p, end);
+
+      if (!(mask & (uint32_t(1) << path)))
+      {
+        return std::make_pair(nullptr, 0);
+      }
+
+      for (path_index_t i = 0; i <= path; i++)
+      {
+        if (mask & (uint32_t(1) << i))
+        {
+          uint32_t key_size = codec<uint32_t>::decode(p, end);
+
+          if (size_t(end - p) < key_size)
+          {
+            throw format_error("mapped_snapshot : truncated key");
+          }
+
+          if (i == path)
+          {
+            return std::make_pair(p, size_t(key_size));
+          }
+
+          p += key_size;
+        }
+      }
+
+      return std::make_pair(nullptr, 0);
+    }
+
+    /**
+      @brief  Helper function to insert a row with the key of its first path,
+              then link its other keys
+      */
+    template <path_index_t P, typename Map_T>
+    inline typename std::enable_if<P != N_Paths, void>::type _insert_first(row_index_t row, Map_T& map) const
+    {
+      if (!has_key<P>(row))
+      {
+        _insert_first<P + 1>(row, map);
+        return;
+      }
+
+      Path_T<P> first_key = key<P>(row);
+
+      map.template insert<P>(first_key, typename Map_T::value_type(value(row)));
+
+      _link_rest<P, P + 1>(row, map, first_key);
+    }
+
+    template <path_index_t P, typename Map_T>
+    inline typename std::enable_if<P == N_Paths, void>::type _insert_first(row_index_t, Map_T&) const
+    {
+      throw format_error("mapped_snapshot : row has no keys");
+    }
+
+    /**
+      @brief  Link the keys of the remaining paths to the row's first key
+      */
+    template <path_index_t P_First, path_index_t P, typename Map_T>
+    inline typename std::enable_if<P != N_Paths, void>::type _link_rest(row_index_t row, Map_T& map, const Path_T<P_First>& first_key) const
+    {
+      if (has_key<P>(row))
+      {
+        map.template link<P_First, P>(first_key, key<P>(row));
+      }
+
+      _link_rest<P_First, P + 1>(row, map, first_key);
+    }
+
+    template <path_index_t P_First, path_index_t P, typename Map_T>
+    inline typename std::enable_if<P == N_Paths, void>::type _link_rest(row_index_t, Map_T&, const Path_T<P_First>&) const
+    {}
+
+  protected:
+    //  ================
+    //  Member Variables
+    //  ================
+
+    /**
+      @brief  Mapped file contents
+      */
+    const char* data;
+
+    size_t file_size;
+
+    const snapshot_header_t* header;
+
+    const snapshot_path_entry_t* directory;
+
+    const uint32_t* offsets;
+
+    const snapshot_chunk_t* chunks;
+  };
+
+  /**
+    @brief  Load a snapshot file into a polykey_map
+            Chunks are validated and decoded in parallel, then inserted with
+            `polykey_map::bulk_insert()`.
+    @param  path
+            Snapshot file path
+    @param  map
+            Map to insert the rows into
+    @param  n_threads
+            Maximum number of threads to use
+    @throw  xu::format_error
+            If the file is not a valid snapshot for this map type, or a
+            chunk's checksum does not match
+    @throw  xu::polykey_map::key_conflict_error
+            If a key of the snapshot already exists in map. No rows are
+            inserted then.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  void load_snapshot(const std::string& path, polykey_map<Value_T, Path_Ts...>& map, size_t n_threads = 1)
+  {
+    using snapshot_t = mapped_snapshot<Value_T, Path_Ts...>;
+    using row_t = std::pair<typename snapshot_t::map_t::row_keys_t, Value_T>;
+
+    snapshot_t snapshot(path);
+
+    std::vector<std::vector<row_t>> decoded(snapshot.n_chunks());
+
+    parallel_for(snapshot.n_chunks(), n_threads, [&snapshot, &decoded](size_t chunk)
+    {
+      if (!snapshot.verify_chunk(chunk))
+      {
+        throw format_error("load_snapshot() : checksum mismatch in chunk " + std::to_string(chunk));
+      }
+
+      std::pair<uint64_t, uint64_t> rows = snapshot.chunk_rows(chunk);
+
+      decoded[chunk].reserve(size_t(rows.second - rows.first));
+
+      for (uint64_t row = rows.first; row < rows.second; row++)
+      {
+        decoded[chunk].push_back(snapshot.decode_row(row));
+      }
+    });
+
+    std::vector<row_t> rows;
+    rows.reserve(snapshot.size());
+
+    for (auto& chunk : decoded)
+    {
+      std::move(chunk.begin(), chunk.end(), std::back_inserter(rows));
+      std::vector<row_t>().swap(chunk);
+    }
+
+    map.bulk_insert(std::move(rows), n_threads);
+  }
+}
@@ -0,0 +1,812 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "path_traits.hpp"
+
+namespace xu
+{
+  /**
+    @brief  Open addressing hash index using Robin Hood insertion and
+            backward-shift deletion
+            Intended as a drop-in replacement for `std::unordered_map` on
+            polykey_map paths which see as many erasures as insertions:
+              - Erasure shifts the following cluster back by one slot instead
+                of leaving a tombstone, so probe sequences never degrade.
+              - Each slot stores its probe distance and a fingerprint of the
+                key's hash. Lookups compare fingerprints before comparing keys
+                and stop as soon as the probed slot is closer to its home than
+                the searched key would be.
+              - Probe distances are bounded by `max_probe_length`. If an
+                insertion would exceed the bound, the table grows, unless
+                its load is already below 1/8: growing further would not
+                break up clusters of keys whose hashes collide, so the
+                insertion throws instead.
+            Only the subset of the `std::unordered_map` interface used by
+            polykey_map is implemented.
+    @note   Iterators and references are invalidated by any insertion or
+            erasure.
+    @tparam Key_T
+            Key type. Should be copy constructible.
+    @tparam Mapped_T
+            Mapped type. Should be copy constructible.
+    */
+  template <typename Key_T, typename Mapped_T, typename Hash = std::hash<Key_T>, typename Key_Equal = std::equal_to<Key_T>>
+  class robin_hood_index
+  {
+  public:
+    //  ========
+    //  Typedefs
+    //  ========
+
+    using key_type = Key_T;
+    using mapped_type = Mapped_T;
+    using value_type = std::pair<const Key_T, Mapped_T>;
+    using size_type = size_t;
+
+    /**
+      @brief  Upper bound on the distance of an entry from its home slot
+      */
+    static const uint32_t max_probe_length = 64;
+
+  protected:
+    /**
+      @brief  Per-slot metadata
+              The low 8 bits hold the probe distance plus one (zero marks an
+              empty slot). The high 24 bits hold the hash fingerprint.
+      */
+    using meta_t = uint32_t;
+
+    static const meta_t dist_mask = 0xff;
+
+    static const meta_t fingerprint_shift = 8;
+
+    /**
+      @brief  Smallest non-zero capacity
+      */
+    static const size_type min_capacity = 16;
+
+  public:
+    //  =========
+    //  Iterators
+    //  =========
+
+    /**
+      @brief  Forward iterator over occupied slots
+      @tparam Deref_T
+              `value_type` or `const value_type`
+      */
+    template <typename Deref_T>
+    class iterator_base
+    {
+      friend robin_hood_index;
+
+    protected:
+      const meta_t* meta;
+
+      const meta_t* meta_end;
+
+      Deref_T* entry;
+
+      /**
+        @brief  Advance to the next occupied slot (or end)
+        */
+      void skip_empty()
+      {
+        while (meta != meta_end and *meta == 0)
+        {
+          meta++;
+          entry++;
+        }
+      }
+
+    public:
+      iterator_base(const meta_t* meta_, const meta_t* meta_end_, Deref_T* entry_)
+        : meta(meta_),
+          meta_end(meta_end_),
+          entry(entry_)
+      {}
+
+      /**
+        @brief  Conversion from iterator to const_iterator
+        */
+      operator iterator_base<const value_type>() const
+      {
+        return iterator_base<const value_type>(meta, meta_end, entry);
+      }
+
+      iterator_base& operator++()
+      {
+        meta++;
+        entry++;
+        skip_empty();
+        return *this;
+      }
+
+      iterator_base operator++(int)
+      {
+        iterator_base res = *this;
+        operator++();
+        return res;
+      }
+
+      bool operator==(const iterator_base& other) const
+      {
+        return meta == other.meta;
+      }
+
+      bool operator!=(const iterator_base& other) const
+      {
+        return meta != other.meta;
+      }
+
+      Deref_T& operator*() const
+      {
+        return *entry;
+      }
+
+      Deref_T* operator->() const
+      {
+        return entry;
+      }
+    };
+
+    using iterator = iterator_base<value_type>;
+    using const_iterator = iterator_base<const value_type>;
+
+    iterator begin()
+    {
+      iterator it(metas.get(), metas.get() + capacity, entries);
+      it.skip_empty();
+      return it;
+    }
+
+    iterator end()
+    {
+      return iterator(metas.get() + capacity, metas.get() + capacity, entries + capacity);
+    }
+
+    const_iterator begin() const
+    {
+      const_iterator it(metas.get(), metas.get() + capacity, entries);
+      it.skip_empty();
+      return it;
+    }
+
+    const_iterator end() const
+    {
+      return const_iterator(metas.get() + capacity, metas.get() + capacity, entries + capacity);
+    }
+
+  public:
+    //  ======================
+    //  Constructor/Destructor
+    //  ======================
+
+    /**
+      @brief  Default constructor
+              No memory is allocated until the first insertion
+      */
+    robin_hood_index()
+      : capacity(0),
+        n_entries(0),
+        shift(64),
+        entries(nullptr)
+    {}
+
+    ~robin_hood_index()
+    {
+      _destroy();
+    }
+
+    //  ===========
+    //  Copy & Move
+    //  ===========
+
+    robin_hood_index(const robin_hood_index& other)
+      : robin_hood_index()
+    {
+      _copy(other);
+    }
+
+    robin_hood_index& operator=(const robin_hood_index& other)
+    {
+      if (this != &other)
+      {
+        _destroy();
+        _copy(other);
+      }
+
+      return *this;
+    }
+
+    robin_hood_index(robin_hood_index&& other)
+      : robin_hood_index()
+    {
+      _swap(other);
+    }
+
+    robin_hood_index& operator=(robin_hood_index&& other)
+    {
+      if (this != &other)
+      {
+        _destroy();
+        _swap(other);
+      }
+
+      return *this;
+    }
+
+    //  ==================
+    //  Container Behavior
+    //  ==================
+
+    size_type size() const
+    {
+      return n_entries;
+    }
+
+    bool empty() const
+    {
+      return n_entries == 0;
+    }
+
+    /**
+      @brief  Returns the number of slots
+      */
+    size_type bucket_count() const
+    {
+      return capacity;
+    }
+
+    /**
+      @brief  Returns the ratio of entries to slots
+      */
+    float load_factor() const
+    {
+      return capacity == 0 ? 0.0f : float(n_entries) / float(capacity);
+    }
+
+    /**
+      @brief  Returns the largest probe distance of any stored entry
+              Useful for checking that lookup latency stays bounded
+      */
+    uint32_t max_probe_distance() const
+    {
+      uint32_t res = 0;
+
+      for (size_type i = 0; i < capacity; i++)
+      {
+        if (metas[i] != 0 and (metas[i] & dist_mask) - 1 > res)
+        {
+          res = (metas[i] & dist_mask) - 1;
+        }
+      }
+
+      return res;
+    }
+
+    /**
+      @brief  Find the entry for a key
+      @return Iterator to the entry, or `end()` if the key does not exist
+      */
+    iterator find(const Key_T& key)
+    {
+      size_type pos = _find(key);
+      return pos == capacity ? end() : iterator(metas.get() + pos, metas.get() + capacity, entries + pos);
+    }
+
+    const_iterator find(const Key_T& key) const
+    {
+      size_type pos = _find(key);
+      return pos == capacity ? end() : const_iterator(metas.get() + pos, metas.get() + capacity, entries + pos);
+    }
+
+    /**
+      @brief  Prefetch the home slot of a key
+              Lets a caller issue the cache misses of several lookups before
+              performing any of them
+      */
+    void prefetch(const Key_T& key) const
+    {
+      if (capacity == 0)
+      {
+        return;
+      }
+
+#if defined(__GNUC__)
+      size_type pos = _home(_hash(key));
+
+      __builtin_prefetch(metas.get() + pos);
+      __builtin_prefetch(entries + pos);
+      __builtin_prefetch(reinterpret_cast<const char*>(entries + pos + 1) - 1);
+#else
+      (void)key;
+#endif
+    }
+
+    /**
+      @brief  Returns 1 if the key exists, otherwise 0
+      */
+    size_type count(const Key_T& key) const
+    {
+      return _find(key) == capacity ? 0 : 1;
+    }
+
+    /**
+      @brief  Returns the mapped value for a key
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    const Mapped_T& at(const Key_T& key) const
+    {
+      size_type pos = _find(key);
+
+      if (pos == capacity)
+      {
+        throw std::out_of_range("robin_hood_index::at() : key does not exist");
+      }
+
+      return entries[pos].second;
+    }
+
+    Mapped_T& at(const Key_T& key)
+    {
+      return const_cast<Mapped_T&>(const_cast<const robin_hood_index&>(*this).at(key));
+    }
+
+    /**
+      @brief  Insert an entry if its key does not already exist
+      @return Iterator to the entry with the key, and whether insertion took
+              place
+      @throw  std::length_error
+              If too many keys have colliding hashes (see `max_probe_length`)
+      */
+    std::pair<iterator, bool> insert(const std::pair<Key_T, Mapped_T>& item)
+    {
+      size_type pos = _find(item.first);
+
+      if (pos != capacity)
+      {
+        return std::make_pair(iterator(metas.get() + pos, metas.get() + capacity, entries + pos), false);
+      }
+
+      if (capacity == 0 or (n_entries + 1) * 8 > capacity * 7)
+      {
+        _rehash(capacity == 0 ? min_capacity : capacity * 2);
+      }
+
+      /* insertion may relocate other entries, so find the key again afterwards */
+      _insert_unique(item.first, item.second);
+
+      pos = _find(item.first);
+
+      return std::make_pair(iterator(metas.get() + pos, metas.get() + capacity, entries + pos), true);
+    }
+
+    /**
+      @brief  Erase the entry for a key, shifting the following entries back
+      @return Number of erased entries (0 or 1)
+      */
+    size_type erase(const Key_T& key)
+    {
+      size_type pos = _find(key);
+
+      if (pos == capacity)
+      {
+        return 0;
+      }
+
+      entries[pos].~value_type();
+
+      /* backward-shift: pull each displaced successor one slot towards its home */
+      size_type next = (pos + 1) & (capacity - 1);
+
+      while ((metas[next] & dist_mask) > 1)
+      {
+        new (entries + pos) value_type(std::move(entries[next]));
+        entries[next].~value_type();
+
+        metas[pos] = metas[next] - 1;
+
+        pos = next;
+        next = (next + 1) & (capacity - 1);
+      }
+
+      metas[pos] = 0;
+      n_entries--;
+
+      return 1;
+    }
+
+    /**
+      @brief  Remove all entries, keeping the allocated slots
+      */
+    void clear()
+    {
+      for (size_type i = 0; i < capacity; i++)
+      {
+        if (metas[i] != 0)
+        {
+          entries[i].~value_type();
+          metas[i] = 0;
+        }
+      }
+
+      n_entries = 0;
+    }
+
+    /**
+      @brief  Ensure that `n` entries fit without growing
+      */
+    void reserve(size_type n)
+    {
+      size_type new_capacity = capacity == 0 ? min_capacity : capacity;
+
+      while (n * 8 > new_capacity * 7)
+      {
+        new_capacity *= 2;
+      }
+
+      if (new_capacity != capacity)
+      {
+        _rehash(new_capacity);
+      }
+    }
+
+  protected:
+    //  =======
+    //  Helpers
+    //  =======
+
+    /**
+      @brief  Mix the user hash so that identity hashes of sequential integers
+              spread over the whole table
+      */
+    static uint64_t _hash(const Key_T& key)
+    {
+      return uint64_t(Hash()(key)) * 0x9e3779b97f4a7c15ull;
+    }
+
+    /**
+      @brief  Home slot of a hash (uses the high bits)
+      */
+    size_type _home(uint64_t h) const
+    {
+      return size_type(h >> shift);
+    }
+
+    /**
+      @brief  Fingerprint of a hash, already shifted into place
+      */
+    static meta_t _fingerprint(uint64_t h)
+    {
+      return meta_t(h << fingerprint_shift) & ~dist_mask;
+    }
+
+    /**
+      @brief  Returns the slot of key, or `capacity` if not found
+      */
+    size_type _find(const Key_T& key) const
+    {
+      if (n_entries == 0)
+      {
+        return capacity;
+      }
+
+      uint64_t h = _hash(key);
+      meta_t fp = _fingerprint(h);
+      size_type pos = _home(h);
+
+      for (meta_t dist = 1; dist <= max_probe_length + 1; dist++)
+      {
+        meta_t meta = metas[pos];
+
+        /* an empty slot or a richer entry ends the probe sequence */
+        if ((meta & dist_mask) < dist)
+        {
+          return capacity;
+        }
+
+        if ((meta & dist_mask) == dist and (meta & ~dist_mask) == fp and Key_Equal()(entries[pos].first, key))
+        {
+          return pos;
+        }
+
+        pos = (pos + 1) & (capacity - 1);
+      }
+
+      return capacity;
+    }
+
+    /**
+      @brief  Insert a key known not to exist, growing as needed
+      */
+    void _insert_unique(const Key_T& key, const Mapped_T& mapped)
+    {
+      value_type item(key, mapped);
+
+      while (!_try_place(item))
+      {
+        /* a sparse table only overflows on colliding hashes, e.g. of a degenerate Hash */
+        if ((n_entries + 1) * 8 < capacity)
+        {
+          throw std::length_error("robin_hood_index::insert() : too many keys with colliding hashes");
+        }
+
+        _rehash(capacity * 2);
+      }
+
+      n_entries++;
+    }
+
+    /**
+      @brief  Place an entry, displacing richer entries along the way
+              If the probe bound is hit, every displaced entry is put back so
+              that the table is unchanged, and false is returned
+      @note   item may be swapped with entries of the table, but it will hold
+              its original value again if false is returned
+      */
+    bool _try_place(value_type& item)
+    {
+      uint64_t h = _hash(item.first);
+      meta_t meta = _fingerprint(h) | 1;
+      size_type pos = _home(h);
+
+      /* first pass: check that the placement respects the probe bound */
+      {
+        meta_t carried = meta;
+        size_type p = pos;
+
+        while (metas[p] != 0)
+        {
+          if ((metas[p] & dist_mask) < (carried & dist_mask))
+          {
+            carried = metas[p];
+          }
+
+          carried++;
+
+          if ((carried & dist_mask) > max_probe_length + 1)
+          {
+            return false;
+          }
+
+          p = (p + 1) & (capacity - 1);
+        }
+      }
+
+      /* second pass: perform the displacement */
+      alignas(value_type) unsigned char buf[sizeof(value_type)];
+      value_type* carried_item = new (buf) value_type(std::move(item));
+
+      while (metas[pos] != 0)
+      {
+        if ((metas[pos] & dist_mask) < (meta & dist_mask))
+        {
+          std::swap(meta, metas[pos]);
+
+          value_type tmp(std::move(entries[pos]));
+          entries[pos].~value_type();
+          new (entries + pos) value_type(std::move(*carried_item));
+          carried_item->~value_type();
+          new (carried_item) value_type(std::move(tmp));
+        }
+
+        meta++;
+        pos = (pos + 1) & (capacity - 1);
+      }
+
+      new (entries + pos) value_type(std::move(*carried_item));
+      carried_item->~value_type();
+      metas[pos] = meta;
+
+      return true;
+    }
+
+    /**
+      @brief  Move all entries into a table with new_capacity slots
+      */
+    void _rehash(size_type new_capacity)
+    {
+      std::unique_ptr<meta_t[]> old_metas = std::move(metas);
+      value_type* old_entries = entries;
+      size_type old_capacity = capacity;
+
+      metas.reset(new meta_t[new_capacity]());
+      entries = std::allocator<value_type>().allocate(new_capacity);
+      capacity = new_capacity;
+      shift = 64 - _log2(new_capacity);
+
+      for (size_type i = 0; i < old_capacity; i++)
+      {
+        if (old_metas[i] != 0)
+        {
+          while (!_try_place(old_entries[i]))
+          {
+            /* pathological clustering: grow further and start over with the new entries */
+            _grow_during_rehash();
+          }
+
+          old_entries[i].~value_type();
+        }
+      }
+
+      if (old_entries != nullptr)
+      {
+        std::allocator<value_type>().deallocate(old_entries, old_capacity);
+      }
+    }
+
+    /**
+      @brief  Double the capacity of a table which is being rebuilt
+      */
+    void _grow_during_rehash()
+    {
+      std::unique_ptr<meta_t[]> cur_metas = std::move(metas);
+      value_type* cur_entries = entries;
+      size_type cur_capacity = capacity;
+
+      metas.reset(new meta_t[cur_capacity * 2]());
+      entries = std::allocator<value_type>().allocate(cur_capacity * 2);
+      capacity = cur_capacity * 2;
+      shift = 64 - _log2(capacity);
+
+      for (size_type i = 0; i < cur_capacity; i++)
+      {
+        if (cur_metas[i] != 0)
+        {
+          while (!_try_place(cur_entries[i]))
+          {
+            _grow_during_rehash();
+          }
+
+          cur_entries[i].~value_type();
+        }
+      }
+
+      std::allocator<value_type>().deallocate(cur_entries, cur_capacity);
+    }
+
+    static uint32_t _log2(size_type n)
+    {
+      uint32_t res = 0;
+
+      while ((size_type(1) << res) < n)
+      {
+        res++;
+      }
+
+      return res;
+    }
+
+    void _destroy()
+    {
+      clear();
+
+      if (entries != nullptr)
+      {
+        std::allocator<value_type>().deallocate(entries, capacity);
+      }
+
+      metas.reset();
+      entries = nullptr;
+      capacity = 0;
+      shift = 64;
+    }
+
+    void _copy(const robin_hood_index& other)
+    {
+      if (other.capacity == 0)
+      {
+        return;
+      }
+
+      metas.reset(new meta_t[other.capacity]());
+      entries = std::allocator<value_type>().allocate(other.capacity);
+      capacity = other.capacity;
+      shift = other.shift;
+
+      for (size_type i = 0; i < capacity; i++)
+      {
+        if (other.metas[i] != 0)
+        {
+          new (entries + i) value_type(other.entries[i]);
+          metas[i] = other.metas[i];
+          n_entries++;
+        }
+      }
+    }
+
+    void _swap(robin_hood_index& other)
+    {
+      std::swap(capacity, other.capacity);
+      std::swap(n_entries, other.n_entries);
+      std::swap(shift, other.shift);
+      std::swap(metas, other.metas);
+      std::swap(entries, other.entries);
+    }
+
+  protected:
+    //  ================
+    //  Member Variables
+    //  ================
+
+    /**
+      @brief  Number of slots, always zero or a power of two
+      */
+    size_type capacity;
+
+    /**
+      @brief  Number of stored entries
+      */
+    size_type n_entries;
+
+    /**
+      @brief  Right shift which maps a 64-bit hash to a home slot
+      */
+    uint32_t shift;
+
+    /**
+      @brief  Slot metadata (distance and fingerprint)
+      */
+    std::unique_ptr<meta_t[]> metas;
+
+    /**
+      @brief  Slot entries, constructed only where metadata is non-zero
+      */
+    value_type* entries;
+  };
+
+  /**
+    @brief  Path tag selecting `xu::robin_hood_index` for a polykey_map path
+            e.g. `xu::polykey_map<Order, unsigned long, xu::robin_hood<std::string>>`
+    @tparam Key_T
+            Key type of the path
+    */
+  template <typename Key_T, typename Hash = std::hash<Key_T>, typename Key_Equal = std::equal_to<Key_T>>
+  struct robin_hood
+  {};
+
+  template <typename Key_T, typename Hash, typename Key_Equal>
+  struct path_traits<robin_hood<Key_T, Hash, Key_Equal>>
+  {
+    using key_type = Key_T;
+
+    using hasher = Hash;
+
+    using key_equal = Key_Equal;
+
+    template <typename Mapped_T>
+    using index_type = robin_hood_index<Key_T, Mapped_T, Hash, Key_Equal>;
+  };
+}
@@ -0,0 +1,154 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace xu
+{
+  /**
+    @brief  Bounded single-producer single-consumer ring buffer
+            One thread may push and one (other) thread may pop concurrently.
+            The producer and consumer indices live on separate cache lines,
+            and each side keeps a private copy of the other side's index so
+            that it only reads the shared one when the ring looks full (or
+            empty).
+    @tparam T
+            Item type. Should be cheap to copy, e.g. a pointer.
+    */
+  template <typename T>
+  class spsc_ring
+  {
+  public:
+    /**
+      @brief  Construct ring holding up to capacity_ items
+              Capacity is rounded up to a power of two
+      */
+    explicit spsc_ring(size_t capacity_)
+      : capacity(_round_up(capacity_)),
+        items(new T[capacity])
+    {
+      producer.index.store(0, std::memory_order_relaxed);
+      producer.cached_other = 0;
+      consumer.index.store(0, std::memory_order_relaxed);
+      consumer.cached_other = 0;
+    }
+
+    spsc_ring(const spsc_ring& other) = delete;
+
+    spsc_ring& operator=(const spsc_ring& other) = delete;
+
+    /**
+      @brief  Push an item (producer only)
+      @return false if the ring is full
+      */
+    bool try_push(const T& item)
+    {
+      size_t head = producer.index.load(std::memory_order_relaxed);
+
+      if (head - producer.cached_other == capacity)
+      {
+        producer.cached_other = consumer.index.load(std::memory_order_acquire);
+
+        if (head - producer.cached_other == capacity)
+        {
+          return false;
+        }
+      }
+
+      items[head & (capacity - 1)] = item;
+      producer.index.store(head + 1, std::memory_order_release);
+
+      return true;
+    }
+
+    /**
+      @brief  Pop an item (consumer only)
+      @return false if the ring is empty
+      */
+    bool try_pop(T& item)
+    {
+      size_t tail = consumer.index.load(std::memory_order_relaxed);
+
+      if (tail == consumer.cached_other)
+      {
+        consumer.cached_other = producer.index.load(std::memory_order_acquire);
+
+        if (tail == consumer.cached_other)
+        {
+          return false;
+        }
+      }
+
+      item = items[tail & (capacity - 1)];
+      consumer.index.store(tail + 1, std::memory_order_release);
+
+      return true;
+    }
+
+    /**
+      @brief  Check whether the ring is empty
+      @note   Only exact when called by the consumer
+      */
+    bool empty() const
+    {
+      return consumer.index.load(std::memory_order_acquire) == producer.index.load(std::memory_order_acquire);
+    }
+
+  protected:
+    static size_t _round_up(size_t n)
+    {
+      size_t res = 1;
+
+      while (res < n)
+      {
+        res *= 2;
+      }
+
+      return res;
+    }
+
+    /**
+      @brief  One side's index and its cached view of the other side's index
+      */
+    struct alignas(64) side_t
+    {
+      std::atomic<size_t> index;
+
+      size_t cached_other;
+    };
+
+  protected:
+    const size_t capacity;
+
+    std::unique_ptr<T[]> items;
+
+    side_t producer;
+
+    side_t consumer;
+  };
+}
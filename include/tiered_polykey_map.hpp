@@ -0,0 +1,524 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+namespace xu
+{
+  /**
+    @brief  A polykey_map which moves rows that have not been accessed for a
+            while to local files
+            Rows live in an in-memory "hot" polykey_map, which also records
+            when each row was last accessed. `spill()` appends the rows not
+            accessed within the configured period to a new cold segment: an
+            immutable snapshot file (see `polykey_snapshot.hpp`) with an
+            on-disk index per path, used through a memory mapping. Accessing
+            a cold row through `at<P>()` or `find<P>()` moves it back to the
+            hot map.
+            Segments only ever get appended, and rows which were moved back
+            or erased are marked dead in their segment. `compact()` merges all
+            segments into one without the dead rows.
+    @note   Key uniqueness is checked against the cold segments too, so
+            insertions of new keys probe each segment's index.
+    @tparam Value_T
+            Type of the stored values. Must have a `xu::codec`.
+    @tparam Path_Ts
+            Each path's type (or path tag). Keys must have a `xu::codec`.
+    */
+  template <typename Value_T, typename ...Path_Ts>
+  class tiered_polykey_map
+  {
+  protected:
+    using path_index_t = size_t;
+
+    template <path_index_t P>
+    using Path_T = path_key_t<typename std::tuple_element<P, std::tuple<Path_Ts...>>::type>;
+
+    static const path_index_t N_Paths = sizeof...(Path_Ts);
+
+  public:
+    using clock_t = std::chrono::steady_clock;
+
+    using snapshot_t = mapped_snapshot<Value_T, Path_Ts...>;
+
+    using row_index_t = typename snapshot_t::row_index_t;
+
+    /**
+      @brief  Hot row: value and time of last access
+      */
+    struct entry_t
+    {
+      entry_t(const Value_T& value_)
+        : value(value_),
+          touched(clock_t::now())
+      {}
+
+      Value_T value;
+
+      clock_t::time_point touched;
+    };
+
+    using hot_map_t = polykey_map<entry_t, Path_Ts...>;
+
+    using key_conflict_error = typename hot_map_t::key_conflict_error;
+
+  protected:
+    /**
+      @brief  A cold segment file
+      */
+    struct segment_t
+    {
+      std::string path;
+
+      std::unique_ptr<snapshot_t> snapshot;
+
+      /**
+        @brief  Rows which were moved back to the hot map or erased
+        */
+      std::unordered_set<row_index_t> dead;
+    };
+
+  public:
+    /**
+      @brief  Constructor
+      @param  path_prefix_
+              Prefix of the segment files, e.g. "/var/tmp/orders". Segments
+              are named "<prefix>.<n>.seg".
+      @param  cold_after_
+              Period after which rows not accessed are spilled
+      @param  max_segments_
+              Number of segments above which `spill()` compacts them
+      */
+    tiered_polykey_map(const std::string& path_prefix_, clock_t::duration cold_after_, size_t max_segments_ = 8)
+      : path_prefix(path_prefix_),
+        cold_after(cold_after_),
+        max_segments(max_segments_),
+        next_segment(0)
+    {}
+
+    /**
+      @brief  Destructor, removes the segment files
+      */
+    ~tiered_polykey_map()
+    {
+      for (auto& segment : segments)
+      {
+        segment.snapshot.reset();
+        std::remove(segment.path.c_str());
+      }
+    }
+
+    tiered_polykey_map(const tiered_polykey_map& other) = delete;
+
+    tiered_polykey_map& operator=(const tiered_polykey_map& other) = delete;
+
+    //  ========
+    //  Capacity
+    //  ========
+
+    /**
+      @brief  Returns number of rows, hot and cold
+      */
+    size_t size() const
+    {
+      return hot.size() + cold_size();
+    }
+
+    /**
+      @brief  Returns number of rows in memory
+      */
+    size_t hot_size() const
+    {
+      return hot.size();
+    }
+
+    /**
+      @brief  Returns number of live rows in segment files
+      */
+    size_t cold_size() const
+    {
+      size_t n = 0;
+
+      for (auto& segment : segments)
+      {
+        n += segment.snapshot->size() - segment.dead.size();
+      }
+
+      return n;
+    }
+
+    /**
+      @brief  Returns number of segment files
+      */
+    size_t segment_count() const
+    {
+      return segments.size();
+    }
+
+    //  ======
+    //  Lookup
+    //  ======
+
+    /**
+      @brief  Check whether key exists for a path, without moving its row
+      */
+    template <path_index_t P>
+    bool contains(const Path_T<P>& key) const
+    {
+      return hot.template contains<P>(key) or _find_cold<P>(key).has_value();
+    }
+
+    /**
+      @brief  Get the value of a key, moving a cold row back to memory
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    template <path_index_t P>
+    Value_T& at(const Path_T<P>& key)
+    {
+      Value_T* value = find<P>(key);
+
+      if (value == nullptr)
+      {
+        throw std::out_of_range("tiered_polykey_map::at() : key does not exist for path");
+      }
+
+      return *value;
+    }
+
+    /**
+      @brief  Find the value of a key, moving a cold row back to memory
+      @return Pointer to value, or nullptr if key does not exist
+      */
+    template <path_index_t P>
+    Value_T* find(const Path_T<P>& key)
+    {
+      auto it = hot.template find<P>(key);
+
+      if (it == hot.end())
+      {
+        if (!_fault<P>(key))
+        {
+          return nullptr;
+        }
+
+        it = hot.template find<P>(key);
+      }
+
+      it->touched = clock_t::now();
+
+      return &it->value;
+    }
+
+    //  =========
+    //  Modifiers
+    //  =========
+
+    /**
+      @brief  Insert a new value
+      @throw  key_conflict_error
+              If key already exists for path, hot or cold
+      */
+    template <path_index_t P>
+    void insert(const Path_T<P>& key, const Value_T& value)
+    {
+      if (_find_cold<P>(key))
+      {
+        throw key_conflict_error("tiered_polykey_map::insert() : key already exists for path");
+      }
+
+      hot.template insert<P>(key, entry_t(value));
+    }
+
+    /**
+      @brief  Link two keys, moving the row of the existing key to memory
+      @throw  std::out_of_range
+              If neither key exists
+      @throw  key_conflict_error
+              If both keys exist
+      */
+    template <path_index_t P1, path_index_t P2>
+    void link(const Path_T<P1>& key1, const Path_T<P2>& key2)
+    {
+      bool has_key1 = contains<P1>(key1);
+      bool has_key2 = contains<P2>(key2);
+
+      if (!has_key1 and !has_key2)
+      {
+        throw std::out_of_range("tiered_polykey_map::link() : keys do not exist");
+      }
+
+      if (has_key1 and has_key2)
+      {
+        throw key_conflict_error("tiered_polykey_map::link() : both keys already exist");
+      }
+
+      if (has_key1)
+      {
+        _fault<P1>(key1);
+      }
+      else
+      {
+        _fault<P2>(key2);
+      }
+
+      hot.template link<P1, P2>(key1, key2);
+    }
+
+    /**
+      @brief  Remove a value and all keys which point to it
+      @throw  std::out_of_range
+              If key does not exist
+      */
+    template <path_index_t P>
+    void erase(const Path_T<P>& key)
+    {
+      if (hot.template contains<P>(key))
+      {
+        hot.template erase<P>(key);
+        return;
+      }
+
+      std::optional<std::pair<size_t, row_index_t>> cold = _find_cold<P>(key);
+
+      if (!cold)
+      {
+        throw std::out_of_range("tiered_polykey_map::erase() : key does not exist for path");
+      }
+
+      segments[cold->first].dead.insert(cold->second);
+    }
+
+    //  =======
+    //  Tiering
+    //  =======
+
+    /**
+      @brief  Move rows not accessed since `now - cold_after` to a new
+              segment
+      @param  now
+              Current time
+      @return Number of rows moved
+      @throw  std::system_error
+              If the segment cannot be written
+      */
+    size_t spill(clock_t::time_point now = clock_t::now())
+    {
+      clock_t::time_point cutoff = now - cold_after;
+
+      std::string path = _segment_path(next_segment);
+
+      size_t n_spilled = 0;
+
+      {
+        snapshot_writer<Value_T, Path_Ts...> writer(path);
+
+        hot.for_each_row([&writer, &cutoff, &n_spilled](const auto& keys, const entry_t& entry)
+        {
+          if (entry.touched <= cutoff)
+          {
+            writer.add_row(keys, entry.value);
+            n_spilled++;
+          }
+        });
+
+        if (n_spilled == 0)
+        {
+          return 0;
+        }
+
+        writer.finish();
+      }
+
+      next_segment++;
+
+      segments.push_back(segment_t{path, std::make_unique<snapshot_t>(path), {}});
+
+      /* only drop the rows once they are safely written */
+      for (auto it = hot.begin(); it != hot.end();)
+      {
+        if (it->touched <= cutoff)
+        {
+          it = hot.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+
+      if (segments.size() > max_segments)
+      {
+        compact();
+      }
+
+      return n_spilled;
+    }
+
+    /**
+      @brief  Merge all segments into one, dropping dead rows
+      @throw  std::system_error
+              If the merged segment cannot be written
+      */
+    void compact()
+    {
+      if (segments.empty() or (segments.size() == 1 and segments[0].dead.empty()))
+      {
+        return;
+      }
+
+      std::string path = _segment_path(next_segment);
+
+      size_t n_live = 0;
+
+      {
+        snapshot_writer<Value_T, Path_Ts...> writer(path);
+
+        for (auto& segment : segments)
+        {
+          for (row_index_t row = 0; row < segment.snapshot->size(); row++)
+          {
+            if (segment.dead.count(row) == 0)
+            {
+              std::pair<const char*, size_t> rec = segment.snapshot->record(row);
+              writer.add_record(rec.first, rec.second);
+              n_live++;
+            }
+          }
+        }
+
+        writer.finish();
+      }
+
+      next_segment++;
+
+      for (auto& segment : segments)
+      {
+        segment.snapshot.reset();
+        std::remove(segment.path.c_str());
+      }
+
+      segments.clear();
+
+      if (n_live != 0)
+      {
+        segments.push_back(segment_t{path, std::make_unique<snapshot_t>(path), {}});
+      }
+      else
+      {
+        std::remove(path.c_str());
+      }
+    }
+
+  protected:
+    //  =======
+    //  Helpers
+    //  =======
+
+    std::string _segment_path(size_t n) const
+    {
+      return path_prefix + "." + std::to_string(n) + ".seg";
+    }
+
+    /**
+      @brief  Find the live cold row of a key, newest segment first
+      @return (segment index, row), or nothing if key is not cold
+      */
+    template <path_index_t P>
+    std::optional<std::pair<size_t, row_index_t>> _find_cold(const Path_T<P>& key) const
+    {
+      for (size_t i = segments.size(); i-- > 0;)
+      {
+        std::optional<row_index_t> row = segments[i].snapshot->template find<P>(key);
+
+        if (row and segments[i].dead.count(*row) == 0)
+        {
+          return std::make_pair(i, *row);
+        }
+      }
+
+      return std::nullopt;
+    }
+
+    /**
+      @brief  Move the cold row of a key back to the hot map
+      @return Whether the key was found
+      */
+    template <path_index_t P>
+    bool _fault(const Path_T<P>& key)
+    {
+      std::optional<std::pair<size_t, row_index_t>> cold = _find_cold<P>(key);
+
+      if (!cold)
+      {
+        return false;
+      }
+
+      segment_t& segment = segments[cold->first];
+
+      segment.snapshot->insert_into(cold->second, hot);
+      segment.dead.insert(cold->second);
+
+      return true;
+    }
+
+  protected:
+    //  ================
+    //  Member Variables
+    //  ================
+
+    const std::string path_prefix;
+
+    const clock_t::duration cold_after;
+
+    const size_t max_segments;
+
+    /**
+      @brief  Number of the next segment file
+      */
+    size_t next_segment;
+
+    hot_map_t hot;
+
+    /**
+      @brief  Cold segments, oldest first
+      */
+    std::vector<segment_t> segments;
+  };
+}
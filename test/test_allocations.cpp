@@ -0,0 +1,202 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../bench/alloc_counter.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_allocations test_allocations.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+/* allowance for the growth of hash tables over n operations */
+const uint64_t rehash_allowance = 64;
+
+int main()
+{
+  const size_t n = 10000;
+
+  OrderTracker otk;
+
+  /* long enough not to fit in the small string buffer */
+  std::vector<std::string> external_ids;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    external_ids.push_back("external-order-id-" + std::to_string(i));
+  }
+
+  /* insert: one node for the value, the keyset and the key */
+  {
+    alloc_scope scope;
+
+    for (size_t i = 0; i < n; i++)
+    {
+      otk.insert<InternalOrderId>(i, Order{"IBM", int(i)});
+    }
+
+    assert(scope.allocs() <= 3 * n + rehash_allowance);
+  }
+
+  /* link: the key node, and the key in it and in the keyset */
+  {
+    alloc_scope scope;
+
+    for (size_t i = 0; i < n; i++)
+    {
+      otk.link<InternalOrderId, ExternalOrderId>(i, external_ids[i]);
+    }
+
+    assert(scope.allocs() <= 3 * n + rehash_allowance);
+  }
+
+  /* lookups, conversions, in-place changes and iteration allocate nothing */
+  {
+    alloc_scope scope;
+    long checksum = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+      checksum += otk.at<ExternalOrderId>(external_ids[i]).svol;
+      checksum += otk.find<InternalOrderId>(i)->svol;
+      checksum += otk.contains<ExternalOrderId>(external_ids[i]);
+      checksum += otk.convert_key<ExternalOrderId, InternalOrderId>(external_ids[i]);
+      checksum += otk.is_linked<InternalOrderId, ExternalOrderId>(i);
+
+      otk.modify<InternalOrderId>(i, [](Order& order) { order.svol++; });
+    }
+
+    for (const Order& order : otk)
+    {
+      checksum += order.svol;
+    }
+
+    otk.for_each_row([&](const OrderTracker::keyset_type& keys, const Order&)
+    {
+      checksum += keys.get<ExternalOrderId>().size();
+    });
+
+    otk.for_each_key<ExternalOrderId>([&](const std::string&, const Order& order)
+    {
+      checksum += order.svol;
+    });
+
+    assert(checksum != 0);
+    assert(scope.allocs() == 0);
+  }
+
+  /* copy: the nodes and keys of each row once */
+  {
+    alloc_scope scope;
+
+    OrderTracker copy(otk);
+    scope.stop();
+
+    assert(copy.size() == n);
+    assert(scope.allocs() <= 6 * n + rehash_allowance);
+  }
+
+  /* snapshot lookups allocate nothing once the key buffer has grown */
+  {
+    const std::string path = "test_allocations.snap";
+
+    xu::save_snapshot(otk, path);
+
+    {
+      xu::mapped_snapshot<Order, InternalOrderId_t, ExternalOrderId_t> snapshot(path);
+      snapshot.find<ExternalOrderId>(external_ids[n - 1]);
+
+      alloc_scope scope;
+      size_t n_found = 0;
+
+      for (size_t i = 0; i < n; i++)
+      {
+        n_found += bool(snapshot.find<ExternalOrderId>(external_ids[i]));
+        n_found += bool(snapshot.find<InternalOrderId>(i));
+      }
+
+      assert(n_found == 2 * n);
+      assert(scope.allocs() == 0);
+    }
+
+    std::remove(path.c_str());
+  }
+
+  /* erase only frees */
+  {
+    alloc_scope scope;
+
+    for (size_t i = 0; i < n; i += 2)
+    {
+      otk.erase<InternalOrderId>(i);
+      otk.erase<ExternalOrderId>(external_ids[i + 1]);
+    }
+
+    assert(otk.size() == 0);
+    assert(scope.allocs() == 0);
+    assert(scope.frees() >= 6 * n);
+  }
+
+  std::cout << "allocation tests passed" << std::endl;
+
+  return 0;
+}
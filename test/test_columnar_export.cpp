@@ -0,0 +1,251 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "columnar_export.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_columnar_export test_columnar_export.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+/* keyset with only an internal id, for add_row() */
+struct internal_only
+{
+  InternalOrderId_t id;
+
+  template <size_t P>
+  bool has_value() const
+  {
+    return P == InternalOrderId;
+  }
+
+  template <size_t P>
+  auto get() const
+  {
+    if constexpr (P == InternalOrderId)
+    {
+      return id;
+    }
+    else
+    {
+      return ExternalOrderId_t();
+    }
+  }
+};
+
+int main()
+{
+  const std::string path = "test_columnar_export.col";
+
+  OrderTracker otk;
+
+  for (unsigned long i = 0; i < 1000; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"T" + std::to_string(i % 7), int(i)});
+
+    /* only even rows have an external id */
+    if (i % 2 == 0)
+    {
+      otk.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+    }
+  }
+
+  /* a row with no internal id */
+  otk.insert<ExternalOrderId>("only-external", Order{"IBM", -5});
+
+  xu::export_columnar(otk, path, 300, {"internal_id", "external_id"},
+    xu::value_projection("ticker", [](const Order& o) { return o.ticker; }),
+    xu::value_projection("notional", [](const Order& o) { return o.svol * 1.5; }),
+    xu::value_projection("big", [](const Order& o) { return o.svol > 500 ? std::optional<bool>(o.svol > 900) : std::nullopt; }));
+
+  {
+    xu::columnar_file file(path);
+    assert(file.n_rows() == 1001);
+    assert(file.n_batches() == 4);
+    assert(file.batch_rows(3) == 101);
+    assert(file.n_columns() == 5);
+    assert(file.column_name(1) == "external_id");
+    assert(file.type(0) == xu::column_type::uint64);
+    assert(file.type(1) == xu::column_type::utf8);
+    assert(file.type(3) == xu::column_type::float64);
+    assert(file.type(4) == xu::column_type::boolean);
+
+    size_t internal = file.column_index("internal_id");
+    size_t external = file.column_index("external_id");
+    size_t ticker = file.column_index("ticker");
+    size_t notional = file.column_index("notional");
+    size_t big = file.column_index("big");
+
+    size_t seen = 0;
+
+    for (size_t b = 0; b < file.n_batches(); b++)
+    {
+      for (uint64_t r = 0; r < file.batch_rows(b); r++)
+      {
+        seen++;
+
+        if (!file.is_valid(b, internal, r))
+        {
+          assert(file.get<std::string>(b, external, r) == "only-external");
+          assert(file.get<std::string>(b, ticker, r) == "IBM");
+          assert(file.get<double>(b, notional, r) == -7.5);
+          assert(!file.is_valid(b, big, r));
+          continue;
+        }
+
+        unsigned long id = file.get<unsigned long>(b, internal, r);
+        const Order& order = otk.at<InternalOrderId>(id);
+
+        assert(file.is_valid(b, external, r) == (id % 2 == 0));
+        assert(file.get<std::string>(b, external, r) == (id % 2 == 0 ? "E" + std::to_string(id) : ""));
+        assert(file.get<std::string>(b, ticker, r) == order.ticker);
+        assert(file.get<double>(b, notional, r) == order.svol * 1.5);
+        assert(file.is_valid(b, big, r) == (order.svol > 500));
+        assert(!file.is_valid(b, big, r) or file.get<bool>(b, big, r) == (order.svol > 900));
+      }
+    }
+
+    assert(seen == 1001);
+
+    bool caught = false;
+
+    try
+    {
+      file.get<int>(0, internal, 0);
+    }
+    catch (const std::invalid_argument& e)
+    {
+      caught = true;
+    }
+
+    assert(caught);
+  }
+
+  /* streaming rows one at a time, none here */
+  {
+    auto svol = xu::value_projection("svol", [](const Order& o) { return o.svol; });
+
+    xu::columnar_exporter<OrderTracker, decltype(svol.f)> exporter(path, {"internal_id", "external_id"}, std::make_tuple(svol));
+    exporter.finish();
+  }
+
+  {
+    xu::columnar_file file(path);
+    assert(file.n_rows() == 0);
+    assert(file.n_batches() == 0);
+    assert(file.n_columns() == 3);
+    assert(file.type(2) == xu::column_type::int32);
+  }
+
+  /* a row whose projection throws is not added, and leaves the batch intact */
+  {
+    auto svol = xu::value_projection("svol", [](const Order& o)
+    {
+      if (o.svol == 3)
+      {
+        throw std::runtime_error("no svol");
+      }
+
+      return o.svol;
+    });
+
+    xu::columnar_exporter<OrderTracker, decltype(svol.f)> exporter(path, {"internal_id", "external_id"}, std::make_tuple(svol));
+    size_t n_failed = 0;
+
+    for (unsigned long i = 0; i < 6; i++)
+    {
+      try
+      {
+        exporter.add_row(internal_only{i}, otk.at<InternalOrderId>(i));
+      }
+      catch (const std::runtime_error&)
+      {
+        n_failed++;
+      }
+    }
+
+    exporter.finish();
+
+    assert(n_failed == 1);
+
+    xu::columnar_file file(path);
+    assert(file.n_rows() == 5);
+
+    for (uint64_t r = 0; r < 5; r++)
+    {
+      assert(file.get<unsigned long>(0, 0, r) == InternalOrderId_t(file.get<int>(0, 2, r)));
+    }
+  }
+
+  /* files which are not columnar files are rejected */
+  {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fputs("not a columnar file, but long enough to be one", file);
+    std::fclose(file);
+
+    bool caught = false;
+
+    try
+    {
+      xu::columnar_file bad(path);
+    }
+    catch (const xu::format_error& e)
+    {
+      std::cout << "Rejected: " << e.what() << std::endl;
+      caught = true;
+    }
+
+    assert(caught);
+  }
+
+  std::remove(path.c_str());
+
+  std::cout << "columnar_export tests passed" << std::endl;
+
+  return 0;
+}
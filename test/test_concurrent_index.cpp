@@ -0,0 +1,139 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "concurrent_index.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_concurrent_index test_concurrent_index.cpp
+
+void readersWritersTest()
+{
+  using index_t = xu::concurrent_index<unsigned long, unsigned long>;
+
+  index_t index;
+
+  const unsigned long n_stable = 1000;
+
+  /* keys which are never erased must always be visible to readers */
+  for (unsigned long i = 0; i < n_stable; i++)
+  {
+    index.insert(std::make_pair(i, i * 2));
+  }
+
+  std::atomic<bool> done(false);
+  std::atomic<unsigned long> n_lookups(0);
+  std::atomic<unsigned long> n_missing(0);
+
+  std::vector<std::thread> readers;
+
+  for (int t = 0; t < 4; t++)
+  {
+    readers.emplace_back([&, t]()
+    {
+      unsigned long i = t;
+
+      while (!done.load())
+      {
+        std::optional<unsigned long> mapped = index.get(i % n_stable);
+
+        if (!mapped or *mapped != (i % n_stable) * 2)
+        {
+          n_missing++;
+        }
+
+        i += 7;
+        n_lookups++;
+      }
+    });
+  }
+
+  std::vector<std::thread> writers;
+
+  for (int t = 0; t < 2; t++)
+  {
+    writers.emplace_back([&, t]()
+    {
+      /* churn which forces rehashes and reclamation */
+      for (unsigned long round = 0; round < 4; round++)
+      {
+        unsigned long base = n_stable + (t + 1) * 1000000 + round * 100000;
+
+        for (unsigned long i = 0; i < 20000; i++)
+        {
+          index.insert(std::make_pair(base + i, i));
+        }
+
+        for (unsigned long i = 0; i < 20000; i++)
+        {
+          assert(index.erase(base + i) == 1);
+        }
+      }
+    });
+  }
+
+  for (auto& writer : writers)
+  {
+    writer.join();
+  }
+
+  done = true;
+
+  for (auto& reader : readers)
+  {
+    reader.join();
+  }
+
+  std::cout << "lookups=" << n_lookups << " missing=" << n_missing << " size=" << index.size() << std::endl;
+
+  assert(n_missing == 0);
+  assert(index.size() == n_stable);
+}
+
+int main()
+{
+  readersWritersTest();
+
+  xu::concurrent_index<std::string, unsigned long> index;
+
+  index.insert(std::make_pair(std::string("1337"), 13ul));
+
+  assert(index.contains("1337"));
+  assert(index.at("1337") == 13);
+
+  xu::concurrent_index<std::string, unsigned long> index_copy = index;
+
+  assert(index.erase("1337") == 1);
+
+  assert(!index.contains("1337"));
+  assert(!index.get("1337"));
+  assert(index_copy.contains("1337"));
+
+  std::cout << "index_copy.size()=" << index_copy.size() << std::endl;
+}
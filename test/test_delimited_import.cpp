@@ -0,0 +1,141 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "delimited_import.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_delimited_import test_delimited_import.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+Order make_order(const xu::delimited_row_t& row)
+{
+  return Order{std::string(row.at(2)), std::stoi(std::string(row.at(3)))};
+}
+
+int main()
+{
+  const std::string path = "test_delimited_import.csv";
+
+  {
+    std::ofstream csv(path, std::ios::binary);
+    csv << "internal_id,external_id,ticker,svol\n";
+
+    for (int i = 0; i < 100; i++)
+    {
+      csv << i << ",E" << i << ",T" << i % 5 << "," << i * 10 << "\n";
+    }
+
+    csv << "100,,IBM,1\r\n";           // line 102: no external id, CRLF
+    csv << "\n";                       // line 103: empty
+    csv << ",E101,IBM,2\n";            // line 104: no internal id
+    csv << "abc,E102,IBM,3\n";         // line 105: bad key
+    csv << ",,IBM,4\n";                // line 106: no keys
+    csv << "103,E5,IBM,5\n";           // line 107: duplicate external id
+    csv << "104,E104,IBM,many\n";      // line 108: bad value
+    csv << "900,E900,IBM,6\n";         // line 109: already in the map
+    csv << "105,E105,IBM";             // line 110: short line, no newline at the end
+  }
+
+  for (size_t n_threads : {1, 3})
+  {
+    OrderTracker otk;
+    otk.insert<InternalOrderId>(900, Order{"MSFT", 0});
+
+    xu::delimited_options_t options;
+    options.n_threads = n_threads;
+    options.chunk_bytes = 64;
+
+    xu::import_report_t report = xu::import_delimited(path, otk, {0, 1}, make_order, options);
+
+    assert(report.n_lines == 108);
+    assert(report.n_inserted == 102);
+    assert(otk.size() == 103);
+
+    assert(otk.at<InternalOrderId>(42).ticker == "T2");
+    assert(otk.at<ExternalOrderId>("E42").svol == 420);
+    assert(otk.at<InternalOrderId>(100).svol == 1);
+    assert(!otk.contains<ExternalOrderId>(""));
+    assert(otk.at<ExternalOrderId>("E101").svol == 2);
+    assert(!otk.contains<InternalOrderId>(103));
+    assert(otk.at<InternalOrderId>(5).svol == 50);
+    assert(otk.at<InternalOrderId>(900).ticker == "MSFT");
+
+    assert(report.issues.size() == 6);
+    assert(report.issues[0].line == 105 and report.issues[0].kind == xu::import_issue_t::parse_error);
+    assert(report.issues[1].line == 106 and report.issues[1].kind == xu::import_issue_t::no_keys);
+    assert(report.issues[2].line == 107 and report.issues[2].kind == xu::import_issue_t::conflict and report.issues[2].path == ExternalOrderId);
+    assert(report.issues[3].line == 108 and report.issues[3].kind == xu::import_issue_t::parse_error);
+    assert(report.issues[4].line == 109 and report.issues[4].kind == xu::import_issue_t::conflict and report.issues[4].path == InternalOrderId);
+    assert(report.issues[5].line == 110 and report.issues[5].kind == xu::import_issue_t::parse_error);
+
+    for (const xu::import_issue_t& issue : report.issues)
+    {
+      std::cout << "line " << issue.line << ": " << issue.message << std::endl;
+    }
+  }
+
+  /* a missing file */
+  bool caught = false;
+
+  try
+  {
+    OrderTracker otk;
+    xu::import_delimited("no_such_file.csv", otk, {0, 1}, make_order);
+  }
+  catch (const std::system_error& e)
+  {
+    caught = true;
+  }
+
+  assert(caught);
+
+  std::remove(path.c_str());
+
+  std::cout << "delimited_import tests passed" << std::endl;
+
+  return 0;
+}
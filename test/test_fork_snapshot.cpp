@@ -0,0 +1,125 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "fork_snapshot.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_fork_snapshot test_fork_snapshot.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+int main()
+{
+  const std::string path = "test_fork_snapshot.snap";
+
+  OrderTracker otk;
+
+  for (unsigned long i = 0; i < 10000; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"T" + std::to_string(i), int(i)});
+    otk.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+  }
+
+  xu::snapshot_process child = xu::fork_snapshot(otk, path);
+
+  /* the parent keeps going, without affecting the snapshot */
+  otk.at<InternalOrderId>(0).svol = -1;
+  otk.erase<InternalOrderId>(1);
+  otk.insert<InternalOrderId>(10000, Order{"NEW", 1});
+
+  child.wait();
+  assert(child.id() == -1);
+
+  OrderTracker loaded;
+  xu::load_snapshot(path, loaded);
+
+  assert(loaded.size() == 10000);
+  assert(loaded.at<InternalOrderId>(0).svol == 0);
+  assert(loaded.contains<InternalOrderId>(1));
+  assert(!loaded.contains<InternalOrderId>(10000));
+
+  std::cout << "Snapshot has " << loaded.size() << " rows" << std::endl;
+
+  /* errors in the child are reported by wait() */
+  xu::snapshot_process failing = xu::fork_snapshot(otk, "no/such/directory/x.snap");
+
+  while (!failing.done())
+  {}
+
+  bool caught = false;
+
+  try
+  {
+    failing.wait();
+  }
+  catch (const std::runtime_error& e)
+  {
+    std::cout << e.what() << std::endl;
+    caught = true;
+  }
+
+  assert(caught);
+
+  std::remove(path.c_str());
+
+  return 0;
+}
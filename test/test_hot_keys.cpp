@@ -0,0 +1,179 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "hot_keys.hpp"
+#include "polykey_map.hpp"
+#include "robin_hood_index.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_hot_keys test_hot_keys.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+/* key without a std::hash specialization, hashed through its path tag */
+struct Venue
+{
+  int id;
+
+  bool operator==(const Venue& other) const
+  {
+    return id == other.id;
+  }
+};
+
+struct VenueHash
+{
+  size_t operator()(const Venue& venue) const
+  {
+    return size_t(venue.id);
+  }
+};
+
+using VenueTracker = xu::polykey_map<Order, InternalOrderId_t, xu::robin_hood<Venue, VenueHash>>;
+
+int main()
+{
+  /* space saving: heavy hitters survive a long tail of distinct keys */
+  {
+    xu::space_saving<int> counts(8);
+
+    for (int i = 0; i < 10000; i++)
+    {
+      counts.add(i % 3 == 0 ? 7 : 1000 + i);
+
+      if (i % 5 == 0)
+      {
+        counts.add(42, 2);
+      }
+    }
+
+    assert(counts.size() == 8);
+    assert(counts.total_count() == 10000 + 2 * 2000);
+
+    auto top = counts.top(2);
+
+    assert(top.size() == 2);
+    assert(top[0].key == 42 and top[1].key == 7);
+
+    /* counts overestimate by at most error */
+    assert(top[0].count >= 4000 and top[0].count - top[0].error <= 4000);
+    assert(top[1].count >= 3334 and top[1].count - top[1].error <= 3334);
+
+    assert(counts.top(100).size() == 8);
+
+    counts.clear();
+    assert(counts.size() == 0 and counts.top(1).empty());
+  }
+
+  OrderTracker otk;
+
+  for (unsigned long i = 0; i < 1000; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"IBM", int(i)});
+    otk.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+  }
+
+  {
+    xu::hot_key_sampler<OrderTracker> sampler(otk, 16, 4);
+
+    for (unsigned long i = 0; i < 100000; i++)
+    {
+      /* one hot order on each path */
+      otk.at<InternalOrderId>(i % 4 == 0 ? 13 : i % 1000);
+
+      const OrderTracker& cotk = otk;
+      cotk.find<ExternalOrderId>(i % 2 == 0 ? "E99" : "missing-" + std::to_string(i % 500));
+    }
+
+    /* one in four lookups of each path, at random intervals */
+    assert(sampler.n_sampled<InternalOrderId>() > 24000 and sampler.n_sampled<InternalOrderId>() < 26000);
+    assert(sampler.n_sampled<ExternalOrderId>() > 24000 and sampler.n_sampled<ExternalOrderId>() < 26000);
+
+    assert(sampler.top<InternalOrderId>(1)[0].key == 13);
+    assert(sampler.top<ExternalOrderId>(1)[0].key == "E99");
+    assert(sampler.top<ExternalOrderId>(1)[0].count >= sampler.n_sampled<ExternalOrderId>() / 2);
+  }
+
+  {
+    xu::hot_key_sampler<OrderTracker> sampler(otk, 16, 1);
+
+    /* lookups which throw are sampled too */
+    for (int i = 0; i < 4; i++)
+    {
+      try
+      {
+        otk.at<InternalOrderId>(5000);
+      }
+      catch (const std::out_of_range&)
+      {}
+    }
+
+    assert(sampler.n_sampled<InternalOrderId>() == 4);
+    assert(sampler.top<InternalOrderId>(1)[0].key == 5000);
+  }
+
+  /* keys are counted with the path's hasher */
+  {
+    VenueTracker venues;
+    venues.insert<1>(Venue{3}, Order{"IBM", 3});
+
+    xu::hot_key_sampler<VenueTracker> sampler(venues, 4, 1);
+
+    for (int i = 0; i < 3; i++)
+    {
+      venues.at<1>(Venue{3});
+    }
+
+    assert(sampler.top<1>(1)[0].key == Venue{3});
+    assert(sampler.top<1>(1)[0].count == 3);
+  }
+
+  /* unset on destruction */
+  otk.at<InternalOrderId>(1);
+  otk.find<ExternalOrderId>("E1");
+
+  std::cout << "hot_keys tests passed" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,275 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_recorder.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_latency_recorder test_latency_recorder.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+uint64_t count(const xu::latency_recorder& recorder, xu::map_operation op)
+{
+  return recorder.histogram(op).count();
+}
+
+void test_buckets()
+{
+  using xu::latency_histogram;
+
+  size_t last = 0;
+
+  for (uint64_t v = 0; v < (uint64_t(1) << 40); v = v < 4096 ? v + 1 : v + v / 37)
+  {
+    size_t bucket = latency_histogram::bucket_of(v);
+
+    /* buckets are ordered like values */
+    assert(bucket >= last and bucket < latency_histogram::n_buckets);
+    last = bucket;
+
+    if (v < (uint64_t(1) << latency_histogram::max_magnitude))
+    {
+      assert(latency_histogram::lowest_of(bucket) <= v and v <= latency_histogram::highest_of(bucket));
+
+      /* within 1 / sub_buckets */
+      assert(latency_histogram::highest_of(bucket) - latency_histogram::lowest_of(bucket) <= v / latency_histogram::sub_buckets);
+    }
+  }
+
+  assert(latency_histogram::bucket_of(~uint64_t(0)) == latency_histogram::n_buckets - 1);
+
+  latency_histogram h;
+
+  assert(h.count() == 0 and h.value_at_percentile(99) == 0 and h.min() == 0);
+
+  for (uint64_t v = 1; v <= 1000; v++)
+  {
+    h.record(v);
+  }
+
+  assert(h.count() == 1000);
+  assert(h.min() == 1 and h.max() == 1000);
+  assert(h.mean() == 500.5);
+  assert(h.value_at_percentile(50) >= 500 and h.value_at_percentile(50) <= 508);
+  assert(h.value_at_percentile(99) >= 990 and h.value_at_percentile(99) <= 1000);
+  assert(h.value_at_percentile(100) == 1000);
+
+  /* the tail is not hidden by the mean */
+  latency_histogram tail;
+
+  for (int i = 0; i < 999; i++)
+  {
+    tail.record(100);
+  }
+
+  tail.record(1000000);
+
+  assert(tail.value_at_percentile(99) == 100);
+  assert(tail.value_at_percentile(99.99) >= 1000000 and tail.max() == 1000000);
+
+  h.merge(tail);
+  assert(h.count() == 2000 and h.max() == 1000000 and h.min() == 1);
+}
+
+void test_map()
+{
+  using op = xu::map_operation;
+
+  OrderTracker tracker;
+  xu::latency_recorder recorder;
+
+  tracker.set_operation_timer(&recorder);
+
+  for (unsigned long i = 0; i < 100; i++)
+  {
+    tracker.insert<InternalOrderId>(i, Order{"IBM", int(i)});
+  }
+
+  for (unsigned long i = 0; i < 50; i++)
+  {
+    tracker.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+  }
+
+  for (unsigned long i = 0; i < 100; i++)
+  {
+    assert(tracker.at<InternalOrderId>(i).svol == int(i));
+  }
+
+  /* failed operations are timed too */
+  try
+  {
+    tracker.at<ExternalOrderId>("missing");
+    assert(false);
+  }
+  catch (const std::out_of_range&)
+  {}
+
+  const OrderTracker& const_tracker = tracker;
+  assert(const_tracker.at<ExternalOrderId>("E3").svol == 3);
+
+  assert(tracker.find<ExternalOrderId>("E4") != tracker.end());
+  assert(const_tracker.find<ExternalOrderId>("E60") == const_tracker.cend());
+
+  assert(tracker.contains<InternalOrderId>(7));
+  assert((tracker.convert_key<ExternalOrderId, InternalOrderId>("E8") == 8));
+
+  tracker.modify<InternalOrderId>(9, [](Order& order) { order.svol = -9; });
+
+  size_t n_rows = 0;
+
+  for (auto it = tracker.begin(); it != tracker.end(); ++it)
+  {
+    n_rows++;
+  }
+
+  tracker.erase<InternalOrderId>(10);
+  tracker.erase(tracker.find<InternalOrderId>(11));
+
+  assert(count(recorder, op::insert) == 100);
+  assert(count(recorder, op::link) == 50);
+  assert(count(recorder, op::at) == 102);
+  assert(count(recorder, op::find) == 3);
+  assert(count(recorder, op::contains) == 1);
+  assert(count(recorder, op::convert_key) == 1);
+  assert(count(recorder, op::modify) == 1);
+  assert(count(recorder, op::iterate) == n_rows);
+  assert(count(recorder, op::erase) == 2);
+
+  xu::latency_histogram inserts = recorder.histogram(op::insert);
+  assert(inserts.min() <= inserts.value_at_percentile(50) and inserts.value_at_percentile(50) <= inserts.max());
+
+  /* dumps */
+  std::ostringstream text;
+  recorder.write_text(text);
+  assert(text.str().find("operation") == 0);
+  assert(text.str().find("\ninsert ") != std::string::npos);
+  assert(text.str().find("\nconvert_key ") != std::string::npos);
+
+  std::ostringstream json;
+  recorder.write_json(json);
+  assert(json.str().find("{\"unit\":\"ns\",\"operations\":{\"insert\":{\"count\":100,") == 0);
+  assert(json.str().find("\"link\":{\"count\":50,") != std::string::npos);
+  assert(json.str().find("\"buckets\":[[") != std::string::npos);
+  assert(json.str().back() == '}');
+
+  /* unset, operations are no longer timed */
+  tracker.set_operation_timer(nullptr);
+
+  tracker.insert<InternalOrderId>(1000, Order{"IBM", 1000});
+  tracker.at<InternalOrderId>(1000);
+
+  assert(count(recorder, op::insert) == 100);
+  assert(count(recorder, op::at) == 102);
+
+  /* copies are not timed */
+  tracker.set_operation_timer(&recorder);
+
+  OrderTracker copy(tracker);
+  copy.at<InternalOrderId>(1000);
+
+  assert(count(recorder, op::at) == 102);
+
+  tracker.set_operation_timer(nullptr);
+}
+
+void test_threads()
+{
+  const size_t n_threads = 4;
+  const uint64_t n_records = 10000;
+
+  xu::latency_recorder recorder;
+
+  std::vector<std::thread> threads;
+
+  for (size_t t = 0; t < n_threads; t++)
+  {
+    threads.emplace_back([&recorder, t]()
+    {
+      for (uint64_t i = 0; i < n_records; i++)
+      {
+        recorder.record(xu::map_operation::at, (t + 1) * 1000 + i % 100);
+      }
+    });
+  }
+
+  /* merging while threads record */
+  recorder.histogram(xu::map_operation::at);
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  xu::latency_histogram at = recorder.histogram(xu::map_operation::at);
+
+  assert(at.count() == n_threads * n_records);
+  assert(at.min() == 1000);
+  assert(at.max() == n_threads * 1000 + 99);
+
+  /* a second recorder does not see the records of the first */
+  xu::latency_recorder other;
+  other.record(xu::map_operation::find, 5);
+
+  assert(other.histogram(xu::map_operation::at).count() == 0);
+  assert(other.histogram(xu::map_operation::find).count() == 1);
+  assert(recorder.histogram(xu::map_operation::find).count() == 0);
+
+  recorder.record(xu::map_operation::find, 7);
+  assert(recorder.histogram(xu::map_operation::find).max() == 7);
+}
+
+int main()
+{
+  test_buckets();
+  test_map();
+  test_threads();
+
+  std::cout << "latency_recorder tests passed" << std::endl;
+
+  return 0;
+}
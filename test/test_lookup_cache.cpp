@@ -0,0 +1,118 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lookup_cache.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_lookup_cache test_lookup_cache.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using ExternalCache = xu::lookup_cache<OrderTracker, ExternalOrderId>;
+
+int main()
+{
+  OrderTracker otk;
+
+  otk.insert<InternalOrderId>(13, Order{"AAPL", 100});
+  otk.link<InternalOrderId, ExternalOrderId>(13, "1337");
+
+  otk.insert<InternalOrderId>(14, Order{"MSFT", -100});
+  otk.link<InternalOrderId, ExternalOrderId>(14, "1338");
+
+  /* first lookup misses, following ones hit */
+  assert(xu::cached_at<ExternalOrderId>(otk, "1337").svol == 100);
+  assert(xu::cached_at<ExternalOrderId>(otk, "1337").svol == 100);
+
+  xu::cached_at<ExternalOrderId>(otk, "1337").svol = 50;
+  assert(otk.at<InternalOrderId>(13).svol == 50);
+
+  assert(ExternalCache::stats().hits == 2);
+  assert(ExternalCache::stats().misses == 1);
+
+  /* missing keys are not cached */
+  assert(xu::cached_find<ExternalOrderId>(otk, "9999") == nullptr);
+
+  /* erasing the row invalidates the cached entry, even if the key comes back */
+  otk.erase<InternalOrderId>(13);
+  assert(xu::cached_find<ExternalOrderId>(otk, "1337") == nullptr);
+
+  otk.insert<InternalOrderId>(15, Order{"TSLA", 20});
+  otk.link<InternalOrderId, ExternalOrderId>(15, "1337");
+  assert(xu::cached_at<ExternalOrderId>(otk, "1337").ticker == "TSLA");
+
+  /* a copy has its own rows, so entries for the original are not used */
+  OrderTracker otk_copy = otk;
+
+  assert(&xu::cached_at<ExternalOrderId>(otk_copy, "1337") == &otk_copy.at<ExternalOrderId>("1337"));
+  assert(&xu::cached_at<ExternalOrderId>(otk, "1337") == &otk.at<ExternalOrderId>("1337"));
+
+  /* reassignment replaces the rows */
+  otk = otk_copy;
+  assert(&xu::cached_at<ExternalOrderId>(otk, "1338") == &otk.at<ExternalOrderId>("1338"));
+
+  /* each thread has its own cache over the shared map */
+  std::vector<std::thread> readers;
+
+  for (int t = 0; t < 4; t++)
+  {
+    readers.emplace_back([&otk]()
+    {
+      for (int i = 0; i < 1000; i++)
+      {
+        assert(xu::cached_at<ExternalOrderId>(otk, i % 2 == 0 ? "1337" : "1338").svol != 0);
+      }
+
+      assert(ExternalCache::stats().misses == 2);
+    });
+  }
+
+  for (auto& reader : readers)
+  {
+    reader.join();
+  }
+
+  std::cout << "hits=" << ExternalCache::stats().hits << " misses=" << ExternalCache::stats().misses << std::endl;
+}
@@ -0,0 +1,189 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "merkle_digest.hpp"
+#include "polykey_codec.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_merkle_digest test_merkle_digest.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using OrderDigest = xu::merkle_observer<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+int main()
+{
+  const size_t n_buckets = 256;
+
+  OrderTracker a;
+  OrderTracker b;
+
+  a.insert<InternalOrderId>(1000, Order{"IBM", 1});
+
+  OrderDigest digest_a(a, n_buckets);
+  OrderDigest digest_b(b, n_buckets);
+
+  /* existing rows are digested on construction */
+  assert(digest_a.digest().size() == 1);
+  assert(digest_a.digest() != digest_b.digest());
+
+  b.insert<InternalOrderId>(1000, Order{"IBM", 1});
+  assert(digest_a.digest() == digest_b.digest());
+
+  /* the same changes keep replicas equal */
+  for (OrderTracker* m : {&a, &b})
+  {
+    for (unsigned long i = 0; i < 1000; i++)
+    {
+      m->insert<InternalOrderId>(i, Order{"T" + std::to_string(i % 7), int(i)});
+
+      if (i % 2 == 0)
+      {
+        m->link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+      }
+    }
+
+    m->modify<ExternalOrderId>("E10", [](Order& order) { order.svol = -10; });
+    m->erase<InternalOrderId>(11);
+  }
+
+  assert(digest_a.digest().size() == 1000);
+  assert(digest_a.digest() == digest_b.digest());
+  assert(digest_a.digest().depth() == 8);
+
+  /* the incremental digest matches a fresh one */
+  {
+    OrderDigest fresh(a, n_buckets);
+
+    assert(fresh.digest() == digest_a.digest());
+
+    for (size_t i = 0; i < n_buckets; i++)
+    {
+      assert(fresh.digest().node(8, i) == digest_a.digest().node(8, i));
+    }
+  }
+
+  /* diverge in two rows */
+  b.modify<InternalOrderId>(500, [](Order& order) { order.svol = 0; });
+  b.link<InternalOrderId, ExternalOrderId>(3, "E3");
+
+  assert(digest_a.digest() != digest_b.digest());
+
+  size_t n_exchanges = 0;
+  size_t n_hashes = 0;
+
+  std::vector<size_t> buckets = xu::divergent_buckets(digest_a.digest(), [&](size_t level, const std::vector<size_t>& indices)
+  {
+    n_exchanges++;
+    n_hashes += indices.size();
+
+    std::vector<uint64_t> hashes;
+
+    for (size_t i : indices)
+    {
+      hashes.push_back(digest_b.digest().node(level, i));
+    }
+
+    return hashes;
+  });
+
+  assert(buckets.size() == 1 or buckets.size() == 2);
+  assert(n_exchanges == 9);
+  assert(n_hashes <= 1 + 8 * 4);
+
+  /* the divergent buckets hold the two rows on each side */
+  std::vector<std::string> rows_a = digest_a.bucket_rows(buckets);
+  std::vector<std::string> rows_b = digest_b.bucket_rows(buckets);
+
+  assert(rows_a.size() == rows_b.size());
+
+  size_t n_differing = 0;
+
+  for (const std::string& row : rows_a)
+  {
+    n_differing += std::find(rows_b.begin(), rows_b.end(), row) == rows_b.end();
+  }
+
+  assert(n_differing == 2);
+
+  /* the maintained digests drive a diff of the two maps */
+  auto d = xu::diff(a, digest_a.digest(), b, digest_b.digest());
+
+  assert(d.inserted.empty() and d.erased.empty());
+  assert(d.changed.size() == 1 and d.changed[0].value.svol == 0);
+  assert(d.rekeyed.size() == 1 and *std::get<ExternalOrderId>(d.rekeyed[0].keys) == "E3");
+
+  /* undo brings the replicas back in line */
+  b.modify<InternalOrderId>(500, [](Order& order) { order.svol = 500; });
+  b.erase<InternalOrderId>(3);
+  b.insert<InternalOrderId>(3, Order{"T3", 3});
+
+  assert(digest_a.digest() == digest_b.digest());
+  assert(xu::divergent_buckets(digest_a.digest(), [&](size_t level, const std::vector<size_t>& indices)
+  {
+    return std::vector<uint64_t>(1, digest_b.digest().node(level, indices[0]));
+  }).empty());
+
+  std::cout << "merkle_digest tests passed" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "ordered_index.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_ordered_index test_ordered_index.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+  double price;
+  long time;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+/* best bids first: highest price, then earliest */
+auto bid_priority = [](const Order& order)
+{
+  return std::make_tuple(order.ticker, -order.price, order.time);
+};
+
+/* internal ids of the best n orders of a ticker, 0 for rows without one */
+template <typename Index_T>
+std::vector<InternalOrderId_t> best(const Index_T& book, const std::string& ticker, size_t n)
+{
+  std::vector<InternalOrderId_t> ids;
+
+  for (auto it = book.lower_bound(std::make_tuple(ticker, -std::numeric_limits<double>::infinity(), 0L));
+       it != book.end() and std::get<0>(it.key()) == ticker and ids.size() < n; ++it)
+  {
+    ids.push_back(it.template has_key<InternalOrderId>() ? it.template get_key<InternalOrderId>() : 0);
+  }
+
+  return ids;
+}
+
+int main()
+{
+  OrderTracker otk;
+
+  otk.insert<InternalOrderId>(1, Order{"IBM", 100, 10.0, 1});
+  otk.insert<InternalOrderId>(2, Order{"IBM", 100, 11.0, 2});
+
+  auto book = xu::order_by(otk, bid_priority);
+
+  /* existing rows are indexed on construction */
+  assert(book.size() == 2);
+  assert(book.front().price == 11.0);
+
+  otk.insert<InternalOrderId>(3, Order{"IBM", 50, 11.0, 3});
+  otk.insert<InternalOrderId>(4, Order{"AAPL", 10, 200.0, 4});
+  otk.insert<ExternalOrderId>("E5", Order{"IBM", 10, 9.0, 5});
+
+  assert(book.size() == 5);
+  assert((best(book, "IBM", 10) == std::vector<InternalOrderId_t>{2, 3, 1, 0}));
+  assert((best(book, "IBM", 2) == std::vector<InternalOrderId_t>{2, 3}));
+  assert((best(book, "AAPL", 10) == std::vector<InternalOrderId_t>{4}));
+
+  /* rows without a key on a path */
+  auto last = --book.end();
+  assert(last->time == 5);
+  assert(!last.has_key<InternalOrderId>());
+  assert(last.get_key<ExternalOrderId>() == "E5");
+
+  /* links are visible through entries */
+  otk.link<ExternalOrderId, InternalOrderId>("E5", 5);
+  assert(last.get_key<InternalOrderId>() == 5);
+
+  /* repositioning on modify */
+  otk.modify<InternalOrderId>(1, [](Order& order) { order.price = 12.0; order.time = 6; });
+  assert((best(book, "IBM", 10) == std::vector<InternalOrderId_t>{1, 2, 3, 5}));
+
+  /* changes outside the key keep the position */
+  otk.modify<InternalOrderId>(2, [](Order& order) { order.svol = 1; });
+  assert((best(book, "IBM", 10) == std::vector<InternalOrderId_t>{1, 2, 3, 5}));
+  assert(std::next(book.lower_bound(std::make_tuple(std::string("IBM"), -12.0, 0L)))->svol == 1);
+
+  /* equal keys keep insertion order */
+  otk.modify<InternalOrderId>(3, [](Order& order) { order.price = 12.0; order.time = 6; });
+  assert((best(book, "IBM", 2) == std::vector<InternalOrderId_t>{1, 3}));
+
+  /* bounds */
+  auto key = std::make_tuple(std::string("IBM"), -12.0, 6L);
+  assert(book.lower_bound(key).get_key<InternalOrderId>() == 1);
+  assert(book.upper_bound(key).get_key<InternalOrderId>() == 2);
+
+  /* erasure */
+  otk.erase<InternalOrderId>(1);
+  otk.erase<InternalOrderId>(4);
+  assert(book.size() == 3);
+  assert((best(book, "IBM", 10) == std::vector<InternalOrderId_t>{3, 2, 5}));
+  assert(best(book, "AAPL", 10).empty());
+
+  otk.erase<InternalOrderId>(2);
+  otk.erase<InternalOrderId>(3);
+  otk.erase<InternalOrderId>(5);
+  assert(book.empty());
+
+  bool thrown = false;
+
+  try
+  {
+    book.front();
+  }
+  catch (const std::out_of_range&)
+  {
+    thrown = true;
+  }
+
+  assert(thrown);
+
+  /* custom ordering */
+  otk.insert<InternalOrderId>(6, Order{"IBM", 1, 1.0, 7});
+  otk.insert<InternalOrderId>(7, Order{"IBM", 2, 2.0, 8});
+
+  auto by_svol_desc = xu::order_by(otk, [](const Order& order) { return order.svol; }, std::greater<int>());
+  assert(by_svol_desc.front().svol == 2);
+
+  /* replacing the rows behind an index's back is refused */
+  OrderTracker other;
+  thrown = false;
+
+  try
+  {
+    otk = other;
+  }
+  catch (const std::logic_error&)
+  {
+    thrown = true;
+  }
+
+  assert(thrown);
+  assert(otk.size() == by_svol_desc.size());
+
+  thrown = false;
+
+  try
+  {
+    OrderTracker moved(std::move(otk));
+  }
+  catch (const std::logic_error&)
+  {
+    thrown = true;
+  }
+
+  assert(thrown);
+
+  std::cout << "ordered_index tests passed" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "overlay_polykey_map.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_overlay_polykey_map test_overlay_polykey_map.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using OverlayTracker = xu::overlay_polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+int main()
+{
+  const std::string base_path = "test_overlay_base.snap";
+  const std::string flat_path = "test_overlay_flat.snap";
+
+  OrderTracker otk;
+
+  otk.insert<InternalOrderId>(13, Order{"AAPL", 100});
+  otk.link<InternalOrderId, ExternalOrderId>(13, "1337");
+
+  otk.insert<InternalOrderId>(14, Order{"MSFT", -100});
+  otk.link<InternalOrderId, ExternalOrderId>(14, "1338");
+
+  otk.insert<InternalOrderId>(15, Order{"GOOG", 10});
+
+  xu::save_snapshot(otk, base_path);
+
+  OverlayTracker overlay(base_path);
+
+  /* reads are served by the snapshot */
+  assert(overlay.size() == 3);
+  assert(overlay.contains<ExternalOrderId>("1337"));
+  assert(overlay.get<ExternalOrderId>("1338").ticker == "MSFT");
+  assert(overlay.delta_size() == 0);
+
+  /* modifying a row promotes it */
+  overlay.at<ExternalOrderId>("1337").svol = 50;
+  assert(overlay.delta_size() == 1);
+  assert(overlay.tombstone_count() == 1);
+  assert(overlay.get<InternalOrderId>(13).svol == 50);
+  assert(overlay.contains<ExternalOrderId>("1337"));
+  assert(overlay.size() == 3);
+
+  /* keys are unique across the snapshot and the delta */
+  bool caught = false;
+
+  try
+  {
+    overlay.insert<InternalOrderId>(14, Order{"IBM", 1});
+  }
+  catch (const OverlayTracker::key_conflict_error& e)
+  {
+    caught = true;
+  }
+
+  assert(caught);
+
+  /* linking to a snapshot row promotes it */
+  overlay.link<InternalOrderId, ExternalOrderId>(15, "1339");
+  assert(overlay.get<ExternalOrderId>("1339").ticker == "GOOG");
+  assert(overlay.delta_size() == 2);
+
+  /* erasing a snapshot row leaves a tombstone */
+  overlay.erase<InternalOrderId>(14);
+  assert(!overlay.contains<ExternalOrderId>("1338"));
+  assert(overlay.size() == 2);
+
+  /* an erased key can be inserted again */
+  overlay.insert<ExternalOrderId>("1338", Order{"IBM", 1});
+  overlay.insert<InternalOrderId>(16, Order{"NFLX", 7});
+  assert(overlay.size() == 4);
+
+  size_t n_rows = 0;
+
+  overlay.for_each_row([&n_rows](const auto& keys, const Order& order)
+  {
+    (void)keys;
+    (void)order;
+    n_rows++;
+  });
+
+  assert(n_rows == 4);
+
+  /* flatten into a new snapshot, while the overlay keeps changing */
+  std::future<void> flattened = overlay.flatten(flat_path);
+  overlay.erase<InternalOrderId>(16);
+  flattened.get();
+
+  OverlayTracker reopened(flat_path);
+
+  assert(reopened.size() == 4);
+  assert(reopened.delta_size() == 0);
+  assert(reopened.get<ExternalOrderId>("1337").svol == 50);
+  assert(reopened.get<InternalOrderId>(15).ticker == "GOOG");
+  assert(reopened.get<ExternalOrderId>("1339").svol == 10);
+  assert(reopened.get<ExternalOrderId>("1338").ticker == "IBM");
+  assert(reopened.contains<InternalOrderId>(16));
+  assert(!reopened.contains<InternalOrderId>(14));
+
+  std::cout << "Flattened " << reopened.size() << " rows" << std::endl;
+
+  std::remove(base_path.c_str());
+  std::remove(flat_path.c_str());
+
+  return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "partitioned_polykey_map.hpp"
+#include "robin_hood_index.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_partitioned_polykey_map test_partitioned_polykey_map.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using PartitionedOrderTracker = xu::partitioned_polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+/* key without a std::hash specialization, hashed through its path tag */
+struct Venue
+{
+  int id;
+
+  bool operator==(const Venue& other) const
+  {
+    return id == other.id;
+  }
+};
+
+struct VenueHash
+{
+  size_t operator()(const Venue& venue) const
+  {
+    return size_t(venue.id);
+  }
+};
+
+using PartitionedVenueTracker = xu::partitioned_polykey_map<Order, InternalOrderId_t, xu::robin_hood<Venue, VenueHash>>;
+
+int main()
+{
+  PartitionedOrderTracker otk(4, 16);
+
+  /* insert and link; external ids are routed to the row owner */
+  for (unsigned long i = 0; i < 1000; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"AAPL", int(i)});
+    otk.link<InternalOrderId, ExternalOrderId>(i, "ext-" + std::to_string(i));
+  }
+
+  std::cout << "size=" << otk.size() << std::endl;
+  assert(otk.size() == 1000);
+
+  for (unsigned long i = 0; i < 1000; i += 100)
+  {
+    assert(otk.partition_of<InternalOrderId>(i) == otk.partition_of<ExternalOrderId>("ext-" + std::to_string(i)));
+  }
+
+  /* lookups are answered by the owning partition */
+  assert(otk.at<ExternalOrderId>("ext-42").get().svol == 42);
+  assert(!otk.find<ExternalOrderId>("ext-missing").get());
+
+  /* modify on the owning thread */
+  int old_svol = otk.visit<ExternalOrderId>("ext-7", [](Order& order)
+  {
+    int res = order.svol;
+    order.svol = 700;
+    return res;
+  }).get();
+
+  assert(old_svol == 7);
+  assert(otk.at<InternalOrderId>(7).get().svol == 700);
+
+  /* key conflicts are detected from the directory */
+  try
+  {
+    otk.insert<InternalOrderId>(7, Order{"MSFT", 1});
+    assert(false);
+  }
+  catch (const PartitionedOrderTracker::key_conflict_error& e)
+  {
+    std::cout << e.what() << std::endl;
+  }
+
+  /* erasing by one key removes the linked keys once the partition answers */
+  std::vector<PartitionedOrderTracker::result<void>> erased;
+
+  for (unsigned long i = 0; i < 1000; i += 2)
+  {
+    erased.push_back(otk.erase<ExternalOrderId>("ext-" + std::to_string(i)));
+  }
+
+  /* reinsert erased internal ids right away, before the erasures complete */
+  for (unsigned long i = 0; i < 1000; i += 4)
+  {
+    otk.insert<InternalOrderId>(i, Order{"TSLA", -int(i)});
+  }
+
+  for (auto& res : erased)
+  {
+    res.get();
+  }
+
+  assert(otk.size() == 750);
+  assert(otk.contains<InternalOrderId>(4));
+  assert(!otk.contains<InternalOrderId>(2));
+  assert(!otk.contains<ExternalOrderId>("ext-4"));
+  assert(otk.at<InternalOrderId>(4).get().ticker == "TSLA");
+
+  /* keys known not to exist are rejected from the directory, without a round trip */
+  otk.erase<InternalOrderId>(5).get();
+
+  try
+  {
+    otk.at<InternalOrderId>(5);
+    assert(false);
+  }
+  catch (const std::out_of_range& e)
+  {
+    std::cout << e.what() << std::endl;
+  }
+
+  /* errors raised on the partition come back through the result */
+  PartitionedOrderTracker::result<int> failed = otk.visit<InternalOrderId>(9, [](Order& order) -> int
+  {
+    throw std::runtime_error("rejected " + order.ticker);
+  });
+
+  try
+  {
+    failed.get();
+    assert(false);
+  }
+  catch (const std::runtime_error& e)
+  {
+    assert(std::string(e.what()) == "rejected AAPL");
+  }
+
+  /* results may be dropped, or kept and read in any order */
+  std::vector<PartitionedOrderTracker::result<Order>> kept;
+
+  for (unsigned long i = 7; i < 200; i += 2)
+  {
+    otk.visit<InternalOrderId>(i, [](Order& order) { order.svol++; });
+    kept.push_back(otk.at<InternalOrderId>(i));
+  }
+
+  for (size_t i = kept.size(); i-- > 0;)
+  {
+    assert(kept[i].get().ticker == "AAPL");
+  }
+
+  assert(otk.at<InternalOrderId>(11).get().svol == 12);
+
+  /* idle workers sleep, and wake up for the next batch */
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  PartitionedOrderTracker::result<Order> woken = otk.at<ExternalOrderId>("ext-43");
+  assert(!woken.ready());
+  otk.flush();
+  assert(woken.get().svol == 44);
+
+  std::cout << "size=" << otk.size() << std::endl;
+
+  /* results may outlive the container */
+  std::optional<PartitionedOrderTracker::result<Order>> outliving;
+  std::optional<PartitionedOrderTracker::result<Order>> outliving_unread;
+
+  {
+    PartitionedOrderTracker scoped(2, 16);
+
+    scoped.insert<InternalOrderId>(1, Order{"IBM", 5});
+    outliving.emplace(scoped.at<InternalOrderId>(1));
+    outliving_unread.emplace(scoped.at<InternalOrderId>(1));
+  }
+
+  assert(outliving->ready());
+  assert(outliving->get().svol == 5);
+
+  /* routes are hashed with the path's hasher */
+  {
+    PartitionedVenueTracker venues(3, 16);
+
+    venues.insert<1>(Venue{7}, Order{"ORCL", 7});
+    venues.link<1, 0>(Venue{7}, 70);
+
+    assert(venues.partition_of<0>(70) == venues.partition_of<1>(Venue{7}));
+    assert(venues.at<0>(70).get().svol == 7);
+  }
+
+  /* several client threads, each through its own session */
+  {
+    PartitionedOrderTracker shared(4, 16, false, 4);
+
+    std::vector<std::thread> clients;
+    std::atomic<int> n_won{0};
+
+    for (unsigned long t = 0; t < 4; t++)
+    {
+      clients.emplace_back([&shared, &n_won, t]()
+      {
+        PartitionedOrderTracker::session client(shared);
+
+        for (unsigned long i = t * 1000; i < t * 1000 + 500; i++)
+        {
+          client.insert<InternalOrderId>(i, Order{"MSFT", int(i)});
+          client.link<InternalOrderId, ExternalOrderId>(i, "ext-" + std::to_string(i));
+        }
+
+        /* a session sees its own operations in order */
+        for (unsigned long i = t * 1000; i < t * 1000 + 500; i += 2)
+        {
+          client.erase<ExternalOrderId>("ext-" + std::to_string(i));
+        }
+
+        assert(!client.contains<InternalOrderId>(t * 1000));
+        assert(client.at<ExternalOrderId>("ext-" + std::to_string(t * 1000 + 1)).get().svol == int(t * 1000 + 1));
+
+        /* only one session routes a contended key */
+        try
+        {
+          client.insert<InternalOrderId>(99999, Order{"MSFT", int(t)}).get();
+          n_won++;
+        }
+        catch (const PartitionedOrderTracker::key_conflict_error&)
+        {}
+      });
+    }
+
+    for (std::thread& client : clients)
+    {
+      client.join();
+    }
+
+    assert(n_won == 1);
+    assert(shared.size() == 1001);
+    assert(shared.at<ExternalOrderId>("ext-3001").get().svol == 3001);
+
+    /* the built-in session and max_sessions others may be open at once */
+    std::vector<std::unique_ptr<PartitionedOrderTracker::session>> open;
+
+    for (int i = 0; i < 4; i++)
+    {
+      open.emplace_back(new PartitionedOrderTracker::session(shared));
+    }
+
+    bool threw = false;
+
+    try
+    {
+      PartitionedOrderTracker::session extra(shared);
+    }
+    catch (const std::length_error&)
+    {
+      threw = true;
+    }
+
+    assert(threw);
+
+    open.pop_back();
+    PartitionedOrderTracker::session reopened(shared);
+  }
+}
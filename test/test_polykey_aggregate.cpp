@@ -0,0 +1,132 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "polykey_aggregate.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_polykey_aggregate test_polykey_aggregate.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+int main()
+{
+  OrderTracker otk;
+
+  otk.insert<InternalOrderId>(1, Order{"IBM", 100});
+  otk.insert<InternalOrderId>(2, Order{"IBM", -40});
+
+  auto by_ticker = [](const Order& order) { return order.ticker; };
+  auto svol = [](const Order& order) { return order.svol; };
+
+  auto net = xu::aggregate_by(otk, by_ticker, svol);
+  auto extremes = xu::aggregate_by<true>(otk, by_ticker, svol);
+
+  /* existing rows are aggregated on construction */
+  assert(net.size() == 1);
+  assert(net.at("IBM").count == 2);
+  assert(net.at("IBM").sum == 60);
+  assert(extremes.at("IBM").min() == -40);
+  assert(extremes.at("IBM").max() == 100);
+
+  otk.insert<ExternalOrderId>("E3", Order{"AAPL", 7});
+  otk.insert<InternalOrderId>(4, Order{"IBM", 100});
+
+  assert(net.size() == 2);
+  assert(net.at("AAPL").sum == 7);
+  assert(net.at("IBM").count == 3 and net.at("IBM").sum == 160);
+
+  /* links do not change values */
+  otk.link<InternalOrderId, ExternalOrderId>(1, "E1");
+  assert(net.at("IBM").count == 3);
+
+  /* modify updates both the old and the new group */
+  otk.modify<ExternalOrderId>("E1", [](Order& order) { order.ticker = "AAPL"; order.svol = 1; });
+
+  assert(net.at("IBM").count == 2 and net.at("IBM").sum == 60);
+  assert(net.at("AAPL").count == 2 and net.at("AAPL").sum == 8);
+  assert(extremes.at("IBM").max() == 100);
+  assert(extremes.at("AAPL").min() == 1);
+
+  /* one of two equal measures erased */
+  otk.erase<InternalOrderId>(4);
+  assert(extremes.at("IBM").max() == -40);
+  assert(extremes.at("IBM").min() == -40);
+
+  /* empty groups are dropped */
+  otk.erase<InternalOrderId>(2);
+  assert(!net.contains("IBM"));
+  assert(net.size() == 1);
+
+  bool thrown = false;
+
+  try
+  {
+    net.at("IBM");
+  }
+  catch (const std::out_of_range&)
+  {
+    thrown = true;
+  }
+
+  assert(thrown);
+
+  size_t n_groups = 0;
+
+  net.for_each([&](const std::string& ticker, const auto& aggregate)
+  {
+    assert(ticker == "AAPL" and aggregate.sum == 8);
+    n_groups++;
+  });
+
+  assert(n_groups == 1);
+
+  /* floating point measures sum as double */
+  auto notional = xu::aggregate_by(otk, by_ticker, [](const Order& order) { return order.svol * 1.5f; });
+  assert(notional.at("AAPL").sum == 12.0);
+
+  std::cout << "polykey_aggregate tests passed" << std::endl;
+
+  return 0;
+}
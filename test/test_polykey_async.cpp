@@ -0,0 +1,123 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "polykey_async.hpp"
+#include "polykey_map.hpp"
+#include "robin_hood_index.hpp"
+
+//g++ -std=c++20 -I ../include -o bin/test_polykey_async test_polykey_async.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+using OrderTracker = xu::polykey_map<Order, xu::robin_hood<InternalOrderId_t>, ExternalOrderId_t>;
+
+int main()
+{
+  OrderTracker otk;
+
+  for (unsigned long i = 0; i < 10000; i++)
+  {
+    otk.insert<InternalOrderId>(i * 3, Order{"AAPL", int(i)});
+
+    if (i % 2 == 0)
+    {
+      otk.link<InternalOrderId, ExternalOrderId>(i * 3, "ext-" + std::to_string(i));
+    }
+  }
+
+  /* find<P> agrees with at<P> */
+  assert(otk.find<InternalOrderId>(30)->svol == 10);
+  assert(otk.find<InternalOrderId>(31) == otk.end());
+
+  /* interleaved lookups over a path with prefetch support, including misses */
+  std::vector<InternalOrderId_t> keys;
+
+  for (unsigned long i = 0; i < 5000; i++)
+  {
+    keys.push_back((i * 7919) % 30000);
+  }
+
+  std::vector<const Order*> found(keys.size(), nullptr);
+
+  xu::run_interleaved(16, keys.size(),
+    [&](size_t i)
+    {
+      return xu::async_find<InternalOrderId>(otk, keys[i]);
+    },
+    [&](size_t i, const Order* order)
+    {
+      found[i] = order;
+    });
+
+  size_t n_found = 0;
+
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    if (otk.contains<InternalOrderId>(keys[i]))
+    {
+      assert(found[i] == &otk.at<InternalOrderId>(keys[i]));
+      n_found++;
+    }
+    else
+    {
+      assert(found[i] == nullptr);
+    }
+  }
+
+  /* paths without prefetch support work the same */
+  size_t n_external = 0;
+
+  xu::run_interleaved(4, 100,
+    [&](size_t i)
+    {
+      return xu::async_find<ExternalOrderId>(otk, "ext-" + std::to_string(i));
+    },
+    [&](size_t i, const Order* order)
+    {
+      assert((order != nullptr) == (i % 2 == 0));
+      n_external += order != nullptr;
+    });
+
+  std::cout << "found=" << n_found << "/" << keys.size() << " external=" << n_external << std::endl;
+
+  assert(n_external == 50);
+}
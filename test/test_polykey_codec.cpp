@@ -0,0 +1,133 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "polykey_codec.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_polykey_codec test_polykey_codec.cpp
+
+template <typename T>
+void round_trip(T value, size_t expected_size)
+{
+  std::string bytes = xu::encode(value);
+  assert(bytes.size() == expected_size);
+
+  /* decode with and without the fast path (which needs 8 readable bytes) */
+  assert(xu::decode<T>(bytes.data(), bytes.size()) == value);
+
+  std::string padded = bytes + std::string(8, '\xff');
+  const char* p = padded.data();
+  assert(xu::codec<T>::decode(p, padded.data() + padded.size()) == value);
+  assert(p == padded.data() + bytes.size());
+}
+
+template <typename F>
+bool throws_format_error(F f)
+{
+  try
+  {
+    f();
+  }
+  catch (const xu::format_error&)
+  {
+    return true;
+  }
+
+  return false;
+}
+
+int main()
+{
+  //  =======
+  //  Varints
+  //  =======
+
+  round_trip<uint64_t>(0, 1);
+  round_trip<uint64_t>(127, 1);
+  round_trip<uint64_t>(128, 2);
+  round_trip<uint64_t>(16383, 2);
+  round_trip<uint64_t>(16384, 3);
+  round_trip<uint64_t>((uint64_t(1) << 56) - 1, 8);
+  round_trip<uint64_t>(uint64_t(1) << 56, 9);
+  round_trip<uint64_t>(std::numeric_limits<uint64_t>::max(), 10);
+
+  for (uint64_t x = 1; x != 0; x <<= 1)
+  {
+    round_trip<uint64_t>(x, x < 128 ? 1 : size_t((64 - __builtin_clzll(x) + 6) / 7));
+    round_trip<uint64_t>(x - 1, x - 1 < 128 ? 1 : size_t((64 - __builtin_clzll(x - 1) + 6) / 7));
+  }
+
+  //  ===============
+  //  Signed integers
+  //  ===============
+
+  round_trip<int>(0, 1);
+  round_trip<int>(-1, 1);
+  round_trip<int>(63, 1);
+  round_trip<int>(-64, 1);
+  round_trip<int>(64, 2);
+  round_trip<int>(std::numeric_limits<int>::max(), 5);
+  round_trip<int>(std::numeric_limits<int>::min(), 5);
+  round_trip<int64_t>(std::numeric_limits<int64_t>::min(), 10);
+  round_trip<int16_t>(-300, 2);
+  round_trip<char>('x', 1);
+
+  //  ======
+  //  Errors
+  //  ======
+
+  /* out of range for the decoded type */
+  std::string big = xu::encode<uint64_t>(uint64_t(1) << 40);
+  assert(throws_format_error([&] { xu::decode<uint32_t>(big.data(), big.size()); }));
+
+  /* truncated varint */
+  std::string truncated = xu::encode<uint64_t>(1 << 20);
+  assert(throws_format_error([&] { xu::decode<uint64_t>(truncated.data(), truncated.size() - 1); }));
+
+  /* more than 64 bits */
+  std::string overflow(11, '\x80');
+  overflow.back() = '\x01';
+  assert(throws_format_error([&] { xu::decode<uint64_t>(overflow.data(), overflow.size()); }));
+
+  //  =======
+  //  Strings
+  //  =======
+
+  round_trip<std::string>("", 1);
+  round_trip<std::string>("AAPL", 5);
+  round_trip<std::string>(std::string(200, 'a'), 202);
+
+  std::string cut = xu::encode<std::string>("AAPL");
+  assert(throws_format_error([&] { xu::decode<std::string>(cut.data(), cut.size() - 1); }));
+
+  std::cout << "polykey_codec tests passed" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "polykey_diff.hpp"
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_polykey_diff test_polykey_diff.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using OrderSnapshot = xu::mapped_snapshot<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using OrderDiff = xu::polykey_diff_t<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+void check(const OrderDiff& d)
+{
+  assert(d.inserted.size() == 2);
+  assert(d.erased.size() == 1);
+  assert(d.rekeyed.size() == 1);
+  assert(d.changed.size() == 1);
+
+  /* inserted: 5000, and a row with only an external id */
+  for (auto& row : d.inserted)
+  {
+    if (std::get<InternalOrderId>(row.keys))
+    {
+      assert(*std::get<InternalOrderId>(row.keys) == 5000);
+      assert(row.value.svol == 5000);
+    }
+    else
+    {
+      assert(*std::get<ExternalOrderId>(row.keys) == "only-external");
+    }
+  }
+
+  assert(*std::get<InternalOrderId>(d.erased[0].keys) == 18);
+  assert(*std::get<ExternalOrderId>(d.erased[0].keys) == "E18");
+
+  assert(*std::get<InternalOrderId>(d.rekeyed[0].keys) == 3);
+  assert(!std::get<ExternalOrderId>(d.rekeyed[0].old_keys));
+  assert(*std::get<ExternalOrderId>(d.rekeyed[0].keys) == "E3");
+  assert(d.rekeyed[0].value.svol == 3);
+
+  assert(*std::get<InternalOrderId>(d.changed[0].keys) == 42);
+  assert(d.changed[0].old_value.svol == 42);
+  assert(d.changed[0].value.svol == -1);
+}
+
+int main()
+{
+  OrderTracker a;
+
+  for (unsigned long i = 0; i < 5000; i++)
+  {
+    a.insert<InternalOrderId>(i, Order{"T" + std::to_string(i % 7), int(i)});
+
+    /* only even rows have an external id */
+    if (i % 2 == 0)
+    {
+      a.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+    }
+  }
+
+  OrderTracker b(a);
+
+  /* identical maps */
+  assert(xu::diff(a, b).empty());
+
+  b.insert<InternalOrderId>(5000, Order{"NEW", 5000});
+  b.insert<ExternalOrderId>("only-external", Order{"IBM", 1});
+  b.erase<InternalOrderId>(18);
+  b.link<InternalOrderId, ExternalOrderId>(3, "E3");
+  b.at<InternalOrderId>(42).svol = -1;
+
+  check(xu::diff(a, b));
+
+  /* the same, reversed */
+  OrderDiff reversed = xu::diff(b, a);
+  assert(reversed.inserted.size() == 1 and reversed.erased.size() == 2);
+  assert(reversed.rekeyed.size() == 1 and reversed.changed.size() == 1);
+
+  /* snapshots */
+  const std::string path_a = "test_polykey_diff_a.snap";
+  const std::string path_b = "test_polykey_diff_b.snap";
+
+  xu::save_snapshot(a, path_a);
+  xu::save_snapshot(b, path_b);
+
+  {
+    OrderSnapshot snap_a(path_a);
+    OrderSnapshot snap_b(path_b);
+
+    check(xu::diff(snap_a, snap_b));
+
+    assert(xu::diff(snap_a, snap_a).empty());
+  }
+
+  /* digests */
+  size_t n_buckets = xu::bucket_digest::buckets_for(a.size());
+
+  xu::bucket_digest digest_a = xu::polykey_differ<Order, InternalOrderId_t, ExternalOrderId_t>::digest(a, n_buckets);
+  xu::bucket_digest digest_b = xu::polykey_differ<Order, InternalOrderId_t, ExternalOrderId_t>::digest(b, n_buckets);
+
+  assert(digest_a.size() == 5000);
+  assert(digest_b.size() == 5001);
+  assert(digest_a != digest_b);
+  assert((digest_a == xu::polykey_differ<Order, InternalOrderId_t, ExternalOrderId_t>::digest(OrderTracker(a), n_buckets)));
+
+  /* with digests, only the rows of differing buckets are encoded */
+  check(xu::diff(a, digest_a, b, digest_b));
+  assert(xu::diff(a, digest_a, a, digest_a).empty());
+
+  try
+  {
+    xu::diff(a, digest_a, b, xu::polykey_differ<Order, InternalOrderId_t, ExternalOrderId_t>::digest(b, 2 * n_buckets));
+    assert(false);
+  }
+  catch (const std::invalid_argument&)
+  {}
+
+  std::remove(path_a.c_str());
+  std::remove(path_b.c_str());
+
+  std::cout << "polykey_diff tests passed" << std::endl;
+
+  return 0;
+}
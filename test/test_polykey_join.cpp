@@ -0,0 +1,147 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include "polykey_join.hpp"
+#include "polykey_map.hpp"
+#include "robin_hood_index.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_polykey_join test_polykey_join.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+enum FillDim
+{
+  FillId,
+  FillOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+struct Fill
+{
+  int qty;
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using FillTracker = xu::polykey_map<Fill, unsigned long, xu::robin_hood<ExternalOrderId_t>>;
+
+/**
+  @brief  Join and return the matched (key -> (svol, qty)) pairs
+  */
+std::map<std::string, std::pair<int, int>> join(const OrderTracker& otk, const FillTracker& fills, size_t n_threads)
+{
+  std::map<std::string, std::pair<int, int>> matched;
+  std::mutex mutex;
+
+  size_t n = xu::hash_join<ExternalOrderId, FillOrderId>(otk, fills, [&](const std::string& key, const Order& order, const Fill& fill)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(matched.emplace(key, std::make_pair(order.svol, fill.qty)).second);
+  }, n_threads);
+
+  assert(n == matched.size());
+
+  return matched;
+}
+
+int main()
+{
+  OrderTracker otk;
+
+  for (unsigned long i = 0; i < 1000; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"T", int(i)});
+
+    /* only even rows have an external id */
+    if (i % 2 == 0)
+    {
+      otk.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+    }
+  }
+
+  /* fewer fills than orders: the fills drive */
+  FillTracker fills;
+
+  for (unsigned long i = 0; i < 300; i++)
+  {
+    fills.insert<FillId>(i, Fill{int(i) * 10});
+
+    if (i % 3 != 0)
+    {
+      fills.link<FillId, FillOrderId>(i, "E" + std::to_string(i));
+    }
+  }
+
+  auto matched = join(otk, fills, 1);
+
+  /* i even, i not a multiple of 3 */
+  assert(matched.size() == 100);
+
+  for (auto& it : matched)
+  {
+    int i = std::stoi(it.first.substr(1));
+    assert(i % 2 == 0 and i % 3 != 0);
+    assert(it.second == std::make_pair(i, i * 10));
+  }
+
+  assert(join(otk, fills, 4) == matched);
+
+  /* more fills than orders: the orders drive, f still gets (order, fill) */
+  for (unsigned long i = 300; i < 5000; i++)
+  {
+    fills.insert<FillOrderId>("E" + std::to_string(i), Fill{int(i) * 10});
+  }
+
+  auto more = join(otk, fills, 1);
+  assert(more.size() == 100 + 350);
+  assert((more.at("E998") == std::make_pair(998, 9980)));
+  assert(join(otk, fills, 3) == more);
+
+  /* nothing to join */
+  FillTracker no_fills;
+  assert(join(otk, no_fills, 2).empty());
+
+  std::cout << "polykey_join tests passed" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "async_journal.hpp"
+#include "polykey_journal.hpp"
+#include "polykey_map.hpp"
+
+//g++ -std=c++17 -pthread -I ../include -o bin/test_polykey_journal test_polykey_journal.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using OrderJournal = xu::journal_observer<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+/* counts notifications */
+class CountingObserver : public OrderTracker::observer
+{
+public:
+  int inserts = 0;
+  int links = 0;
+  int modifies = 0;
+  int erases = 0;
+  int volume = 0;
+
+  void on_insert(const OrderTracker::keyset_type& /* keys */, const Order& order) override
+  {
+    inserts++;
+    volume += order.svol;
+  }
+
+  void on_link(const OrderTracker::keyset_type& keys, size_t path, const Order& /* order */) override
+  {
+    links++;
+    assert(path == ExternalOrderId);
+    assert(keys.has_value<ExternalOrderId>());
+  }
+
+  void on_modify(const OrderTracker::keyset_type& /* keys */, const Order& old_order, const Order& order) override
+  {
+    modifies++;
+    volume += order.svol - old_order.svol;
+  }
+
+  void on_erase(const OrderTracker::keyset_type& /* keys */, const Order& order) override
+  {
+    erases++;
+    volume -= order.svol;
+  }
+};
+
+void runJournal(const std::string& path, bool try_io_uring)
+{
+  std::remove(path.c_str());
+
+  OrderTracker otk;
+  CountingObserver counter;
+  otk.add_observer(&counter);
+
+  {
+    xu::async_journal journal(path, try_io_uring, 4, 256);
+    OrderJournal journaled(otk, journal);
+
+    std::cout << (journal.uses_io_uring() ? "io_uring" : "thread") << " backend" << std::endl;
+
+    for (unsigned long i = 0; i < 1000; i++)
+    {
+      otk.insert<InternalOrderId>(i, Order{"T" + std::to_string(i), 1});
+      otk.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+    }
+
+    otk.modify<ExternalOrderId>("E7", [](Order& order) { order.svol = 70; });
+    otk.erase<InternalOrderId>(8);
+    otk.erase(otk.find<ExternalOrderId>("E9"));
+
+    journal.wait_durable(journaled.last_seq());
+    assert(journal.durable_seq() >= journaled.last_seq());
+    assert(journaled.last_seq() == 2003);
+
+    /* more changes, made durable by the destructor */
+    otk.insert<ExternalOrderId>("lonely", Order{"AAPL", 5});
+  }
+
+  otk.remove_observer(&counter);
+
+  assert(counter.inserts == 1001);
+  assert(counter.links == 1000);
+  assert(counter.modifies == 1);
+  assert(counter.erases == 2);
+  assert(counter.volume == 1000 + 69 - 2 + 5);
+
+  OrderTracker replayed;
+  assert(xu::replay_journal(path, replayed) == 2004);
+
+  assert(replayed.size() == otk.size());
+  assert(replayed.size<ExternalOrderId>() == otk.size<ExternalOrderId>());
+  assert(replayed.at<InternalOrderId>(7).svol == 70);
+  assert(!replayed.contains<ExternalOrderId>("E8"));
+  assert(!replayed.contains<InternalOrderId>(9));
+  assert((replayed.convert_key<InternalOrderId, ExternalOrderId>(500) == "E500"));
+  assert(replayed.at<ExternalOrderId>("lonely").ticker == "AAPL");
+
+  /* a torn entry is cut off, and numbering continues after the last good one */
+  std::FILE* file = std::fopen(path.c_str(), "ab");
+  std::fputs("torn", file);
+  std::fclose(file);
+
+  {
+    xu::async_journal journal(path, try_io_uring);
+    assert(journal.durable_seq() == 2004);
+
+    OrderJournal journaled(replayed, journal);
+    replayed.erase<ExternalOrderId>("lonely");
+
+    assert(journaled.last_seq() == 2005);
+    journal.wait_durable(2005);
+
+    /* waiting for an entry which was not appended fails instead of hanging */
+    bool threw = false;
+
+    try
+    {
+      journal.wait_durable(2006);
+    }
+    catch (const std::invalid_argument&)
+    {
+      threw = true;
+    }
+
+    assert(threw);
+  }
+
+  OrderTracker again;
+  assert(xu::replay_journal(path, again) == 2005);
+  assert(again.size() == otk.size() - 1);
+
+  /* entries already reflected in a map are skipped */
+  assert(xu::replay_journal(path, again, 2005) == 2005);
+
+  std::remove(path.c_str());
+}
+
+int main()
+{
+  runJournal("test_polykey_journal_uring.log", true);
+  runJournal("test_polykey_journal_thread.log", false);
+
+  return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include "polykey_map.hpp"
+#include "polykey_snapshot.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_polykey_snapshot test_polykey_snapshot.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+using OrderSnapshot = xu::mapped_snapshot<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+int main()
+{
+  const std::string path = "test_polykey_snapshot.snap";
+
+  OrderTracker otk;
+
+  for (unsigned long i = 0; i < 1000; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"T" + std::to_string(i), int(i)});
+
+    /* only even rows have an external id */
+    if (i % 2 == 0)
+    {
+      otk.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+    }
+  }
+
+  /* a row with only an external id */
+  otk.insert<ExternalOrderId>("lonely", Order{"AAPL", -5});
+
+  xu::save_snapshot(otk, path);
+
+  {
+    OrderSnapshot snapshot(path);
+
+    assert(snapshot.size() == 1001);
+    assert(snapshot.size<InternalOrderId>() == 1000);
+    assert(snapshot.size<ExternalOrderId>() == 501);
+
+    auto row = snapshot.find<InternalOrderId>(42);
+    assert(row.has_value());
+    assert(snapshot.value(*row).ticker == "T42");
+    assert(snapshot.has_key<ExternalOrderId>(*row));
+    assert(snapshot.key<ExternalOrderId>(*row) == "E42");
+
+    row = snapshot.find<InternalOrderId>(43);
+    assert(row.has_value());
+    assert(!snapshot.has_key<ExternalOrderId>(*row));
+
+    row = snapshot.find<ExternalOrderId>("lonely");
+    assert(row.has_value());
+    assert(snapshot.value(*row).svol == -5);
+    assert(!snapshot.has_key<InternalOrderId>(*row));
+
+    assert(!snapshot.find<InternalOrderId>(1000).has_value());
+    assert(!snapshot.find<ExternalOrderId>("E43").has_value());
+
+    std::cout << "Mapped " << snapshot.size() << " rows" << std::endl;
+  }
+
+  /* loading rebuilds an equivalent map */
+  OrderTracker loaded;
+  xu::load_snapshot(path, loaded);
+
+  assert(loaded.size() == otk.size());
+  assert(loaded.size<ExternalOrderId>() == 501);
+  assert(loaded.at<ExternalOrderId>("E998").svol == 998);
+  assert((loaded.convert_key<InternalOrderId, ExternalOrderId>(998) == "E998"));
+  assert(loaded.at<ExternalOrderId>("lonely").ticker == "AAPL");
+
+  std::cout << "Loaded " << loaded.size() << " rows" << std::endl;
+
+  /* chunks are encoded, validated and decoded in parallel */
+  xu::save_snapshot(otk, path, 4);
+
+  {
+    OrderSnapshot snapshot(path);
+    assert(snapshot.n_chunks() == 1);
+    assert(snapshot.verify(4));
+  }
+
+  OrderTracker parallel_loaded;
+  xu::load_snapshot(path, parallel_loaded, 4);
+
+  assert(parallel_loaded.size() == otk.size());
+  assert(parallel_loaded.at<ExternalOrderId>("E500").ticker == "T500");
+  assert(parallel_loaded.at<InternalOrderId>(501).ticker == "T501");
+
+  /* loading into a map with a conflicting key inserts nothing */
+  OrderTracker conflicting;
+  conflicting.insert<InternalOrderId>(7, Order{"IBM", 1});
+  conflicting.insert<ExternalOrderId>("E998", Order{"IBM", 2});
+
+  bool conflict = false;
+
+  try
+  {
+    xu::load_snapshot(path, conflicting, 2);
+  }
+  catch (const OrderTracker::key_conflict_error& e)
+  {
+    conflict = true;
+  }
+
+  assert(conflict);
+  assert(conflicting.size() == 2);
+  assert(conflicting.size<InternalOrderId>() == 1);
+  assert(conflicting.at<ExternalOrderId>("E998").svol == 2);
+  assert(!conflicting.contains<InternalOrderId>(998));
+
+  /* small chunks, one of which gets corrupted */
+  {
+    xu::snapshot_writer<Order, InternalOrderId_t, ExternalOrderId_t> writer(path, 100);
+
+    otk.for_each_row([&writer](const auto& keys, const Order& order)
+    {
+      writer.add_row(keys, order);
+    });
+
+    writer.finish();
+  }
+
+  {
+    OrderSnapshot snapshot(path);
+    assert(snapshot.n_chunks() == 11);
+    assert((snapshot.chunk_rows(10) == std::make_pair<uint64_t, uint64_t>(1000, 1001)));
+
+    /* flip the last byte of the value of row 250 */
+    auto rec = snapshot.record(250);
+
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    std::fseek(file, long(rec.first - snapshot.record(0).first) + long(sizeof(xu::snapshot_header_t) + 2 * sizeof(xu::snapshot_path_entry_t)) + long(rec.second) - 1, SEEK_SET);
+    std::fputc(0x7f, file);
+    std::fclose(file);
+  }
+
+  {
+    OrderSnapshot snapshot(path);
+    assert(snapshot.verify_chunk(0));
+    assert(!snapshot.verify_chunk(2));
+    assert(!snapshot.verify());
+
+    bool corrupt = false;
+
+    try
+    {
+      OrderTracker damaged;
+      xu::load_snapshot(path, damaged, 2);
+    }
+    catch (const xu::format_error& e)
+    {
+      std::cout << "Rejected: " << e.what() << std::endl;
+      corrupt = true;
+    }
+
+    assert(corrupt);
+  }
+
+  /* partial chunks are merged into whole ones */
+  {
+    using Writer = xu::snapshot_writer<Order, InternalOrderId_t, ExternalOrderId_t>;
+    Writer writer(path, 100);
+    Writer::chunk_t chunk;
+    size_t n = 0;
+
+    otk.for_each_row([&](const auto& keys, const Order& order)
+    {
+      if (n++ < 30)
+      {
+        writer.add_row(keys, order);
+        return;
+      }
+
+      Writer::encode_row(keys, order, chunk);
+
+      if (chunk.size() == 100 or n == 1001)
+      {
+        writer.add_chunk(chunk);
+        chunk.clear();
+      }
+    });
+
+    writer.finish();
+  }
+
+  {
+    OrderSnapshot snapshot(path);
+    assert(snapshot.size() == 1001);
+    assert(snapshot.n_chunks() == 11);
+    assert(snapshot.verify());
+
+    OrderTracker merged;
+    xu::load_snapshot(path, merged);
+    assert(merged.size() == 1001);
+    assert(merged.at<ExternalOrderId>("E998").svol == otk.at<ExternalOrderId>("E998").svol);
+  }
+
+  /* an empty map gives a valid snapshot */
+  OrderTracker empty;
+  xu::save_snapshot(empty, path);
+
+  {
+    OrderSnapshot snapshot(path);
+    assert(snapshot.size() == 0);
+    assert(!snapshot.find<InternalOrderId>(0).has_value());
+  }
+
+  /* a corrupt index without empty slots does not make lookups loop */
+  {
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    xu::snapshot_path_entry_t entry;
+
+    std::fseek(file, long(sizeof(xu::snapshot_header_t)), SEEK_SET);
+    size_t n_read = std::fread(&entry, sizeof(entry), 1, file);
+    assert(n_read == 1);
+
+    std::fseek(file, long(entry.index_offset), SEEK_SET);
+
+    for (uint64_t i = 0; i < entry.n_slots; i++)
+    {
+      xu::snapshot_slot_t full{0, 1};
+      std::fwrite(&full, sizeof(full), 1, file);
+    }
+
+    std::fclose(file);
+
+    OrderSnapshot snapshot(path);
+    bool corrupt = false;
+
+    try
+    {
+      snapshot.find<InternalOrderId>(0);
+    }
+    catch (const xu::format_error& e)
+    {
+      std::cout << "Rejected: " << e.what() << std::endl;
+      corrupt = true;
+    }
+
+    assert(corrupt);
+  }
+
+  /* files which are not snapshots are rejected */
+  {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fputs("not a snapshot, but long enough to hold a header", file);
+    std::fclose(file);
+
+    bool caught = false;
+
+    try
+    {
+      OrderSnapshot snapshot(path);
+    }
+    catch (const xu::format_error& e)
+    {
+      std::cout << "Rejected: " << e.what() << std::endl;
+      caught = true;
+    }
+
+    assert(caught);
+  }
+
+  std::remove(path.c_str());
+
+  return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "polykey_map.hpp"
+#include "robin_hood_index.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_robin_hood_index test_robin_hood_index.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+/* the external id path is erase-heavy, so it uses the robin hood index */
+using OrderTracker = xu::polykey_map<Order, InternalOrderId_t, xu::robin_hood<ExternalOrderId_t>>;
+
+void churnTest()
+{
+  xu::robin_hood_index<unsigned long, unsigned long> index;
+  std::unordered_map<unsigned long, unsigned long> reference;
+
+  std::mt19937_64 rng(42);
+
+  /* as many erasures as insertions, over a slowly moving window of keys */
+  for (unsigned long i = 0; i < 200000; i++)
+  {
+    unsigned long key = (i / 4) + rng() % 1024;
+
+    if (rng() % 2 == 0)
+    {
+      bool inserted = index.insert(std::make_pair(key, i)).second;
+      assert(inserted == reference.insert(std::make_pair(key, i)).second);
+    }
+    else
+    {
+      assert(index.erase(key) == reference.erase(key));
+    }
+  }
+
+  assert(index.size() == reference.size());
+
+  for (auto& it : reference)
+  {
+    auto found = index.find(it.first);
+    assert(found != index.end());
+    assert(found->second == it.second);
+  }
+
+  size_t n_iterated = 0;
+
+  for (auto& it : index)
+  {
+    assert(reference.at(it.first) == it.second);
+    n_iterated++;
+  }
+
+  assert(n_iterated == reference.size());
+
+  std::cout << "size=" << index.size()
+            << " load_factor=" << index.load_factor()
+            << " max_probe_distance=" << index.max_probe_distance() << std::endl;
+
+  using index_t = xu::robin_hood_index<unsigned long, unsigned long>;
+  assert(index.max_probe_distance() <= index_t::max_probe_length);
+}
+
+void copyMoveTest()
+{
+  xu::robin_hood_index<std::string, int> index;
+
+  for (int i = 0; i < 1000; i++)
+  {
+    index.insert(std::make_pair("order-" + std::to_string(i), i));
+  }
+
+  xu::robin_hood_index<std::string, int> index_copy = index;
+
+  index.erase("order-10");
+
+  assert(index.count("order-10") == 0);
+  assert(index_copy.at("order-10") == 10);
+
+  xu::robin_hood_index<std::string, int> index_moved = std::move(index_copy);
+
+  assert(index_copy.size() == 0);
+  assert(index_moved.size() == 1000);
+  assert(index_copy.find("order-10") == index_copy.end());
+}
+
+/* every key hashes alike */
+struct ConstantHash
+{
+  size_t operator()(unsigned long) const
+  {
+    return 7;
+  }
+};
+
+void degenerateHashTest()
+{
+  xu::robin_hood_index<unsigned long, int, ConstantHash> index;
+  bool thrown = false;
+  unsigned long n = 0;
+
+  try
+  {
+    for (; n < 1000; n++)
+    {
+      index.insert(std::make_pair(n, int(n)));
+    }
+  }
+  catch (const std::length_error&)
+  {
+    thrown = true;
+  }
+
+  /* the table is left intact */
+  assert(thrown);
+  assert(n == index.max_probe_length + 1);
+  assert(index.size() == n);
+  assert(index.at(n - 1) == int(n - 1));
+}
+
+int main()
+{
+  churnTest();
+
+  copyMoveTest();
+
+  degenerateHashTest();
+
+  OrderTracker otk;
+
+  otk.insert<InternalOrderId>(13, Order{"AAPL", 100});
+  otk.insert<InternalOrderId>(14, Order{"MSFT", -100});
+
+  otk.link<InternalOrderId, ExternalOrderId>(13, "1337");
+  otk.link<InternalOrderId, ExternalOrderId>(14, "1338");
+
+  otk.at<ExternalOrderId>("1337").svol = 50;
+
+  std::cout << otk.at<InternalOrderId>(13).ticker << ":" << otk.at<InternalOrderId>(13).svol << std::endl;
+
+  otk.erase<ExternalOrderId>("1337");
+
+  assert(!otk.contains<InternalOrderId>(13));
+  assert(otk.size<ExternalOrderId>() == 1);
+  assert((otk.convert_key<InternalOrderId, ExternalOrderId>(14) == "1338"));
+
+  OrderTracker otk_copy = otk;
+
+  std::cout << "otk_copy.size()=" << otk_copy.size() << std::endl;
+}
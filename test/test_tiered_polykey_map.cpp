@@ -0,0 +1,143 @@
+/*
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Kevin Xu
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "tiered_polykey_map.hpp"
+
+//g++ -std=c++17 -I ../include -o bin/test_tiered_polykey_map test_tiered_polykey_map.cpp
+
+enum Dim
+{
+  InternalOrderId,
+  ExternalOrderId
+};
+
+using InternalOrderId_t = unsigned long;
+using ExternalOrderId_t = std::string;
+
+struct Order
+{
+  std::string ticker;
+  int svol;
+};
+
+template <>
+struct xu::codec<Order>
+{
+  static void encode(const Order& order, std::string& out)
+  {
+    xu::codec<std::string>::encode(order.ticker, out);
+    xu::codec<int>::encode(order.svol, out);
+  }
+
+  static Order decode(const char*& p, const char* end)
+  {
+    std::string ticker = xu::codec<std::string>::decode(p, end);
+    return Order{ticker, xu::codec<int>::decode(p, end)};
+  }
+};
+
+using OrderTracker = xu::tiered_polykey_map<Order, InternalOrderId_t, ExternalOrderId_t>;
+
+int main()
+{
+  using namespace std::chrono_literals;
+
+  OrderTracker otk("test_tiered_polykey_map", 1h, 2);
+
+  for (unsigned long i = 0; i < 100; i++)
+  {
+    otk.insert<InternalOrderId>(i, Order{"T" + std::to_string(i), int(i)});
+    otk.link<InternalOrderId, ExternalOrderId>(i, "E" + std::to_string(i));
+  }
+
+  /* nothing is old enough yet */
+  assert(otk.spill() == 0);
+  assert(otk.segment_count() == 0);
+
+  /* an hour later, everything is cold */
+  auto later = OrderTracker::clock_t::now() + 2h;
+
+  assert(otk.spill(later) == 100);
+  assert(otk.hot_size() == 0);
+  assert(otk.cold_size() == 100);
+  assert(otk.segment_count() == 1);
+
+  /* cold rows are still visible, and move back on access */
+  assert(otk.contains<ExternalOrderId>("E42"));
+  assert(otk.hot_size() == 0);
+
+  otk.at<ExternalOrderId>("E42").svol = -42;
+  assert(otk.hot_size() == 1);
+  assert(otk.cold_size() == 99);
+  assert(otk.at<InternalOrderId>(42).svol == -42);
+  assert((otk.find<InternalOrderId>(42) == &otk.at<ExternalOrderId>("E42")));
+
+  /* keys are unique across tiers */
+  bool caught = false;
+
+  try
+  {
+    otk.insert<InternalOrderId>(7, Order{"IBM", 1});
+  }
+  catch (const OrderTracker::key_conflict_error& e)
+  {
+    caught = true;
+  }
+
+  assert(caught);
+
+  /* linking a new key to a cold row moves it back */
+  otk.erase<ExternalOrderId>("E8");
+  otk.insert<InternalOrderId>(1000, Order{"NFLX", 7});
+  otk.link<InternalOrderId, ExternalOrderId>(1000, "E8");
+  assert(otk.at<ExternalOrderId>("E8").ticker == "NFLX");
+
+  otk.erase<InternalOrderId>(9);
+  assert(!otk.contains<ExternalOrderId>("E9"));
+  assert(otk.find<InternalOrderId>(9) == nullptr);
+  assert(otk.size() == 99);
+
+  /* spilling more segments than allowed compacts them */
+  assert(otk.spill(later + 2h) == 2);
+  assert(otk.segment_count() == 2);
+
+  otk.at<InternalOrderId>(50);
+  assert(otk.spill(later + 4h) == 1);
+  assert(otk.segment_count() == 1);
+  assert(otk.size() == 99);
+  assert(otk.hot_size() == 0);
+
+  assert(otk.at<ExternalOrderId>("E8").svol == 7);
+  assert(otk.at<InternalOrderId>(42).svol == -42);
+  assert(otk.at<InternalOrderId>(99).ticker == "T99");
+
+  std::cout << "Hot rows: " << otk.hot_size() << ", cold rows: " << otk.cold_size() << std::endl;
+
+  return 0;
+}